@@ -1,8 +1,14 @@
 #ifndef BBST_AVL_TREE_H
 #define BBST_AVL_TREE_H
 
+#include <bit>
 #include <concepts>
+#include <iterator>
+#include <limits>
 #include <memory>
+#include <tuple>
+#include "tree_custom_invoke.h"
+#include "tree_set_operation.h"
 #include "tree_utils.h"
 
 //invariant debug
@@ -31,7 +37,7 @@ namespace bbst
         if (right_height == 0)
             return 0;
 
-        if (right_height != left_height + ptr->height_diff_) //this won't overflow
+        if (right_height != left_height + ptr->height_diff()) //this won't overflow
             return 0;
 
         return 1 + std::max(left_height, right_height);
@@ -56,21 +62,27 @@ namespace bbst
         typedef typename tree_node_base_traits<avl_tree_node>::value_type value_type;
         typedef typename tree_node_base_traits<avl_tree_node>::key_type key_type;
         typedef typename tree_node_base_traits<avl_tree_node>::metadata_type metadata_type;
-        int32_t height_diff_//:2
-        ;
         value_type value_;
 
         template<class... Args>
         explicit avl_tree_node(int32_t height_diff, Args... args)
                 :
-                height_diff_(height_diff)
+                base_tree_node<avl_tree_node>(nullptr, nullptr, nullptr)
                 , value_(std::forward<Args>(args)...)
-        {}
+        {
+            set_height_diff(height_diff);
+        }
+
+        //height(right) - height(left), kept biased by one in the low bits of the parent pointer, see tree_tagged_pointer
+        [[nodiscard]] inline int32_t height_diff() const noexcept
+        {
+            return int32_t(this->parent.tag()) - 1;
+        }
 
-        ~avl_tree_node()
+        inline void set_height_diff(int32_t height_diff) noexcept
         {
-            delete this->left;
-            delete this->right;
+            ASSERT(-1 <= height_diff && height_diff <= 1, "avl balance out of range");
+            this->parent.set_tag(uintptr_t(height_diff + 1));
         }
 
         inline value_type &value() noexcept
@@ -144,7 +156,7 @@ namespace bbst
             return root_ == nullptr;
         }
 
-        template<class key_holder_t, class mapped_holder_t, class metadata_holder_t, class metadata_updator_holder_t, class comparator_holder_t, class tag_holder_t> friend
+        template<class key_holder_t, class mapped_holder_t, class metadata_holder_t, class metadata_updator_holder_t, class comparator_holder_t, class tag_holder_t, class allocator_holder_t> friend
         class avl_tree_custom_invoke;
     };
 }
@@ -163,23 +175,23 @@ namespace bbst
             avl_tree_node_ptr_t X = Z->parent_unsafe();
             if (X->right == Z)
             {
-                if (X->height_diff_ > 0)
+                if (X->height_diff() > 0)
                 {
-                    ASSERT(X->height_diff_ == 1, "X is right heavy");
-                    if (Z->height_diff_ < 0)
+                    ASSERT(X->height_diff() == 1, "X is right heavy");
+                    if (Z->height_diff() < 0)
                     {
-                        avl_tree_node_ptr_t Y = (X == root) ? tree_root_right_left_rotate(X, Z) : unguarded_tree_right_left_rotate(X, Z);
-                        if (Y->height_diff_ == 0)
+                        avl_tree_node_ptr_t Y = (X == root) ? tree_root_right_left_rotate(X, Z, updator) : unguarded_tree_right_left_rotate(X, Z, updator);
+                        if (Y->height_diff() == 0)
                         {
-                            X->height_diff_ = Z->height_diff_ = 0;
+                            X->set_height_diff(0), Z->set_height_diff(0);
                         }
                         else
                         {
-                            if (Y->height_diff_ > 0)
-                                X->height_diff_ = -1, Z->height_diff_ = 0;
+                            if (Y->height_diff() > 0)
+                                X->set_height_diff(-1), Z->set_height_diff(0);
                             else
-                                X->height_diff_ = 0, Z->height_diff_ = 1;
-                            Y->height_diff_ = 0;
+                                X->set_height_diff(0), Z->set_height_diff(1);
+                            Y->set_height_diff(0);
                         }
                         updator(X);
                         updator(Z);
@@ -196,10 +208,10 @@ namespace bbst
                     else
                     {
                         if (X == root)
-                            tree_root_left_rotate(X);
+                            tree_root_left_rotate(X, updator);
                         else
-                            unguarded_tree_left_rotate(X);
-                        X->height_diff_ = Z->height_diff_ = 0;
+                            unguarded_tree_left_rotate(X, updator);
+                        X->set_height_diff(0), Z->set_height_diff(0);
                         updator(X);
                         updator(Z);
                         if (X == root)
@@ -219,34 +231,34 @@ namespace bbst
                 {
                     Z = X;
                     updator(X);
-                    if (X->height_diff_ < 0)
+                    if (X->height_diff() < 0)
                     {
-                        X->height_diff_ = 0;
+                        X->set_height_diff(0);
                         height_inc = false;
                         break;
                     }
-                    X->height_diff_ = 1;
+                    X->set_height_diff(1);
                 }
             }
             else
             {
-                if (X->height_diff_ < 0)
+                if (X->height_diff() < 0)
                 {
-                    ASSERT(X->height_diff_ == -1, "X is left heavy");
-                    if (Z->height_diff_ > 0)
+                    ASSERT(X->height_diff() == -1, "X is left heavy");
+                    if (Z->height_diff() > 0)
                     {
-                        avl_tree_node_ptr_t Y = (X == root) ? tree_root_left_right_rotate(X, Z) : unguarded_tree_left_right_rotate(X, Z);
-                        if (Y->height_diff_ == 0)
+                        avl_tree_node_ptr_t Y = (X == root) ? tree_root_left_right_rotate(X, Z, updator) : unguarded_tree_left_right_rotate(X, Z, updator);
+                        if (Y->height_diff() == 0)
                         {
-                            X->height_diff_ = Z->height_diff_ = 0;
+                            X->set_height_diff(0), Z->set_height_diff(0);
                         }
                         else
                         {
-                            if (Y->height_diff_ < 0)
-                                X->height_diff_ = 1, Z->height_diff_ = 0;
+                            if (Y->height_diff() < 0)
+                                X->set_height_diff(1), Z->set_height_diff(0);
                             else
-                                X->height_diff_ = 0, Z->height_diff_ = -1;
-                            Y->height_diff_ = 0;
+                                X->set_height_diff(0), Z->set_height_diff(-1);
+                            Y->set_height_diff(0);
                         }
                         updator(X);
                         updator(Z);
@@ -263,10 +275,10 @@ namespace bbst
                     else
                     {
                         if (X == root)
-                            tree_root_right_rotate(X);
+                            tree_root_right_rotate(X, updator);
                         else
-                            unguarded_tree_right_rotate(X);
-                        X->height_diff_ = Z->height_diff_ = 0;
+                            unguarded_tree_right_rotate(X, updator);
+                        X->set_height_diff(0), Z->set_height_diff(0);
                         updator(X);
                         updator(Z);
                         if (X == root)
@@ -287,22 +299,26 @@ namespace bbst
                 {
                     Z = X;
                     updator(X);
-                    if (X->height_diff_ > 0)
+                    if (X->height_diff() > 0)
                     {
-                        X->height_diff_ = 0;
+                        X->set_height_diff(0);
                         height_inc = false;
                         break;
                     }
-                    X->height_diff_ = -1;
+                    X->set_height_diff(-1);
                 }
             }
         }
         ASSERT(avl_tree_invariant(Z), "post condition failed");
-        while (Z != root)
-        {
-            Z = Z->parent_unsafe();
-            updator(Z);
-        }
+        //the shape above Z is final, what is left only refreshes metadata
+        if constexpr (is_noop_metadata_updator<metadata_updator_t>)
+            Z = root;
+        else
+            while (Z != root)
+            {
+                Z = Z->parent_unsafe();
+                updator(Z);
+            }
         return {height_inc, Z};
     }
 
@@ -311,9 +327,9 @@ namespace bbst
                                       , const comparator_t &comparator) noexcept(std::is_nothrow_invocable_v<const metadata_updator_t &, avl_tree_node_ptr_t>)
     {
         ASSERT(avl_tree_header_invariant(left), "left header invariant false");
-        ASSERT(left.root_ == nullptr || comparator(bbst::tree_max(left.root_)->key(), x->key()), "left tree must be less than x");
+        ASSERT(left.root_ == nullptr || tree_less(comparator, bbst::tree_max(left.root_)->key(), x->key()), "left tree must be less than x");
         ASSERT(avl_tree_header_invariant(right), "right header invariant false");
-        ASSERT(right.root_ == nullptr || comparator(x->key(), bbst::tree_min(right.root_)->key()), "right tree must be greater than x");
+        ASSERT(right.root_ == nullptr || tree_less(comparator, x->key(), bbst::tree_min(right.root_)->key()), "right tree must be greater than x");
         if (left.height_ > right.height_ + 1)
         {
             avl_tree_node_ptr_t ptr = left.root_;
@@ -321,7 +337,8 @@ namespace bbst
             uint32_t right_height = right.height_;
             while (true)
             {
-                left_height -= ptr->height_diff_ < 0 ? 2 : 1;
+                tree_push_down(metadata_updator, ptr);
+                left_height -= ptr->height_diff() < 0 ? 2 : 1;
                 if (left_height <= right_height + 1) break;
                 ptr = ptr->right;
             }
@@ -329,7 +346,7 @@ namespace bbst
             if (x->left) x->left->parent = x;
             x->right = right.root_;
             if (x->right) x->right->parent = x;
-            x->height_diff_ = left_height < right_height ? 1 : left_height == right_height ? 0 : -1;
+            x->set_height_diff(left_height < right_height ? 1 : left_height == right_height ? 0 : -1);
             ptr->right = x;
             x->parent = ptr;
             metadata_updator(x);
@@ -346,7 +363,8 @@ namespace bbst
             uint32_t right_height = right.height_;
             while (true)
             {
-                right_height -= ptr->height_diff_ > 0 ? 2 : 1;
+                tree_push_down(metadata_updator, ptr);
+                right_height -= ptr->height_diff() > 0 ? 2 : 1;
                 if (right_height <= left_height + 1) break;
                 ptr = ptr->left;
             }
@@ -354,7 +372,7 @@ namespace bbst
             if (x->left) x->left->parent = x;
             x->right = ptr->left;
             if (x->right) x->right->parent = x;
-            x->height_diff_ = left_height < right_height ? 1 : left_height == right_height ? 0 : -1;
+            x->set_height_diff(left_height < right_height ? 1 : left_height == right_height ? 0 : -1);
             ptr->left = x;
             x->parent = ptr;
             metadata_updator(x);
@@ -371,7 +389,7 @@ namespace bbst
             x->right = right.root_;
             if (x->right) x->right->parent = x;
             left.root_ = x;
-            x->height_diff_ = left.height_ < right.height_ ? 1 : left.height_ == right.height_ ? 0 : -1;
+            x->set_height_diff(left.height_ < right.height_ ? 1 : left.height_ == right.height_ ? 0 : -1);
             left.height_ = std::max(left.height_, right.height_) + 1;
             metadata_updator(x);
             ASSERT(avl_tree_header_invariant(left), "post condition failed");
@@ -379,14 +397,262 @@ namespace bbst
         }
     }
 
+    /*
+     * Unlink z from the tree hanging off end_node (end_node->left is the root, end_node has no parent),
+     * retrace toward the root rotating where a node got out of balance, and refresh the metadata along the path.
+     * z is detached but not destroyed.
+     * Returns whether the height of the tree decreased.
+     */
+    template<class base_tree_node_ptr_t, class avl_tree_node_ptr_t, class metadata_updator_t>
+    bool avl_tree_remove(base_tree_node_ptr_t end_node, avl_tree_node_ptr_t z
+                         , const metadata_updator_t &updator) noexcept(std::is_nothrow_invocable_v<const metadata_updator_t &, avl_tree_node_ptr_t>)
+    {
+        // y is either z, or if z has two children, tree_next(z), y has at most one child x
+        avl_tree_node_ptr_t y = (z->left == nullptr || z->right == nullptr) ? z : tree_min(z->right);
+        // with a lazy updator, every tag above the nodes about to move has to be settled first
+        tree_push_down_path(updator, end_node, y);
+        avl_tree_node_ptr_t x = y->left != nullptr ? y->left : y->right;
+        // P is the lowest node that lost height on one side
+        base_tree_node_ptr_t P = y->parent;
+        bool left_shrunk = tree_is_left_child(y);
+        if (x != nullptr)
+            x->parent = y->parent;
+        if (left_shrunk)
+            y->parent->left = x;
+        else
+            y->parent->right = x;
+        if (y != z)
+        {
+            // y was z->right, after taking z's place the shrunk side is y's right
+            if (P == z)
+                P = y;
+            y->parent = z->parent;
+            if (tree_is_left_child(z))
+                y->parent->left = y;
+            else
+                y->parent->right = y;
+            y->left = z->left;
+            y->left->parent = y;
+            y->right = z->right;
+            if (y->right != nullptr)
+                y->right->parent = y;
+            y->set_height_diff(z->height_diff());
+        }
+        bool height_dec = true;
+        while (P != end_node)
+        {
+            avl_tree_node_ptr_t X = P->self_downcast_unsafe();
+            // rotations below put the new subtree root in X's slot, so remember the slot first
+            base_tree_node_ptr_t next = X->parent;
+            bool next_left_shrunk = tree_is_left_child(X);
+            if (!height_dec)
+            {
+                //the shape above X is final, what is left only refreshes metadata
+                if constexpr (is_noop_metadata_updator<metadata_updator_t>)
+                    break;
+                updator(X);
+            }
+            else if (left_shrunk)
+            {
+                if (X->height_diff() <= 0)
+                {
+                    // was balanced: now right heavy but just as tall, was left heavy: now balanced and shorter
+                    height_dec = X->height_diff() < 0;
+                    X->set_height_diff(X->height_diff() + 1);
+                    updator(X);
+                }
+                else
+                {
+                    avl_tree_node_ptr_t Z = X->right;
+                    if (Z->height_diff() >= 0)
+                    {
+                        unguarded_tree_left_rotate(X, updator);
+                        if (Z->height_diff() == 0)
+                        {
+                            X->set_height_diff(1), Z->set_height_diff(-1);
+                            height_dec = false;
+                        }
+                        else
+                        {
+                            X->set_height_diff(0), Z->set_height_diff(0);
+                        }
+                        updator(X);
+                        updator(Z);
+                    }
+                    else
+                    {
+                        avl_tree_node_ptr_t Y = unguarded_tree_right_left_rotate(X, Z, updator);
+                        if (Y->height_diff() == 0)
+                            X->set_height_diff(0), Z->set_height_diff(0);
+                        else if (Y->height_diff() > 0)
+                            X->set_height_diff(-1), Z->set_height_diff(0);
+                        else
+                            X->set_height_diff(0), Z->set_height_diff(1);
+                        Y->set_height_diff(0);
+                        updator(X);
+                        updator(Z);
+                        updator(Y);
+                    }
+                }
+            }
+            else
+            {
+                if (X->height_diff() >= 0)
+                {
+                    height_dec = X->height_diff() > 0;
+                    X->set_height_diff(X->height_diff() - 1);
+                    updator(X);
+                }
+                else
+                {
+                    avl_tree_node_ptr_t Z = X->left;
+                    if (Z->height_diff() <= 0)
+                    {
+                        unguarded_tree_right_rotate(X, updator);
+                        if (Z->height_diff() == 0)
+                        {
+                            X->set_height_diff(-1), Z->set_height_diff(1);
+                            height_dec = false;
+                        }
+                        else
+                        {
+                            X->set_height_diff(0), Z->set_height_diff(0);
+                        }
+                        updator(X);
+                        updator(Z);
+                    }
+                    else
+                    {
+                        avl_tree_node_ptr_t Y = unguarded_tree_left_right_rotate(X, Z, updator);
+                        if (Y->height_diff() == 0)
+                            X->set_height_diff(0), Z->set_height_diff(0);
+                        else if (Y->height_diff() < 0)
+                            X->set_height_diff(1), Z->set_height_diff(0);
+                        else
+                            X->set_height_diff(0), Z->set_height_diff(-1);
+                        Y->set_height_diff(0);
+                        updator(X);
+                        updator(Z);
+                        updator(Y);
+                    }
+                }
+            }
+            P = next;
+            left_shrunk = next_left_shrunk;
+        }
+        return height_dec;
+    }
+
+    //cut a non-empty tree at its root: headers of both subtrees and the root itself, with stale child pointers
+    template<class avl_tree_header_t, class metadata_updator_t>
+    std::tuple<avl_tree_header_t, decltype(avl_tree_header_t::root_), avl_tree_header_t> avl_tree_expose(avl_tree_header_t header, const metadata_updator_t &metadata_updator) noexcept
+    {
+        auto root = header.root_;
+        tree_push_down(metadata_updator, root);
+        return {avl_tree_header_t(root->left, header.height_ - (root->height_diff() > 0 ? 2 : 1)), root,
+                avl_tree_header_t(root->right, header.height_ - (root->height_diff() < 0 ? 2 : 1))};
+    }
+
+    /*
+     * Split around key: nodes less than key end up in the left header, nodes greater in the right one.
+     * By default the node equivalent to key (nullptr if none) is handed back detached, with stale child pointers,
+     * equal_policy left/right joins it into that side instead (the middle is nullptr then).
+     * Iterative, see tree_split.
+     */
+    template<tree_split_equal equal_policy = tree_split_equal::detach, class avl_tree_header_t, class key_t, class metadata_updator_t, class comparator_t>
+    std::tuple<avl_tree_header_t, decltype(avl_tree_header_t::root_), avl_tree_header_t>
+    avl_tree_split(avl_tree_header_t header, const key_t &key, const metadata_updator_t &metadata_updator, const comparator_t &comparator)
+    {
+        return tree_split<equal_policy>(header, key, comparator, [&metadata_updator](auto h) { return avl_tree_expose(h, metadata_updator); }
+                                        , [&metadata_updator, &comparator](auto left, auto x, auto right)
+                                        {
+                                            return avl_tree_join_x(left, x, right, metadata_updator, comparator);
+                                        });
+    }
+
+    /*
+     * Split right before x, a node of the tree under header whose root hangs from end_node: x and everything after it go right.
+     * Steers by x's parent links instead of comparing keys, the joins still make it O(log n). See tree_split_at.
+     */
+    template<class avl_tree_header_t, class base_tree_node_ptr_t, class metadata_updator_t, class comparator_t>
+    std::pair<avl_tree_header_t, avl_tree_header_t>
+    avl_tree_split_at(avl_tree_header_t header, base_tree_node_ptr_t end_node, base_tree_node_ptr_t x, const metadata_updator_t &metadata_updator
+                     , const comparator_t &comparator)
+    {
+        return tree_split_at(header, end_node, x, [&metadata_updator](auto h) { return avl_tree_expose(h, metadata_updator); }
+                             , [&metadata_updator, &comparator](auto left, auto pivot, auto right)
+                             {
+                                 return avl_tree_join_x(left, pivot, right, metadata_updator, comparator);
+                             });
+    }
+
+    /*
+     * Join without a middle node, every key of left must be less than every key of right.
+     * The maximum of left is unlinked and used as the pivot of join_x.
+     */
+    template<class avl_tree_header_t, class metadata_updator_t, class comparator_t>
+    avl_tree_header_t avl_tree_join(avl_tree_header_t left, avl_tree_header_t right, const metadata_updator_t &metadata_updator
+                                  , const comparator_t &comparator) noexcept(std::is_nothrow_invocable_v<const metadata_updator_t &, decltype(left.root_)>)
+    {
+        if (left.empty())
+            return right;
+        if (right.empty())
+            return left;
+        auto x = tree_max(left.root_);
+        base_tree_node<std::remove_pointer_t<decltype(x)>> end_node(nullptr, left.root_, nullptr);
+        left.root_->parent = &end_node;
+        left.height_ -= avl_tree_remove(&end_node, x, metadata_updator);
+        left.root_ = end_node.left;
+        return avl_tree_join_x(left, x, right, metadata_updator, comparator);
+    }
+
+    //header level primitives, the interface join based algorithms shared between trees (tree_set_operation.h) build on
+    struct avl_tree_header_ops
+    {
+        template<class avl_tree_header_t, class metadata_updator_t>
+        static inline auto expose(avl_tree_header_t header, const metadata_updator_t &metadata_updator) noexcept
+        {
+            return avl_tree_expose(header, metadata_updator);
+        }
+
+        template<class avl_tree_header_t, class key_t, class metadata_updator_t, class comparator_t>
+        static inline auto split(avl_tree_header_t header, const key_t &key, const metadata_updator_t &metadata_updator, const comparator_t &comparator)
+        {
+            return avl_tree_split(header, key, metadata_updator, comparator);
+        }
+
+        template<class avl_tree_header_t, class avl_tree_node_ptr_t, class metadata_updator_t, class comparator_t>
+        static inline avl_tree_header_t join_x(avl_tree_header_t left, avl_tree_node_ptr_t x, avl_tree_header_t right, const metadata_updator_t &metadata_updator
+                                               , const comparator_t &comparator)
+        {
+            return avl_tree_join_x(left, x, right, metadata_updator, comparator);
+        }
+
+        template<class avl_tree_header_t, class metadata_updator_t, class comparator_t>
+        static inline avl_tree_header_t join(avl_tree_header_t left, avl_tree_header_t right, const metadata_updator_t &metadata_updator, const comparator_t &comparator)
+        {
+            return avl_tree_join(left, right, metadata_updator, comparator);
+        }
+
+        //the sparsest avl tree of height h is the fibonacci tree: N(h) = N(h-1) + N(h-2) + 1, saturated at cap
+        template<class avl_tree_header_t>
+        static inline size_t size_lower_bound(const avl_tree_header_t &header, size_t cap) noexcept
+        {
+            size_t shorter = 0, taller = 0;
+            for (uint32_t h = 1; h < header.height_ && taller < cap; h++)
+                shorter = std::exchange(taller, taller + shorter + 1);
+            return std::min(cap, taller);
+        }
+    };
 }
 
 //avl_tree
 namespace bbst
 {
-    template<class key_t, class mapped_t, class metadata_t, class metadata_updator_t, class comparator_t=std::less<key_t>>
-    requires (std::predicate<const comparator_t &, const key_t &, const key_t &> &&
-              std::regular_invocable<const metadata_updator_t &, rb_tree_node<bbst::exposure<key_t, mapped_t, metadata_t>> *>)
+    template<class key_t, class mapped_t, class metadata_t, class metadata_updator_t, class comparator_t=std::less<key_t>,
+            class allocator_t = std::allocator<exposure<key_t, mapped_t, metadata_t>>>
+    requires (is_tree_comparator<comparator_t, key_t, key_t> &&
+              std::regular_invocable<const metadata_updator_t &, avl_tree_node<bbst::exposure<key_t, mapped_t, metadata_t>> *>)
     class avl_tree
     {
     private:
@@ -396,30 +662,70 @@ namespace bbst
         typedef avl_tree_node_t *avl_tree_node_ptr_t;
         typedef avl_tree_header<key_t, mapped_t, metadata_t> avl_tree_header_t;
         typedef typename avl_tree_node_t::value_type value_type;
+        typedef typename std::allocator_traits<allocator_t>::template rebind_alloc<avl_tree_node_t> node_allocator_t;
+        typedef std::allocator_traits<node_allocator_t> node_allocator_traits;
     public:
+        typedef allocator_t allocator_type;
         typedef tree_bidirectional_iterator_<base_tree_node_t> iterator;
         typedef tree_bidirectional_const_iterator_<base_tree_node_t> const_iterator;
 
     private:
         base_tree_node_t end_node_;
         base_tree_node_ptr_t begin_node_;
-        comparator_t comp_;
-        metadata_updator_t updator_;
+        base_tree_node_ptr_t last_node_;//greatest node, &end_node_ if empty
+        [[no_unique_address]] comparator_t comp_;
+        [[no_unique_address]] metadata_updator_t updator_;
+        [[no_unique_address]] node_allocator_t alloc_;
         uint32_t height_;
 
         template<class... Args>
         avl_tree_node_ptr_t construct_node(Args... args)
         {
-            return new avl_tree_node_t(std::forward<Args>(args)...);
+            avl_tree_node_ptr_t ptr = node_allocator_traits::allocate(alloc_, 1);
+            try
+            {
+                node_allocator_traits::construct(alloc_, ptr, std::forward<Args>(args)...);
+            }
+            catch (...)
+            {
+                node_allocator_traits::deallocate(alloc_, ptr, 1);
+                throw;
+            }
+            return ptr;
         }
 
-        std::pair<avl_tree_node_ptr_t &, base_tree_node_ptr_t> inline find_equal_or_insert_pos(const key_t &key)
+        void destroy_node(avl_tree_node_ptr_t ptr) noexcept
         {
-            return bbst::find_equal_or_insert_pos<key_t, base_tree_node_ptr_t, avl_tree_node_ptr_t, comparator_t>(key, &end_node_, comp_);
+            tree_destroy_node(alloc_, ptr);
+        }
+
+        void destroy_subtree(avl_tree_node_ptr_t ptr) noexcept
+        {
+            tree_destroy(ptr, [this](avl_tree_node_ptr_t p) { destroy_node(p); });
+        }
+
+        //node a finger search starts from, tree must not be empty
+        [[nodiscard]] base_tree_node_ptr_t finger_node(const_iterator finger) const noexcept
+        {
+            return finger.get() == &end_node_ ? last_node_ : const_cast<base_tree_node_ptr_t>(finger.get());
+        }
+
+        static inline iterator mutable_iterator(const_iterator it) noexcept
+        {
+            return iterator(const_cast<base_tree_node_ptr_t>(it.get()));
+        }
+
+        //key_t, or a query of a transparent comparator (emplace_query_args)
+        template<class query_t>
+        std::pair<avl_tree_node_ptr_t &, base_tree_node_ptr_t> inline find_equal_or_insert_pos(const query_t &key)
+        {
+            return bbst::find_equal_or_insert_pos<query_t, base_tree_node_ptr_t, avl_tree_node_ptr_t, comparator_t>(key, &end_node_, comp_);
         }
 
         void insert_node_at(base_tree_node_ptr_t parent, avl_tree_node_ptr_t &child, avl_tree_node_ptr_t new_node) noexcept
         {
+            if (parent != &end_node_)
+                tree_push_down_path(updator_, &end_node_, parent->self_downcast_unsafe());
             new_node->left = nullptr;
             new_node->right = nullptr;
             new_node->parent = parent;
@@ -427,6 +733,10 @@ namespace bbst
             child = new_node;
             if (begin_node_->left != nullptr)
                 begin_node_ = begin_node_->left;
+            if (last_node_ == &end_node_)
+                last_node_ = new_node;
+            else if (last_node_->right != nullptr)
+                last_node_ = last_node_->right;
             auto [height_inc, new_root] = avl_tree_insert_fixup(new_node, end_node_.left, updator_);
             end_node_.left = new_root;
             height_ += height_inc;
@@ -446,13 +756,167 @@ namespace bbst
             return {iterator(child), false};
         }
 
-        avl_tree(avl_tree_header_t header, const metadata_updator_t &updator, const comparator_t &comp)
+        //key_t is only materialized from the query once a node is actually inserted
+        template<class query_t, class... Args>
+        std::pair<iterator, bool> emplace_query_args(query_t &&key, Args... args)
+        {
+            auto [child, parent] = find_equal_or_insert_pos(key);
+            if (child == nullptr)
+            {
+                avl_tree_node_ptr_t new_node = construct_node(0, key_t(std::forward<query_t>(key)), std::forward<Args>(args)...);
+                insert_node_at(parent, child, new_node);
+                return {iterator(new_node), true};
+            }
+            return {iterator(child), false};
+        }
+
+        /*
+         * Insert position for key next to hint: if key fits right before (or right after) hint, the free child link
+         * between the two neighbours is returned without descending, otherwise the ordinary search from the root.
+         */
+        std::pair<avl_tree_node_ptr_t &, base_tree_node_ptr_t> find_equal_or_insert_pos(base_tree_node_ptr_t hint, const key_t &key)
+        {
+            if (hint == &end_node_ || tree_less(comp_, key, hint->self_downcast_unsafe()->key()))
+            {
+                if (hint != &end_node_ && hint == begin_node_)
+                    return {hint->left, hint};
+                if (hint != begin_node_)
+                {
+                    base_tree_node_ptr_t prev = hint == &end_node_ ? last_node_ : tree_prev_iter(hint);
+                    if (tree_less(comp_, prev->self_downcast_unsafe()->key(), key))
+                    {
+                        if (hint == &end_node_ || hint->left != nullptr)
+                            return {prev->right, prev};
+                        return {hint->left, hint};
+                    }
+                }
+            }
+            else if (tree_less(comp_, hint->self_downcast_unsafe()->key(), key))
+            {
+                base_tree_node_ptr_t next = hint == last_node_ ? &end_node_ : tree_next_iter(hint);
+                if (next == &end_node_ || tree_less(comp_, key, next->self_downcast_unsafe()->key()))
+                {
+                    if (hint->right == nullptr)
+                        return {hint->right, hint};
+                    return {next->left, next};
+                }
+            }
+            else
+            {
+                return {tree_is_left_child(hint) ? hint->parent->left : hint->parent->right, hint};
+            }
+            return find_equal_or_insert_pos(key);
+        }
+
+        template<class... Args>
+        std::pair<iterator, bool> emplace_hint_key_args(base_tree_node_ptr_t hint, key_t key, Args... args)
+        {
+            auto [child, parent] = find_equal_or_insert_pos(hint, key);
+            if (child == nullptr)
+            {
+                avl_tree_node_ptr_t new_node = construct_node(0, std::forward<key_t>(key), std::forward<Args>(args)...);
+                insert_node_at(parent, child, new_node);
+                return {iterator(new_node), true};
+            }
+            return {iterator(child), false};
+        }
+
+        template<class element_t>
+        avl_tree_node_ptr_t construct_sorted_element(element_t &&element)
+        {
+            if constexpr (std::is_convertible_v<element_t, key_t>)
+                return construct_node(0, key_t(std::forward<element_t>(element)));
+            else if constexpr (std::is_empty_v<mapped_t>)
+                //nothing to read from an empty mapped type, a set's no_mapped may share its address with the key
+                return construct_node(0, key_t(std::forward<element_t>(element).first));
+            else
+                return construct_node(0, key_t(std::forward<element_t>(element).first), metadata_t(), mapped_t(std::forward<element_t>(element).second));
+        }
+
+        template<class iterator_t>
+        size_t count_sorted_unique(iterator_t first, iterator_t last) const
+        {
+            if (first == last)
+                return 0;
+            size_t n = 1;
+            for (iterator_t run = first; ++first != last;)
+            {
+                if (tree_less(comp_, sorted_element_key<key_t>(*run), sorted_element_key<key_t>(*first)))
+                {
+                    run = first;
+                    n++;
+                }
+            }
+            return n;
+        }
+
+        /*
+         * O(n) build from a sorted range into an empty tree, n is the number of distinct keys in the range.
+         * With skip_equivalent only the first element of each run of equivalent keys becomes a node.
+         */
+        template<bool skip_equivalent, class iterator_t>
+        void build_from_sorted(iterator_t first, iterator_t last, size_t n)
+        {
+            ASSERT(end_node_.left == nullptr, "tree must be empty");
+            auto make_node = [this, &first, &last]() -> avl_tree_node_ptr_t
+            {
+                avl_tree_node_ptr_t node = construct_sorted_element(*first);
+                ++first;
+                if constexpr (skip_equivalent)
+                {
+                    while (first != last && !tree_less(comp_, node->key(), sorted_element_key<key_t>(*first)))
+                        ++first;
+                }
+                ASSERT(first == last || tree_less(comp_, node->key(), sorted_element_key<key_t>(*first)), "range must be sorted");
+                return node;
+            };
+            auto finish = [this](avl_tree_node_ptr_t node, size_t left_size, size_t right_size, uint32_t)
+            {
+                node->set_height_diff(int32_t(std::bit_width(right_size)) - int32_t(std::bit_width(left_size)));
+                updator_(node);
+            };
+            auto destroy = [this](avl_tree_node_ptr_t ptr) { destroy_node(ptr); };
+            avl_tree_node_ptr_t root = tree_build_balanced<avl_tree_node_ptr_t>(n, 0, make_node, finish, destroy);
+            end_node_.left = root;
+            if (root != nullptr)
+            {
+                root->parent = &end_node_;
+                begin_node_ = tree_min(root);
+                last_node_ = tree_max(root);
+            }
+            height_ = std::bit_width(n) + 1;
+        }
+
+        //hand every node over as a header, leaving the tree empty
+        avl_tree_header_t release_header() noexcept
+        {
+            begin_node_ = last_node_ = &end_node_;
+            return {std::exchange(end_node_.left, nullptr), std::exchange(height_, 1)};
+        }
+
+        //take over the nodes of header, tree must be empty
+        void adopt_header(avl_tree_header_t header) noexcept
+        {
+            ASSERT(end_node_.left == nullptr, "tree must be empty");
+            end_node_.left = header.root_;
+            if (header.root_ != nullptr)
+            {
+                header.root_->parent = &end_node_;
+                begin_node_ = tree_min(header.root_);
+                last_node_ = tree_max(header.root_);
+            }
+            height_ = header.height_;
+        }
+
+        avl_tree(avl_tree_header_t header, const metadata_updator_t &updator, const comparator_t &comp, const node_allocator_t &alloc)
                 :
                 height_(header.height_)
                 , end_node_(nullptr, header.root_, nullptr)
                 , begin_node_(header.root_ == nullptr ? &end_node_ : tree_min(header.root_))
+                , last_node_(header.root_ == nullptr ? &end_node_ : tree_max(header.root_))
                 , comp_(comp)
                 , updator_(updator)
+                , alloc_(alloc)
         {
             if (header.root_ != nullptr) header.root_->parent = &end_node_;
         }
@@ -462,12 +926,15 @@ namespace bbst
         template<class comparator_forward_t=comparator_t, class metadata_updator_forward_t=metadata_updator_t>
         requires (std::is_same_v<comparator_t, std::decay_t<comparator_forward_t>> &&
                   std::is_same_v<metadata_updator_t, std::decay_t<metadata_updator_forward_t>>)
-        avl_tree(metadata_updator_forward_t &&updator = metadata_updator_t(), comparator_forward_t &&comp = comparator_t())
+        avl_tree(metadata_updator_forward_t &&updator = metadata_updator_t(), comparator_forward_t &&comp = comparator_t()
+                 , const allocator_t &alloc = allocator_t())
                 :
                 end_node_(nullptr, nullptr, nullptr)
                 , begin_node_(&end_node_)
+                , last_node_(&end_node_)
                 , updator_(std::forward<metadata_updator_forward_t>(updator))
                 , comp_(std::forward<comparator_forward_t>(comp))
+                , alloc_(alloc)
                 , height_(1)
         {}
 
@@ -475,22 +942,126 @@ namespace bbst
                 :
                 end_node_(nullptr, std::exchange(other.end_node_.left, nullptr), nullptr)
                 , begin_node_(other.begin_node_ == &other.end_node_ ? &end_node_ : std::exchange(other.begin_node_, &other.end_node_))
+                , last_node_(other.last_node_ == &other.end_node_ ? &end_node_ : std::exchange(other.last_node_, &other.end_node_))
                 , height_(std::exchange(other.height_, 1))
                 , comp_(std::move(other.comp_))
                 , updator_(std::move(other.updator_))
+                , alloc_(other.alloc_)
         {
             if (end_node_.left) end_node_.left->parent = &end_node_;
         }
 
+        //O(n) construction from a range sorted by comp, elements are keys or (key, mapped) pairs
+        template<std::forward_iterator iterator_t, class comparator_forward_t=comparator_t, class metadata_updator_forward_t=metadata_updator_t>
+        requires (std::is_same_v<comparator_t, std::decay_t<comparator_forward_t>> &&
+                  std::is_same_v<metadata_updator_t, std::decay_t<metadata_updator_forward_t>>)
+        avl_tree(sorted_unique_t, iterator_t first, iterator_t last, metadata_updator_forward_t &&updator = metadata_updator_t()
+                , comparator_forward_t &&comp = comparator_t(), const allocator_t &alloc = allocator_t())
+                :
+                avl_tree(std::forward<metadata_updator_forward_t>(updator), std::forward<comparator_forward_t>(comp), alloc)
+        {
+            build_from_sorted<false>(first, last, std::distance(first, last));
+        }
+
+        template<std::forward_iterator iterator_t, class comparator_forward_t=comparator_t, class metadata_updator_forward_t=metadata_updator_t>
+        requires (std::is_same_v<comparator_t, std::decay_t<comparator_forward_t>> &&
+                  std::is_same_v<metadata_updator_t, std::decay_t<metadata_updator_forward_t>>)
+        avl_tree(sorted_equivalent_t, iterator_t first, iterator_t last, metadata_updator_forward_t &&updator = metadata_updator_t()
+                , comparator_forward_t &&comp = comparator_t(), const allocator_t &alloc = allocator_t())
+                :
+                avl_tree(std::forward<metadata_updator_forward_t>(updator), std::forward<comparator_forward_t>(comp), alloc)
+        {
+            build_from_sorted<true>(first, last, count_sorted_unique(first, last));
+        }
+
         template<class... Args>
         inline std::pair<iterator, bool> try_emplace(key_t key, Args...args)
         {
             return emplace_key_args(std::forward<key_t>(key), std::forward<Args>(args)...);
         }
 
+        //with a transparent comparator, look up by anything key_t can be built from, and only build it on insertion
+        template<class query_t, class... Args>
+        requires (is_transparent_comparator<comparator_t> && !std::is_same_v<std::remove_cvref_t<query_t>, key_t> &&
+                  std::constructible_from<key_t, query_t>)
+        inline std::pair<iterator, bool> try_emplace(query_t &&key, Args...args)
+        {
+            return emplace_query_args(std::forward<query_t>(key), std::forward<Args>(args)...);
+        }
+
+        /*
+         * try_emplace that first tries the spot right before hint (or right after it): if key fits there no descent is needed,
+         * and with the amortized O(1) rebalancing the whole insertion is amortized O(1) (O(log n) for updators that refresh ancestors).
+         * A wrong hint only costs the ordinary search.
+         */
+        template<class... Args>
+        inline iterator emplace_hint(const_iterator hint, key_t key, Args...args)
+        {
+            return emplace_hint_key_args(const_cast<base_tree_node_ptr_t>(hint.get()), std::forward<key_t>(key), std::forward<Args>(args)...).first;
+        }
+
+        //try_emplace for a key beyond the current greatest one (monotone ingestion), see emplace_hint
+        template<class... Args>
+        inline std::pair<iterator, bool> push_back(key_t key, Args...args)
+        {
+            return emplace_hint_key_args(&end_node_, std::forward<key_t>(key), std::forward<Args>(args)...);
+        }
+
+        //try_emplace for a key below the current least one, see emplace_hint
+        template<class... Args>
+        inline std::pair<iterator, bool> push_front(key_t key, Args...args)
+        {
+            return emplace_hint_key_args(begin_node_, std::forward<key_t>(key), std::forward<Args>(args)...);
+        }
+
+        /*
+         * try_emplace of every element of a range sorted by comp (keys or (key, mapped) pairs, of a run of equivalent keys only the first counts).
+         * Each element is placed by a finger search from the previous one, O(m log(n/m + 1)) for m elements into n instead of m full descents.
+         * With policy.pool set and at least policy.grain elements, the range is built into a tree and merged in with a forked
+         * join based union instead (see tree_set_operation), allocators that are not always equal keep to the sequential path.
+         */
+        template<std::forward_iterator iterator_t>
+        void insert_sorted_batch(iterator_t first, iterator_t last, parallel_policy policy = {})
+        {
+            if constexpr(node_allocator_traits::is_always_equal::value)
+            {
+                if (policy.pool != nullptr && size_t(std::distance(first, last)) >= policy.grain)
+                {
+                    avl_tree batch(avl_tree_header_t::empty_header(), updator_, comp_, alloc_);
+                    batch.template build_from_sorted<true>(first, last, batch.count_sorted_unique(first, last));
+                    auto destroy = [this](avl_tree_node_ptr_t root) { destroy_subtree(root); };
+                    tree_set_operation<avl_tree_header_ops, avl_tree_header_t, metadata_updator_t, comparator_t, decltype(destroy)> op(updator_, comp_, destroy, policy);
+                    avl_tree_header_t result = op.union_(release_header(), batch.release_header());
+                    ASSERT(avl_tree_header_invariant(result), "post condition failed");
+                    adopt_header(result);
+                    return;
+                }
+            }
+            base_tree_node_ptr_t finger = begin_node_;
+            for (; first != last; ++first)
+            {
+                //proxy iterators (transform, zip views) hand out pairs by value, keep the element alive as long as the key
+                auto &&element = *first;
+                const key_t &key = sorted_element_key<key_t>(element);
+                if (finger != &end_node_)
+                    finger = tree_finger_lower_bound(&end_node_, finger, key, comp_);
+                auto [child, parent] = find_equal_or_insert_pos(finger, key);
+                if (child == nullptr)
+                {
+                    avl_tree_node_ptr_t new_node = construct_sorted_element(std::forward<decltype(element)>(element));
+                    insert_node_at(parent, child, new_node);
+                    finger = new_node;
+                }
+                else
+                {
+                    finger = child;
+                }
+            }
+        }
+
         ~avl_tree()
         {
-            delete end_node_.left;
+            tree_destroy_all(alloc_, end_node_.left);
         }
 
         inline iterator begin() noexcept
@@ -533,6 +1104,44 @@ namespace bbst
             return const_iterator(bbst::lower_bound(&end_node_, key, comp_));
         }
 
+        template<class query_t>
+        requires is_transparent_comparator<comparator_t>
+        iterator lower_bound(const query_t &key)
+        {
+            return iterator(bbst::lower_bound(&end_node_, key, comp_));
+        }
+
+        template<class query_t>
+        requires is_transparent_comparator<comparator_t>
+        [[nodiscard]] const_iterator lower_bound(const query_t &key) const
+        {
+            return const_iterator(bbst::lower_bound(&end_node_, key, comp_));
+        }
+
+        iterator upper_bound(const key_t &key)
+        {
+            return iterator(bbst::upper_bound(&end_node_, key, comp_));
+        }
+
+        [[nodiscard]] const_iterator upper_bound(const key_t &key) const
+        {
+            return const_iterator(bbst::upper_bound(&end_node_, key, comp_));
+        }
+
+        template<class query_t>
+        requires is_transparent_comparator<comparator_t>
+        iterator upper_bound(const query_t &key)
+        {
+            return iterator(bbst::upper_bound(&end_node_, key, comp_));
+        }
+
+        template<class query_t>
+        requires is_transparent_comparator<comparator_t>
+        [[nodiscard]] const_iterator upper_bound(const query_t &key) const
+        {
+            return const_iterator(bbst::upper_bound(&end_node_, key, comp_));
+        }
+
         iterator find(const key_t &key)
         {
             return iterator(bbst::find(&end_node_, key, comp_));
@@ -543,9 +1152,184 @@ namespace bbst
             return const_iterator(bbst::find(&end_node_, key, comp_));
         }
 
-        template<class key_holder_t, class mapped_holder_t, class metadata_holder_t, class metadata_updator_holder_t, class comparator_holder_t, class tag> friend
+        template<class query_t>
+        requires is_transparent_comparator<comparator_t>
+        iterator find(const query_t &key)
+        {
+            return iterator(bbst::find(&end_node_, key, comp_));
+        }
+
+        template<class query_t>
+        requires is_transparent_comparator<comparator_t>
+        [[nodiscard]] const_iterator find(const query_t &key) const
+        {
+            return const_iterator(bbst::find(&end_node_, key, comp_));
+        }
+
+        /*
+         * lower_bound and find from a finger instead of the root: parent links are climbed only as far as needed,
+         * O(log d) for d elements between finger and the answer. A finger at end() starts from the greatest node.
+         */
+        iterator lower_bound_from(const_iterator finger, const key_t &key)
+        {
+            if (empty())
+                return end();
+            return iterator(tree_finger_lower_bound(&end_node_, finger_node(finger), key, comp_));
+        }
+
+        [[nodiscard]] const_iterator lower_bound_from(const_iterator finger, const key_t &key) const
+        {
+            if (empty())
+                return end();
+            return const_iterator(tree_finger_lower_bound(&end_node_, static_cast<const base_tree_node_t *>(finger_node(finger)), key, comp_));
+        }
+
+        iterator find_from(const_iterator finger, const key_t &key)
+        {
+            if (empty())
+                return end();
+            return iterator(tree_finger_find(&end_node_, finger_node(finger), key, comp_));
+        }
+
+        [[nodiscard]] const_iterator find_from(const_iterator finger, const key_t &key) const
+        {
+            if (empty())
+                return end();
+            return const_iterator(tree_finger_find(&end_node_, static_cast<const base_tree_node_t *>(finger_node(finger)), key, comp_));
+        }
+
+        /*
+         * lower_bound and find of every key in [first, last), iterators written to out in the same order.
+         * Same results as one call per key, but the descents of a batch are interleaved so their cache misses overlap,
+         * see tree_lower_bound_batch.
+         */
+        template<std::forward_iterator key_iterator_t, class output_iterator_t>
+        output_iterator_t lower_bound_batch(key_iterator_t first, key_iterator_t last, output_iterator_t out)
+        {
+            tree_lower_bound_batch(&end_node_, first, last, comp_, [&out](const auto &, base_tree_node_ptr_t p) { *out++ = iterator(p); });
+            return out;
+        }
+
+        template<std::forward_iterator key_iterator_t, class output_iterator_t>
+        output_iterator_t lower_bound_batch(key_iterator_t first, key_iterator_t last, output_iterator_t out) const
+        {
+            tree_lower_bound_batch(&end_node_, first, last, comp_, [&out](const auto &, const base_tree_node_t *p) { *out++ = const_iterator(p); });
+            return out;
+        }
+
+        template<std::forward_iterator key_iterator_t, class output_iterator_t>
+        output_iterator_t find_batch(key_iterator_t first, key_iterator_t last, output_iterator_t out)
+        {
+            tree_find_batch(&end_node_, first, last, comp_, [&out](base_tree_node_ptr_t p) { *out++ = iterator(p); });
+            return out;
+        }
+
+        template<std::forward_iterator key_iterator_t, class output_iterator_t>
+        output_iterator_t find_batch(key_iterator_t first, key_iterator_t last, output_iterator_t out) const
+        {
+            tree_find_batch(&end_node_, first, last, comp_, [&out](const base_tree_node_t *p) { *out++ = const_iterator(p); });
+            return out;
+        }
+
+        [[nodiscard]] bool empty() const
+        {
+            return begin_node_ == &end_node_;
+        }
+
+        [[nodiscard]] allocator_t get_allocator() const noexcept
+        {
+            return allocator_t(alloc_);
+        }
+
+        iterator erase(const_iterator pos) noexcept
+        {
+            ASSERT(pos != end(), "end() is not erasable");
+            avl_tree_node_ptr_t node = const_cast<base_tree_node_ptr_t>(pos.get())->self_downcast_unsafe();
+            base_tree_node_ptr_t next = tree_next_iter(static_cast<base_tree_node_ptr_t>(node));
+            if (last_node_ == node)
+                last_node_ = begin_node_ == node ? &end_node_ : tree_prev_iter(static_cast<base_tree_node_ptr_t>(node));
+            if (begin_node_ == node)
+                begin_node_ = next;
+            height_ -= avl_tree_remove(&end_node_, node, updator_);
+            ASSERT(avl_tree_header_invariant(avl_tree_header_t(end_node_.left, height_)), "post condition failed");
+            destroy_node(node);
+            return iterator(next);
+        }
+
+        inline iterator erase(iterator pos) noexcept
+        {
+            return erase(const_iterator(pos));
+        }
+
+        size_t erase(const key_t &key)
+        {
+            iterator pos = find(key);
+            if (pos == end())
+                return 0;
+            erase(pos);
+            return 1;
+        }
+
+        /*
+         * O(log n + k): cut [first, last) out with two splits and sew the rest back with a single join,
+         * instead of k independent removals
+         */
+        iterator erase(const_iterator first, const_iterator last)
+        {
+            base_tree_node_ptr_t last_node = const_cast<base_tree_node_ptr_t>(last.get());
+            if (first == last)
+                return iterator(last_node);
+            if (first == begin() && last == end())
+            {
+                clear();
+                return end();
+            }
+            if (const_iterator second = first; ++second == last)
+                return erase(first);
+            avl_tree_node_ptr_t first_node = const_cast<base_tree_node_ptr_t>(first.get())->self_downcast_unsafe();
+            if (last_node == &end_node_)
+                last_node_ = tree_prev_iter(static_cast<base_tree_node_ptr_t>(first_node));
+            avl_tree_header_t header(std::exchange(end_node_.left, nullptr), height_);
+            auto [left, first_x, right] = avl_tree_split(header, first_node->key(), updator_, comp_);
+            ASSERT(first_x == first_node, "first must be in the tree");
+            destroy_node(first_x);
+            if (last_node == &end_node_)
+            {
+                destroy_subtree(right.root_);
+                header = left;
+            }
+            else
+            {
+                auto [middle, last_x, rest] = avl_tree_split(right, last_node->self_downcast_unsafe()->key(), updator_, comp_);
+                ASSERT(last_x == last_node, "last must be in the tree");
+                destroy_subtree(middle.root_);
+                header = avl_tree_join_x(left, last_x, rest, updator_, comp_);
+            }
+            end_node_.left = header.root_;
+            if (header.root_ != nullptr)
+                header.root_->parent = &end_node_;
+            height_ = header.height_;
+            if (begin_node_ == first_node)
+                begin_node_ = last_node;
+            return iterator(last_node);
+        }
+
+        void clear() noexcept
+        {
+            destroy_subtree(std::exchange(end_node_.left, nullptr));
+            begin_node_ = &end_node_;
+            last_node_ = &end_node_;
+            height_ = 1;
+        }
+
+        template<class key_holder_t, class mapped_holder_t, class metadata_holder_t, class metadata_updator_holder_t, class comparator_holder_t, class tag, class allocator_holder_t> friend
         class avl_tree_custom_invoke;
     };
 
+    //ordered set: nodes have no mapped field, elements convert to their key
+    template<class key_t, class metadata_t = no_metadata, class metadata_updator_t = noop_metadata_updator_impl, class comparator_t = std::less<key_t>,
+            class allocator_t = std::allocator<exposure<key_t, no_mapped, metadata_t>>>
+    using avl_set = avl_tree<key_t, no_mapped, metadata_t, metadata_updator_t, comparator_t, allocator_t>;
+
 }
 #endif //BBST_AVL_TREE_H
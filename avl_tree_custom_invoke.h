@@ -1,17 +1,23 @@
 #ifndef BBST_AVL_TREE_CUSTOM_INVOKE_H
 #define BBST_AVL_TREE_CUSTOM_INVOKE_H
 
+#include <type_traits>
+#include "avl_tree.h"
+#include "tree_set_operation.h"
+#include "tree_custom_invoke.h"
+
 namespace bbst
 {
-    template<class key_t, class mapped_t, class metadata_t, class metadata_updator_t, class comparator_t, class tag>
+    template<class key_t, class mapped_t, class metadata_t, class metadata_updator_t, class comparator_t, class tag,
+            class allocator_t = std::allocator<exposure<key_t, mapped_t, metadata_t>>>
     struct avl_tree_custom_invoke {};
 
     struct avl_tree_custom_invoke_default_tag {};
 
-    template<class key_t, class mapped_t, class metadata_t, class metadata_updator_t, class comparator_t>
-    struct avl_tree_custom_invoke<key_t, mapped_t, metadata_t, metadata_updator_t, comparator_t, avl_tree_custom_invoke_default_tag>
+    template<class key_t, class mapped_t, class metadata_t, class metadata_updator_t, class comparator_t, class allocator_t>
+    struct avl_tree_custom_invoke<key_t, mapped_t, metadata_t, metadata_updator_t, comparator_t, avl_tree_custom_invoke_default_tag, allocator_t>
     {
-        using avl_tree_t = avl_tree<key_t, mapped_t, metadata_t, metadata_updator_t, comparator_t>;
+        using avl_tree_t = avl_tree<key_t, mapped_t, metadata_t, metadata_updator_t, comparator_t, allocator_t>;
         using avl_tree_header_t = avl_tree_header<key_t, mapped_t, metadata_t>;
         using avl_tree_node_ptr_t = typename avl_tree_t::avl_tree_node_ptr_t;
 
@@ -19,68 +25,274 @@ namespace bbst
         {
             avl_tree_node_ptr_t root = std::exchange(tree.end_node_.left, nullptr);
             tree.begin_node_ = &tree.end_node_;
+            tree.last_node_ = &tree.end_node_;
             uint32_t height = std::exchange(tree.height_, 1);
             return {root, height};
         };
 
+        //inverse of to_avl_tree_header, tree must be empty
+        static inline void from_avl_tree_header(avl_tree_t &tree, avl_tree_header_t header)
+        {
+            ASSERT(tree.end_node_.left == nullptr, "tree must be empty");
+            tree.end_node_.left = header.root_;
+            if (header.root_ != nullptr)
+                header.root_->parent = &tree.end_node_;
+            tree.begin_node_ = header.root_ == nullptr ? &tree.end_node_ : tree_min(header.root_);
+            tree.last_node_ = header.root_ == nullptr ? &tree.end_node_ : tree_max(header.root_);
+            tree.height_ = header.height_;
+        }
+
         template<bool equal_on_left_side>
         static std::pair<avl_tree_t, avl_tree_t> split_by_key(avl_tree_t &&tree, const key_t &key)
+        {
+            return split_by_key_impl<equal_on_left_side>(std::move(tree), key);
+        }
+
+        //split by anything the transparent comparator orders against the keys
+        template<bool equal_on_left_side, class query_t>
+        requires is_transparent_comparator<comparator_t>
+        static std::pair<avl_tree_t, avl_tree_t> split_by_key(avl_tree_t &&tree, const query_t &key)
+        {
+            return split_by_key_impl<equal_on_left_side>(std::move(tree), key);
+        }
+
+        //split right before pos (pos and everything after it go right) without comparing keys, pos == end() leaves the right side empty
+        static std::pair<avl_tree_t, avl_tree_t> split_at(avl_tree_t &&tree, typename avl_tree_t::const_iterator pos)
         {
             auto &comparator = tree.comp_;
             auto &metadata_updator = tree.updator_;
-            auto split_routine = [&comparator, &metadata_updator](auto self, avl_tree_header_t header
-                                                                  , const key_t &key) -> std::pair<avl_tree_header_t, avl_tree_header_t>
+            auto end_node = &tree.end_node_;
+            auto x = const_cast<decltype(end_node)>(pos.get());
+            avl_tree_header_t header = to_avl_tree_header(std::move(tree));
+            ASSERT(avl_tree_header_invariant(header), "pre condition failed");
+            avl_tree_header_t l = header, r = avl_tree_header_t::empty_header();
+            if (x != end_node)
+                std::tie(l, r) = avl_tree_split_at(header, end_node, x, metadata_updator, comparator);
+            ASSERT(avl_tree_header_invariant(l), "post condition failed");
+            ASSERT(avl_tree_header_invariant(r), "post condition failed");
+            return {avl_tree_t(l, metadata_updator, comparator, tree.alloc_), avl_tree_t(r, metadata_updator, comparator, tree.alloc_)};
+        }
+
+        /*
+         * Hand the subtree holding exactly the keys in [lo, hi] to f (nullptr if there are none), by splitting around the range
+         * and joining back. With a lazy updator f tags the root (e.g. range_add_sum_metadata_updator::add) and a range update costs O(log n).
+         * f may change values and metadata but not keys.
+         */
+        template<class function_t>
+        static void range_update(avl_tree_t &tree, const key_t &lo, const key_t &hi, function_t &&f)
+        {
+            auto &comparator = tree.comp_;
+            auto &metadata_updator = tree.updator_;
+            avl_tree_header_t header = to_avl_tree_header(std::move(tree));
+            auto [less, less_equal, rest] = avl_tree_split<tree_split_equal::right>(header, lo, metadata_updator, comparator);
+            auto [middle, middle_equal, greater] = avl_tree_split<tree_split_equal::left>(rest, hi, metadata_updator, comparator);
+            f(middle.root_);
+            header = avl_tree_join(less, avl_tree_join(middle, greater, metadata_updator, comparator), metadata_updator, comparator);
+            ASSERT(avl_tree_header_invariant(header), "post condition failed");
+            from_avl_tree_header(tree, header);
+        }
+
+        /*
+         * Aggregate of the keys in [lo, hi] in O(log n), read from the subtree metadata through monoid (see is_aggregate_monoid).
+         * Lazy updators are excluded since metadata below a pending tag is stale, read those through range_update instead.
+         */
+        template<class monoid_t>
+        requires (is_aggregate_monoid<monoid_t, avl_tree_node_ptr_t> && !is_lazy_metadata_updator<metadata_updator_t, avl_tree_node_ptr_t>)
+        static typename monoid_t::value_type range_aggregate(const avl_tree_t &tree, const key_t &lo, const key_t &hi, const monoid_t &monoid = monoid_t())
+        {
+            return tree_range_aggregate<avl_tree_node_ptr_t>(tree.end_node_.left, lo, hi, tree.comp_, monoid);
+        }
+
+        //settle every lazy tag above it, so the value behind it is current. O(log n)
+        static void push_down_path(avl_tree_t &tree, typename avl_tree_t::const_iterator it)
+        requires is_lazy_metadata_updator<metadata_updator_t, avl_tree_node_ptr_t>
+        {
+            if (it != tree.end())
+                tree_push_down_path(tree.updator_, &tree.end_node_, const_cast<avl_tree_node_ptr_t>(it.get()->self_downcast_unsafe()));
+        }
+
+        //settle every lazy tag in the tree (pre-order), plain iteration reads current values afterwards. O(n)
+        static void push_down_all(avl_tree_t &tree)
+        requires is_lazy_metadata_updator<metadata_updator_t, avl_tree_node_ptr_t>
+        {
+            avl_tree_node_ptr_t ptr = tree.end_node_.left;
+            while (ptr != nullptr)
             {
-                if (header.empty())
+                tree.updator_.push_down(ptr);
+                if (ptr->left != nullptr)
                 {
-                    return {avl_tree_header_t::empty_header(), avl_tree_header_t::empty_header()};
+                    ptr = ptr->left;
+                    continue;
                 }
-                if (comparator(key, header.root_->key()))
+                if (ptr->right != nullptr)
                 {
-                    //key < header.root_
-                    auto [left_header, right_header] = self(self, avl_tree_header_t(header.root_->left,
-                            header.height_ - (header.root_->height_diff_ > 0 ? 2 : 1)), key);
-                    return {left_header, bbst::avl_tree_join_x(right_header, header.root_, avl_tree_header_t(header.root_->right,
-                            header.height_ - (header.root_->height_diff_ < 0 ? 2 : 1)), metadata_updator, comparator)};
+                    ptr = ptr->right;
+                    continue;
                 }
-                else
+                //climb to the first left child whose sibling is still unvisited
+                while (true)
                 {
-                    if (comparator(header.root_->key(), key))
-                    {
-                        //header.root_ < key
-                        auto [left_header, right_header] = self(self, avl_tree_header_t(header.root_->right,
-                                header.height_ - (header.root_->height_diff_ < 0 ? 2 : 1)), key);
-                        return {bbst::avl_tree_join_x(avl_tree_header_t(header.root_->left, header.height_ - (header.root_->height_diff_ > 0 ? 2 : 1)), header
-                                .root_, left_header, metadata_updator, comparator), right_header};
-                    }
-                    else
+                    if (ptr->parent == &tree.end_node_)
+                        return;
+                    avl_tree_node_ptr_t parent = ptr->parent_unsafe();
+                    if (tree_is_left_child(ptr) && parent->right != nullptr)
                     {
-                        //==
-                        int32_t root_diff = header.root_->height_diff_;
-                        uint32_t root_height = header.height_;
-                        avl_tree_node_ptr_t left = header.root_->left;
-                        avl_tree_node_ptr_t right = header.root_->right;
-                        if constexpr(equal_on_left_side)
-                        {
-                            return {bbst::avl_tree_join_x(avl_tree_header_t(left, root_height - (root_diff > 0 ? 2 : 1)), header
-                                    .root_, avl_tree_header_t::empty_header(), metadata_updator, comparator),
-                                    avl_tree_header_t(right, root_height - (root_diff < 0 ? 2 : 1))};
-                        }
-                        else
-                        {
-                            return {avl_tree_header_t(left, root_height - (root_diff > 0 ? 2 : 1)),
-                                    bbst::avl_tree_join_x(avl_tree_header_t::empty_header(), header.root_, avl_tree_header_t(right,
-                                            root_height - (root_diff < 0 ? 2 : 1)), metadata_updator, comparator)};
-                        }
+                        ptr = parent->right;
+                        break;
                     }
+                    ptr = parent;
                 }
-            };
+            }
+        }
+
+        /*
+         * Join based set operations, both trees are consumed and must share the allocator.
+         * With policy.pool set, subproblems of at least policy.grain elements are forked onto the pool.
+         * Allocators that are not always equal (node_pool_allocator) aren't safe to share between threads, those always run sequentially.
+         */
+        static avl_tree_t union_(avl_tree_t &&lhs, avl_tree_t &&rhs, const parallel_policy &policy = {})
+        {
+            return set_operation(std::move(lhs), std::move(rhs), policy, [](auto &op, avl_tree_header_t a, avl_tree_header_t b) { return op.union_(a, b); });
+        }
+
+        static avl_tree_t intersection(avl_tree_t &&lhs, avl_tree_t &&rhs, const parallel_policy &policy = {})
+        {
+            return set_operation(std::move(lhs), std::move(rhs), policy, [](auto &op, avl_tree_header_t a, avl_tree_header_t b) { return op.intersection(a, b); });
+        }
+
+        static avl_tree_t difference(avl_tree_t &&lhs, avl_tree_t &&rhs, const parallel_policy &policy = {})
+        {
+            return set_operation(std::move(lhs), std::move(rhs), policy, [](auto &op, avl_tree_header_t a, avl_tree_header_t b) { return op.difference(a, b); });
+        }
+
+    private:
+        template<bool equal_on_left_side, class query_t>
+        static std::pair<avl_tree_t, avl_tree_t> split_by_key_impl(avl_tree_t &&tree, const query_t &key)
+        {
+            auto &comparator = tree.comp_;
+            auto &metadata_updator = tree.updator_;
             avl_tree_header_t header = to_avl_tree_header(std::move(tree));
             ASSERT(avl_tree_header_invariant(header), "pre condition failed");
-            auto [l, r] = split_routine(split_routine, header, key);
+            constexpr auto equal_policy = equal_on_left_side ? tree_split_equal::left : tree_split_equal::right;
+            auto [l, equal, r] = avl_tree_split<equal_policy>(header, key, metadata_updator, comparator);
+            ASSERT(avl_tree_header_invariant(l), "post condition failed");
+            ASSERT(avl_tree_header_invariant(r), "post condition failed");
+            return {avl_tree_t(l, metadata_updator, comparator, tree.alloc_), avl_tree_t(r, metadata_updator, comparator, tree.alloc_)};
+        }
+
+        template<class operation_t>
+        static avl_tree_t set_operation(avl_tree_t &&lhs, avl_tree_t &&rhs, parallel_policy policy, operation_t operation)
+        {
+            ASSERT(lhs.alloc_ == rhs.alloc_, "set operation on trees with different allocators");
+            using node_allocator_traits = typename avl_tree_t::node_allocator_traits;
+            if constexpr(!node_allocator_traits::is_always_equal::value)
+                policy.pool = nullptr;
+            auto &alloc = lhs.alloc_;
+            auto destroy = [&alloc](avl_tree_node_ptr_t root)
+            {
+                tree_destroy(root, [&alloc](avl_tree_node_ptr_t ptr) { tree_destroy_node(alloc, ptr); });
+            };
+            tree_set_operation<avl_tree_header_ops, avl_tree_header_t, metadata_updator_t, comparator_t, decltype(destroy)> op(lhs.updator_, lhs.comp_, destroy, policy);
+            avl_tree_header_t result = operation(op, to_avl_tree_header(std::move(lhs)), to_avl_tree_header(std::move(rhs)));
+            ASSERT(avl_tree_header_invariant(result), "post condition failed");
+            return avl_tree_t(result, lhs.updator_, lhs.comp_, alloc);
+        }
+    };
+
+    struct avl_tree_custom_invoke_order_statistic_tag {};
+
+    template<class key_t, class mapped_t, class metadata_t, class metadata_updator_t, class comparator_t, class allocator_t>
+    requires (std::is_integral_v<metadata_t> &&
+              bbst::is_order_statistic_metadata_updator<metadata_updator_t, bbst::avl_tree_node<bbst::exposure<key_t, mapped_t, metadata_t>> *>)
+    struct avl_tree_custom_invoke<key_t, mapped_t, metadata_t, metadata_updator_t, comparator_t, avl_tree_custom_invoke_order_statistic_tag, allocator_t>
+    {
+        using avl_tree_t = avl_tree<key_t, mapped_t, metadata_t, metadata_updator_t, comparator_t, allocator_t>;
+        using avl_tree_header_t = avl_tree_header<key_t, mapped_t, metadata_t>;
+        using avl_tree_node_ptr_t = typename avl_tree_t::avl_tree_node_ptr_t;
+        using default_invoker = avl_tree_custom_invoke<key_t, mapped_t, metadata_t, metadata_updator_t, comparator_t, avl_tree_custom_invoke_default_tag, allocator_t>;
+        using iterator = typename avl_tree_t::iterator;
+        using const_iterator = typename avl_tree_t::const_iterator;
+
+        static const_iterator find_by_order(const avl_tree_t &tree, size_t index)
+        {
+            avl_tree_node_ptr_t node = tree.end_node_.left;
+            if (node == nullptr || size_t(metadata_updator_t::get_order_metadata(node)) <= index)
+                return tree.end();
+            while (true)
+            {
+                auto left_count = size_t(metadata_updator_t::get_order_metadata(node->left));
+                if (left_count == index)
+                    return const_iterator(node);
+                else if (left_count > index)
+                    node = node->left;
+                else
+                {
+                    node = node->right;
+                    index -= left_count + 1;//minus node
+                }
+            }
+            ASSERT(false, "unreachable");
+        }
+
+        static iterator find_by_order(avl_tree_t &tree, size_t index)
+        {
+            return avl_tree_t::mutable_iterator(find_by_order(std::as_const(tree), index));
+        }
+
+        static size_t size(const avl_tree_t &tree)
+        {
+            return metadata_updator_t::get_order_metadata(tree.end_node_.left);
+        }
+
+        static size_t order_of_key(const avl_tree_t &tree, const key_t &key)
+        {
+            return order_of_key_impl(tree, key);
+        }
+
+        template<class query_t>
+        requires is_transparent_comparator<comparator_t>
+        static size_t order_of_key(const avl_tree_t &tree, const query_t &key)
+        {
+            return order_of_key_impl(tree, key);
+        }
+
+        /*
+         * Split by rank: the first index elements go to the left tree, the rest to the right one.
+         * O(log n), same shape as split_by_key but steering with the subtree sizes. Iterative, see tree_split_by_order.
+         */
+        static std::pair<avl_tree_t, avl_tree_t> split_by_order(avl_tree_t &&tree, size_t index)
+        {
+            auto &comparator = tree.comp_;
+            auto &metadata_updator = tree.updator_;
+            auto [l, r] = tree_split_by_order<metadata_updator_t>(default_invoker::to_avl_tree_header(std::move(tree)), index
+                                                                  , [&metadata_updator](auto h) { return avl_tree_expose(h, metadata_updator); }
+                                                                  , [&metadata_updator, &comparator](auto left, auto x, auto right)
+                                                                  {
+                                                                      return avl_tree_join_x(left, x, right, metadata_updator, comparator);
+                                                                  });
             ASSERT(avl_tree_header_invariant(l), "post condition failed");
             ASSERT(avl_tree_header_invariant(r), "post condition failed");
-            return {avl_tree_t(l, metadata_updator, comparator), avl_tree_t(r, metadata_updator, comparator)};
+            return {avl_tree_t(l, metadata_updator, comparator, tree.alloc_), avl_tree_t(r, metadata_updator, comparator, tree.alloc_)};
+        }
+
+    private:
+        template<class query_t>
+        static size_t order_of_key_impl(const avl_tree_t &tree, const query_t &key)
+        {
+            size_t less_than = 0;
+            avl_tree_node_ptr_t ptr = tree.end_node_.left;
+            auto &comparator = tree.comp_;
+            while (ptr != nullptr)
+            {
+                if (tree_less(comparator, ptr->key(), key))
+                {
+                    less_than += size_t(metadata_updator_t::get_order_metadata(ptr->left)) + 1;
+                    ptr = ptr->right;
+                }
+                else
+                    ptr = ptr->left;
+            }
+            return less_than;
         }
     };
 }
@@ -2,9 +2,20 @@
  * .cpp file to enable static library build
  */
 #include "tree_utils.h"
+#include "node_pool.h"
+#include "fork_join_pool.h"
 #include "rb_tree.h"
 #include "avl_tree.h"
 #include "tree_custom_invoke.h"
+#include "tree_set_operation.h"
 #include "rb_tree_custom_invoke.h"
 #include "avl_tree_custom_invoke.h"
+#include "epoch_reclamation.h"
+#include "persistent_avl_tree.h"
 
+#include "tree_serialization.h"
+#include "treap.h"
+#include "treap_custom_invoke.h"
+#include "simd_key_search.h"
+#include "bplus_tree.h"
+#include "bplus_tree_custom_invoke.h"
@@ -1,4 +1,786 @@
 #include "benchmark/benchmark.h"
 
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <numeric>
+#include <optional>
+#include <random>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
 
-BENCHMARK_MAIN();
\ No newline at end of file
+#include "../rb_tree.h"
+#include "../avl_tree.h"
+#include "../rb_tree_custom_invoke.h"
+#include "../avl_tree_custom_invoke.h"
+#include "../treap.h"
+#include "../treap_custom_invoke.h"
+#include "../bplus_tree.h"
+#include "../bplus_tree_custom_invoke.h"
+
+#ifndef BBST_BENCHMARK_MAX_SIZE
+#define BBST_BENCHMARK_MAX_SIZE 100000000
+#endif
+
+//allocation accounting
+namespace
+{
+    inline int64_t allocated_bytes = 0;
+
+    //stateless allocator that keeps track of the live bytes, gives bytes per node for every container alike
+    template<class T>
+    struct counting_allocator
+    {
+        typedef T value_type;
+
+        counting_allocator() noexcept = default;
+
+        template<class U>
+        counting_allocator(const counting_allocator<U> &) noexcept
+        {}
+
+        T *allocate(size_t n)
+        {
+            allocated_bytes += int64_t(n * sizeof(T));
+            return std::allocator<T>().allocate(n);
+        }
+
+        void deallocate(T *p, size_t n) noexcept
+        {
+            allocated_bytes -= int64_t(n * sizeof(T));
+            std::allocator<T>().deallocate(p, n);
+        }
+
+        template<class U>
+        friend inline bool operator==(const counting_allocator &, const counting_allocator<U> &) noexcept
+        {
+            return true;
+        }
+
+        template<class U>
+        friend inline bool operator!=(const counting_allocator &, const counting_allocator<U> &) noexcept
+        {
+            return false;
+        }
+    };
+
+    //whether the last reset_peak_rss went through, peak_rss is only reported per case when it did
+    inline bool peak_rss_reset = false;
+
+    /*
+     * Restart the high-water mark of the resident set at the current resident set (linux: clear_refs).
+     * Heap freed by earlier cases is handed back first, or the mark would restart at the largest case so far.
+     */
+    void reset_peak_rss()
+    {
+#ifdef __GLIBC__
+        malloc_trim(0);
+#endif
+        std::ofstream clear_refs("/proc/self/clear_refs");
+        clear_refs << "5";
+        clear_refs.flush();
+        peak_rss_reset = bool(clear_refs);
+    }
+
+    int64_t peak_rss_bytes()
+    {
+        std::ifstream status("/proc/self/status");
+        std::string field;
+        int64_t kilobytes = 0;
+        while (status >> field)
+            if (field == "VmHWM:" && status >> kilobytes)
+                break;
+        return kilobytes * 1024;
+    }
+
+    //start of a case: returns the live bytes to measure bytes per node against
+    int64_t start_memory_accounting()
+    {
+        reset_peak_rss();
+        return allocated_bytes;
+    }
+
+    void report_memory(benchmark::State &state, int64_t before, size_t nodes)
+    {
+        state.counters["bytes_per_node"] = nodes == 0 ? 0 : double(allocated_bytes - before) / double(nodes);
+        if (peak_rss_reset)
+            state.counters["peak_rss"] = benchmark::Counter(double(peak_rss_bytes()), benchmark::Counter::kDefaults, benchmark::Counter::kIs1024);
+    }
+}
+
+//key generation
+namespace
+{
+    using key_type = int64_t;
+    using mapped_type = int64_t;
+    using metadata_type = int64_t;
+
+    constexpr size_t max_queries = 1 << 20;
+
+    std::vector<key_type> sequential_keys(size_t n)
+    {
+        std::vector<key_type> keys(n);
+        std::iota(keys.begin(), keys.end(), key_type(0));
+        return keys;
+    }
+
+    std::vector<key_type> random_keys(size_t n, uint64_t seed = 42)
+    {
+        auto keys = sequential_keys(n);
+        std::shuffle(keys.begin(), keys.end(), std::mt19937_64(seed));
+        return keys;
+    }
+
+    /*
+     * Zipf(s) over [0, n) by rejection-inversion (Hörmann, Derflinger), O(1) memory so it scales to any n.
+     * Rank 0 is the most frequent one, ranks are scattered afterwards so hot keys aren't clustered.
+     */
+    class zipf_distribution
+    {
+    private:
+        double n_, s_, h_x1_, h_n_, threshold_;
+
+        [[nodiscard]] double h(double x) const
+        {
+            return std::abs(s_ - 1) < 1e-9 ? std::log(x) : (std::pow(x, 1 - s_) - 1) / (1 - s_);
+        }
+
+        [[nodiscard]] double h_inverse(double x) const
+        {
+            return std::abs(s_ - 1) < 1e-9 ? std::exp(x) : std::pow(1 + x * (1 - s_), 1 / (1 - s_));
+        }
+
+    public:
+        zipf_distribution(size_t n, double s)
+                :
+                n_(double(n))
+                , s_(s)
+                , h_x1_(h(1.5) - 1)
+                , h_n_(h(double(n) + 0.5))
+                , threshold_(2 - h_inverse(h(2.5) - std::pow(2, -s)))
+        {}
+
+        template<class generator_t>
+        size_t operator()(generator_t &gen)
+        {
+            std::uniform_real_distribution<double> uniform(0, 1);
+            while (true)
+            {
+                double u = h_n_ + uniform(gen) * (h_x1_ - h_n_);
+                double x = h_inverse(u);
+                double k = std::clamp(std::floor(x + 0.5), 1.0, n_);
+                if (k - x <= threshold_ || u >= h(k + 0.5) - std::pow(k, -s_))
+                    return size_t(k) - 1;
+            }
+        }
+    };
+
+    std::vector<key_type> zipf_keys(size_t n, double s = 0.99, uint64_t seed = 42)
+    {
+        std::mt19937_64 gen(seed);
+        zipf_distribution zipf(n, s);
+        //multiplicative scatter, odd multiplier is a bijection modulo 2^64
+        std::vector<key_type> keys(n);
+        for (auto &k: keys) k = key_type(uint64_t(zipf(gen)) * 0x9E3779B97F4A7C15ull % uint64_t(n));
+        return keys;
+    }
+
+    std::vector<key_type> query_keys(size_t n, uint64_t seed = 7)
+    {
+        std::mt19937_64 gen(seed);
+        std::uniform_int_distribution<key_type> key(0, key_type(n) - 1);
+        std::vector<key_type> keys(std::min(n, max_queries));
+        for (auto &k: keys) k = key(gen);
+        return keys;
+    }
+}
+
+//containers under test
+namespace
+{
+    template<class updator_t>
+    using rb_t = bbst::rb_tree<key_type, mapped_type, metadata_type, updator_t, std::less<key_type>, counting_allocator<bbst::exposure<key_type, mapped_type, metadata_type>>>;
+
+    template<class updator_t>
+    using avl_t = bbst::avl_tree<key_type, mapped_type, metadata_type, updator_t, std::less<key_type>, counting_allocator<bbst::exposure<key_type, mapped_type, metadata_type>>>;
+
+    template<class updator_t>
+    using treap_t = bbst::treap<key_type, mapped_type, metadata_type, updator_t, std::less<key_type>, counting_allocator<bbst::exposure<key_type, mapped_type, metadata_type>>>;
+
+    template<class updator_t>
+    using bplus_t = bbst::bplus_tree<key_type, mapped_type, metadata_type, updator_t, std::less<key_type>, counting_allocator<bbst::exposure<key_type, mapped_type, metadata_type>>>;
+
+    //noop updator over no_metadata, the metadata field takes no room in a node
+    using compact_exposure = bbst::exposure<key_type, mapped_type, bbst::no_metadata>;
+    using rb_compact_t = bbst::rb_tree<key_type, mapped_type, bbst::no_metadata, bbst::noop_metadata_updator_impl, std::less<key_type>, counting_allocator<compact_exposure>>;
+    using avl_compact_t = bbst::avl_tree<key_type, mapped_type, bbst::no_metadata, bbst::noop_metadata_updator_impl, std::less<key_type>, counting_allocator<compact_exposure>>;
+    using treap_compact_t = bbst::treap<key_type, mapped_type, bbst::no_metadata, bbst::noop_metadata_updator_impl, std::less<key_type>, counting_allocator<compact_exposure>>;
+
+    //ordered sets over no_metadata: nothing but the key in a node
+    using set_exposure = bbst::exposure<key_type, bbst::no_mapped, bbst::no_metadata>;
+    using rb_set_t = bbst::rb_set<key_type, bbst::no_metadata, bbst::noop_metadata_updator_impl, std::less<key_type>, counting_allocator<set_exposure>>;
+    using avl_set_t = bbst::avl_set<key_type, bbst::no_metadata, bbst::noop_metadata_updator_impl, std::less<key_type>, counting_allocator<set_exposure>>;
+    using treap_set_t = bbst::treap_set<key_type, bbst::no_metadata, bbst::noop_metadata_updator_impl, std::less<key_type>, counting_allocator<set_exposure>>;
+
+    template<class tree_t>
+    constexpr bool has_no_metadata = std::is_same_v<typename tree_t::allocator_type::value_type, compact_exposure>;
+
+    template<class tree_t>
+    constexpr bool is_set = std::is_same_v<typename tree_t::allocator_type::value_type, set_exposure>;
+
+    using map_t = std::map<key_type, mapped_type, std::less<key_type>, counting_allocator<std::pair<const key_type, mapped_type>>>;
+
+    using std_set_t = std::set<key_type, std::less<key_type>, counting_allocator<key_type>>;
+
+    template<class tree_t>
+    struct tree_traits;
+
+    template<class updator_t>
+    struct tree_traits<rb_t<updator_t>>
+    {
+        using default_invoker = bbst::rb_tree_custom_invoke<key_type, mapped_type, metadata_type, updator_t, std::less<key_type>, bbst::rb_tree_custom_invoke_default_tag, counting_allocator<bbst::exposure<key_type, mapped_type, metadata_type>>>;
+        using order_statistic_invoker = bbst::rb_tree_custom_invoke<key_type, mapped_type, metadata_type, updator_t, std::less<key_type>, bbst::rb_tree_custom_invoke_order_statistic_tag, counting_allocator<bbst::exposure<key_type, mapped_type, metadata_type>>>;
+
+        static auto to_header(rb_t<updator_t> &&tree)
+        {
+            return default_invoker::to_rb_tree_header(std::move(tree));
+        }
+
+        //put the two sides of a split back together
+        static rb_t<updator_t> concat(rb_t<updator_t> &&left, rb_t<updator_t> &&right)
+        {
+            return default_invoker::union_(std::move(left), std::move(right));
+        }
+
+        template<class header_t, class node_ptr_t>
+        static header_t join_x(header_t left, node_ptr_t x, header_t right)
+        {
+            return bbst::rb_tree_join_x(left, x, right, updator_t(), std::less<key_type>());
+        }
+
+        template<class header_t>
+        static auto split(header_t header, key_type key)
+        {
+            return bbst::rb_tree_split(header, key, updator_t(), std::less<key_type>());
+        }
+    };
+
+    template<class updator_t>
+    struct tree_traits<avl_t<updator_t>>
+    {
+        using default_invoker = bbst::avl_tree_custom_invoke<key_type, mapped_type, metadata_type, updator_t, std::less<key_type>, bbst::avl_tree_custom_invoke_default_tag, counting_allocator<bbst::exposure<key_type, mapped_type, metadata_type>>>;
+        using order_statistic_invoker = bbst::avl_tree_custom_invoke<key_type, mapped_type, metadata_type, updator_t, std::less<key_type>, bbst::avl_tree_custom_invoke_order_statistic_tag, counting_allocator<bbst::exposure<key_type, mapped_type, metadata_type>>>;
+
+        static auto to_header(avl_t<updator_t> &&tree)
+        {
+            return default_invoker::to_avl_tree_header(std::move(tree));
+        }
+
+        //put the two sides of a split back together
+        static avl_t<updator_t> concat(avl_t<updator_t> &&left, avl_t<updator_t> &&right)
+        {
+            return default_invoker::union_(std::move(left), std::move(right));
+        }
+
+        template<class header_t, class node_ptr_t>
+        static header_t join_x(header_t left, node_ptr_t x, header_t right)
+        {
+            return bbst::avl_tree_join_x(left, x, right, updator_t(), std::less<key_type>());
+        }
+
+        template<class header_t>
+        static auto split(header_t header, key_type key)
+        {
+            return bbst::avl_tree_split(header, key, updator_t(), std::less<key_type>());
+        }
+    };
+
+    template<class updator_t>
+    struct tree_traits<treap_t<updator_t>>
+    {
+        using default_invoker = bbst::treap_custom_invoke<key_type, mapped_type, metadata_type, updator_t, std::less<key_type>, bbst::treap_custom_invoke_default_tag, counting_allocator<bbst::exposure<key_type, mapped_type, metadata_type>>>;
+        using order_statistic_invoker = bbst::treap_custom_invoke<key_type, mapped_type, metadata_type, updator_t, std::less<key_type>, bbst::treap_custom_invoke_order_statistic_tag, counting_allocator<bbst::exposure<key_type, mapped_type, metadata_type>>>;
+
+        static auto to_header(treap_t<updator_t> &&tree)
+        {
+            return default_invoker::to_treap_header(std::move(tree));
+        }
+
+        //put the two sides of a split back together
+        static treap_t<updator_t> concat(treap_t<updator_t> &&left, treap_t<updator_t> &&right)
+        {
+            return default_invoker::union_(std::move(left), std::move(right));
+        }
+
+        template<class header_t, class node_ptr_t>
+        static header_t join_x(header_t left, node_ptr_t x, header_t right)
+        {
+            return bbst::treap_join_x(left, x, right, updator_t(), std::less<key_type>());
+        }
+
+        template<class header_t>
+        static auto split(header_t header, key_type key)
+        {
+            return bbst::treap_split(header, key, updator_t(), std::less<key_type>());
+        }
+    };
+
+    //no header level join_x/split: a B+-tree element is a slot, not a node
+    template<class updator_t>
+    struct tree_traits<bplus_t<updator_t>>
+    {
+        using default_invoker = bbst::bplus_tree_custom_invoke<key_type, mapped_type, metadata_type, updator_t, std::less<key_type>, bbst::bplus_tree_custom_invoke_default_tag, counting_allocator<bbst::exposure<key_type, mapped_type, metadata_type>>>;
+        using order_statistic_invoker = bbst::bplus_tree_custom_invoke<key_type, mapped_type, metadata_type, updator_t, std::less<key_type>, bbst::bplus_tree_custom_invoke_order_statistic_tag, counting_allocator<bbst::exposure<key_type, mapped_type, metadata_type>>>;
+
+        static bplus_t<updator_t> concat(bplus_t<updator_t> &&left, bplus_t<updator_t> &&right)
+        {
+            return default_invoker::join(std::move(left), std::move(right));
+        }
+    };
+
+    //the key doubles as metadata (overwritten by the updator) or mapped value, trees over no_metadata take it as mapped value and sets not at all
+    template<class tree_t>
+    void emplace_key(tree_t &tree, key_type k)
+    {
+        if constexpr (has_no_metadata<tree_t>)
+            tree.try_emplace(k, bbst::no_metadata(), k);
+        else if constexpr (is_set<tree_t>)
+            tree.try_emplace(k);
+        else if constexpr (std::is_same_v<tree_t, std_set_t>)
+            tree.emplace(k);
+        else
+            tree.try_emplace(k, k);
+    }
+
+    template<class tree_t>
+    tree_t build(const std::vector<key_type> &keys)
+    {
+        tree_t tree;
+        for (key_type k: keys) emplace_key(tree, k);
+        return tree;
+    }
+
+    template<class tree_t>
+    size_t count(const tree_t &tree)
+    {
+        size_t n = 0;
+        for (auto it = tree.begin(); it != tree.end(); ++it) n++;
+        return n;
+    }
+
+    template<class header_t>
+    void destroy_header(header_t header)
+    {
+        using node_t = std::remove_pointer_t<decltype(header.root_)>;
+        counting_allocator<node_t> alloc;
+        bbst::tree_destroy_all(alloc, header.root_);
+    }
+}
+
+//insert
+namespace
+{
+    template<class tree_t>
+    void insert_benchmark(benchmark::State &state, const std::vector<key_type> &keys, bool append = false)
+    {
+        int64_t before = start_memory_accounting();
+        size_t nodes = 0;
+        for (auto _: state)
+        {
+            tree_t tree;
+            if (!append)
+                for (key_type k: keys) emplace_key(tree, k);
+            else if constexpr (std::is_same_v<tree_t, map_t>)
+                for (key_type k: keys) tree.emplace_hint(tree.end(), k, k);
+            else if constexpr (has_no_metadata<tree_t>)
+                for (key_type k: keys) tree.push_back(k, bbst::no_metadata(), k);
+            else if constexpr (is_set<tree_t>)
+                for (key_type k: keys) tree.push_back(k);
+            else if constexpr (requires { tree.push_back(key_type(), key_type()); })
+                for (key_type k: keys) tree.push_back(k, k);
+            benchmark::DoNotOptimize(tree);
+            state.PauseTiming();
+            nodes = count(tree);
+            report_memory(state, before, nodes);
+            {
+                tree_t discard = std::move(tree);
+            }
+            state.ResumeTiming();
+        }
+        state.SetItemsProcessed(int64_t(state.iterations()) * int64_t(keys.size()));
+    }
+
+    template<class tree_t>
+    void BM_insert_sequential(benchmark::State &state)
+    {
+        insert_benchmark<tree_t>(state, sequential_keys(size_t(state.range(0))));
+    }
+
+    //same keys as BM_insert_sequential, appended at the end without descending (std::map: emplace_hint(end()))
+    template<class tree_t>
+    void BM_push_back(benchmark::State &state)
+    {
+        insert_benchmark<tree_t>(state, sequential_keys(size_t(state.range(0))), true);
+    }
+
+    template<class tree_t>
+    void BM_insert_random(benchmark::State &state)
+    {
+        insert_benchmark<tree_t>(state, random_keys(size_t(state.range(0))));
+    }
+
+    template<class tree_t>
+    void BM_insert_zipf(benchmark::State &state)
+    {
+        insert_benchmark<tree_t>(state, zipf_keys(size_t(state.range(0))));
+    }
+}
+
+//sorted batch insert
+namespace
+{
+    /*
+     * A sorted batch of n/10 new keys (odd, the tree holds the even ones) merged into a tree of n keys,
+     * through insert_sorted_batch or a try_emplace per key. Items are inserted keys, the tree is rebuilt outside the measured time.
+     */
+    template<class tree_t, class insert_t>
+    void sorted_batch_benchmark(benchmark::State &state, insert_t insert)
+    {
+        size_t n = size_t(state.range(0));
+        int64_t before = start_memory_accounting();
+        auto tree_keys = sequential_keys(n);
+        for (auto &k: tree_keys) k *= 2;
+        auto batch = random_keys(n);
+        batch.resize(std::max<size_t>(1, n / 10));
+        for (auto &k: batch) k = 2 * k + 1;
+        std::sort(batch.begin(), batch.end());
+        for (auto _: state)
+        {
+            state.PauseTiming();
+            std::optional<tree_t> tree(std::in_place, bbst::sorted_unique, tree_keys.begin(), tree_keys.end());
+            state.ResumeTiming();
+            insert(*tree, batch);
+            benchmark::DoNotOptimize(*tree);
+            state.PauseTiming();
+            report_memory(state, before, n + batch.size());
+            tree.reset();
+            state.ResumeTiming();
+        }
+        state.SetItemsProcessed(int64_t(state.iterations()) * int64_t(batch.size()));
+    }
+
+    template<class tree_t>
+    void BM_insert_sorted_batch(benchmark::State &state)
+    {
+        sorted_batch_benchmark<tree_t>(state, [](tree_t &tree, const std::vector<key_type> &batch) { tree.insert_sorted_batch(batch.begin(), batch.end()); });
+    }
+
+    template<class tree_t>
+    void BM_insert_sorted_batch_parallel(benchmark::State &state)
+    {
+        sorted_batch_benchmark<tree_t>(state, [](tree_t &tree, const std::vector<key_type> &batch)
+        {
+            tree.insert_sorted_batch(batch.begin(), batch.end(), {&bbst::fork_join_pool::default_pool()});
+        });
+    }
+
+    template<class tree_t>
+    void BM_insert_sorted_loop(benchmark::State &state)
+    {
+        sorted_batch_benchmark<tree_t>(state, [](tree_t &tree, const std::vector<key_type> &batch) { for (key_type k: batch) tree.try_emplace(k); });
+    }
+}
+
+//lookup
+namespace
+{
+    template<class tree_t, class lookup_t>
+    void lookup_benchmark(benchmark::State &state, lookup_t lookup)
+    {
+        size_t n = size_t(state.range(0));
+        int64_t before = start_memory_accounting();
+        tree_t tree = build<tree_t>(random_keys(n));
+        auto queries = query_keys(n);
+        size_t i = 0;
+        for (auto _: state)
+        {
+            benchmark::DoNotOptimize(lookup(tree, queries[i]));
+            if (++i == queries.size()) i = 0;
+        }
+        state.SetItemsProcessed(int64_t(state.iterations()));
+        report_memory(state, before, n);
+    }
+
+    template<class tree_t>
+    void BM_find(benchmark::State &state)
+    {
+        lookup_benchmark<tree_t>(state, [](const tree_t &tree, key_type k) { return tree.find(k) != tree.end(); });
+    }
+
+    template<class tree_t>
+    void BM_lower_bound(benchmark::State &state)
+    {
+        lookup_benchmark<tree_t>(state, [](const tree_t &tree, key_type k) { return tree.lower_bound(k) != tree.end(); });
+    }
+
+    /*
+     * Batches of queries, through find_batch (interleaved, prefetching descents) or a plain find per key.
+     * Items are keys, so the rates compare directly with each other and with BM_find.
+     */
+    constexpr size_t lookup_batch_size = 256;
+
+    template<class tree_t, class batch_t>
+    void batch_lookup_benchmark(benchmark::State &state, batch_t batch)
+    {
+        size_t n = size_t(state.range(0));
+        int64_t before = start_memory_accounting();
+        tree_t tree = build<tree_t>(random_keys(n));
+        auto queries = query_keys(n);
+        std::vector<typename tree_t::const_iterator> results(lookup_batch_size, std::as_const(tree).end());
+        size_t i = 0;
+        for (auto _: state)
+        {
+            if (i + lookup_batch_size > queries.size()) i = 0;
+            batch(tree, queries.begin() + std::ptrdiff_t(i), queries.begin() + std::ptrdiff_t(i + lookup_batch_size), results.begin());
+            benchmark::DoNotOptimize(results.data());
+            benchmark::ClobberMemory();
+            i += lookup_batch_size;
+        }
+        state.SetItemsProcessed(int64_t(state.iterations()) * int64_t(lookup_batch_size));
+        report_memory(state, before, n);
+    }
+
+    template<class tree_t>
+    void BM_find_batch(benchmark::State &state)
+    {
+        batch_lookup_benchmark<tree_t>(state, [](const tree_t &tree, auto first, auto last, auto out) { tree.find_batch(first, last, out); });
+    }
+
+    template<class tree_t>
+    void BM_find_loop(benchmark::State &state)
+    {
+        batch_lookup_benchmark<tree_t>(state, [](const tree_t &tree, auto first, auto last, auto out)
+        {
+            for (; first != last; ++first) *out++ = tree.find(*first);
+        });
+    }
+
+    template<class tree_t>
+    void BM_find_by_order(benchmark::State &state)
+    {
+        using invoker = typename tree_traits<tree_t>::order_statistic_invoker;
+        lookup_benchmark<tree_t>(state, [](const tree_t &tree, key_type k) { return invoker::find_by_order(tree, size_t(k)) != tree.end(); });
+    }
+
+    template<class tree_t>
+    void BM_order_of_key(benchmark::State &state)
+    {
+        using invoker = typename tree_traits<tree_t>::order_statistic_invoker;
+        lookup_benchmark<tree_t>(state, [](const tree_t &tree, key_type k) { return invoker::order_of_key(tree, k); });
+    }
+
+    //sum of keys over a window of about 1% of the tree, O(log n) whatever the window
+    template<class tree_t>
+    void BM_range_aggregate(benchmark::State &state)
+    {
+        using invoker = typename tree_traits<tree_t>::default_invoker;
+        key_type window = std::max<key_type>(1, state.range(0) / 100);
+        lookup_benchmark<tree_t>(state, [window](const tree_t &tree, key_type k)
+        {
+            return invoker::range_aggregate(tree, k, k + window, bbst::key_sum_aggregate_monoid<metadata_type>());
+        });
+    }
+
+    template<class tree_t>
+    void BM_iterate(benchmark::State &state)
+    {
+        size_t n = size_t(state.range(0));
+        int64_t before = start_memory_accounting();
+        tree_t tree = build<tree_t>(random_keys(n));
+        for (auto _: state)
+        {
+            for (auto it = tree.begin(); it != tree.end(); ++it)
+            {
+                auto &&value = *it;
+                benchmark::DoNotOptimize(&value);
+            }
+        }
+        state.SetItemsProcessed(int64_t(state.iterations()) * int64_t(n));
+        report_memory(state, before, n);
+    }
+}
+
+//split/join
+namespace
+{
+    /*
+     * split_by_key consumes the tree, so every iteration splits at a random key and puts the halves back together
+     * with tree_traits::concat outside the measured time.
+     */
+    template<class tree_t>
+    void BM_split_by_key(benchmark::State &state)
+    {
+        using invoker = typename tree_traits<tree_t>::default_invoker;
+        size_t n = size_t(state.range(0));
+        int64_t before = start_memory_accounting();
+        std::optional<tree_t> tree(build<tree_t>(random_keys(n)));
+        auto queries = query_keys(n);
+        size_t i = 0;
+        for (auto _: state)
+        {
+            auto start = std::chrono::high_resolution_clock::now();
+            auto [left, right] = invoker::template split_by_key<true>(std::move(*tree), queries[i]);
+            auto stop = std::chrono::high_resolution_clock::now();
+            state.SetIterationTime(std::chrono::duration<double>(stop - start).count());
+            tree.emplace(tree_traits<tree_t>::concat(std::move(left), std::move(right)));
+            if (++i == queries.size()) i = 0;
+        }
+        state.SetItemsProcessed(int64_t(state.iterations()));
+        report_memory(state, before, n);
+    }
+
+    template<class tree_t>
+    void BM_split_by_order(benchmark::State &state)
+    {
+        using traits = tree_traits<tree_t>;
+        size_t n = size_t(state.range(0));
+        int64_t before = start_memory_accounting();
+        std::optional<tree_t> tree(build<tree_t>(random_keys(n)));
+        auto queries = query_keys(n);
+        size_t i = 0;
+        for (auto _: state)
+        {
+            auto start = std::chrono::high_resolution_clock::now();
+            auto [left, right] = traits::order_statistic_invoker::split_by_order(std::move(*tree), size_t(queries[i]));
+            auto stop = std::chrono::high_resolution_clock::now();
+            state.SetIterationTime(std::chrono::duration<double>(stop - start).count());
+            tree.emplace(traits::concat(std::move(left), std::move(right)));
+            if (++i == queries.size()) i = 0;
+        }
+        state.SetItemsProcessed(int64_t(state.iterations()));
+        report_memory(state, before, n);
+    }
+
+    //join_x of the two sides of a three-way split, the split itself is not measured
+    template<class tree_t>
+    void BM_join_x(benchmark::State &state)
+    {
+        using traits = tree_traits<tree_t>;
+        size_t n = size_t(state.range(0));
+        int64_t before = start_memory_accounting();
+        auto header = traits::to_header(build<tree_t>(random_keys(n)));
+        auto queries = query_keys(n);
+        size_t i = 0;
+        for (auto _: state)
+        {
+            auto [left, x, right] = traits::split(header, queries[i]);
+            auto start = std::chrono::high_resolution_clock::now();
+            header = traits::join_x(left, x, right);
+            auto stop = std::chrono::high_resolution_clock::now();
+            state.SetIterationTime(std::chrono::duration<double>(stop - start).count());
+            if (++i == queries.size()) i = 0;
+        }
+        state.SetItemsProcessed(int64_t(state.iterations()));
+        report_memory(state, before, n);
+        destroy_header(header);
+    }
+}
+
+//registration
+namespace
+{
+    //shows up in the context block printed before the results
+    const bool key_search_reported = (benchmark::AddCustomContext("bplus_tree key search", bbst::key_search_path_name(bplus_t<bbst::noop_metadata_updator_impl>::key_search)), true);
+
+    void sizes(benchmark::internal::Benchmark *b)
+    {
+        for (int64_t n = 1000; n <= BBST_BENCHMARK_MAX_SIZE; n *= 10)
+            b->Arg(n);
+    }
+
+    using noop = bbst::noop_metadata_updator_impl;
+    using order_statistic = bbst::order_statistic_metadata_updator_impl;
+    using sum = bbst::sum_metadata_updator;
+}
+
+#define BBST_BENCHMARK_TREES(benchmark_name, updator, options) \
+    BENCHMARK_TEMPLATE(benchmark_name, rb_t<updator>)->Apply(sizes)->Unit(benchmark::kNanosecond)options; \
+    BENCHMARK_TEMPLATE(benchmark_name, avl_t<updator>)->Apply(sizes)->Unit(benchmark::kNanosecond)options; \
+    BENCHMARK_TEMPLATE(benchmark_name, treap_t<updator>)->Apply(sizes)->Unit(benchmark::kNanosecond)options
+
+//bplus_tree only where its interface matches: no push_back, batches or range_aggregate
+#define BBST_BENCHMARK_BPLUS(benchmark_name, updator, options) \
+    BENCHMARK_TEMPLATE(benchmark_name, bplus_t<updator>)->Apply(sizes)->Unit(benchmark::kNanosecond)options
+
+//against the noop trees of BBST_BENCHMARK_ALL: same shape, no metadata field (and no mapped field for the sets, next to std::set)
+#define BBST_BENCHMARK_COMPACT(benchmark_name) \
+    BENCHMARK_TEMPLATE(benchmark_name, rb_compact_t)->Apply(sizes)->Unit(benchmark::kNanosecond); \
+    BENCHMARK_TEMPLATE(benchmark_name, avl_compact_t)->Apply(sizes)->Unit(benchmark::kNanosecond); \
+    BENCHMARK_TEMPLATE(benchmark_name, treap_compact_t)->Apply(sizes)->Unit(benchmark::kNanosecond); \
+    BENCHMARK_TEMPLATE(benchmark_name, rb_set_t)->Apply(sizes)->Unit(benchmark::kNanosecond); \
+    BENCHMARK_TEMPLATE(benchmark_name, avl_set_t)->Apply(sizes)->Unit(benchmark::kNanosecond); \
+    BENCHMARK_TEMPLATE(benchmark_name, treap_set_t)->Apply(sizes)->Unit(benchmark::kNanosecond); \
+    BENCHMARK_TEMPLATE(benchmark_name, std_set_t)->Apply(sizes)->Unit(benchmark::kNanosecond)
+
+#define BBST_BENCHMARK_ALL(benchmark_name) \
+    BBST_BENCHMARK_TREES(benchmark_name, noop, ); \
+    BBST_BENCHMARK_TREES(benchmark_name, order_statistic, ); \
+    BBST_BENCHMARK_TREES(benchmark_name, sum, ); \
+    BENCHMARK_TEMPLATE(benchmark_name, map_t)->Apply(sizes)->Unit(benchmark::kNanosecond)
+
+#define BBST_BENCHMARK_ALL_BPLUS(benchmark_name) \
+    BBST_BENCHMARK_ALL(benchmark_name); \
+    BBST_BENCHMARK_BPLUS(benchmark_name, noop, ); \
+    BBST_BENCHMARK_BPLUS(benchmark_name, order_statistic, ); \
+    BBST_BENCHMARK_BPLUS(benchmark_name, sum, )
+
+BBST_BENCHMARK_ALL_BPLUS(BM_insert_sequential);
+BBST_BENCHMARK_ALL(BM_push_back);
+BBST_BENCHMARK_ALL_BPLUS(BM_insert_random);
+BBST_BENCHMARK_ALL_BPLUS(BM_insert_zipf);
+BBST_BENCHMARK_ALL_BPLUS(BM_find);
+BBST_BENCHMARK_ALL_BPLUS(BM_lower_bound);
+BBST_BENCHMARK_ALL_BPLUS(BM_iterate);
+BBST_BENCHMARK_COMPACT(BM_insert_random);
+BBST_BENCHMARK_COMPACT(BM_find);
+BBST_BENCHMARK_COMPACT(BM_iterate);
+
+//merged against one try_emplace per key for the same sorted batch
+BBST_BENCHMARK_TREES(BM_insert_sorted_batch, noop, );
+BBST_BENCHMARK_TREES(BM_insert_sorted_batch_parallel, noop, );
+BBST_BENCHMARK_TREES(BM_insert_sorted_loop, noop, );
+
+//batched against one find per key over the same batches
+BBST_BENCHMARK_TREES(BM_find_batch, noop, );
+BBST_BENCHMARK_TREES(BM_find_loop, noop, );
+
+BBST_BENCHMARK_TREES(BM_split_by_key, noop, ->UseManualTime());
+BBST_BENCHMARK_TREES(BM_split_by_key, order_statistic, ->UseManualTime());
+BBST_BENCHMARK_TREES(BM_split_by_key, sum, ->UseManualTime());
+BBST_BENCHMARK_BPLUS(BM_split_by_key, noop, ->UseManualTime());
+BBST_BENCHMARK_BPLUS(BM_split_by_key, order_statistic, ->UseManualTime());
+BBST_BENCHMARK_BPLUS(BM_split_by_key, sum, ->UseManualTime());
+BBST_BENCHMARK_TREES(BM_join_x, noop, ->UseManualTime());
+BBST_BENCHMARK_TREES(BM_join_x, order_statistic, ->UseManualTime());
+BBST_BENCHMARK_TREES(BM_join_x, sum, ->UseManualTime());
+
+//only the order statistic tag provides these
+BBST_BENCHMARK_TREES(BM_find_by_order, order_statistic, );
+BBST_BENCHMARK_TREES(BM_order_of_key, order_statistic, );
+BBST_BENCHMARK_TREES(BM_split_by_order, order_statistic, ->UseManualTime());
+BBST_BENCHMARK_BPLUS(BM_find_by_order, order_statistic, );
+BBST_BENCHMARK_BPLUS(BM_order_of_key, order_statistic, );
+BBST_BENCHMARK_BPLUS(BM_split_by_order, order_statistic, ->UseManualTime());
+
+//reads back sum_metadata_updator
+BBST_BENCHMARK_TREES(BM_range_aggregate, sum, );
+
+BENCHMARK_MAIN();
@@ -0,0 +1,1563 @@
+#ifndef BBST_BPLUS_TREE_H
+#define BBST_BPLUS_TREE_H
+
+#include <algorithm>
+#include <array>
+#include <concepts>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <utility>
+#include <vector>
+#include "tree_utils.h"
+#include "simd_key_search.h"
+
+//updator hooks
+namespace bbst
+{
+    /*
+     * A wide node has no left/right children, so updators plug into bplus_tree through two folds instead of operator():
+     * a node's metadata starts value initialized, then leaves fold_entry every (key, mapped) they hold
+     * and inner nodes fold_child the metadata of every child, in key order.
+     * order_statistic_metadata_updator_impl and sum_metadata_updator provide both, noop updators need neither.
+     */
+    template<class updator_t, class key_t, class mapped_t, class metadata_t> concept is_bplus_tree_metadata_updator =
+    is_noop_metadata_updator<updator_t> ||
+    requires(const updator_t updator, metadata_t &metadata, const metadata_t &child, const key_t &key, const mapped_t &mapped) {
+        updator.fold_entry(metadata, key, mapped);
+        updator.fold_child(metadata, child);
+    };
+}
+
+//node
+namespace bbst
+{
+    //doubly linked list of the leaves, closed by the tree's end link
+    struct bplus_tree_leaf_link
+    {
+        bplus_tree_leaf_link *prev;
+        bplus_tree_leaf_link *next;
+    };
+
+    //keys sit in one contiguous array per node, searched without touching anything else
+    template<class key_t, class metadata_t, size_t node_order>
+    struct bplus_tree_node
+    {
+        typedef key_t key_type;
+        typedef metadata_t metadata_type;
+
+        uint32_t count;//keys in use
+        bool leaf;
+        metadata_t metadata_;
+        std::array<key_t, node_order> keys;
+
+        explicit bplus_tree_node(bool is_leaf)
+                :
+                count(0)
+                , leaf(is_leaf)
+                , metadata_()
+                , keys()
+        {}
+
+        inline metadata_t &metadata() noexcept
+        {
+            return metadata_;
+        }
+
+        inline const metadata_t &metadata() const noexcept
+        {
+            return metadata_;
+        }
+    };
+
+    template<class key_t, class mapped_t, class metadata_t, size_t node_order>
+    struct bplus_tree_leaf : bplus_tree_node<key_t, metadata_t, node_order>, bplus_tree_leaf_link
+    {
+        typedef mapped_t mapped_type;
+
+        std::array<mapped_t, node_order> mapped;
+
+        bplus_tree_leaf()
+                :
+                bplus_tree_node<key_t, metadata_t, node_order>(true)
+                , bplus_tree_leaf_link{nullptr, nullptr}
+                , mapped()
+        {}
+    };
+
+    //children[i] holds the keys in [keys[i - 1], keys[i]), a separator is a copy of the least key on its right at the time it was set
+    template<class key_t, class metadata_t, size_t node_order>
+    struct bplus_tree_inner : bplus_tree_node<key_t, metadata_t, node_order>
+    {
+        std::array<bplus_tree_node<key_t, metadata_t, node_order> *, node_order + 1> children;
+
+        bplus_tree_inner()
+                :
+                bplus_tree_node<key_t, metadata_t, node_order>(false)
+                , children()
+        {}
+    };
+
+    template<class key_t, class mapped_t, class metadata_t, size_t node_order>
+    struct bplus_tree_header
+    {
+    private:
+        typedef bplus_tree_node<key_t, metadata_t, node_order> *bplus_tree_node_ptr_t;
+    public:
+
+        bplus_tree_node_ptr_t root_;
+        uint32_t height_;//levels, 1 for a lone leaf, 0 iff empty
+
+        bplus_tree_header(bplus_tree_node_ptr_t root, uint32_t height)
+                :
+                root_(root)
+                , height_(height)
+        {}
+
+        static inline bplus_tree_header empty_header()
+        {
+            return bplus_tree_header(nullptr, 0);
+        }
+
+        [[nodiscard]] bool empty() const
+        {
+            return root_ == nullptr;
+        }
+    };
+
+    //element of a leaf as seen through an iterator, the key is read only
+    template<class key_t, class mapped_t>
+    struct bplus_tree_reference
+    {
+        typedef const key_t key_type;
+        typedef mapped_t mapped_type;
+
+        const key_t &key;
+        mapped_t &mapped;
+    };
+
+    //(leaf, slot) cursor; insertion and erasure shift the slots of a leaf, so they invalidate every iterator
+    template<class leaf_t, bool is_const>
+    class bplus_tree_iterator_
+    {
+    private:
+        typedef std::conditional_t<is_const, const bplus_tree_leaf_link, bplus_tree_leaf_link> link_t;
+        typedef std::conditional_t<is_const, const leaf_t, leaf_t> leaf_type;
+
+        link_t *link_;
+        uint32_t index_;
+    public:
+        typedef std::bidirectional_iterator_tag iterator_category;
+        typedef std::ptrdiff_t difference_type;
+        typedef bplus_tree_reference<typename leaf_t::key_type, std::conditional_t<is_const, const typename leaf_t::mapped_type, typename leaf_t::mapped_type>> value_type;
+        typedef value_type reference;
+
+        struct pointer
+        {
+            reference ref;
+
+            const reference *operator->() const noexcept
+            {
+                return &ref;
+            }
+        };
+
+        bplus_tree_iterator_(link_t *link, uint32_t index) noexcept
+                :
+                link_(link)
+                , index_(index)
+        {}
+
+        template<bool other_const>
+        requires (is_const && !other_const)
+        bplus_tree_iterator_(const bplus_tree_iterator_<leaf_t, other_const> &other) noexcept
+                :
+                link_(other.link())
+                , index_(other.index())
+        {}
+
+        [[nodiscard]] inline link_t *link() const noexcept
+        {
+            return link_;
+        }
+
+        [[nodiscard]] inline uint32_t index() const noexcept
+        {
+            return index_;
+        }
+
+        reference operator*() const noexcept
+        {
+            leaf_type *leaf = static_cast<leaf_type *>(link_);
+            return {leaf->keys[index_], leaf->mapped[index_]};
+        }
+
+        pointer operator->() const noexcept
+        {
+            return {**this};
+        }
+
+        bplus_tree_iterator_ &operator++() noexcept
+        {
+            if (++index_ == static_cast<leaf_type *>(link_)->count)
+            {
+                link_ = link_->next;
+                index_ = 0;
+            }
+            return *this;
+        }
+
+        bplus_tree_iterator_ operator++(int) noexcept
+        {
+            bplus_tree_iterator_ old = *this;
+            ++*this;
+            return old;
+        }
+
+        bplus_tree_iterator_ &operator--() noexcept
+        {
+            if (index_ == 0)
+            {
+                link_ = link_->prev;
+                index_ = static_cast<leaf_type *>(link_)->count;
+            }
+            --index_;
+            return *this;
+        }
+
+        bplus_tree_iterator_ operator--(int) noexcept
+        {
+            bplus_tree_iterator_ old = *this;
+            --*this;
+            return old;
+        }
+
+        friend inline bool operator==(const bplus_tree_iterator_ &lhs, const bplus_tree_iterator_ &rhs) noexcept
+        {
+            return lhs.link_ == rhs.link_ && lhs.index_ == rhs.index_;
+        }
+    };
+}
+
+//invariant debug
+namespace bbst
+{
+    /*
+     * Occupancy (at least half full below the root), uniform leaf depth, key order within and across nodes,
+     * separators bounding their children and the leaf list following the key order.
+     * lo/hi receive the least/greatest key of the subtree, previous is the leaf before it in key order.
+     */
+    template<class leaf_t, class inner_t, class node_ptr_t, class comparator_t>
+    bool bplus_tree_node_invariant(node_ptr_t node, uint32_t height, bool is_root, const comparator_t &comp, const typename leaf_t::key_type *&lo
+                                   , const typename leaf_t::key_type *&hi, const bplus_tree_leaf_link *&previous)
+    {
+        constexpr uint32_t node_order = uint32_t(std::tuple_size_v<decltype(node->keys)>);
+        if (node->leaf != (height == 1) || node->count > node_order)
+            return false;
+        if (node->count < (is_root ? 1 : node_order / 2))
+            return false;
+        for (uint32_t i = 1; i < node->count; i++)
+            if (!tree_less(comp, node->keys[i - 1], node->keys[i]))
+                return false;
+        if (node->leaf)
+        {
+            const leaf_t *leaf = static_cast<const leaf_t *>(node);
+            if (previous != nullptr && (previous->next != leaf || leaf->prev != previous))
+                return false;
+            previous = leaf;
+            lo = &leaf->keys[0];
+            hi = &leaf->keys[leaf->count - 1];
+            return true;
+        }
+        const inner_t *inner = static_cast<const inner_t *>(node);
+        for (uint32_t i = 0; i <= inner->count; i++)
+        {
+            const typename leaf_t::key_type *child_lo, *child_hi;
+            if (!bplus_tree_node_invariant<leaf_t, inner_t>(inner->children[i], height - 1, false, comp, child_lo, child_hi, previous))
+                return false;
+            if (i > 0 && tree_less(comp, *child_lo, inner->keys[i - 1]))
+                return false;
+            if (i < inner->count && !tree_less(comp, *child_hi, inner->keys[i]))
+                return false;
+            if (i == 0)
+                lo = child_lo;
+            hi = child_hi;
+        }
+        return true;
+    }
+
+    template<class leaf_t, class inner_t, class header_t, class comparator_t>
+    bool bplus_tree_header_invariant(const header_t &header, const comparator_t &comp)
+    {
+        if (header.empty())
+            return header.height_ == 0;
+        const typename leaf_t::key_type *lo, *hi;
+        const bplus_tree_leaf_link *previous = nullptr;
+        return bplus_tree_node_invariant<leaf_t, inner_t>(header.root_, header.height_, true, comp, lo, hi, previous);
+    }
+}
+
+//B+-tree
+namespace bbst
+{
+    /*
+     * B+-tree: every element lives in a leaf of up to node_order (key, mapped) slots, inner nodes only route with up to node_order separators,
+     * leaves are chained for iteration. With tens of keys per node the height is a third to a fifth of a binary tree's
+     * and a descent touches a few contiguous key arrays instead of one cache line per level.
+     * Metadata is per node (see is_bplus_tree_metadata_updator), split and join are O(node_order * log n) like rb_tree_join_x,
+     * iterators are invalidated by any insertion or erasure.
+     * Keys and mapped values must be default constructible: the slot arrays are built with the node.
+     */
+    template<class key_t, class mapped_t, class metadata_t, class metadata_updator_t, class comparator_t=std::less<key_t>,
+            class allocator_t = std::allocator<exposure<key_t, mapped_t, metadata_t>>, size_t node_order = 32>
+    requires (is_tree_comparator<comparator_t, key_t, key_t> && is_bplus_tree_metadata_updator<metadata_updator_t, key_t, mapped_t, metadata_t> &&
+              std::default_initializable<key_t> && std::copyable<key_t> && std::default_initializable<mapped_t> && std::movable<mapped_t> &&
+              8 <= node_order && node_order <= 256)
+    class bplus_tree
+    {
+    private:
+        typedef bplus_tree_node<key_t, metadata_t, node_order> bplus_tree_node_t;
+        typedef bplus_tree_node_t *bplus_tree_node_ptr_t;
+        typedef bplus_tree_leaf<key_t, mapped_t, metadata_t, node_order> leaf_t;
+        typedef bplus_tree_inner<key_t, metadata_t, node_order> inner_t;
+        typedef bplus_tree_header<key_t, mapped_t, metadata_t, node_order> bplus_tree_header_t;
+        typedef typename std::allocator_traits<allocator_t>::template rebind_alloc<leaf_t> leaf_allocator_t;
+        typedef typename std::allocator_traits<allocator_t>::template rebind_alloc<inner_t> inner_allocator_t;
+        typedef std::allocator_traits<leaf_allocator_t> leaf_allocator_traits;
+        typedef std::allocator_traits<inner_allocator_t> inner_allocator_traits;
+
+        static constexpr uint32_t order = uint32_t(node_order);
+        static constexpr uint32_t min_count = order / 2;//below the root
+        //a non root node has at least 5 children, 32 levels hold more than 2^64 elements
+        static constexpr uint32_t max_height = 32;
+
+        //inner nodes from the root down to a node, with the child taken at each
+        struct bplus_tree_path
+        {
+            inner_t *node[max_height];
+            uint32_t index[max_height];
+            uint32_t depth = 0;
+
+            inline void push(inner_t *inner, uint32_t i) noexcept
+            {
+                node[depth] = inner;
+                index[depth++] = i;
+            }
+        };
+
+        //inner nodes allocated ahead of an insertion, split or join, so that running out of memory leaves the trees untouched
+        struct spare_nodes
+        {
+            //a split needs at most five per level, see split_headers
+            inner_t *node[5 * max_height];
+            uint32_t count = 0;
+        };
+    public:
+        typedef allocator_t allocator_type;
+        typedef bplus_tree_iterator_<leaf_t, false> iterator;
+        //how slots are searched, fixed at compile time by key_t, comparator_t and the target instruction set
+        static constexpr key_search_path key_search = key_search_path_for<key_t, comparator_t>;
+        typedef bplus_tree_iterator_<leaf_t, true> const_iterator;
+
+    private:
+        bplus_tree_leaf_link end_link_;//next: first leaf, prev: last leaf, itself if empty
+        bplus_tree_header_t header_;
+        [[no_unique_address]] comparator_t comp_;
+        [[no_unique_address]] metadata_updator_t updator_;
+        [[no_unique_address]] allocator_t alloc_;
+
+        static inline leaf_t *as_leaf(bplus_tree_node_ptr_t node) noexcept
+        {
+            return static_cast<leaf_t *>(node);
+        }
+
+        static inline inner_t *as_inner(bplus_tree_node_ptr_t node) noexcept
+        {
+            return static_cast<inner_t *>(node);
+        }
+
+        leaf_t *construct_leaf()
+        {
+            leaf_allocator_t alloc(alloc_);
+            leaf_t *ptr = leaf_allocator_traits::allocate(alloc, 1);
+            try
+            {
+                leaf_allocator_traits::construct(alloc, ptr);
+            }
+            catch (...)
+            {
+                leaf_allocator_traits::deallocate(alloc, ptr, 1);
+                throw;
+            }
+            return ptr;
+        }
+
+        inner_t *construct_inner()
+        {
+            inner_allocator_t alloc(alloc_);
+            inner_t *ptr = inner_allocator_traits::allocate(alloc, 1);
+            try
+            {
+                inner_allocator_traits::construct(alloc, ptr);
+            }
+            catch (...)
+            {
+                inner_allocator_traits::deallocate(alloc, ptr, 1);
+                throw;
+            }
+            return ptr;
+        }
+
+        static inner_t *take_spare(spare_nodes &spares) noexcept
+        {
+            ASSERT(spares.count > 0, "enough spares were reserved");
+            return spares.node[--spares.count];
+        }
+
+        void destroy_leaf(leaf_t *leaf) noexcept
+        {
+            leaf_allocator_t alloc(alloc_);
+            leaf_allocator_traits::destroy(alloc, leaf);
+            leaf_allocator_traits::deallocate(alloc, leaf, 1);
+        }
+
+        void destroy_inner(inner_t *inner) noexcept
+        {
+            inner_allocator_t alloc(alloc_);
+            inner_allocator_traits::destroy(alloc, inner);
+            inner_allocator_traits::deallocate(alloc, inner, 1);
+        }
+
+        //for nodes whose kind is only known at run time, destroy_leaf/destroy_inner otherwise
+        void destroy_node(bplus_tree_node_ptr_t node) noexcept
+        {
+            if (node->leaf)
+                destroy_leaf(as_leaf(node));
+            else
+                destroy_inner(as_inner(node));
+        }
+
+        void destroy_subtree(bplus_tree_node_ptr_t node) noexcept
+        {
+            if (!node->leaf)
+                for (uint32_t i = 0; i <= node->count; i++)
+                    destroy_subtree(as_inner(node)->children[i]);
+            destroy_node(node);
+        }
+
+        void release_spares(spare_nodes &spares) noexcept
+        {
+            while (spares.count > 0)
+                destroy_inner(spares.node[--spares.count]);
+        }
+
+        //top spares up to n nodes, on failure every spare is released before the exception propagates
+        void reserve_spares(spare_nodes &spares, uint32_t n)
+        {
+            ASSERT(n <= std::size(spares.node), "spares fit");
+            try
+            {
+                while (spares.count < n)
+                    spares.node[spares.count++] = construct_inner();
+            }
+            catch (...)
+            {
+                release_spares(spares);
+                throw;
+            }
+        }
+
+        //refold the metadata of node from its slots or children
+        void refresh(bplus_tree_node_ptr_t node) const
+        {
+            if constexpr (!is_noop_metadata_updator<metadata_updator_t>)
+            {
+                metadata_t metadata{};
+                if (node->leaf)
+                {
+                    leaf_t *leaf = as_leaf(node);
+                    for (uint32_t i = 0; i < leaf->count; i++)
+                        updator_.fold_entry(metadata, std::as_const(leaf->keys[i]), std::as_const(leaf->mapped[i]));
+                }
+                else
+                {
+                    inner_t *inner = as_inner(node);
+                    for (uint32_t i = 0; i <= inner->count; i++)
+                        updator_.fold_child(metadata, std::as_const(inner->children[i]->metadata()));
+                }
+                node->metadata() = std::move(metadata);
+            }
+        }
+
+        //refresh path.node[depth - 1] up to the root
+        void refresh_path(const bplus_tree_path &path, uint32_t depth) const
+        {
+            if constexpr (!is_noop_metadata_updator<metadata_updator_t>)
+                while (depth > 0)
+                    refresh(path.node[--depth]);
+        }
+
+        //first slot whose key is not before key
+        template<class query_t>
+        inline uint32_t lower_index(const bplus_tree_node_t *node, const query_t &key) const
+        {
+            if constexpr (is_simd_searchable_key<key_t, comparator_t, query_t>)
+                return simd_count_less<false>(node->keys.data(), node->count, key);
+            auto first = node->keys.begin();
+            return uint32_t(std::partition_point(first, first + node->count, [&](const key_t &k) { return tree_less(comp_, k, key); }) - first);
+        }
+
+        //first slot whose key is after key, for inner nodes the child to descend into
+        template<class query_t>
+        inline uint32_t upper_index(const bplus_tree_node_t *node, const query_t &key) const
+        {
+            if constexpr (is_simd_searchable_key<key_t, comparator_t, query_t>)
+                return simd_count_less<true>(node->keys.data(), node->count, key);
+            auto first = node->keys.begin();
+            return uint32_t(std::partition_point(first, first + node->count, [&](const key_t &k) { return !tree_less(comp_, key, k); }) - first);
+        }
+
+        //slots going left of a split at key
+        template<bool equal_on_left_side, class query_t>
+        inline uint32_t split_index(const bplus_tree_node_t *node, const query_t &key) const
+        {
+            return equal_on_left_side ? upper_index(node, key) : lower_index(node, key);
+        }
+
+        template<class query_t>
+        leaf_t *descend(const query_t &key) const
+        {
+            bplus_tree_node_ptr_t node = header_.root_;
+            while (!node->leaf)
+                node = as_inner(node)->children[upper_index(node, key)];
+            return as_leaf(node);
+        }
+
+        template<class query_t>
+        leaf_t *descend(const query_t &key, bplus_tree_path &path) const
+        {
+            bplus_tree_node_ptr_t node = header_.root_;
+            while (!node->leaf)
+            {
+                uint32_t i = upper_index(node, key);
+                path.push(as_inner(node), i);
+                node = as_inner(node)->children[i];
+            }
+            return as_leaf(node);
+        }
+
+        static leaf_t *first_leaf(bplus_tree_header_t header) noexcept
+        {
+            bplus_tree_node_ptr_t node = header.root_;
+            while (!node->leaf)
+                node = as_inner(node)->children[0];
+            return as_leaf(node);
+        }
+
+        static leaf_t *last_leaf(bplus_tree_header_t header) noexcept
+        {
+            bplus_tree_node_ptr_t node = header.root_;
+            while (!node->leaf)
+                node = as_inner(node)->children[node->count];
+            return as_leaf(node);
+        }
+
+        //slot i of leaf, past the last slot is the first one of the next leaf
+        template<class link_t>
+        static inline auto make_iterator(link_t *leaf, uint32_t i) noexcept
+        {
+            using result_t = std::conditional_t<std::is_const_v<link_t>, const_iterator, iterator>;
+            return i == leaf->count ? result_t(leaf->next, 0) : result_t(leaf, i);
+        }
+
+        //move slots [from, to) of source to the end of target
+        static void append_entries(leaf_t *target, leaf_t *source, uint32_t from, uint32_t to)
+        {
+            std::move(source->keys.begin() + from, source->keys.begin() + to, target->keys.begin() + target->count);
+            std::move(source->mapped.begin() + from, source->mapped.begin() + to, target->mapped.begin() + target->count);
+            target->count += to - from;
+        }
+
+        static void insert_entry(leaf_t *leaf, uint32_t i, key_t &&key, mapped_t &&mapped)
+        {
+            std::move_backward(leaf->keys.begin() + i, leaf->keys.begin() + leaf->count, leaf->keys.begin() + leaf->count + 1);
+            std::move_backward(leaf->mapped.begin() + i, leaf->mapped.begin() + leaf->count, leaf->mapped.begin() + leaf->count + 1);
+            leaf->keys[i] = std::move(key);
+            leaf->mapped[i] = std::move(mapped);
+            leaf->count++;
+        }
+
+        static void remove_entry(leaf_t *leaf, uint32_t i)
+        {
+            std::move(leaf->keys.begin() + i + 1, leaf->keys.begin() + leaf->count, leaf->keys.begin() + i);
+            std::move(leaf->mapped.begin() + i + 1, leaf->mapped.begin() + leaf->count, leaf->mapped.begin() + i);
+            leaf->count--;
+        }
+
+        //separator at keys[i] with child to its right, inner must have room
+        static void insert_separator(inner_t *inner, uint32_t i, key_t &&separator, bplus_tree_node_ptr_t child)
+        {
+            std::move_backward(inner->keys.begin() + i, inner->keys.begin() + inner->count, inner->keys.begin() + inner->count + 1);
+            std::move_backward(inner->children.begin() + i + 1, inner->children.begin() + inner->count + 1, inner->children.begin() + inner->count + 2);
+            inner->keys[i] = std::move(separator);
+            inner->children[i + 1] = child;
+            inner->count++;
+        }
+
+        //drop keys[i] and the child to its right
+        static void remove_separator(inner_t *inner, uint32_t i)
+        {
+            std::move(inner->keys.begin() + i + 1, inner->keys.begin() + inner->count, inner->keys.begin() + i);
+            std::move(inner->children.begin() + i + 2, inner->children.begin() + inner->count + 1, inner->children.begin() + i + 1);
+            inner->count--;
+        }
+
+        /*
+         * Insert separator/child at i into a full inner node: the node keeps the lower half, right gets the upper half,
+         * separator comes back as the key between them
+         */
+        static void split_inner(inner_t *inner, uint32_t i, key_t &separator, bplus_tree_node_ptr_t child, inner_t *right)
+        {
+            std::array<key_t, order + 1> keys;
+            std::array<bplus_tree_node_ptr_t, order + 2> children;
+            std::move(inner->keys.begin(), inner->keys.begin() + i, keys.begin());
+            keys[i] = std::move(separator);
+            std::move(inner->keys.begin() + i, inner->keys.end(), keys.begin() + i + 1);
+            std::copy(inner->children.begin(), inner->children.begin() + i + 1, children.begin());
+            children[i + 1] = child;
+            std::copy(inner->children.begin() + i + 1, inner->children.end(), children.begin() + i + 2);
+            constexpr uint32_t half = order / 2;
+            std::move(keys.begin(), keys.begin() + half, inner->keys.begin());
+            std::copy(children.begin(), children.begin() + half + 1, inner->children.begin());
+            inner->count = half;
+            separator = std::move(keys[half]);
+            std::move(keys.begin() + half + 1, keys.end(), right->keys.begin());
+            std::copy(children.begin() + half + 1, children.end(), right->children.begin());
+            right->count = order - half;
+        }
+
+        static inline bool fits(bplus_tree_node_ptr_t left, bplus_tree_node_ptr_t right) noexcept
+        {
+            return left->count + right->count + (left->leaf ? 0 : 1) <= order;
+        }
+
+        //right is folded into its left sibling and destroyed, separator is the key between them
+        void merge_nodes(bplus_tree_node_ptr_t left, bplus_tree_node_ptr_t right, const key_t &separator) noexcept
+        {
+            if (left->leaf)
+            {
+                leaf_t *l = as_leaf(left), *r = as_leaf(right);
+                append_entries(l, r, 0, r->count);
+                l->next = r->next;
+                if (r->next != nullptr)
+                    r->next->prev = l;
+                destroy_leaf(r);
+            }
+            else
+            {
+                inner_t *l = as_inner(left), *r = as_inner(right);
+                l->keys[l->count] = separator;
+                std::move(r->keys.begin(), r->keys.begin() + r->count, l->keys.begin() + l->count + 1);
+                std::copy(r->children.begin(), r->children.begin() + r->count + 1, l->children.begin() + l->count + 1);
+                l->count += r->count + 1;
+                destroy_inner(r);
+            }
+        }
+
+        //even out two siblings that do not fit in one node, separator is updated to the key between them
+        static void balance_nodes(bplus_tree_node_ptr_t left, bplus_tree_node_ptr_t right, key_t &separator)
+        {
+            if (left->leaf)
+            {
+                leaf_t *l = as_leaf(left), *r = as_leaf(right);
+                uint32_t keep = (l->count + r->count) / 2;
+                if (l->count > keep)
+                {
+                    uint32_t shift = l->count - keep;
+                    std::move_backward(r->keys.begin(), r->keys.begin() + r->count, r->keys.begin() + r->count + shift);
+                    std::move_backward(r->mapped.begin(), r->mapped.begin() + r->count, r->mapped.begin() + r->count + shift);
+                    std::move(l->keys.begin() + keep, l->keys.begin() + l->count, r->keys.begin());
+                    std::move(l->mapped.begin() + keep, l->mapped.begin() + l->count, r->mapped.begin());
+                    r->count += shift;
+                    l->count = keep;
+                }
+                else
+                {
+                    uint32_t shift = keep - l->count;
+                    append_entries(l, r, 0, shift);
+                    std::move(r->keys.begin() + shift, r->keys.begin() + r->count, r->keys.begin());
+                    std::move(r->mapped.begin() + shift, r->mapped.begin() + r->count, r->mapped.begin());
+                    r->count -= shift;
+                }
+                separator = r->keys[0];
+                return;
+            }
+            inner_t *l = as_inner(left), *r = as_inner(right);
+            std::array<key_t, 2 * order + 1> keys;
+            std::array<bplus_tree_node_ptr_t, 2 * order + 2> children;
+            uint32_t n = l->count + r->count + 1;
+            std::move(l->keys.begin(), l->keys.begin() + l->count, keys.begin());
+            keys[l->count] = std::move(separator);
+            std::move(r->keys.begin(), r->keys.begin() + r->count, keys.begin() + l->count + 1);
+            std::copy(l->children.begin(), l->children.begin() + l->count + 1, children.begin());
+            std::copy(r->children.begin(), r->children.begin() + r->count + 1, children.begin() + l->count + 1);
+            uint32_t keep = (n - 1) / 2;
+            std::move(keys.begin(), keys.begin() + keep, l->keys.begin());
+            std::copy(children.begin(), children.begin() + keep + 1, l->children.begin());
+            l->count = keep;
+            separator = std::move(keys[keep]);
+            std::move(keys.begin() + keep + 1, keys.begin() + n, r->keys.begin());
+            std::copy(children.begin() + keep + 1, children.begin() + n + 1, r->children.begin());
+            r->count = n - keep - 1;
+        }
+
+        //children[i] of inner fell below half: merge it with a sibling, or even them out if that would overflow
+        void rebalance_child(inner_t *inner, uint32_t i)
+        {
+            if (i == 0)
+                i = 1;
+            bplus_tree_node_ptr_t left = inner->children[i - 1], right = inner->children[i];
+            if (fits(left, right))
+            {
+                merge_nodes(left, right, inner->keys[i - 1]);
+                remove_separator(inner, i - 1);
+                refresh(left);
+            }
+            else
+            {
+                balance_nodes(left, right, inner->keys[i - 1]);
+                refresh(left);
+                refresh(right);
+            }
+        }
+
+        /*
+         * Link child in right after the child path.index[depth - 1] of path.node[depth - 1], splitting full nodes up the path
+         * and growing a new root when the old one splits. Refreshes the path.
+         */
+        void insert_child(bplus_tree_header_t &header, bplus_tree_path &path, uint32_t depth, key_t separator, bplus_tree_node_ptr_t child
+                          , spare_nodes &spares)
+        {
+            for (; depth > 0; depth--)
+            {
+                inner_t *inner = path.node[depth - 1];
+                uint32_t i = path.index[depth - 1];
+                if (inner->count < order)
+                {
+                    insert_separator(inner, i, std::move(separator), child);
+                    refresh(inner);
+                    refresh_path(path, depth - 1);
+                    return;
+                }
+                inner_t *right = take_spare(spares);
+                split_inner(inner, i, separator, child, right);
+                refresh(inner);
+                refresh(right);
+                child = right;
+            }
+            inner_t *root = take_spare(spares);
+            root->keys[0] = std::move(separator);
+            root->children[0] = header.root_;
+            root->children[1] = child;
+            root->count = 1;
+            refresh(root);
+            header.root_ = root;
+            header.height_++;
+        }
+
+        //an insertion below path splits every full node from the bottom up, plus a new root if they all are
+        static uint32_t splits_needed(const bplus_tree_path &path) noexcept
+        {
+            uint32_t n = 0;
+            while (n < path.depth && path.node[path.depth - 1 - n]->count == order)
+                n++;
+            return n == path.depth ? n + 1 : n;
+        }
+
+        //leaf chain of header closed by the end link, or the end link looped onto itself
+        void link_ends() noexcept
+        {
+            if (header_.empty())
+            {
+                end_link_.prev = end_link_.next = &end_link_;
+                return;
+            }
+            leaf_t *first = first_leaf(header_), *last = last_leaf(header_);
+            end_link_.next = first;
+            first->prev = &end_link_;
+            end_link_.prev = last;
+            last->next = &end_link_;
+        }
+
+        /*
+         * Concatenate two trees, every key of left before every key of right. Roots may be below half (pieces of a split),
+         * the result is valid apart from its root. The shorter tree is hung off the facing spine of the taller one at its own height,
+         * merged into or evened out with the node it lands next to, and splits propagate up from there:
+         * O(node_order * (|height difference| + 1)).
+         * Takes at most join_spares_needed(left, right) nodes from spares.
+         */
+        bplus_tree_header_t join_headers(bplus_tree_header_t left, bplus_tree_header_t right, spare_nodes &spares) noexcept
+        {
+            if (left.empty())
+                return right;
+            if (right.empty())
+                return left;
+            leaf_t *seam_left = last_leaf(left), *seam_right = first_leaf(right);
+            seam_left->next = seam_right;
+            seam_right->prev = seam_left;
+            key_t separator = seam_right->keys[0];
+            if (left.height_ == right.height_)
+            {
+                bplus_tree_node_ptr_t l = left.root_, r = right.root_;
+                if (fits(l, r))
+                {
+                    merge_nodes(l, r, separator);
+                    refresh(l);
+                    return left;
+                }
+                if (l->count < min_count || r->count < min_count)
+                {
+                    balance_nodes(l, r, separator);
+                    refresh(l);
+                    refresh(r);
+                }
+                bplus_tree_path path;
+                insert_child(left, path, 0, std::move(separator), r, spares);
+                return left;
+            }
+            bplus_tree_path path;
+            if (left.height_ > right.height_)
+            {
+                bplus_tree_node_ptr_t node = left.root_;
+                for (uint32_t height = left.height_; height > right.height_; height--)
+                {
+                    path.push(as_inner(node), node->count);
+                    node = as_inner(node)->children[node->count];
+                }
+                if (fits(node, right.root_))
+                {
+                    merge_nodes(node, right.root_, separator);
+                    refresh(node);
+                    refresh_path(path, path.depth);
+                    return left;
+                }
+                if (right.root_->count < min_count)
+                {
+                    balance_nodes(node, right.root_, separator);
+                    refresh(node);
+                    refresh(right.root_);
+                }
+                insert_child(left, path, path.depth, std::move(separator), right.root_, spares);
+                return left;
+            }
+            bplus_tree_node_ptr_t node = right.root_;
+            for (uint32_t height = right.height_; height > left.height_; height--)
+            {
+                path.push(as_inner(node), 0);
+                node = as_inner(node)->children[0];
+            }
+            inner_t *parent = path.node[path.depth - 1];
+            parent->children[0] = left.root_;
+            if (fits(left.root_, node))
+            {
+                merge_nodes(left.root_, node, separator);
+                refresh(left.root_);
+                refresh_path(path, path.depth);
+                return right;
+            }
+            if (left.root_->count < min_count)
+            {
+                balance_nodes(left.root_, node, separator);
+                refresh(left.root_);
+                refresh(node);
+            }
+            insert_child(right, path, path.depth, std::move(separator), node, spares);
+            return right;
+        }
+
+        //one split per level walked down the taller tree, plus a new root
+        static uint32_t join_spares_needed(bplus_tree_header_t left, bplus_tree_header_t right) noexcept
+        {
+            if (left.empty() || right.empty())
+                return 0;
+            return (left.height_ > right.height_ ? left.height_ - right.height_ : right.height_ - left.height_) + 1;
+        }
+
+        //join_headers with its nodes allocated up front, left and right are untouched if that throws
+        bplus_tree_header_t join_headers(bplus_tree_header_t left, bplus_tree_header_t right)
+        {
+            spare_nodes spares;
+            reserve_spares(spares, join_spares_needed(left, right));
+            bplus_tree_header_t header = join_headers(left, right, spares);
+            release_spares(spares);
+            return header;
+        }
+
+        /*
+         * Cut header into keys going left and right: every node on the search path splits in two, the pieces beside the path
+         * are whole subtrees of decreasing height, and each side is put back together bottom up with join_headers.
+         * Heights grow along each side, so the joins telescope to O(node_order * log n).
+         * The leaf chain is cut between the sides.
+         * The search path is walked once before anything is cut to allocate every node the split can need, header is untouched if that throws.
+         * Per side, a join takes the height it adds to that side plus one node if the side was taller than the piece,
+         * which sums to at most twice the height of header; the cut path nodes come on top.
+         */
+        template<bool equal_on_left_side, class query_t>
+        std::pair<bplus_tree_header_t, bplus_tree_header_t> split_headers(bplus_tree_header_t header, const query_t &key)
+        {
+            if (header.empty())
+                return {header, header};
+            //child taken at each level
+            uint32_t index[max_height];
+            uint32_t cuts = 0;
+            bplus_tree_node_ptr_t node = header.root_;
+            for (uint32_t level = 0; !node->leaf; level++)
+            {
+                inner_t *inner = as_inner(node);
+                uint32_t c = index[level] = split_index<equal_on_left_side>(inner, key);
+                if (c + 1 < inner->count)
+                    cuts++;
+                node = inner->children[c];
+            }
+            leaf_t *leaf = as_leaf(node);
+            uint32_t i = split_index<equal_on_left_side>(leaf, key);
+            spare_nodes spares;
+            reserve_spares(spares, cuts + 4 * header.height_);
+            leaf_t *rest = nullptr;
+            if (i != 0 && i != leaf->count)
+            {
+                try
+                {
+                    rest = construct_leaf();
+                }
+                catch (...)
+                {
+                    release_spares(spares);
+                    throw;
+                }
+            }
+            //roots and heights of the subtrees cut off each level, an empty piece has a null root
+            bplus_tree_node_ptr_t left_roots[max_height], right_roots[max_height];
+            uint32_t left_heights[max_height], right_heights[max_height];
+            uint32_t pieces = 0;
+            node = header.root_;
+            for (uint32_t height = header.height_; height > 1; height--, pieces++)
+            {
+                inner_t *inner = as_inner(node);
+                uint32_t c = index[pieces];
+                node = inner->children[c];
+                left_roots[pieces] = right_roots[pieces] = nullptr;
+                left_heights[pieces] = right_heights[pieces] = 0;
+                if (c + 1 < inner->count)
+                {
+                    inner_t *right = take_spare(spares);
+                    std::move(inner->keys.begin() + c + 1, inner->keys.begin() + inner->count, right->keys.begin());
+                    std::copy(inner->children.begin() + c + 1, inner->children.begin() + inner->count + 1, right->children.begin());
+                    right->count = inner->count - c - 1;
+                    refresh(right);
+                    right_roots[pieces] = right;
+                    right_heights[pieces] = height;
+                }
+                else if (c + 1 == inner->count)
+                {
+                    right_roots[pieces] = inner->children[c + 1];
+                    right_heights[pieces] = height - 1;
+                }
+                if (c > 1)
+                {
+                    inner->count = c - 1;
+                    refresh(inner);
+                    left_roots[pieces] = inner;
+                    left_heights[pieces] = height;
+                }
+                else
+                {
+                    if (c == 1)
+                    {
+                        left_roots[pieces] = inner->children[0];
+                        left_heights[pieces] = height - 1;
+                    }
+                    destroy_inner(inner);
+                }
+            }
+            bplus_tree_header_t left = bplus_tree_header_t::empty_header(), right = bplus_tree_header_t::empty_header();
+            if (i == 0)
+            {
+                right = bplus_tree_header_t(leaf, 1);
+            }
+            else if (i == leaf->count)
+            {
+                left = bplus_tree_header_t(leaf, 1);
+            }
+            else
+            {
+                append_entries(rest, leaf, i, leaf->count);
+                leaf->count = i;
+                rest->next = leaf->next;
+                if (rest->next != nullptr)
+                    rest->next->prev = rest;
+                rest->prev = leaf;
+                leaf->next = rest;
+                refresh(leaf);
+                refresh(rest);
+                left = bplus_tree_header_t(leaf, 1);
+                right = bplus_tree_header_t(rest, 1);
+            }
+            while (pieces-- > 0)
+            {
+                left = join_headers(bplus_tree_header_t(left_roots[pieces], left_heights[pieces]), left, spares);
+                right = join_headers(right, bplus_tree_header_t(right_roots[pieces], right_heights[pieces]), spares);
+            }
+            release_spares(spares);
+            if (!left.empty() && !right.empty())
+            {
+                last_leaf(left)->next = nullptr;
+                first_leaf(right)->prev = nullptr;
+            }
+            return {left, right};
+        }
+
+        template<class query_t>
+        const_iterator lower_bound_impl(const query_t &key) const
+        {
+            if (empty())
+                return end();
+            const leaf_t *leaf = descend(key);
+            return make_iterator(leaf, lower_index(leaf, key));
+        }
+
+        template<class query_t>
+        const_iterator upper_bound_impl(const query_t &key) const
+        {
+            if (empty())
+                return end();
+            const leaf_t *leaf = descend(key);
+            return make_iterator(leaf, upper_index(leaf, key));
+        }
+
+        template<class query_t>
+        const_iterator find_impl(const query_t &key) const
+        {
+            if (empty())
+                return end();
+            const leaf_t *leaf = descend(key);
+            uint32_t i = lower_index(leaf, key);
+            if (i == leaf->count || tree_less(comp_, key, leaf->keys[i]))
+                return end();
+            return const_iterator(leaf, i);
+        }
+
+        static inline iterator mutable_iterator(const_iterator it) noexcept
+        {
+            return iterator(const_cast<bplus_tree_leaf_link *>(it.link()), it.index());
+        }
+
+        template<class... Args>
+        std::pair<iterator, bool> emplace_key_args(key_t &&key, Args &&...args)
+        {
+            if (empty())
+            {
+                leaf_t *leaf = construct_leaf();
+                try
+                {
+                    leaf->mapped[0] = mapped_t(std::forward<Args>(args)...);
+                }
+                catch (...)
+                {
+                    destroy_leaf(leaf);
+                    throw;
+                }
+                leaf->keys[0] = std::move(key);
+                leaf->count = 1;
+                refresh(leaf);
+                header_ = bplus_tree_header_t(leaf, 1);
+                link_ends();
+                return {iterator(leaf, 0), true};
+            }
+            bplus_tree_path path;
+            leaf_t *leaf = descend(key, path);
+            uint32_t i = lower_index(leaf, key);
+            if (i < leaf->count && !tree_less(comp_, key, leaf->keys[i]))
+                return {iterator(leaf, i), false};
+            mapped_t mapped(std::forward<Args>(args)...);
+            if (leaf->count < order)
+            {
+                insert_entry(leaf, i, std::move(key), std::move(mapped));
+                refresh(leaf);
+                refresh_path(path, path.depth);
+                return {iterator(leaf, i), true};
+            }
+            leaf_t *right = construct_leaf();
+            spare_nodes spares;
+            try
+            {
+                reserve_spares(spares, splits_needed(path));
+            }
+            catch (...)
+            {
+                destroy_leaf(right);
+                throw;
+            }
+            //order + 1 slots: the left leaf keeps half, rounded up
+            constexpr uint32_t half = (order + 1) / 2;
+            iterator result(leaf, i);
+            if (i < half)
+            {
+                append_entries(right, leaf, half - 1, order);
+                leaf->count = half - 1;
+                insert_entry(leaf, i, std::move(key), std::move(mapped));
+            }
+            else
+            {
+                append_entries(right, leaf, half, order);
+                leaf->count = half;
+                insert_entry(right, i - half, std::move(key), std::move(mapped));
+                result = iterator(right, i - half);
+            }
+            right->next = leaf->next;
+            right->next->prev = right;
+            right->prev = leaf;
+            leaf->next = right;
+            refresh(leaf);
+            refresh(right);
+            insert_child(header_, path, path.depth, right->keys[0], right, spares);
+            ASSERT(spares.count == 0, "every spare is used");
+            return {result, true};
+        }
+
+        /*
+         * Remove slot i of the leaf at the end of path. A node that falls below half borrows from or merges with a sibling,
+         * which may leave its parent below half in turn; a root left with a single child is dropped.
+         * Returns whether nodes were restructured.
+         */
+        bool erase_entry(bplus_tree_path &path, leaf_t *leaf, uint32_t i) noexcept
+        {
+            remove_entry(leaf, i);
+            bplus_tree_node_ptr_t node = leaf;
+            uint32_t depth = path.depth;
+            while (depth > 0 && node->count < min_count)
+            {
+                depth--;
+                rebalance_child(path.node[depth], path.index[depth]);
+                node = path.node[depth];
+            }
+            bool restructured = depth != path.depth;
+            refresh(node);
+            refresh_path(path, depth);
+            bplus_tree_node_ptr_t root = header_.root_;
+            if (root->count == 0)
+            {
+                if (root->leaf)
+                {
+                    header_ = bplus_tree_header_t::empty_header();
+                    link_ends();
+                    destroy_leaf(as_leaf(root));
+                }
+                else
+                {
+                    header_ = bplus_tree_header_t(as_inner(root)->children[0], header_.height_ - 1);
+                    destroy_inner(as_inner(root));
+                }
+            }
+            return restructured;
+        }
+
+        template<class element_t>
+        void assign_sorted_element(leaf_t *leaf, uint32_t i, element_t &&element)
+        {
+            if constexpr (std::is_convertible_v<element_t, key_t>)
+            {
+                leaf->keys[i] = key_t(std::forward<element_t>(element));
+            }
+            else
+            {
+                leaf->keys[i] = key_t(std::forward<element_t>(element).first);
+                //nothing to read from an empty mapped type, a set's no_mapped may share its address with the key
+                if constexpr (!std::is_empty_v<mapped_t>)
+                    leaf->mapped[i] = mapped_t(std::forward<element_t>(element).second);
+            }
+        }
+
+        template<class iterator_t>
+        size_t count_sorted_unique(iterator_t first, iterator_t last) const
+        {
+            if (first == last)
+                return 0;
+            size_t n = 1;
+            for (iterator_t run = first; ++first != last;)
+            {
+                if (tree_less(comp_, sorted_element_key<key_t>(*run), sorted_element_key<key_t>(*first)))
+                {
+                    run = first;
+                    n++;
+                }
+            }
+            return n;
+        }
+
+        /*
+         * O(n) build from a sorted range into an empty tree, n is the number of distinct keys in the range.
+         * Each level is cut into as few nodes as fit and the slots are spread evenly over them, so every node but the root is over half full.
+         * With skip_equivalent only the first element of each run of equivalent keys is kept.
+         */
+        template<bool skip_equivalent, class iterator_t>
+        void build_from_sorted(iterator_t first, iterator_t last, size_t n)
+        {
+            ASSERT(empty(), "tree must be empty");
+            if (n == 0)
+                return;
+            std::vector<bplus_tree_node_ptr_t> level, parents;
+            std::vector<const key_t *> lows, parent_lows;//least key under each node
+            bool linked = false;//parents own level
+            try
+            {
+                size_t leaves = (n + order - 1) / order;
+                level.reserve(leaves);
+                lows.reserve(leaves);
+                leaf_t *previous = nullptr;
+                for (size_t j = 0; j < leaves; j++)
+                {
+                    leaf_t *leaf = construct_leaf();
+                    level.push_back(leaf);
+                    leaf->prev = previous;
+                    if (previous != nullptr)
+                        previous->next = leaf;
+                    previous = leaf;
+                    uint32_t size = uint32_t(n / leaves + (j < n % leaves));
+                    for (uint32_t k = 0; k < size; k++)
+                    {
+                        assign_sorted_element(leaf, k, *first);
+                        leaf->count = k + 1;
+                        ++first;
+                        if constexpr (skip_equivalent)
+                        {
+                            while (first != last && !tree_less(comp_, leaf->keys[k], sorted_element_key<key_t>(*first)))
+                                ++first;
+                        }
+                        ASSERT(first == last || tree_less(comp_, leaf->keys[k], sorted_element_key<key_t>(*first)), "range must be sorted");
+                    }
+                    refresh(leaf);
+                    lows.push_back(&leaf->keys[0]);
+                }
+                uint32_t height = 1;
+                while (level.size() > 1)
+                {
+                    size_t count = (level.size() + order) / (order + 1);
+                    parents.reserve(count);
+                    parent_lows.reserve(count);
+                    while (parents.size() < count)
+                        parents.push_back(construct_inner());
+                    for (size_t j = 0, child = 0; j < count; j++)
+                    {
+                        inner_t *inner = as_inner(parents[j]);
+                        uint32_t size = uint32_t(level.size() / count + (j < level.size() % count));
+                        std::copy(level.begin() + std::ptrdiff_t(child), level.begin() + std::ptrdiff_t(child + size), inner->children.begin());
+                        inner->count = size - 1;
+                        child += size;
+                    }
+                    linked = true;
+                    for (size_t j = 0, child = 0; j < count; j++)
+                    {
+                        inner_t *inner = as_inner(parents[j]);
+                        for (uint32_t k = 0; k < inner->count; k++)
+                            inner->keys[k] = *lows[child + k + 1];
+                        parent_lows.push_back(lows[child]);
+                        child += inner->count + 1;
+                        refresh(inner);
+                    }
+                    level.swap(parents);
+                    lows.swap(parent_lows);
+                    parents.clear();
+                    parent_lows.clear();
+                    linked = false;
+                    height++;
+                }
+                header_ = bplus_tree_header_t(level[0], height);
+            }
+            catch (...)
+            {
+                for (bplus_tree_node_ptr_t node: parents)
+                    linked ? destroy_subtree(node) : destroy_inner(as_inner(node));
+                if (!linked)
+                    for (bplus_tree_node_ptr_t node: level)
+                        destroy_subtree(node);
+                throw;
+            }
+            link_ends();
+        }
+
+        //hand every node over as a header with an open leaf chain, leaving the tree empty
+        bplus_tree_header_t release_header() noexcept
+        {
+            if (!header_.empty())
+            {
+                end_link_.next->prev = nullptr;
+                end_link_.prev->next = nullptr;
+            }
+            end_link_.prev = end_link_.next = &end_link_;
+            return std::exchange(header_, bplus_tree_header_t::empty_header());
+        }
+
+        //take over the nodes of header, tree must be empty
+        void adopt_header(bplus_tree_header_t header) noexcept
+        {
+            ASSERT(header_.empty(), "tree must be empty");
+            header_ = header;
+            link_ends();
+        }
+
+        [[nodiscard]] bool header_invariant(bplus_tree_header_t header) const
+        {
+            return bplus_tree_header_invariant<leaf_t, inner_t>(header, comp_);
+        }
+
+        bplus_tree(bplus_tree_header_t header, const metadata_updator_t &updator, const comparator_t &comp, const allocator_t &alloc)
+                :
+                end_link_{&end_link_, &end_link_}
+                , header_(header)
+                , comp_(comp)
+                , updator_(updator)
+                , alloc_(alloc)
+        {
+            link_ends();
+        }
+
+    public:
+
+        template<class comparator_forward_t=comparator_t, class metadata_updator_forward_t=metadata_updator_t>
+        requires (std::is_same_v<comparator_t, std::decay_t<comparator_forward_t>> &&
+                  std::is_same_v<metadata_updator_t, std::decay_t<metadata_updator_forward_t>>)
+        bplus_tree(metadata_updator_forward_t &&updator = metadata_updator_t(), comparator_forward_t &&comp = comparator_t()
+                   , const allocator_t &alloc = allocator_t())
+                :
+                end_link_{&end_link_, &end_link_}
+                , header_(bplus_tree_header_t::empty_header())
+                , comp_(std::forward<comparator_forward_t>(comp))
+                , updator_(std::forward<metadata_updator_forward_t>(updator))
+                , alloc_(alloc)
+        {}
+
+        bplus_tree(bplus_tree &&other) noexcept(std::is_nothrow_move_constructible_v<comparator_t> && std::is_nothrow_move_constructible_v<metadata_updator_t>)
+                :
+                end_link_{&end_link_, &end_link_}
+                , header_(other.release_header())
+                , comp_(std::move(other.comp_))
+                , updator_(std::move(other.updator_))
+                , alloc_(other.alloc_)
+        {
+            link_ends();
+        }
+
+        //O(n) construction from a range sorted by comp, elements are keys or (key, mapped) pairs
+        template<std::forward_iterator iterator_t, class comparator_forward_t=comparator_t, class metadata_updator_forward_t=metadata_updator_t>
+        requires (std::is_same_v<comparator_t, std::decay_t<comparator_forward_t>> &&
+                  std::is_same_v<metadata_updator_t, std::decay_t<metadata_updator_forward_t>>)
+        bplus_tree(sorted_unique_t, iterator_t first, iterator_t last, metadata_updator_forward_t &&updator = metadata_updator_t()
+                   , comparator_forward_t &&comp = comparator_t(), const allocator_t &alloc = allocator_t())
+                :
+                bplus_tree(std::forward<metadata_updator_forward_t>(updator), std::forward<comparator_forward_t>(comp), alloc)
+        {
+            build_from_sorted<false>(first, last, std::distance(first, last));
+        }
+
+        template<std::forward_iterator iterator_t, class comparator_forward_t=comparator_t, class metadata_updator_forward_t=metadata_updator_t>
+        requires (std::is_same_v<comparator_t, std::decay_t<comparator_forward_t>> &&
+                  std::is_same_v<metadata_updator_t, std::decay_t<metadata_updator_forward_t>>)
+        bplus_tree(sorted_equivalent_t, iterator_t first, iterator_t last, metadata_updator_forward_t &&updator = metadata_updator_t()
+                   , comparator_forward_t &&comp = comparator_t(), const allocator_t &alloc = allocator_t())
+                :
+                bplus_tree(std::forward<metadata_updator_forward_t>(updator), std::forward<comparator_forward_t>(comp), alloc)
+        {
+            build_from_sorted<true>(first, last, count_sorted_unique(first, last));
+        }
+
+        ~bplus_tree()
+        {
+            clear();
+        }
+
+        //unlike the binary trees the arguments build the mapped value alone, there is no per element metadata
+        template<class... Args>
+        inline std::pair<iterator, bool> try_emplace(key_t key, Args &&...args)
+        {
+            auto result = emplace_key_args(std::move(key), std::forward<Args>(args)...);
+            ASSERT(header_invariant(header_), "post condition failed");
+            return result;
+        }
+
+        //with a transparent comparator, look up by anything key_t can be built from, and only build it on insertion
+        template<class query_t, class... Args>
+        requires (is_transparent_comparator<comparator_t> && !std::is_same_v<std::remove_cvref_t<query_t>, key_t> &&
+                  std::constructible_from<key_t, query_t>)
+        inline std::pair<iterator, bool> try_emplace(query_t &&key, Args &&...args)
+        {
+            if (const_iterator it = find_impl(key); it != end())
+                return {mutable_iterator(it), false};
+            return try_emplace(key_t(std::forward<query_t>(key)), std::forward<Args>(args)...);
+        }
+
+        inline iterator begin() noexcept
+        {
+            return iterator(end_link_.next, 0);
+        }
+
+        [[nodiscard]] inline const_iterator begin() const noexcept
+        {
+            return const_iterator(end_link_.next, 0);
+        }
+
+        inline iterator end() noexcept
+        {
+            return iterator(&end_link_, 0);
+        }
+
+        [[nodiscard]] inline const_iterator end() const noexcept
+        {
+            return const_iterator(&end_link_, 0);
+        }
+
+        inline comparator_t &value_comp() noexcept
+        {
+            return comp_;
+        }
+
+        [[nodiscard]] inline const comparator_t &value_comp() const noexcept
+        {
+            return comp_;
+        }
+
+        iterator lower_bound(const key_t &key)
+        {
+            return mutable_iterator(lower_bound_impl(key));
+        }
+
+        const_iterator lower_bound(const key_t &key) const
+        {
+            return lower_bound_impl(key);
+        }
+
+        template<class query_t>
+        requires is_transparent_comparator<comparator_t>
+        iterator lower_bound(const query_t &key)
+        {
+            return mutable_iterator(lower_bound_impl(key));
+        }
+
+        template<class query_t>
+        requires is_transparent_comparator<comparator_t>
+        const_iterator lower_bound(const query_t &key) const
+        {
+            return lower_bound_impl(key);
+        }
+
+        iterator upper_bound(const key_t &key)
+        {
+            return mutable_iterator(upper_bound_impl(key));
+        }
+
+        const_iterator upper_bound(const key_t &key) const
+        {
+            return upper_bound_impl(key);
+        }
+
+        template<class query_t>
+        requires is_transparent_comparator<comparator_t>
+        iterator upper_bound(const query_t &key)
+        {
+            return mutable_iterator(upper_bound_impl(key));
+        }
+
+        template<class query_t>
+        requires is_transparent_comparator<comparator_t>
+        const_iterator upper_bound(const query_t &key) const
+        {
+            return upper_bound_impl(key);
+        }
+
+        iterator find(const key_t &key)
+        {
+            return mutable_iterator(find_impl(key));
+        }
+
+        const_iterator find(const key_t &key) const
+        {
+            return find_impl(key);
+        }
+
+        template<class query_t>
+        requires is_transparent_comparator<comparator_t>
+        iterator find(const query_t &key)
+        {
+            return mutable_iterator(find_impl(key));
+        }
+
+        template<class query_t>
+        requires is_transparent_comparator<comparator_t>
+        const_iterator find(const query_t &key) const
+        {
+            return find_impl(key);
+        }
+
+        [[nodiscard]] bool empty() const
+        {
+            return header_.empty();
+        }
+
+        [[nodiscard]] allocator_t get_allocator() const noexcept
+        {
+            return alloc_;
+        }
+
+        //the iterator to the element after pos; the search path is found again from pos's key
+        iterator erase(const_iterator pos)
+        {
+            ASSERT(pos != end(), "end() is not erasable");
+            bplus_tree_path path;
+            leaf_t *leaf = descend(pos->key, path);
+            ASSERT(leaf == pos.link() && lower_index(leaf, pos->key) == pos.index(), "pos must be in the tree");
+            uint32_t i = pos.index();
+            if (leaf->count > min_count || path.depth == 0)
+            {
+                erase_entry(path, leaf, i);
+                ASSERT(header_invariant(header_), "post condition failed");
+                return empty() ? end() : make_iterator(leaf, i);
+            }
+            key_t key = leaf->keys[i];
+            erase_entry(path, leaf, i);
+            ASSERT(header_invariant(header_), "post condition failed");
+            return upper_bound(key);
+        }
+
+        inline iterator erase(iterator pos)
+        {
+            return erase(const_iterator(pos));
+        }
+
+        size_t erase(const key_t &key)
+        {
+            if (empty())
+                return 0;
+            bplus_tree_path path;
+            leaf_t *leaf = descend(key, path);
+            uint32_t i = lower_index(leaf, key);
+            if (i == leaf->count || tree_less(comp_, key, leaf->keys[i]))
+                return 0;
+            erase_entry(path, leaf, i);
+            ASSERT(header_invariant(header_), "post condition failed");
+            return 1;
+        }
+
+        void clear() noexcept
+        {
+            if (!header_.empty())
+                destroy_subtree(header_.root_);
+            header_ = bplus_tree_header_t::empty_header();
+            link_ends();
+        }
+
+        template<class key_holder_t, class mapped_holder_t, class metadata_holder_t, class metadata_updator_holder_t, class comparator_holder_t, class tag
+                , class allocator_holder_t, size_t node_order_holder> friend
+        struct bplus_tree_custom_invoke;
+    };
+}
+#endif //BBST_BPLUS_TREE_H
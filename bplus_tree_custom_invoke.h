@@ -0,0 +1,172 @@
+#ifndef BBST_BPLUS_TREE_CUSTOM_INVOKE_H
+#define BBST_BPLUS_TREE_CUSTOM_INVOKE_H
+
+#include <type_traits>
+#include "bplus_tree.h"
+#include "tree_custom_invoke.h"
+
+namespace bbst
+{
+    template<class key_t, class mapped_t, class metadata_t, class metadata_updator_t, class comparator_t, class tag,
+            class allocator_t = std::allocator<exposure<key_t, mapped_t, metadata_t>>, size_t node_order = 32>
+    struct bplus_tree_custom_invoke {};
+
+    struct bplus_tree_custom_invoke_default_tag {};
+
+    template<class key_t, class mapped_t, class metadata_t, class metadata_updator_t, class comparator_t, class allocator_t, size_t node_order>
+    struct bplus_tree_custom_invoke<key_t, mapped_t, metadata_t, metadata_updator_t, comparator_t, bplus_tree_custom_invoke_default_tag, allocator_t, node_order>
+    {
+        using bplus_tree_t = bplus_tree<key_t, mapped_t, metadata_t, metadata_updator_t, comparator_t, allocator_t, node_order>;
+        using bplus_tree_header_t = bplus_tree_header<key_t, mapped_t, metadata_t, node_order>;
+
+        static inline bplus_tree_header_t to_bplus_tree_header(bplus_tree_t &&tree)
+        {
+            return tree.release_header();
+        };
+
+        //inverse of to_bplus_tree_header, tree must be empty
+        static inline void from_bplus_tree_header(bplus_tree_t &tree, bplus_tree_header_t header)
+        {
+            tree.adopt_header(header);
+        }
+
+        template<bool equal_on_left_side>
+        static std::pair<bplus_tree_t, bplus_tree_t> split_by_key(bplus_tree_t &&tree, const key_t &key)
+        {
+            return split_by_key_impl<equal_on_left_side>(std::move(tree), key);
+        }
+
+        //split by anything the transparent comparator orders against the keys
+        template<bool equal_on_left_side, class query_t>
+        requires is_transparent_comparator<comparator_t>
+        static std::pair<bplus_tree_t, bplus_tree_t> split_by_key(bplus_tree_t &&tree, const query_t &key)
+        {
+            return split_by_key_impl<equal_on_left_side>(std::move(tree), key);
+        }
+
+        //every key of lhs must go before every key of rhs, O(node_order * log n)
+        static bplus_tree_t join(bplus_tree_t &&lhs, bplus_tree_t &&rhs)
+        {
+            ASSERT(lhs.empty() || rhs.empty() || tree_less(lhs.comp_, (*--lhs.end()).key, (*rhs.begin()).key), "lhs must go before rhs");
+            bplus_tree_header_t l = to_bplus_tree_header(std::move(lhs));
+            bplus_tree_header_t r = to_bplus_tree_header(std::move(rhs));
+            bplus_tree_header_t header = bplus_tree_header_t::empty_header();
+            try
+            {
+                header = lhs.join_headers(l, r);
+            }
+            catch (...)
+            {
+                //nothing was linked yet, the trees get their nodes back
+                from_bplus_tree_header(lhs, l);
+                from_bplus_tree_header(rhs, r);
+                throw;
+            }
+            ASSERT(lhs.header_invariant(header), "post condition failed");
+            return bplus_tree_t(header, lhs.updator_, lhs.comp_, lhs.alloc_);
+        }
+
+        //join with (key, mapped) in between, key must go after every key of lhs and before every key of rhs
+        static bplus_tree_t join_x(bplus_tree_t &&lhs, key_t key, mapped_t mapped, bplus_tree_t &&rhs)
+        {
+            ASSERT(lhs.empty() || tree_less(lhs.comp_, (*--lhs.end()).key, key), "key must go after lhs");
+            ASSERT(rhs.empty() || tree_less(lhs.comp_, key, (*rhs.begin()).key), "key must go before rhs");
+            lhs.try_emplace(std::move(key), std::move(mapped));
+            return join(std::move(lhs), std::move(rhs));
+        }
+
+    private:
+        //a split that runs out of memory throws before cutting anything, tree gets its nodes back
+        template<bool equal_on_left_side, class query_t>
+        static std::pair<bplus_tree_t, bplus_tree_t> split_by_key_impl(bplus_tree_t &&tree, const query_t &key)
+        {
+            bplus_tree_header_t header = to_bplus_tree_header(std::move(tree));
+            ASSERT(tree.header_invariant(header), "pre condition failed");
+            std::pair<bplus_tree_header_t, bplus_tree_header_t> pieces = {header, header};
+            try
+            {
+                pieces = tree.template split_headers<equal_on_left_side>(header, key);
+            }
+            catch (...)
+            {
+                from_bplus_tree_header(tree, header);
+                throw;
+            }
+            auto [l, r] = pieces;
+            ASSERT(tree.header_invariant(l), "post condition failed");
+            ASSERT(tree.header_invariant(r), "post condition failed");
+            return {bplus_tree_t(l, tree.updator_, tree.comp_, tree.alloc_), bplus_tree_t(r, tree.updator_, tree.comp_, tree.alloc_)};
+        }
+    };
+
+    struct bplus_tree_custom_invoke_order_statistic_tag {};
+
+    //the count of a node is the fold of its children's, no walk below the search path
+    template<class key_t, class mapped_t, class metadata_t, class metadata_updator_t, class comparator_t, class allocator_t, size_t node_order>
+    requires (std::is_integral_v<metadata_t> &&
+              bbst::is_order_statistic_metadata_updator<metadata_updator_t, bbst::bplus_tree_node<key_t, metadata_t, node_order> *>)
+    struct bplus_tree_custom_invoke<key_t, mapped_t, metadata_t, metadata_updator_t, comparator_t, bplus_tree_custom_invoke_order_statistic_tag, allocator_t, node_order>
+    {
+        using bplus_tree_t = bplus_tree<key_t, mapped_t, metadata_t, metadata_updator_t, comparator_t, allocator_t, node_order>;
+        using bplus_tree_node_ptr_t = typename bplus_tree_t::bplus_tree_node_ptr_t;
+        using default_invoker = bplus_tree_custom_invoke<key_t, mapped_t, metadata_t, metadata_updator_t, comparator_t, bplus_tree_custom_invoke_default_tag, allocator_t, node_order>;
+        using iterator = typename bplus_tree_t::iterator;
+        using const_iterator = typename bplus_tree_t::const_iterator;
+
+        static const_iterator find_by_order(const bplus_tree_t &tree, size_t index)
+        {
+            if (index >= size(tree))
+                return tree.end();
+            bplus_tree_node_ptr_t node = tree.header_.root_;
+            while (!node->leaf)
+            {
+                auto inner = bplus_tree_t::as_inner(node);
+                uint32_t i = 0;
+                for (size_t count; index >= (count = size_t(metadata_updator_t::get_order_metadata(inner->children[i]))); i++)
+                    index -= count;
+                node = inner->children[i];
+            }
+            return const_iterator(bplus_tree_t::as_leaf(node), uint32_t(index));
+        }
+
+        static iterator find_by_order(bplus_tree_t &tree, size_t index)
+        {
+            return bplus_tree_t::mutable_iterator(find_by_order(std::as_const(tree), index));
+        }
+
+        static size_t size(const bplus_tree_t &tree)
+        {
+            return tree.empty() ? 0 : size_t(metadata_updator_t::get_order_metadata(tree.header_.root_));
+        }
+
+        static size_t order_of_key(const bplus_tree_t &tree, const key_t &key)
+        {
+            if (tree.empty())
+                return 0;
+            size_t order = 0;
+            bplus_tree_node_ptr_t node = tree.header_.root_;
+            while (!node->leaf)
+            {
+                auto inner = bplus_tree_t::as_inner(node);
+                uint32_t i = tree.upper_index(node, key);
+                for (uint32_t j = 0; j < i; j++)
+                    order += size_t(metadata_updator_t::get_order_metadata(inner->children[j]));
+                node = inner->children[i];
+            }
+            return order + tree.lower_index(node, key);
+        }
+
+        //the first index elements go left
+        static std::pair<bplus_tree_t, bplus_tree_t> split_by_order(bplus_tree_t &&tree, size_t index)
+        {
+            if (index >= size(tree))
+            {
+                bplus_tree_t right(bplus_tree_t::bplus_tree_header_t::empty_header(), tree.updator_, tree.comp_, tree.alloc_);
+                return {std::move(tree), std::move(right)};
+            }
+            key_t key = (*find_by_order(std::as_const(tree), index)).key;
+            return default_invoker::template split_by_key<false>(std::move(tree), key);
+        }
+    };
+}
+#endif //BBST_BPLUS_TREE_CUSTOM_INVOKE_H
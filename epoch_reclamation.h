@@ -0,0 +1,129 @@
+#ifndef BBST_EPOCH_RECLAMATION_H
+#define BBST_EPOCH_RECLAMATION_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include "tree_utils.h"
+
+//epoch_domain
+namespace bbst
+{
+    /*
+     * Epoch based reclamation for one writer and many readers.
+     * A reader pins the current epoch before reading shared structure and unpins when done, pinning and unpinning are a couple of
+     * atomic stores with no loop, so readers are wait-free. The writer unlinks (retires) memory, publishes, then calls advance():
+     * whatever it retired before advance() returned epoch e can be freed once min_pinned() > e.
+     * Readers are registered up front, each one owns a slot (one cache line) for its whole lifetime.
+     */
+    class epoch_domain
+    {
+    private:
+        //0 is "not pinned", epochs start at 1
+        struct alignas(64) reader_slot
+        {
+            std::atomic<uint64_t> epoch{0};
+            std::atomic<bool> claimed{false};
+        };
+
+        std::unique_ptr<reader_slot[]> slots_;
+        size_t slot_count_;
+        alignas(64) std::atomic<uint64_t> epoch_;
+
+        //claim a free slot, throws std::length_error once max_readers readers are registered
+        reader_slot *claim_slot()
+        {
+            for (size_t i = 0; i < slot_count_; i++)
+            {
+                bool expected = false;
+                if (!slots_[i].claimed.load(std::memory_order_relaxed) &&
+                    slots_[i].claimed.compare_exchange_strong(expected, true, std::memory_order_acquire))
+                    return &slots_[i];
+            }
+            throw std::length_error("epoch_domain: too many readers");
+        }
+
+    public:
+        //a registered reader, to be used by one thread at a time
+        class reader
+        {
+        private:
+            epoch_domain *domain_;
+            reader_slot *slot_;
+
+        public:
+            explicit reader(epoch_domain &domain)
+                    :
+                    domain_(&domain)
+                    , slot_(domain.claim_slot())
+            {}
+
+            reader(const reader &) = delete;
+
+            reader &operator=(const reader &) = delete;
+
+            ~reader()
+            {
+                ASSERT(slot_->epoch.load(std::memory_order_relaxed) == 0, "reader destroyed while pinned");
+                slot_->claimed.store(false, std::memory_order_release);
+            }
+
+            //memory the writer retires from now on stays valid until unpin, pins don't nest
+            void pin() noexcept
+            {
+                ASSERT(slot_->epoch.load(std::memory_order_relaxed) == 0, "reader already pinned");
+                slot_->epoch.store(domain_->epoch_.load(std::memory_order_seq_cst), std::memory_order_seq_cst);
+            }
+
+            void unpin() noexcept
+            {
+                slot_->epoch.store(0, std::memory_order_release);
+            }
+        };
+
+        explicit epoch_domain(size_t max_readers = 64)
+                :
+                slots_(std::make_unique<reader_slot[]>(max_readers))
+                , slot_count_(max_readers)
+                , epoch_(1)
+        {}
+
+        epoch_domain(const epoch_domain &) = delete;
+
+        epoch_domain &operator=(const epoch_domain &) = delete;
+
+        /*
+         * Writer side: call after publishing, everything retired so far belongs to the returned epoch.
+         * A reader that pinned a later epoch loaded the shared structure after the publication and can't reach it anymore.
+         */
+        uint64_t advance() noexcept
+        {
+            return epoch_.fetch_add(1, std::memory_order_seq_cst);
+        }
+
+        //writer side: the epoch the next advance() returns
+        [[nodiscard]] uint64_t current() const noexcept
+        {
+            return epoch_.load(std::memory_order_relaxed);
+        }
+
+        //oldest epoch still pinned by a reader, memory retired in an earlier epoch is unreachable
+        [[nodiscard]] uint64_t min_pinned() const noexcept
+        {
+            uint64_t result = std::numeric_limits<uint64_t>::max();
+            for (size_t i = 0; i < slot_count_; i++)
+            {
+                uint64_t epoch = slots_[i].epoch.load(std::memory_order_seq_cst);
+                if (epoch != 0)
+                    result = std::min(result, epoch);
+            }
+            return result;
+        }
+    };
+}
+
+#endif //BBST_EPOCH_RECLAMATION_H
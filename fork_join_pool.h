@@ -0,0 +1,207 @@
+#ifndef BBST_FORK_JOIN_POOL_H
+#define BBST_FORK_JOIN_POOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <iterator>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+//fork_join_pool
+namespace bbst
+{
+    /*
+     * Minimal fork-join pool for divide and conquer over trees.
+     * invoke(f, g) runs f on the calling thread and offers g to the workers, the caller takes g back if nobody
+     * picked it up yet, otherwise it helps with other queued work until g is finished.
+     * Helping (instead of blocking) is what keeps nested invoke from dead-locking the pool.
+     */
+    class fork_join_pool
+    {
+    private:
+        struct job
+        {
+            std::atomic<bool> done{false};
+            std::exception_ptr error;
+
+            virtual void execute() noexcept = 0;
+
+            virtual ~job() = default;
+        };
+
+        template<class function_t>
+        struct job_impl : job
+        {
+            function_t &function;
+
+            explicit job_impl(function_t &function_) : function(function_)
+            {}
+
+            void execute() noexcept override
+            {
+                try
+                {
+                    function();
+                }
+                catch (...)
+                {
+                    this->error = std::current_exception();
+                }
+            }
+        };
+
+        std::mutex mutex_;
+        std::condition_variable cv_;
+        std::deque<job *> queue_;
+        std::vector<std::thread> workers_;
+        bool stop_;
+
+        void run(job *j) noexcept
+        {
+            j->execute();
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                j->done.store(true, std::memory_order_release);
+            }
+            cv_.notify_all();
+        }
+
+        bool take_back(job *j)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = std::find(queue_.rbegin(), queue_.rend(), j);
+            if (it == queue_.rend())
+                return false;
+            queue_.erase(std::next(it).base());
+            return true;
+        }
+
+        void help_until_done(job *j)
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            while (!j->done.load(std::memory_order_acquire))
+            {
+                if (!queue_.empty())
+                {
+                    job *other = queue_.back();
+                    queue_.pop_back();
+                    lock.unlock();
+                    run(other);
+                    lock.lock();
+                }
+                else
+                {
+                    cv_.wait(lock, [this, j] { return j->done.load(std::memory_order_acquire) || !queue_.empty(); });
+                }
+            }
+        }
+
+        void worker_loop()
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            while (true)
+            {
+                cv_.wait(lock, [this] { return stop_ || !queue_.empty(); });
+                if (queue_.empty())
+                    return;
+                //oldest job first, those are the biggest ones in a divide and conquer
+                job *j = queue_.front();
+                queue_.pop_front();
+                lock.unlock();
+                run(j);
+                lock.lock();
+            }
+        }
+
+    public:
+        //worker count excludes the calling thread, which always takes part in invoke
+        explicit fork_join_pool(size_t workers = std::max(1u, std::thread::hardware_concurrency()) - 1)
+                :
+                stop_(false)
+        {
+            workers_.reserve(workers);
+            for (size_t i = 0; i < workers; i++)
+                workers_.emplace_back([this] { worker_loop(); });
+        }
+
+        fork_join_pool(const fork_join_pool &) = delete;
+
+        fork_join_pool &operator=(const fork_join_pool &) = delete;
+
+        ~fork_join_pool()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                stop_ = true;
+            }
+            cv_.notify_all();
+            for (auto &worker: workers_)
+                worker.join();
+        }
+
+        [[nodiscard]] size_t concurrency() const noexcept
+        {
+            return workers_.size() + 1;
+        }
+
+        //run f and g, possibly in parallel, return once both are finished. The first exception thrown is rethrown.
+        template<class function_f_t, class function_g_t>
+        void invoke(function_f_t &&f, function_g_t &&g)
+        {
+            if (workers_.empty())
+            {
+                f();
+                g();
+                return;
+            }
+            job_impl<std::remove_reference_t<function_g_t>> forked(g);
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                queue_.push_back(&forked);
+            }
+            cv_.notify_one();
+            std::exception_ptr error;
+            try
+            {
+                f();
+            }
+            catch (...)
+            {
+                error = std::current_exception();
+            }
+            //forked lives on this stack frame, never leave before it is finished
+            if (take_back(&forked))
+                run(&forked);
+            else
+                help_until_done(&forked);
+            if (error)
+                std::rethrow_exception(error);
+            if (forked.error)
+                std::rethrow_exception(forked.error);
+        }
+
+        static fork_join_pool &default_pool()
+        {
+            static fork_join_pool pool;
+            return pool;
+        }
+    };
+
+    /*
+     * How a divide and conquer algorithm may fork: pool == nullptr keeps everything on the calling thread,
+     * subproblems estimated below grain elements are never forked.
+     */
+    struct parallel_policy
+    {
+        fork_join_pool *pool = nullptr;
+        size_t grain = 1 << 14;
+    };
+}
+
+#endif //BBST_FORK_JOIN_POOL_H
@@ -0,0 +1,224 @@
+#ifndef BBST_NODE_POOL_H
+#define BBST_NODE_POOL_H
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+//node_pool_resource
+namespace bbst
+{
+    /*
+     * Slab/free-list resource for fixed-size blocks.
+     * The block size is fixed by the first allocation (the tree node after rebinding),
+     * anything bigger or more aligned than that falls back to ::operator new and is counted while live.
+     * Blocks are carved from slabs with a bump pointer and recycled through an intrusive free list.
+     * Slabs are only returned on release() or destruction.
+     * Not thread safe: trees sharing a pool must not be modified concurrently.
+     */
+    class node_pool_resource
+    {
+    private:
+        struct free_block
+        {
+            free_block *next;
+        };
+
+        std::vector<void *> slabs_;
+        free_block *free_list_;
+        char *bump_;
+        char *bump_end_;
+        size_t block_size_;
+        size_t block_align_;
+        size_t blocks_per_slab_;
+        size_t oversized_blocks_;
+
+        [[nodiscard]] inline bool serves(size_t size, size_t align) const noexcept
+        {
+            return size <= block_size_ && align <= block_align_;
+        }
+
+        void grow()
+        {
+            void *slab = ::operator new(block_size_ * blocks_per_slab_, std::align_val_t(block_align_));
+            slabs_.push_back(slab);
+            bump_ = static_cast<char *>(slab);
+            bump_end_ = bump_ + block_size_ * blocks_per_slab_;
+        }
+
+    public:
+        explicit node_pool_resource(size_t blocks_per_slab = 4096) noexcept
+                :
+                free_list_(nullptr)
+                , bump_(nullptr)
+                , bump_end_(nullptr)
+                , block_size_(0)
+                , block_align_(0)
+                , blocks_per_slab_(blocks_per_slab == 0 ? 1 : blocks_per_slab)
+                , oversized_blocks_(0)
+        {}
+
+        node_pool_resource(const node_pool_resource &) = delete;
+
+        node_pool_resource &operator=(const node_pool_resource &) = delete;
+
+        ~node_pool_resource()
+        {
+            release();
+        }
+
+        void *allocate(size_t size, size_t align)
+        {
+            if (block_size_ == 0)
+            {
+                //first allocation fixes the block layout
+                block_align_ = std::max(align, alignof(free_block));
+                size_t raw = std::max(size, sizeof(free_block));
+                block_size_ = (raw + block_align_ - 1) / block_align_ * block_align_;
+            }
+            if (!serves(size, align))
+            {
+                void *p = ::operator new(size, std::align_val_t(align));
+                oversized_blocks_++;
+                return p;
+            }
+            if (free_list_ != nullptr)
+                return std::exchange(free_list_, free_list_->next);
+            if (bump_ == bump_end_)
+                grow();
+            return std::exchange(bump_, bump_ + block_size_);
+        }
+
+        void deallocate(void *p, size_t size, size_t align) noexcept
+        {
+            if (!serves(size, align))
+            {
+                ::operator delete(p, std::align_val_t(align));
+                oversized_blocks_--;
+                return;
+            }
+            free_list_ = ::new(p) free_block{free_list_};
+        }
+
+        /*
+         * Give every slab back at once. All blocks handed out by this pool become invalid,
+         * so it's the caller's responsibility to make sure no live object still sits in one.
+         * Oversized blocks aren't slabs, they stay live until deallocated.
+         */
+        void release() noexcept
+        {
+            for (void *slab: slabs_)
+                ::operator delete(slab, std::align_val_t(block_align_));
+            slabs_.clear();
+            free_list_ = nullptr;
+            bump_ = bump_end_ = nullptr;
+        }
+
+        [[nodiscard]] size_t block_size() const noexcept
+        {
+            return block_size_;
+        }
+
+        [[nodiscard]] size_t slab_count() const noexcept
+        {
+            return slabs_.size();
+        }
+
+        //blocks handed out through the ::operator new fallback and not deallocated yet
+        [[nodiscard]] size_t oversized_block_count() const noexcept
+        {
+            return oversized_blocks_;
+        }
+    };
+}
+
+//node_pool_allocator
+namespace bbst
+{
+    /*
+     * Stateful allocator over a shared node_pool_resource.
+     * Copies and rebinds share the same pool, so trees split from (or joined into) each other
+     * keep handing nodes back to the pool they came from.
+     */
+    template<class T>
+    class node_pool_allocator
+    {
+    private:
+        std::shared_ptr<node_pool_resource> pool_;
+
+        template<class U> friend
+        class node_pool_allocator;
+
+    public:
+        typedef T value_type;
+        typedef std::true_type propagate_on_container_copy_assignment;
+        typedef std::true_type propagate_on_container_move_assignment;
+        typedef std::true_type propagate_on_container_swap;
+        typedef std::false_type is_always_equal;
+
+        explicit node_pool_allocator(size_t blocks_per_slab = 4096)
+                :
+                pool_(std::make_shared<node_pool_resource>(blocks_per_slab))
+        {}
+
+        explicit node_pool_allocator(std::shared_ptr<node_pool_resource> pool) noexcept
+                :
+                pool_(std::move(pool))
+        {}
+
+        template<class U>
+        node_pool_allocator(const node_pool_allocator<U> &other) noexcept
+                :
+                pool_(other.pool_)
+        {}
+
+        T *allocate(size_t n)
+        {
+            if (n == 1)
+                return static_cast<T *>(pool_->allocate(sizeof(T), alignof(T)));
+            return static_cast<T *>(::operator new(n * sizeof(T), std::align_val_t(alignof(T))));
+        }
+
+        void deallocate(T *p, size_t n) noexcept
+        {
+            if (n == 1)
+                pool_->deallocate(p, sizeof(T), alignof(T));
+            else
+                ::operator delete(p, std::align_val_t(alignof(T)));
+        }
+
+        /*
+         * Give back every slab at once if no other allocator shares the pool, returns whether it did.
+         * Refuses while oversized blocks are live: release() can't free those, the caller has to deallocate them one by one.
+         */
+        bool release_if_exclusive() noexcept
+        {
+            if (pool_.use_count() != 1 || pool_->oversized_block_count() != 0)
+                return false;
+            pool_->release();
+            return true;
+        }
+
+        [[nodiscard]] const std::shared_ptr<node_pool_resource> &resource() const noexcept
+        {
+            return pool_;
+        }
+
+        template<class U>
+        friend inline bool operator==(const node_pool_allocator &lhs, const node_pool_allocator<U> &rhs) noexcept
+        {
+            return lhs.pool_ == rhs.pool_;
+        }
+
+        template<class U>
+        friend inline bool operator!=(const node_pool_allocator &lhs, const node_pool_allocator<U> &rhs) noexcept
+        {
+            return lhs.pool_ != rhs.pool_;
+        }
+    };
+}
+
+#endif //BBST_NODE_POOL_H
@@ -0,0 +1,519 @@
+#ifndef BBST_PERSISTENT_AVL_TREE_H
+#define BBST_PERSISTENT_AVL_TREE_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <utility>
+#include <vector>
+#include "epoch_reclamation.h"
+#include "tree_utils.h"
+
+//persistent_avl_tree_node
+namespace bbst
+{
+    /*
+     * Node of a path copying tree, immutable once published.
+     * No parent pointer: a node is shared by every version that still reaches it, so it has no single parent.
+     * For the same reason the balance information is the subtree height (a leaf is 1) rather than a tag.
+     */
+    template<class exposure_t>
+    struct persistent_avl_tree_node
+    {
+        typedef exposure_t value_type;
+        typedef typename exposure_t::key_type key_type;
+        typedef typename exposure_t::mapped_type mapped_type;
+        typedef typename exposure_t::metadata_type metadata_type;
+
+        const persistent_avl_tree_node *left, *right;
+        uint32_t height;
+        value_type value_;
+
+        template<class... Args>
+        explicit persistent_avl_tree_node(const persistent_avl_tree_node *left_, const persistent_avl_tree_node *right_, Args &&... args)
+                :
+                left(left_)
+                , right(right_)
+                , height(1 + std::max(height_of(left_), height_of(right_)))
+                , value_(std::forward<Args>(args)...)
+        {}
+
+        static inline uint32_t height_of(const persistent_avl_tree_node *ptr) noexcept
+        {
+            return ptr == nullptr ? 0 : ptr->height;
+        }
+
+        inline value_type &value() noexcept
+        {
+            return value_;
+        }
+
+        inline const value_type &value() const noexcept
+        {
+            return value_;
+        }
+
+        inline key_type &key() const noexcept
+        {
+            return value_.key;
+        }
+
+        inline metadata_type &metadata() noexcept
+        {
+            return value_.metadata;
+        }
+
+        inline const metadata_type &metadata() const noexcept
+        {
+            return value_.metadata;
+        }
+    };
+
+    //height of the subtree if every node is balanced and stores its true height, -1 otherwise
+    template<class persistent_avl_tree_node_ptr_t>
+    int64_t persistent_avl_tree_invariant(persistent_avl_tree_node_ptr_t ptr)
+    {
+        if (ptr == nullptr)
+            return 0;
+        int64_t left_height = persistent_avl_tree_invariant(ptr->left);
+        int64_t right_height = persistent_avl_tree_invariant(ptr->right);
+        if (left_height < 0 || right_height < 0 || left_height - right_height > 1 || right_height - left_height > 1)
+            return -1;
+        int64_t height = 1 + std::max(left_height, right_height);
+        return height == int64_t(ptr->height) ? height : -1;
+    }
+}
+
+//persistent_avl_tree
+namespace bbst
+{
+    /*
+     * AVL tree for one writer thread and any number of reader threads, without locks.
+     * The writer never modifies a reachable node: insert, erase and join_x copy the O(log n) nodes on the touched path
+     * (plus the rotated ones) and publish the new root with a single atomic store.
+     * A reader pins an epoch (see epoch_domain) and loads the root: that version stays intact and allocated until the reader unpins,
+     * whatever the writer does meanwhile. Lookups on a snapshot are wait-free.
+     * Replaced nodes are retired with the epoch of their last version and freed by the writer once no reader can still be in it.
+     * The trade-off against rb_tree/avl_tree: no parent pointers, hence no iterators, and an allocation per copied node on every write.
+     */
+    template<class key_t, class mapped_t, class metadata_t, class metadata_updator_t, class comparator_t = std::less<key_t>,
+            class allocator_t = std::allocator<exposure<key_t, mapped_t, metadata_t>>>
+    requires (is_tree_comparator<comparator_t, key_t, key_t> &&
+              std::regular_invocable<const metadata_updator_t &, persistent_avl_tree_node<bbst::exposure<key_t, mapped_t, metadata_t>> *> &&
+              !is_lazy_metadata_updator<metadata_updator_t, persistent_avl_tree_node<bbst::exposure<key_t, mapped_t, metadata_t>> *>)
+    class persistent_avl_tree
+    {
+    private:
+        typedef persistent_avl_tree_node<exposure<key_t, mapped_t, metadata_t>> node_t;
+        typedef const node_t *node_ptr_t;
+        typedef typename std::allocator_traits<allocator_t>::template rebind_alloc<node_t> node_allocator_t;
+        typedef std::allocator_traits<node_allocator_t> node_allocator_traits;
+    public:
+        typedef allocator_t allocator_type;
+        typedef typename node_t::value_type value_type;
+
+        /*
+         * One consistent version of the tree, as of its construction. Holds the reader's pin, so keep it short lived:
+         * nothing retired after it was taken is freed until it's gone. One snapshot per reader at a time.
+         */
+        class read_snapshot
+        {
+        private:
+            epoch_domain::reader &reader_;
+            const comparator_t &comp_;
+            node_ptr_t root_;
+
+            template<class function_t>
+            static void for_each_routine(node_ptr_t ptr, function_t &f)
+            {
+                //depth is bounded by the avl height, about 1.44 log n
+                if (ptr == nullptr)
+                    return;
+                for_each_routine(ptr->left, f);
+                f(ptr->value());
+                for_each_routine(ptr->right, f);
+            }
+
+        public:
+            read_snapshot(epoch_domain::reader &reader, const std::atomic<node_ptr_t> &root, const comparator_t &comp) noexcept
+                    :
+                    reader_(reader)
+                    , comp_(comp)
+                    , root_(nullptr)
+            {
+                reader_.pin();
+                root_ = root.load(std::memory_order_seq_cst);
+            }
+
+            read_snapshot(const read_snapshot &) = delete;
+
+            read_snapshot &operator=(const read_snapshot &) = delete;
+
+            ~read_snapshot()
+            {
+                reader_.unpin();
+            }
+
+            //least element not less than key, nullptr if none
+            [[nodiscard]] const value_type *lower_bound(const key_t &key) const
+            {
+                node_ptr_t result = nullptr;
+                for (node_ptr_t current = root_; current != nullptr;)
+                {
+                    if (!tree_less(comp_, current->key(), key))
+                        result = std::exchange(current, current->left);
+                    else
+                        current = current->right;
+                }
+                return result == nullptr ? nullptr : &result->value();
+            }
+
+            [[nodiscard]] const value_type *find(const key_t &key) const
+            {
+                const value_type *result = lower_bound(key);
+                return result != nullptr && !tree_less(comp_, key, result->key) ? result : nullptr;
+            }
+
+            [[nodiscard]] bool empty() const noexcept
+            {
+                return root_ == nullptr;
+            }
+
+            //every element in key order
+            template<class function_t>
+            void for_each(function_t &&f) const
+            {
+                for_each_routine(root_, f);
+            }
+
+            //root of this version, for descents steered by metadata (order statistic and the like)
+            [[nodiscard]] const node_t *root() const noexcept
+            {
+                return root_;
+            }
+        };
+
+    private:
+        //how many retired nodes the writer lets pile up before it looks at the readers' epochs
+        static constexpr size_t reclaim_threshold = 64;
+
+        std::atomic<node_ptr_t> root_;
+        [[no_unique_address]] comparator_t comp_;
+        [[no_unique_address]] metadata_updator_t updator_;
+        [[no_unique_address]] node_allocator_t alloc_;
+        epoch_domain domain_;
+        size_t size_;
+        std::vector<node_ptr_t> fresh_;//made by the write in progress, only reachable from its unpublished root
+        //last epoch each node was reachable in, non decreasing. The write in progress appends the nodes it replaces
+        //with the epoch its publish ends
+        std::deque<std::pair<uint64_t, node_ptr_t>> retired_;
+
+        template<class... Args>
+        node_ptr_t make_node(node_ptr_t left, node_ptr_t right, Args &&... args)
+        {
+            node_t *ptr = node_allocator_traits::allocate(alloc_, 1);
+            try
+            {
+                node_allocator_traits::construct(alloc_, ptr, left, right, std::forward<Args>(args)...);
+            }
+            catch (...)
+            {
+                node_allocator_traits::deallocate(alloc_, ptr, 1);
+                throw;
+            }
+            try
+            {
+                fresh_.push_back(ptr);
+            }
+            catch (...)
+            {
+                destroy_node(ptr);
+                throw;
+            }
+            updator_(ptr);
+            return ptr;
+        }
+
+        //fresh node with x's value over left and right, x itself is left untouched
+        node_ptr_t copy_node(node_ptr_t x, node_ptr_t left, node_ptr_t right)
+        {
+            return make_node(left, right, x->value());
+        }
+
+        void destroy_node(node_ptr_t ptr) noexcept
+        {
+            node_t *node = const_cast<node_t *>(ptr);
+            node_allocator_traits::destroy(alloc_, node);
+            node_allocator_traits::deallocate(alloc_, node, 1);
+        }
+
+        void destroy_version(node_ptr_t ptr) noexcept
+        {
+            if (ptr == nullptr)
+                return;
+            destroy_version(ptr->left);
+            destroy_version(ptr->right);
+            destroy_node(ptr);
+        }
+
+        inline void retire(node_ptr_t ptr)
+        {
+            retired_.emplace_back(domain_.current(), ptr);
+        }
+
+        static inline uint32_t height_of(node_ptr_t ptr) noexcept
+        {
+            return node_t::height_of(ptr);
+        }
+
+        //copy of x over left and right, whose heights differ by at most 2, with one rotation if they differ by 2
+        node_ptr_t balance(node_ptr_t x, node_ptr_t left, node_ptr_t right)
+        {
+            uint32_t left_height = height_of(left), right_height = height_of(right);
+            if (left_height > right_height + 1)
+            {
+                retire(left);
+                if (height_of(left->left) >= height_of(left->right))
+                    return copy_node(left, left->left, copy_node(x, left->right, right));
+                retire(left->right);
+                return copy_node(left->right, copy_node(left, left->left, left->right->left), copy_node(x, left->right->right, right));
+            }
+            if (right_height > left_height + 1)
+            {
+                retire(right);
+                if (height_of(right->right) >= height_of(right->left))
+                    return copy_node(right, copy_node(x, left, right->left), right->right);
+                retire(right->left);
+                return copy_node(right->left, copy_node(x, left, right->left->left), copy_node(right, right->left->right, right->right));
+            }
+            return copy_node(x, left, right);
+        }
+
+        //path copying join: every key of left < x < every key of right, copies along the spine of the taller side only
+        node_ptr_t join_x(node_ptr_t left, node_ptr_t x, node_ptr_t right)
+        {
+            uint32_t left_height = height_of(left), right_height = height_of(right);
+            if (left_height > right_height + 1)
+            {
+                retire(left);
+                return balance(left, left->left, join_x(left->right, x, right));
+            }
+            if (right_height > left_height + 1)
+            {
+                retire(right);
+                return balance(right, join_x(left, x, right->left), right->right);
+            }
+            return copy_node(x, left, right);
+        }
+
+        template<class... Args>
+        node_ptr_t insert_routine(node_ptr_t ptr, key_t &key, bool &inserted, Args &&... args)
+        {
+            if (ptr == nullptr)
+            {
+                inserted = true;
+                return make_node(nullptr, nullptr, std::move(key), std::forward<Args>(args)...);
+            }
+            auto order = tree_compare(comp_, key, ptr->key());
+            if (order == 0)
+                return ptr;
+            if (order < 0)
+            {
+                node_ptr_t left = insert_routine(ptr->left, key, inserted, std::forward<Args>(args)...);
+                if (!inserted)
+                    return ptr;
+                retire(ptr);
+                return balance(ptr, left, ptr->right);
+            }
+            node_ptr_t right = insert_routine(ptr->right, key, inserted, std::forward<Args>(args)...);
+            if (!inserted)
+                return ptr;
+            retire(ptr);
+            return balance(ptr, ptr->left, right);
+        }
+
+        //subtree without its least node, which is retired and handed back through min
+        node_ptr_t remove_min(node_ptr_t ptr, node_ptr_t &min)
+        {
+            retire(ptr);
+            if (ptr->left == nullptr)
+            {
+                min = ptr;
+                return ptr->right;
+            }
+            return balance(ptr, remove_min(ptr->left, min), ptr->right);
+        }
+
+        node_ptr_t erase_routine(node_ptr_t ptr, const key_t &key, bool &erased)
+        {
+            if (ptr == nullptr)
+                return nullptr;
+            auto order = tree_compare(comp_, key, ptr->key());
+            if (order < 0)
+            {
+                node_ptr_t left = erase_routine(ptr->left, key, erased);
+                if (!erased)
+                    return ptr;
+                retire(ptr);
+                return balance(ptr, left, ptr->right);
+            }
+            if (order > 0)
+            {
+                node_ptr_t right = erase_routine(ptr->right, key, erased);
+                if (!erased)
+                    return ptr;
+                retire(ptr);
+                return balance(ptr, ptr->left, right);
+            }
+            erased = true;
+            retire(ptr);
+            if (ptr->right == nullptr)
+                return ptr->left;
+            node_ptr_t min = nullptr;
+            node_ptr_t right = remove_min(ptr->right, min);
+            return join_x(ptr->left, min, right);
+        }
+
+        /*
+         * Make root the current version: readers loading the root from now on see it, the nodes the write replaced
+         * belong to the version before and wait for the readers still in it. Their retire records were made by the write.
+         */
+        void publish(node_ptr_t root) noexcept
+        {
+            root_.store(root, std::memory_order_seq_cst);
+            fresh_.clear();//published, no longer the write's to free
+            domain_.advance();
+            if (retired_.size() >= reclaim_threshold)
+                reclaim();
+        }
+
+        //a throwing copy or allocation leaves the current version as it was, the copies made so far are freed
+        template<class write_t>
+        void write(write_t &&write)
+        {
+            size_t retired = retired_.size();
+            try
+            {
+                write();
+            }
+            catch (...)
+            {
+                for (node_ptr_t ptr: fresh_)
+                    destroy_node(ptr);
+                fresh_.clear();
+                while (retired_.size() > retired)
+                    retired_.pop_back();
+                throw;
+            }
+        }
+
+    public:
+        explicit persistent_avl_tree(size_t max_readers = 64, const metadata_updator_t &updator = metadata_updator_t()
+                                     , const comparator_t &comp = comparator_t(), const allocator_t &alloc = allocator_t())
+                :
+                root_(nullptr)
+                , comp_(comp)
+                , updator_(updator)
+                , alloc_(alloc)
+                , domain_(max_readers)
+                , size_(0)
+        {}
+
+        persistent_avl_tree(const persistent_avl_tree &) = delete;
+
+        persistent_avl_tree &operator=(const persistent_avl_tree &) = delete;
+
+        //no reader may hold a snapshot anymore
+        ~persistent_avl_tree()
+        {
+            for (auto [epoch, ptr]: retired_)
+                destroy_node(ptr);
+            destroy_version(root_.load(std::memory_order_relaxed));
+        }
+
+        //readers register once against the domain (epoch_domain::reader reader(tree.domain())), then take snapshots
+        [[nodiscard]] epoch_domain &domain() noexcept
+        {
+            return domain_;
+        }
+
+        [[nodiscard]] read_snapshot snapshot(epoch_domain::reader &reader) const noexcept
+        {
+            return read_snapshot(reader, root_, comp_);
+        }
+
+        //writer thread only from here on
+
+        template<class... Args>
+        bool try_emplace(key_t key, Args... args)
+        {
+            bool inserted = false;
+            write([&]
+                  {
+                      node_ptr_t root = insert_routine(root_.load(std::memory_order_relaxed), key, inserted, std::forward<Args>(args)...);
+                      if (inserted)
+                      {
+                          size_++;
+                          publish(root);
+                      }
+                  });
+            return inserted;
+        }
+
+        size_t erase(const key_t &key)
+        {
+            bool erased = false;
+            write([&]
+                  {
+                      node_ptr_t root = erase_routine(root_.load(std::memory_order_relaxed), key, erased);
+                      if (erased)
+                      {
+                          size_--;
+                          publish(root);
+                      }
+                  });
+            return erased;
+        }
+
+        //the writer reads the current version without pinning, it's the only one freeing nodes
+        [[nodiscard]] const value_type *find(const key_t &key) const
+        {
+            node_ptr_t current = root_.load(std::memory_order_relaxed);
+            while (current != nullptr)
+            {
+                auto order = tree_compare(comp_, key, current->key());
+                if (order == 0)
+                    return &current->value();
+                current = order < 0 ? current->left : current->right;
+            }
+            return nullptr;
+        }
+
+        [[nodiscard]] size_t size() const noexcept
+        {
+            return size_;
+        }
+
+        [[nodiscard]] bool empty() const noexcept
+        {
+            return size_ == 0;
+        }
+
+        //free every retired node no reader can reach anymore, returns how many are still waiting. Writes call it on their own
+        size_t reclaim() noexcept
+        {
+            uint64_t min_pinned = domain_.min_pinned();
+            while (!retired_.empty() && retired_.front().first < min_pinned)
+            {
+                destroy_node(retired_.front().second);
+                retired_.pop_front();
+            }
+            return retired_.size();
+        }
+    };
+}
+
+#endif //BBST_PERSISTENT_AVL_TREE_H
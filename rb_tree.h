@@ -1,8 +1,14 @@
 #ifndef BBST_RB_TREE_H
 #define BBST_RB_TREE_H
 
+#include <bit>
 #include <concepts>
+#include <iterator>
+#include <limits>
 #include <memory>
+#include <tuple>
+#include "tree_custom_invoke.h"
+#include "tree_set_operation.h"
 #include "tree_utils.h"
 
 namespace bbst
@@ -13,8 +19,8 @@ namespace bbst
     template<class key_t, class mapped_t, class metadata_t>
     struct rb_tree_header;
 
-    template<class key_t, class mapped_t, class metadata_t, class metadata_updator_t, class comparator_t>
-    requires (std::predicate<const comparator_t &, const key_t &, const key_t &> &&
+    template<class key_t, class mapped_t, class metadata_t, class metadata_updator_t, class comparator_t, class allocator_t>
+    requires (is_tree_comparator<comparator_t, key_t, key_t> &&
               std::regular_invocable<const metadata_updator_t &, rb_tree_node<bbst::exposure<key_t, mapped_t, metadata_t>> *>)
     class rb_tree;
 }
@@ -37,11 +43,11 @@ namespace bbst
         if (ptr->left != nullptr && ptr->right != nullptr && ptr->left == ptr->right)
             return 0;
 
-        if (!ptr->is_black_)
+        if (!ptr->is_black())
         {
-            if (ptr->left != nullptr && !ptr->left->is_black_)
+            if (ptr->left != nullptr && !ptr->left->is_black())
                 return 0;
-            if (ptr->right != nullptr && !ptr->right->is_black_)
+            if (ptr->right != nullptr && !ptr->right->is_black())
                 return 0;
         }
 
@@ -52,7 +58,7 @@ namespace bbst
         if (rb_subtree_invariant(ptr->right) != left_height)
             return 0;
 
-        return left_height + ptr->is_black_;
+        return left_height + ptr->is_black();
     }
 
     template<class rb_tree_node_ptr_t>
@@ -60,7 +66,7 @@ namespace bbst
     {
         if (root == nullptr)
             return 1;
-        if (!root->is_black_)
+        if (!root->is_black())
             return 0;
         return rb_subtree_invariant(root);
     }
@@ -89,21 +95,32 @@ namespace bbst
         typedef typename tree_node_base_traits<rb_tree_node>::value_type value_type;
         typedef typename tree_node_base_traits<rb_tree_node>::key_type key_type;
         typedef typename tree_node_base_traits<rb_tree_node>::metadata_type metadata_type;
-        bool is_black_//: 1
-        ;
         value_type value_;
 
+        //new nodes are red
         template<class... Args>
         explicit rb_tree_node(Args... args)
                 :
-                is_black_(false)
+                base_tree_node<rb_tree_node>(nullptr, nullptr, nullptr)
                 , value_(std::forward<Args>(args)...)
         {}
 
-        ~rb_tree_node()
+        //the color lives in the low bit of the parent pointer, see tree_tagged_pointer
+        [[nodiscard]] inline bool is_black() const noexcept
         {
-            delete this->left;
-            delete this->right;
+            return this->parent.tag() & 1;
+        }
+
+        inline void set_black(bool is_black) noexcept
+        {
+            this->parent.set_tag(is_black);
+        }
+
+        inline bool exchange_black(bool is_black) noexcept
+        {
+            bool old = this->is_black();
+            this->set_black(is_black);
+            return old;
         }
 
         inline value_type &value() noexcept
@@ -175,7 +192,7 @@ namespace bbst
             return root_ == nullptr;
         }
 
-        template<class key_holder_t, class mapped_holder_t, class metadata_holder_t, class metadata_updator_holder_t, class comparator_holder_t, class tag_holder_t> friend
+        template<class key_holder_t, class mapped_holder_t, class metadata_holder_t, class metadata_updator_holder_t, class comparator_holder_t, class tag_holder_t, class allocator_holder_t> friend
         class rb_tree_custom_invoke;
     };
 }
@@ -196,9 +213,9 @@ namespace bbst
     rb_tree_node_ptr_t rb_tree_insert_fixup(rb_tree_node_ptr_t ptr, rb_tree_node_ptr_t root
                                             , const metadata_updator_t &updator_) noexcept(std::is_nothrow_invocable_v<const metadata_updator_t &, rb_tree_node_ptr_t>)
     {
-        ASSERT(!ptr->is_black_ && (ptr == root || (rb_subtree_invariant(ptr->parent->left) == rb_subtree_invariant(ptr->parent->right) &&
-                                                   root->is_black_)), "precondition failed");
-        while (ptr != root && !ptr->parent_unsafe()->is_black_)
+        ASSERT(!ptr->is_black() && (ptr == root || (rb_subtree_invariant(ptr->parent->left) == rb_subtree_invariant(ptr->parent->right) &&
+                                                   root->is_black())), "precondition failed");
+        while (ptr != root && !ptr->parent_unsafe()->is_black())
         {
             //ptr->parent is not root
             if (tree_is_left_child(ptr->parent))
@@ -211,14 +228,14 @@ namespace bbst
                  *  /                    /
                  * C(R)                 C(R)
                  */
-                if (ptrUncle != nullptr && !ptrUncle->is_black_)
+                if (ptrUncle != nullptr && !ptrUncle->is_black())
                 {
                     ptr = ptr->parent_unsafe();
-                    ptr->is_black_ = true;
+                    ptr->set_black(true);
                     updator_(ptr);//update U
                     ptr = ptr->parent_unsafe();
-                    ptr->is_black_ = false;
-                    ptrUncle->is_black_ = true;
+                    ptr->set_black(false);
+                    ptrUncle->set_black(true);
                     updator_(ptr);//update G
                 }
                 else
@@ -233,7 +250,7 @@ namespace bbst
                     if (!tree_is_left_child(ptr))
                     {
                         ptr = ptr->parent_unsafe();
-                        unguarded_tree_left_rotate(ptr);
+                        unguarded_tree_left_rotate(ptr, updator_);
                         updator_(ptr);//update P
                     }
                     /*
@@ -244,15 +261,15 @@ namespace bbst
                      *  C(R)                  C(R)                             U(B)
                      */
                     ptr = ptr->parent_unsafe();
-                    ptr->is_black_ = true;
+                    ptr->set_black(true);
                     //                    updator_(ptr); // unnecessary update P
                     ptr = ptr->parent_unsafe();
-                    ptr->is_black_ = false;
+                    ptr->set_black(false);
                     bool is_finish = ptr == root;
                     if (is_finish)
-                        tree_root_right_rotate(ptr);
+                        tree_root_right_rotate(ptr, updator_);
                     else
-                        unguarded_tree_right_rotate(ptr);
+                        unguarded_tree_right_rotate(ptr, updator_);
                     updator_(ptr); //update G
                     ptr = ptr->parent_unsafe();
                     updator_(ptr); //update P
@@ -274,14 +291,14 @@ namespace bbst
                  *           \                    \
                  *            C(R)                 C(R)
                  */
-                if (ptrUncle != nullptr && !ptrUncle->is_black_)
+                if (ptrUncle != nullptr && !ptrUncle->is_black())
                 {
                     ptr = ptr->parent_unsafe();
-                    ptr->is_black_ = true;
+                    ptr->set_black(true);
                     updator_(ptr); //update P
                     ptr = ptr->parent_unsafe();
-                    ptr->is_black_ = false;
-                    ptrUncle->is_black_ = true;
+                    ptr->set_black(false);
+                    ptrUncle->set_black(true);
                     updator_(ptr); // update G
                 }
                 else
@@ -296,7 +313,7 @@ namespace bbst
                     if (tree_is_left_child(ptr))
                     {
                         ptr = ptr->parent_unsafe();
-                        unguarded_tree_right_rotate(ptr);
+                        unguarded_tree_right_rotate(ptr, updator_);
                         updator_(ptr);//update P
                     }
                     /*
@@ -307,15 +324,15 @@ namespace bbst
                      *             C(R)                  C(R)                                    U(B)
                      */
                     ptr = ptr->parent_unsafe();
-                    ptr->is_black_ = true;
+                    ptr->set_black(true);
                     //                    updator_(ptr);//unnecessary
                     ptr = ptr->parent_unsafe();
-                    ptr->is_black_ = false;
+                    ptr->set_black(false);
                     bool is_finish = ptr == root;
                     if (is_finish)
-                        tree_root_left_rotate(ptr);
+                        tree_root_left_rotate(ptr, updator_);
                     else
-                        unguarded_tree_left_rotate(ptr);
+                        unguarded_tree_left_rotate(ptr, updator_);
                     updator_(ptr);//update G
                     ptr = ptr->parent_unsafe();
                     updator_(ptr);//update P
@@ -328,11 +345,15 @@ namespace bbst
                 }
             }
         }
-        while (ptr != root)
-        {
-            ptr = ptr->parent_unsafe();
-            updator_(ptr);
-        }
+        //the shape above ptr is final, what is left only refreshes metadata
+        if constexpr (is_noop_metadata_updator<metadata_updator_t>)
+            ptr = root;
+        else
+            while (ptr != root)
+            {
+                ptr = ptr->parent_unsafe();
+                updator_(ptr);
+            }
         ASSERT(rb_subtree_invariant(ptr), "post condition failed");
         return ptr;
     }
@@ -342,9 +363,9 @@ namespace bbst
                                     , const comparator_t &comparator) noexcept(std::is_nothrow_invocable_v<const metadata_updator_t &, rb_tree_node_ptr_t>)
     {
         ASSERT(rb_tree_header_invariant(left), "left header invariant false");
-        ASSERT(left.root_ == nullptr || comparator(bbst::tree_max(left.root_)->key(), x->key()), "left tree must be less than x");
+        ASSERT(left.root_ == nullptr || tree_less(comparator, bbst::tree_max(left.root_)->key(), x->key()), "left tree must be less than x");
         ASSERT(rb_tree_header_invariant(right), "right header invariant false");
-        ASSERT(right.root_ == nullptr || comparator(x->key(), bbst::tree_min(right.root_)->key()), "right tree must be greater than x");
+        ASSERT(right.root_ == nullptr || tree_less(comparator, x->key(), bbst::tree_min(right.root_)->key()), "right tree must be greater than x");
         if (left.black_height_ == right.black_height_)
         {
             x->left = left.root_;
@@ -353,7 +374,7 @@ namespace bbst
             x->right = right.root_;
             if (right.root_)
                 right.root_->parent = x;
-            x->is_black_ = true;
+            x->set_black(true);
             left.root_ = x;
             left.black_height_++;
             metadata_updator(x);
@@ -366,7 +387,8 @@ namespace bbst
             uint32_t diff = right.black_height_ - left.black_height_;
             while (true)
             {
-                if ((ptr->left == nullptr || ptr->left->is_black_) && --diff == 0)
+                tree_push_down(metadata_updator, ptr);
+                if ((ptr->left == nullptr || ptr->left->is_black()) && --diff == 0)
                     break;
                 ptr = ptr->left;
             }
@@ -376,14 +398,14 @@ namespace bbst
             x->right = ptr->left;
             if (x->right)
                 x->right->parent = x;
-            x->is_black_ = false;
+            x->set_black(false);
             ptr->left = x;
             x->parent = ptr;
             metadata_updator(x);
             right.root_ = rb_tree_insert_fixup(x, right.root_, metadata_updator);
-            if (!right.root_->is_black_)
+            if (!right.root_->is_black())
             {
-                right.root_->is_black_ = true;
+                right.root_->set_black(true);
                 right.black_height_++;
             }
             ASSERT(rb_tree_header_invariant(right), "post condition failed");
@@ -395,7 +417,8 @@ namespace bbst
             uint32_t diff = left.black_height_ - right.black_height_;
             while (true)
             {
-                if ((ptr->right == nullptr || ptr->right->is_black_) && --diff == 0)
+                tree_push_down(metadata_updator, ptr);
+                if ((ptr->right == nullptr || ptr->right->is_black()) && --diff == 0)
                     break;
                 ptr = ptr->right;
             }
@@ -405,27 +428,346 @@ namespace bbst
                 x->right->parent = x;
             if (x->left)
                 x->left->parent = x;
-            x->is_black_ = false;
+            x->set_black(false);
             ptr->right = x;
             x->parent = ptr;
             metadata_updator(x);
             left.root_ = rb_tree_insert_fixup(x, left.root_, metadata_updator);
-            if (!left.root_->is_black_)
+            if (!left.root_->is_black())
             {
-                left.root_->is_black_ = true;
+                left.root_->set_black(true);
                 left.black_height_++;
             }
             ASSERT(rb_tree_header_invariant(left), "post condition failed");
             return left;
         }
     }
+
+    /*
+     * Unlink z from the tree hanging off end_node (end_node->left is the root, end_node has no parent),
+     * repair the coloring and refresh the metadata from the removal point up to the root.
+     * z is detached but not destroyed.
+     * Returns whether the black height of the tree decreased.
+     * Adapted from libc++ __tree_remove
+     */
+    template<class base_tree_node_ptr_t, class rb_tree_node_ptr_t, class metadata_updator_t>
+    bool rb_tree_remove(base_tree_node_ptr_t end_node, rb_tree_node_ptr_t z
+                        , const metadata_updator_t &updator) noexcept(std::is_nothrow_invocable_v<const metadata_updator_t &, rb_tree_node_ptr_t>)
+    {
+        rb_tree_node_ptr_t root = end_node->left;
+        // y is either z, or if z has two children, tree_next(z).
+        // y will have at most one child.
+        // y will be the initial hole in the tree (make the hole at a leaf)
+        rb_tree_node_ptr_t y = (z->left == nullptr || z->right == nullptr) ? z : tree_min(z->right);
+        // with a lazy updator, every tag above the nodes about to move has to be settled first
+        tree_push_down_path(updator, end_node, y);
+        // x is y's possibly null single child
+        rb_tree_node_ptr_t x = y->left != nullptr ? y->left : y->right;
+        // w is x's possibly null uncle (will become x's sibling)
+        rb_tree_node_ptr_t w = nullptr;
+        // lowest node whose subtree loses an element
+        base_tree_node_ptr_t fix = y->parent;
+        // link x to y's parent, and find w
+        if (x != nullptr)
+            x->parent = y->parent;
+        if (tree_is_left_child(y))
+        {
+            y->parent->left = x;
+            if (y != root)
+                w = y->parent->right;
+            else
+                root = x;  // w == nullptr
+        }
+        else
+        {
+            y->parent->right = x;
+            // y can't be root if it is a right child
+            w = y->parent->left;
+        }
+        bool removed_black = y->is_black();
+        // If we didn't remove z, do so now by splicing in y for z,
+        //    but copy z's color.  This does not impact x or w.
+        if (y != z)
+        {
+            if (fix == z)
+                fix = y;
+            // z->left != nullptr but z->right might == x == nullptr
+            y->parent = z->parent;
+            if (tree_is_left_child(z))
+                y->parent->left = y;
+            else
+                y->parent->right = y;
+            y->left = z->left;
+            y->left->parent = y;
+            y->right = z->right;
+            if (y->right != nullptr)
+                y->right->parent = y;
+            y->set_black(z->is_black());
+            if (root == z)
+                root = y;
+        }
+        // the tree is a valid search tree again, fix metadata now: rotations below preserve the content of the rotated subtree
+        // so only the rotated nodes need another update
+        if constexpr (!is_noop_metadata_updator<metadata_updator_t>)
+            while (fix != end_node)
+            {
+                rb_tree_node_ptr_t ptr = fix->self_downcast_unsafe();
+                updator(ptr);
+                fix = ptr->parent;
+            }
+        // There is no need to rebalance if we removed a red
+        if (!removed_black)
+            return false;
+        // the last node is gone
+        if (root == nullptr)
+            return true;
+        // x has an implicit black color (transferred from the removed y) associated with it, no matter what its color is.
+        // Since y was black and only had one child (which x points to), x is either red with no children, else null,
+        // otherwise y would have different black heights under left and right pointers.
+        // If x is red it can absorb the implicit black just by setting its color to black.
+        if (x != nullptr)
+        {
+            x->set_black(true);
+            return false;
+        }
+        // Else x isn't root, and is "doubly black", even though it may be null.
+        // w can not be null here, else the parent would see a black height >= 2 on the x side and a black height
+        // of 1 on the w side (w must be a non-null black or a red with a non-null black child).
+        while (true)
+        {
+            if (!tree_is_left_child(w))  // if x is left child
+            {
+                if (!w->is_black())
+                {
+                    rb_tree_node_ptr_t P = w->parent_unsafe();
+                    w->set_black(true);
+                    P->set_black(false);
+                    unguarded_tree_left_rotate(P, updator);
+                    updator(P);
+                    updator(w);
+                    // reset root only if necessary
+                    if (root == P)
+                        root = w;
+                    // reset sibling, and it still can't be null
+                    w = P->right;
+                }
+                // w->is_black() is now true, w may have null children
+                if ((w->left == nullptr || w->left->is_black()) && (w->right == nullptr || w->right->is_black()))
+                {
+                    w->set_black(false);
+                    x = w->parent_unsafe();
+                    // x can no longer be null
+                    if (!x->is_black())
+                    {
+                        x->set_black(true);
+                        return false;
+                    }
+                    // the missing black reached the root, every path lost one
+                    if (x == root)
+                        return true;
+                    // reset sibling, and it still can't be null
+                    w = tree_is_left_child(x) ? x->parent->right : x->parent->left;
+                }
+                else  // w has a red child
+                {
+                    if (w->right == nullptr || w->right->is_black())
+                    {
+                        // w left child is non-null and red
+                        w->left->set_black(true);
+                        w->set_black(false);
+                        unguarded_tree_right_rotate(w, updator);
+                        updator(w);
+                        // w is known not to be root, so root hasn't changed
+                        // reset sibling, and it still can't be null
+                        w = w->parent_unsafe();
+                        updator(w);
+                    }
+                    // w has a right red child, left child may be null
+                    rb_tree_node_ptr_t P = w->parent_unsafe();
+                    w->set_black(P->is_black());
+                    P->set_black(true);
+                    w->right->set_black(true);
+                    unguarded_tree_left_rotate(P, updator);
+                    updator(P);
+                    updator(w);
+                    return false;
+                }
+            }
+            else
+            {
+                if (!w->is_black())
+                {
+                    rb_tree_node_ptr_t P = w->parent_unsafe();
+                    w->set_black(true);
+                    P->set_black(false);
+                    unguarded_tree_right_rotate(P, updator);
+                    updator(P);
+                    updator(w);
+                    // reset root only if necessary
+                    if (root == P)
+                        root = w;
+                    // reset sibling, and it still can't be null
+                    w = P->left;
+                }
+                // w->is_black() is now true, w may have null children
+                if ((w->left == nullptr || w->left->is_black()) && (w->right == nullptr || w->right->is_black()))
+                {
+                    w->set_black(false);
+                    x = w->parent_unsafe();
+                    // x can no longer be null
+                    if (!x->is_black())
+                    {
+                        x->set_black(true);
+                        return false;
+                    }
+                    if (x == root)
+                        return true;
+                    // reset sibling, and it still can't be null
+                    w = tree_is_left_child(x) ? x->parent->right : x->parent->left;
+                }
+                else  // w has a red child
+                {
+                    if (w->left == nullptr || w->left->is_black())
+                    {
+                        // w right child is non-null and red
+                        w->right->set_black(true);
+                        w->set_black(false);
+                        unguarded_tree_left_rotate(w, updator);
+                        updator(w);
+                        // w is known not to be root, so root hasn't changed
+                        // reset sibling, and it still can't be null
+                        w = w->parent_unsafe();
+                        updator(w);
+                    }
+                    // w has a left red child, right child may be null
+                    rb_tree_node_ptr_t P = w->parent_unsafe();
+                    w->set_black(P->is_black());
+                    P->set_black(true);
+                    w->left->set_black(true);
+                    unguarded_tree_right_rotate(P, updator);
+                    updator(P);
+                    updator(w);
+                    return false;
+                }
+            }
+        }
+    }
+
+    /*
+     * Cut a non-empty tree at its root: headers of both subtrees (a red child is painted black to stand as a root)
+     * and the root itself, with stale child pointers.
+     */
+    template<class rb_tree_header_t, class metadata_updator_t>
+    std::tuple<rb_tree_header_t, decltype(rb_tree_header_t::root_), rb_tree_header_t> rb_tree_expose(rb_tree_header_t header, const metadata_updator_t &metadata_updator) noexcept
+    {
+        auto root = header.root_;
+        tree_push_down(metadata_updator, root);
+        bool left_is_black = root->left == nullptr || root->left->exchange_black(true);
+        bool right_is_black = root->right == nullptr || root->right->exchange_black(true);
+        return {rb_tree_header_t(root->left, header.black_height_ - left_is_black), root,
+                rb_tree_header_t(root->right, header.black_height_ - right_is_black)};
+    }
+
+    /*
+     * Split around key: nodes less than key end up in the left header, nodes greater in the right one.
+     * By default the node equivalent to key (nullptr if none) is handed back detached, with stale child pointers,
+     * equal_policy left/right joins it into that side instead (the middle is nullptr then).
+     * O(log n) since every join_x on the way up costs the black height difference.
+     * Iterative, see tree_split.
+     */
+    template<tree_split_equal equal_policy = tree_split_equal::detach, class rb_tree_header_t, class key_t, class metadata_updator_t, class comparator_t>
+    std::tuple<rb_tree_header_t, decltype(rb_tree_header_t::root_), rb_tree_header_t>
+    rb_tree_split(rb_tree_header_t header, const key_t &key, const metadata_updator_t &metadata_updator, const comparator_t &comparator)
+    {
+        return tree_split<equal_policy>(header, key, comparator, [&metadata_updator](auto h) { return rb_tree_expose(h, metadata_updator); }
+                                        , [&metadata_updator, &comparator](auto left, auto x, auto right)
+                                        {
+                                            return rb_tree_join_x(left, x, right, metadata_updator, comparator);
+                                        });
+    }
+
+    /*
+     * Split right before x, a node of the tree under header whose root hangs from end_node: x and everything after it go right.
+     * Steers by x's parent links instead of comparing keys, the joins still make it O(log n). See tree_split_at.
+     */
+    template<class rb_tree_header_t, class base_tree_node_ptr_t, class metadata_updator_t, class comparator_t>
+    std::pair<rb_tree_header_t, rb_tree_header_t>
+    rb_tree_split_at(rb_tree_header_t header, base_tree_node_ptr_t end_node, base_tree_node_ptr_t x, const metadata_updator_t &metadata_updator
+                     , const comparator_t &comparator)
+    {
+        return tree_split_at(header, end_node, x, [&metadata_updator](auto h) { return rb_tree_expose(h, metadata_updator); }
+                             , [&metadata_updator, &comparator](auto left, auto pivot, auto right)
+                             {
+                                 return rb_tree_join_x(left, pivot, right, metadata_updator, comparator);
+                             });
+    }
+
+    /*
+     * Join without a middle node, every key of left must be less than every key of right.
+     * The maximum of left is unlinked and used as the pivot of join_x.
+     */
+    template<class rb_tree_header_t, class metadata_updator_t, class comparator_t>
+    rb_tree_header_t rb_tree_join(rb_tree_header_t left, rb_tree_header_t right, const metadata_updator_t &metadata_updator
+                                  , const comparator_t &comparator) noexcept(std::is_nothrow_invocable_v<const metadata_updator_t &, decltype(left.root_)>)
+    {
+        if (left.empty())
+            return right;
+        if (right.empty())
+            return left;
+        auto x = tree_max(left.root_);
+        base_tree_node<std::remove_pointer_t<decltype(x)>> end_node(nullptr, left.root_, nullptr);
+        left.root_->parent = &end_node;
+        left.black_height_ -= rb_tree_remove(&end_node, x, metadata_updator);
+        left.root_ = end_node.left;
+        return rb_tree_join_x(left, x, right, metadata_updator, comparator);
+    }
+
+    //header level primitives, the interface join based algorithms shared between trees (tree_set_operation.h) build on
+    struct rb_tree_header_ops
+    {
+        template<class rb_tree_header_t, class metadata_updator_t>
+        static inline auto expose(rb_tree_header_t header, const metadata_updator_t &metadata_updator) noexcept
+        {
+            return rb_tree_expose(header, metadata_updator);
+        }
+
+        template<class rb_tree_header_t, class key_t, class metadata_updator_t, class comparator_t>
+        static inline auto split(rb_tree_header_t header, const key_t &key, const metadata_updator_t &metadata_updator, const comparator_t &comparator)
+        {
+            return rb_tree_split(header, key, metadata_updator, comparator);
+        }
+
+        template<class rb_tree_header_t, class rb_tree_node_ptr_t, class metadata_updator_t, class comparator_t>
+        static inline rb_tree_header_t join_x(rb_tree_header_t left, rb_tree_node_ptr_t x, rb_tree_header_t right, const metadata_updator_t &metadata_updator
+                                              , const comparator_t &comparator)
+        {
+            return rb_tree_join_x(left, x, right, metadata_updator, comparator);
+        }
+
+        template<class rb_tree_header_t, class metadata_updator_t, class comparator_t>
+        static inline rb_tree_header_t join(rb_tree_header_t left, rb_tree_header_t right, const metadata_updator_t &metadata_updator, const comparator_t &comparator)
+        {
+            return rb_tree_join(left, right, metadata_updator, comparator);
+        }
+
+        //a tree of black height h holds at least 2^(h-1)-1 nodes, saturated at cap
+        template<class rb_tree_header_t>
+        static inline size_t size_lower_bound(const rb_tree_header_t &header, size_t cap) noexcept
+        {
+            uint32_t black_levels = header.black_height_ - 1;
+            if (black_levels >= std::numeric_limits<size_t>::digits)
+                return cap;
+            return std::min(cap, (size_t(1) << black_levels) - 1);
+        }
+    };
 }
 
 //rb_tree
 namespace bbst
 {
-    template<class key_t, class mapped_t, class metadata_t, class metadata_updator_t, class comparator_t = std::less<key_t>>
-    requires (std::predicate<const comparator_t &, const key_t &, const key_t &> &&
+    template<class key_t, class mapped_t, class metadata_t, class metadata_updator_t, class comparator_t = std::less<key_t>,
+            class allocator_t = std::allocator<exposure<key_t, mapped_t, metadata_t>>>
+    requires (is_tree_comparator<comparator_t, key_t, key_t> &&
               std::regular_invocable<const metadata_updator_t &, rb_tree_node<bbst::exposure<key_t, mapped_t, metadata_t>> *>)
     class rb_tree
     {
@@ -436,24 +778,44 @@ namespace bbst
         typedef rb_tree_node_t *rb_tree_node_ptr_t;
         typedef rb_tree_header<key_t, mapped_t, metadata_t> rb_tree_header_t;
         typedef typename rb_tree_node_t::value_type value_type;
+        typedef typename std::allocator_traits<allocator_t>::template rebind_alloc<rb_tree_node_t> node_allocator_t;
+        typedef std::allocator_traits<node_allocator_t> node_allocator_traits;
     public:
+        typedef allocator_t allocator_type;
         typedef tree_bidirectional_iterator_<base_tree_node_t> iterator;
         typedef tree_bidirectional_const_iterator_<base_tree_node_t> const_iterator;
     private:
 
         base_tree_node_t end_node_;
         base_tree_node_ptr_t begin_node_;
-        comparator_t comp_;
-        metadata_updator_t updator_;
+        base_tree_node_ptr_t last_node_;//greatest node, &end_node_ if empty
+        [[no_unique_address]] comparator_t comp_;
+        [[no_unique_address]] metadata_updator_t updator_;
+        [[no_unique_address]] node_allocator_t alloc_;
         uint32_t black_height_;
 
-        std::pair<rb_tree_node_ptr_t &, base_tree_node_ptr_t> inline find_equal_or_insert_pos(const key_t &key)
+        //node a finger search starts from, tree must not be empty
+        [[nodiscard]] base_tree_node_ptr_t finger_node(const_iterator finger) const noexcept
+        {
+            return finger.get() == &end_node_ ? last_node_ : const_cast<base_tree_node_ptr_t>(finger.get());
+        }
+
+        static inline iterator mutable_iterator(const_iterator it) noexcept
+        {
+            return iterator(const_cast<base_tree_node_ptr_t>(it.get()));
+        }
+
+        //key_t, or a query of a transparent comparator (emplace_query_args)
+        template<class query_t>
+        std::pair<rb_tree_node_ptr_t &, base_tree_node_ptr_t> inline find_equal_or_insert_pos(const query_t &key)
         {
-            return bbst::find_equal_or_insert_pos<key_t, base_tree_node_ptr_t, rb_tree_node_ptr_t, comparator_t>(key, &end_node_, comp_);
+            return bbst::find_equal_or_insert_pos<query_t, base_tree_node_ptr_t, rb_tree_node_ptr_t, comparator_t>(key, &end_node_, comp_);
         }
 
         void insert_node_at(base_tree_node_ptr_t parent, rb_tree_node_ptr_t &child, rb_tree_node_ptr_t new_node) noexcept
         {
+            if (parent != &end_node_)
+                tree_push_down_path(updator_, &end_node_, parent->self_downcast_unsafe());
             new_node->left = nullptr;
             new_node->right = nullptr;
             new_node->parent = parent;
@@ -461,10 +823,14 @@ namespace bbst
             updator_(new_node);
             if (begin_node_->left != nullptr)
                 begin_node_ = begin_node_->left;
+            if (last_node_ == &end_node_)
+                last_node_ = new_node;
+            else if (last_node_->right != nullptr)
+                last_node_ = last_node_->right;
             rb_tree_node_ptr_t root = (end_node_.left = rb_tree_insert_fixup(new_node, end_node_.left, updator_));
-            if (!root->is_black_)
+            if (!root->is_black())
             {
-                root->is_black_ = true;
+                root->set_black(true);
                 black_height_++;
             }
         }
@@ -483,40 +849,210 @@ namespace bbst
             return {iterator(child), false};
         }
 
+        //key_t is only materialized from the query once a node is actually inserted
+        template<class query_t, class... Args>
+        std::pair<iterator, bool> emplace_query_args(query_t &&key, Args... args)
+        {
+            auto [child, parent] = find_equal_or_insert_pos(key);
+            if (child == nullptr)
+            {
+                rb_tree_node_ptr_t new_node = construct_node(key_t(std::forward<query_t>(key)), std::forward<Args>(args)...);
+                insert_node_at(parent, child, new_node);
+                return {iterator(new_node), true};
+            }
+            return {iterator(child), false};
+        }
+
+        /*
+         * Insert position for key next to hint: if key fits right before (or right after) hint, the free child link
+         * between the two neighbours is returned without descending, otherwise the ordinary search from the root.
+         */
+        std::pair<rb_tree_node_ptr_t &, base_tree_node_ptr_t> find_equal_or_insert_pos(base_tree_node_ptr_t hint, const key_t &key)
+        {
+            if (hint == &end_node_ || tree_less(comp_, key, hint->self_downcast_unsafe()->key()))
+            {
+                if (hint != &end_node_ && hint == begin_node_)
+                    return {hint->left, hint};
+                if (hint != begin_node_)
+                {
+                    base_tree_node_ptr_t prev = hint == &end_node_ ? last_node_ : tree_prev_iter(hint);
+                    if (tree_less(comp_, prev->self_downcast_unsafe()->key(), key))
+                    {
+                        if (hint == &end_node_ || hint->left != nullptr)
+                            return {prev->right, prev};
+                        return {hint->left, hint};
+                    }
+                }
+            }
+            else if (tree_less(comp_, hint->self_downcast_unsafe()->key(), key))
+            {
+                base_tree_node_ptr_t next = hint == last_node_ ? &end_node_ : tree_next_iter(hint);
+                if (next == &end_node_ || tree_less(comp_, key, next->self_downcast_unsafe()->key()))
+                {
+                    if (hint->right == nullptr)
+                        return {hint->right, hint};
+                    return {next->left, next};
+                }
+            }
+            else
+            {
+                return {tree_is_left_child(hint) ? hint->parent->left : hint->parent->right, hint};
+            }
+            return find_equal_or_insert_pos(key);
+        }
+
+        template<class... Args>
+        std::pair<iterator, bool> emplace_hint_key_args(base_tree_node_ptr_t hint, key_t key, Args... args)
+        {
+            auto [child, parent] = find_equal_or_insert_pos(hint, key);
+            if (child == nullptr)
+            {
+                rb_tree_node_ptr_t new_node = construct_node(std::forward<key_t>(key), std::forward<Args>(args)...);
+                insert_node_at(parent, child, new_node);
+                return {iterator(new_node), true};
+            }
+            return {iterator(child), false};
+        }
+
         template<class... Args>
         std::pair<iterator, bool> emplace_args(Args...args)
         {
-            std::unique_ptr<rb_tree_node_t> new_node = std::make_unique<>(std::forward<Args>(args)...);
+            rb_tree_node_ptr_t new_node = construct_node(std::forward<Args>(args)...);
             auto [child, parent] = find_equal_or_insert_pos(new_node->value_.key);
             if (child == nullptr)
             {
-                insert_node_at(parent, child, new_node.release());
-                return {new_node, true};
+                insert_node_at(parent, child, new_node);
+                return {iterator(new_node), true};
             }
-
-            return {*child, false};
+            destroy_node(new_node);
+            return {iterator(child), false};
         }
 
-        //TODO: templatize with allocator https://stackoverflow.com/questions/65262899/what-is-the-purpose-of-pointer-rebind
         template<class... Args>
         rb_tree_node_ptr_t construct_node(Args... args)
         {
-            return new rb_tree_node_t(std::forward<Args>(args)...);
+            rb_tree_node_ptr_t ptr = node_allocator_traits::allocate(alloc_, 1);
+            try
+            {
+                node_allocator_traits::construct(alloc_, ptr, std::forward<Args>(args)...);
+            }
+            catch (...)
+            {
+                node_allocator_traits::deallocate(alloc_, ptr, 1);
+                throw;
+            }
+            return ptr;
+        }
+
+        void destroy_node(rb_tree_node_ptr_t ptr) noexcept
+        {
+            tree_destroy_node(alloc_, ptr);
+        }
+
+        void destroy_subtree(rb_tree_node_ptr_t ptr) noexcept
+        {
+            tree_destroy(ptr, [this](rb_tree_node_ptr_t p) { destroy_node(p); });
+        }
+
+        template<class element_t>
+        rb_tree_node_ptr_t construct_sorted_element(element_t &&element)
+        {
+            if constexpr (std::is_convertible_v<element_t, key_t>)
+                return construct_node(key_t(std::forward<element_t>(element)));
+            else if constexpr (std::is_empty_v<mapped_t>)
+                //nothing to read from an empty mapped type, a set's no_mapped may share its address with the key
+                return construct_node(key_t(std::forward<element_t>(element).first));
+            else
+                return construct_node(key_t(std::forward<element_t>(element).first), metadata_t(), mapped_t(std::forward<element_t>(element).second));
+        }
+
+        template<class iterator_t>
+        size_t count_sorted_unique(iterator_t first, iterator_t last) const
+        {
+            if (first == last)
+                return 0;
+            size_t n = 1;
+            for (iterator_t run = first; ++first != last;)
+            {
+                if (tree_less(comp_, sorted_element_key<key_t>(*run), sorted_element_key<key_t>(*first)))
+                {
+                    run = first;
+                    n++;
+                }
+            }
+            return n;
+        }
+
+        /*
+         * O(n) build from a sorted range into an empty tree, n is the number of distinct keys in the range.
+         * With skip_equivalent only the first element of each run of equivalent keys becomes a node.
+         */
+        template<bool skip_equivalent, class iterator_t>
+        void build_from_sorted(iterator_t first, iterator_t last, size_t n)
+        {
+            ASSERT(end_node_.left == nullptr, "tree must be empty");
+            auto make_node = [this, &first, &last]() -> rb_tree_node_ptr_t
+            {
+                rb_tree_node_ptr_t node = construct_sorted_element(*first);
+                ++first;
+                if constexpr (skip_equivalent)
+                {
+                    while (first != last && !tree_less(comp_, node->key(), sorted_element_key<key_t>(*first)))
+                        ++first;
+                }
+                ASSERT(first == last || tree_less(comp_, node->key(), sorted_element_key<key_t>(*first)), "range must be sorted");
+                return node;
+            };
+            uint32_t height = std::bit_width(n);
+            //perfectly balanced: every nil sits at depth height or height-1, so painting the deepest level red
+            //leaves the same number of black nodes on every path
+            auto finish = [this, height](rb_tree_node_ptr_t node, size_t, size_t, uint32_t depth)
+            {
+                node->set_black(height == 1 || depth + 1 != height);
+                updator_(node);
+            };
+            auto destroy = [this](rb_tree_node_ptr_t ptr) { destroy_node(ptr); };
+            rb_tree_node_ptr_t root = tree_build_balanced<rb_tree_node_ptr_t>(n, 0, make_node, finish, destroy);
+            end_node_.left = root;
+            if (root != nullptr)
+            {
+                root->parent = &end_node_;
+                begin_node_ = tree_min(root);
+                last_node_ = tree_max(root);
+            }
+            black_height_ = height <= 1 ? height + 1 : height;
         }
 
-        //TODO: templatize with allocator
-        void destruct_node(const_iterator p)
+        //hand every node over as a header, leaving the tree empty
+        rb_tree_header_t release_header() noexcept
         {
-            delete static_cast<rb_tree_node_ptr_t>(p.get());
+            begin_node_ = last_node_ = &end_node_;
+            return {std::exchange(end_node_.left, nullptr), std::exchange(black_height_, 1)};
         }
 
-        rb_tree(rb_tree_header_t header, const metadata_updator_t &updator, const comparator_t &comp)
+        //take over the nodes of header, tree must be empty
+        void adopt_header(rb_tree_header_t header) noexcept
+        {
+            ASSERT(end_node_.left == nullptr, "tree must be empty");
+            end_node_.left = header.root_;
+            if (header.root_ != nullptr)
+            {
+                header.root_->parent = &end_node_;
+                begin_node_ = tree_min(header.root_);
+                last_node_ = tree_max(header.root_);
+            }
+            black_height_ = header.black_height_;
+        }
+
+        rb_tree(rb_tree_header_t header, const metadata_updator_t &updator, const comparator_t &comp, const node_allocator_t &alloc)
                 :
                 black_height_(header.black_height_)
                 , end_node_(nullptr, header.root_, nullptr)
                 , begin_node_(header.root_ == nullptr ? &end_node_ : tree_min(header.root_))
+                , last_node_(header.root_ == nullptr ? &end_node_ : tree_max(header.root_))
                 , comp_(comp)
                 , updator_(updator)
+                , alloc_(alloc)
         {
             if (header.root_ != nullptr) header.root_->parent = &end_node_;
         }
@@ -525,12 +1061,15 @@ namespace bbst
         template<class comparator_forward_t=comparator_t, class metadata_updator_forward_t=metadata_updator_t>
         requires (std::is_same_v<comparator_t, std::decay_t<comparator_forward_t>> &&
                   std::is_same_v<metadata_updator_t, std::decay_t<metadata_updator_forward_t>>)
-        rb_tree(metadata_updator_forward_t &&updator = metadata_updator_t(), comparator_forward_t &&comp = comparator_t())
+        rb_tree(metadata_updator_forward_t &&updator = metadata_updator_t(), comparator_forward_t &&comp = comparator_t()
+                , const allocator_t &alloc = allocator_t())
                 :
                 end_node_(nullptr, nullptr, nullptr)
                 , begin_node_(&end_node_)
+                , last_node_(&end_node_)
                 , updator_(std::forward<metadata_updator_forward_t>(updator))
                 , comp_(std::forward<comparator_forward_t>(comp))
+                , alloc_(alloc)
                 , black_height_(1)
         {
 
@@ -540,16 +1079,41 @@ namespace bbst
                 :
                 end_node_(nullptr, std::exchange(other.end_node_.left, nullptr), nullptr)
                 , begin_node_(other.begin_node_ == &other.end_node_ ? &end_node_ : std::exchange(other.begin_node_, &other.end_node_))
+                , last_node_(other.last_node_ == &other.end_node_ ? &end_node_ : std::exchange(other.last_node_, &other.end_node_))
                 , black_height_(std::exchange(other.black_height_, 1))
                 , comp_(std::move(other.comp_))
                 , updator_(std::move(other.updator_))
+                , alloc_(other.alloc_)
         {
             if (end_node_.left) end_node_.left->parent = &end_node_;
         }
 
+        //O(n) construction from a range sorted by comp, elements are keys or (key, mapped) pairs
+        template<std::forward_iterator iterator_t, class comparator_forward_t=comparator_t, class metadata_updator_forward_t=metadata_updator_t>
+        requires (std::is_same_v<comparator_t, std::decay_t<comparator_forward_t>> &&
+                  std::is_same_v<metadata_updator_t, std::decay_t<metadata_updator_forward_t>>)
+        rb_tree(sorted_unique_t, iterator_t first, iterator_t last, metadata_updator_forward_t &&updator = metadata_updator_t()
+                , comparator_forward_t &&comp = comparator_t(), const allocator_t &alloc = allocator_t())
+                :
+                rb_tree(std::forward<metadata_updator_forward_t>(updator), std::forward<comparator_forward_t>(comp), alloc)
+        {
+            build_from_sorted<false>(first, last, std::distance(first, last));
+        }
+
+        template<std::forward_iterator iterator_t, class comparator_forward_t=comparator_t, class metadata_updator_forward_t=metadata_updator_t>
+        requires (std::is_same_v<comparator_t, std::decay_t<comparator_forward_t>> &&
+                  std::is_same_v<metadata_updator_t, std::decay_t<metadata_updator_forward_t>>)
+        rb_tree(sorted_equivalent_t, iterator_t first, iterator_t last, metadata_updator_forward_t &&updator = metadata_updator_t()
+                , comparator_forward_t &&comp = comparator_t(), const allocator_t &alloc = allocator_t())
+                :
+                rb_tree(std::forward<metadata_updator_forward_t>(updator), std::forward<comparator_forward_t>(comp), alloc)
+        {
+            build_from_sorted<true>(first, last, count_sorted_unique(first, last));
+        }
+
         ~rb_tree()
         {
-            delete end_node_.left;
+            tree_destroy_all(alloc_, end_node_.left);
         }
 
         inline iterator begin() noexcept
@@ -592,6 +1156,44 @@ namespace bbst
             return const_iterator(bbst::lower_bound(&end_node_, key, comp_));
         }
 
+        template<class query_t>
+        requires is_transparent_comparator<comparator_t>
+        iterator lower_bound(const query_t &key)
+        {
+            return iterator(bbst::lower_bound(&end_node_, key, comp_));
+        }
+
+        template<class query_t>
+        requires is_transparent_comparator<comparator_t>
+        [[nodiscard]] const_iterator lower_bound(const query_t &key) const
+        {
+            return const_iterator(bbst::lower_bound(&end_node_, key, comp_));
+        }
+
+        iterator upper_bound(const key_t &key)
+        {
+            return iterator(bbst::upper_bound(&end_node_, key, comp_));
+        }
+
+        [[nodiscard]] const_iterator upper_bound(const key_t &key) const
+        {
+            return const_iterator(bbst::upper_bound(&end_node_, key, comp_));
+        }
+
+        template<class query_t>
+        requires is_transparent_comparator<comparator_t>
+        iterator upper_bound(const query_t &key)
+        {
+            return iterator(bbst::upper_bound(&end_node_, key, comp_));
+        }
+
+        template<class query_t>
+        requires is_transparent_comparator<comparator_t>
+        [[nodiscard]] const_iterator upper_bound(const query_t &key) const
+        {
+            return const_iterator(bbst::upper_bound(&end_node_, key, comp_));
+        }
+
         iterator find(const key_t &key)
         {
             return iterator(bbst::find(&end_node_, key, comp_));
@@ -602,11 +1204,95 @@ namespace bbst
             return const_iterator(bbst::find(&end_node_, key, comp_));
         }
 
+        template<class query_t>
+        requires is_transparent_comparator<comparator_t>
+        iterator find(const query_t &key)
+        {
+            return iterator(bbst::find(&end_node_, key, comp_));
+        }
+
+        template<class query_t>
+        requires is_transparent_comparator<comparator_t>
+        [[nodiscard]] const_iterator find(const query_t &key) const
+        {
+            return const_iterator(bbst::find(&end_node_, key, comp_));
+        }
+
+        /*
+         * lower_bound and find from a finger instead of the root: parent links are climbed only as far as needed,
+         * O(log d) for d elements between finger and the answer. A finger at end() starts from the greatest node.
+         */
+        iterator lower_bound_from(const_iterator finger, const key_t &key)
+        {
+            if (empty())
+                return end();
+            return iterator(tree_finger_lower_bound(&end_node_, finger_node(finger), key, comp_));
+        }
+
+        [[nodiscard]] const_iterator lower_bound_from(const_iterator finger, const key_t &key) const
+        {
+            if (empty())
+                return end();
+            return const_iterator(tree_finger_lower_bound(&end_node_, static_cast<const base_tree_node_t *>(finger_node(finger)), key, comp_));
+        }
+
+        iterator find_from(const_iterator finger, const key_t &key)
+        {
+            if (empty())
+                return end();
+            return iterator(tree_finger_find(&end_node_, finger_node(finger), key, comp_));
+        }
+
+        [[nodiscard]] const_iterator find_from(const_iterator finger, const key_t &key) const
+        {
+            if (empty())
+                return end();
+            return const_iterator(tree_finger_find(&end_node_, static_cast<const base_tree_node_t *>(finger_node(finger)), key, comp_));
+        }
+
+        /*
+         * lower_bound and find of every key in [first, last), iterators written to out in the same order.
+         * Same results as one call per key, but the descents of a batch are interleaved so their cache misses overlap,
+         * see tree_lower_bound_batch.
+         */
+        template<std::forward_iterator key_iterator_t, class output_iterator_t>
+        output_iterator_t lower_bound_batch(key_iterator_t first, key_iterator_t last, output_iterator_t out)
+        {
+            tree_lower_bound_batch(&end_node_, first, last, comp_, [&out](const auto &, base_tree_node_ptr_t p) { *out++ = iterator(p); });
+            return out;
+        }
+
+        template<std::forward_iterator key_iterator_t, class output_iterator_t>
+        output_iterator_t lower_bound_batch(key_iterator_t first, key_iterator_t last, output_iterator_t out) const
+        {
+            tree_lower_bound_batch(&end_node_, first, last, comp_, [&out](const auto &, const base_tree_node_t *p) { *out++ = const_iterator(p); });
+            return out;
+        }
+
+        template<std::forward_iterator key_iterator_t, class output_iterator_t>
+        output_iterator_t find_batch(key_iterator_t first, key_iterator_t last, output_iterator_t out)
+        {
+            tree_find_batch(&end_node_, first, last, comp_, [&out](base_tree_node_ptr_t p) { *out++ = iterator(p); });
+            return out;
+        }
+
+        template<std::forward_iterator key_iterator_t, class output_iterator_t>
+        output_iterator_t find_batch(key_iterator_t first, key_iterator_t last, output_iterator_t out) const
+        {
+            tree_find_batch(&end_node_, first, last, comp_, [&out](const base_tree_node_t *p) { *out++ = const_iterator(p); });
+            return out;
+        }
+
         [[nodiscard]] bool empty() const
         {
             return begin_node_ == &end_node_;
         }
 
+        [[nodiscard]] allocator_t get_allocator() const noexcept
+        {
+            return allocator_t(alloc_);
+        }
+
         //key,metadata,mapped
         template<class... Args>
         inline std::pair<iterator, bool> try_emplace(key_t key, Args...args)
@@ -614,200 +1300,175 @@ namespace bbst
             return emplace_key_args(std::forward<key_t>(key), std::forward<Args>(args)...);
         }
 
-        //TODO:
-        void tree_remove(rb_tree_node_ptr_t z) noexcept
+        //with a transparent comparator, look up by anything key_t can be built from, and only build it on insertion
+        template<class query_t, class... Args>
+        requires (is_transparent_comparator<comparator_t> && !std::is_same_v<std::remove_cvref_t<query_t>, key_t> &&
+                  std::constructible_from<key_t, query_t>)
+        inline std::pair<iterator, bool> try_emplace(query_t &&key, Args...args)
         {
-            rb_tree_node_ptr_t root = end_node_->left;
-            // z will be removed from the tree.  Client still needs to destruct/deallocate it
-            // y is either z, or if z has two children, tree_next(z).
-            // y will have at most one child.
-            // y will be the initial hole in the tree (make the hole at a leaf)
-            rb_tree_node_ptr_t y;
-            if (z->left == nullptr || z->right == nullptr)
-            {
-                y = z;
-            }
-            else
+            return emplace_query_args(std::forward<query_t>(key), std::forward<Args>(args)...);
+        }
+
+        /*
+         * try_emplace that first tries the spot right before hint (or right after it): if key fits there no descent is needed,
+         * and with the amortized O(1) rebalancing the whole insertion is amortized O(1) (O(log n) for updators that refresh ancestors).
+         * A wrong hint only costs the ordinary search.
+         */
+        template<class... Args>
+        inline iterator emplace_hint(const_iterator hint, key_t key, Args...args)
+        {
+            return emplace_hint_key_args(const_cast<base_tree_node_ptr_t>(hint.get()), std::forward<key_t>(key), std::forward<Args>(args)...).first;
+        }
+
+        //try_emplace for a key beyond the current greatest one (monotone ingestion), see emplace_hint
+        template<class... Args>
+        inline std::pair<iterator, bool> push_back(key_t key, Args...args)
+        {
+            return emplace_hint_key_args(&end_node_, std::forward<key_t>(key), std::forward<Args>(args)...);
+        }
+
+        //try_emplace for a key below the current least one, see emplace_hint
+        template<class... Args>
+        inline std::pair<iterator, bool> push_front(key_t key, Args...args)
+        {
+            return emplace_hint_key_args(begin_node_, std::forward<key_t>(key), std::forward<Args>(args)...);
+        }
+
+        /*
+         * try_emplace of every element of a range sorted by comp (keys or (key, mapped) pairs, of a run of equivalent keys only the first counts).
+         * Each element is placed by a finger search from the previous one, O(m log(n/m + 1)) for m elements into n instead of m full descents.
+         * With policy.pool set and at least policy.grain elements, the range is built into a tree and merged in with a forked
+         * join based union instead (see tree_set_operation), allocators that are not always equal keep to the sequential path.
+         */
+        template<std::forward_iterator iterator_t>
+        void insert_sorted_batch(iterator_t first, iterator_t last, parallel_policy policy = {})
+        {
+            if constexpr(node_allocator_traits::is_always_equal::value)
             {
-                y = z->right;
-                while (y->left != nullptr)
-                    y = y->left;
+                if (policy.pool != nullptr && size_t(std::distance(first, last)) >= policy.grain)
+                {
+                    rb_tree batch(rb_tree_header_t::empty_header(), updator_, comp_, alloc_);
+                    batch.template build_from_sorted<true>(first, last, batch.count_sorted_unique(first, last));
+                    auto destroy = [this](rb_tree_node_ptr_t root) { destroy_subtree(root); };
+                    tree_set_operation<rb_tree_header_ops, rb_tree_header_t, metadata_updator_t, comparator_t, decltype(destroy)> op(updator_, comp_, destroy, policy);
+                    rb_tree_header_t result = op.union_(release_header(), batch.release_header());
+                    ASSERT(rb_tree_header_invariant(result), "post condition failed");
+                    adopt_header(result);
+                    return;
+                }
             }
-            // x is y's possibly null single child
-            rb_tree_node_ptr_t x = y->left != nullptr ? y->left : y->right;
-            // w is x's possibly null uncle (will become x's sibling)
-            rb_tree_node_ptr_t w = nullptr;
-            // link x to y's parent, and find w
-            if (x != nullptr)
-                x->parent = y->parent;
-            if (tree_is_left_child(y))
+            base_tree_node_ptr_t finger = begin_node_;
+            for (; first != last; ++first)
             {
-                y->parent->left = x;
-                if (y != root)
-                    w = y->parent->right;
+                //proxy iterators (transform, zip views) hand out pairs by value, keep the element alive as long as the key
+                auto &&element = *first;
+                const key_t &key = sorted_element_key<key_t>(element);
+                if (finger != &end_node_)
+                    finger = tree_finger_lower_bound(&end_node_, finger, key, comp_);
+                auto [child, parent] = find_equal_or_insert_pos(finger, key);
+                if (child == nullptr)
+                {
+                    rb_tree_node_ptr_t new_node = construct_sorted_element(std::forward<decltype(element)>(element));
+                    insert_node_at(parent, child, new_node);
+                    finger = new_node;
+                }
                 else
-                    root = x;  // w == nullptr
+                {
+                    finger = child;
+                }
             }
-            else
+        }
+
+        iterator erase(const_iterator pos) noexcept
+        {
+            ASSERT(pos != end(), "end() is not erasable");
+            rb_tree_node_ptr_t node = const_cast<base_tree_node_ptr_t>(pos.get())->self_downcast_unsafe();
+            base_tree_node_ptr_t next = tree_next_iter(static_cast<base_tree_node_ptr_t>(node));
+            if (last_node_ == node)
+                last_node_ = begin_node_ == node ? &end_node_ : tree_prev_iter(static_cast<base_tree_node_ptr_t>(node));
+            if (begin_node_ == node)
+                begin_node_ = next;
+            black_height_ -= rb_tree_remove(&end_node_, node, updator_);
+            ASSERT(rb_tree_header_invariant(rb_tree_header_t(end_node_.left, black_height_)), "post condition failed");
+            destroy_node(node);
+            return iterator(next);
+        }
+
+        inline iterator erase(iterator pos) noexcept
+        {
+            return erase(const_iterator(pos));
+        }
+
+        size_t erase(const key_t &key)
+        {
+            iterator pos = find(key);
+            if (pos == end())
+                return 0;
+            erase(pos);
+            return 1;
+        }
+
+        /*
+         * O(log n + k): cut [first, last) out with two splits and sew the rest back with a single join,
+         * instead of k independent removals
+         */
+        iterator erase(const_iterator first, const_iterator last)
+        {
+            base_tree_node_ptr_t last_node = const_cast<base_tree_node_ptr_t>(last.get());
+            if (first == last)
+                return iterator(last_node);
+            if (first == begin() && last == end())
             {
-                y->parent->right = x;
-                // y can't be root if it is a right child
-                w = y->parent->left;
+                clear();
+                return end();
             }
-            bool removed_black = y->is_black_;
-            // If we didn't remove z, do so now by splicing in y for z,
-            //    but copy z's color.  This does not impact x or w.
-            if (y != z)
+            if (const_iterator second = first; ++second == last)
+                return erase(first);
+            rb_tree_node_ptr_t first_node = const_cast<base_tree_node_ptr_t>(first.get())->self_downcast_unsafe();
+            if (last_node == &end_node_)
+                last_node_ = tree_prev_iter(static_cast<base_tree_node_ptr_t>(first_node));
+            rb_tree_header_t header(std::exchange(end_node_.left, nullptr), black_height_);
+            auto [left, first_x, right] = rb_tree_split(header, first_node->key(), updator_, comp_);
+            ASSERT(first_x == first_node, "first must be in the tree");
+            destroy_node(first_x);
+            if (last_node == &end_node_)
             {
-                // z->left != nullptr but z->right might == x == nullptr
-                y->parent = z->parent;
-                if (tree_is_left_child(z))
-                    y->parent->left = y;
-                else
-                    y->parent->right = y;
-                y->left = z->left;
-                y->left->parent = y;
-                y->right = z->right;
-                if (y->right != nullptr)
-                    y->right->parent = y;
-                y->is_black_ = z->is_black_;
-                if (root == z)
-                    root = y;
+                destroy_subtree(right.root_);
+                header = left;
             }
-            // There is no need to rebalance if we removed a red, or if we removed
-            //     the last node.
-            if (removed_black && root != nullptr)
+            else
             {
-                // Rebalance:
-                // x has an implicit black color (transferred from the removed y)
-                //    associated with it, no matter what its color is.
-                // If x is root (in which case it can't be null), it is supposed
-                //    to be black anyway, and if it is doubly black, then the double
-                //    can just be ignored.
-                // If x is red (in which case it can't be null), then it can absorb
-                //    the implicit black just by setting its color to black.
-                // Since y was black and only had one child (which x points to), x
-                //   is either red with no children, else null, otherwise y would have
-                //   different black heights under left and right pointers.
-                // if (x == root || x != nullptr && !x->isBlack)
-                if (x != nullptr)
-                    x->is_black_ = true;
-                else
-                {
-                    //  Else x isn't root, and is "doubly black", even though it may
-                    //     be null.  w can not be null here, else the parent would
-                    //     see a black height >= 2 on the x side and a black height
-                    //     of 1 on the w side (w must be a non-null black or a red
-                    //     with a non-null black child).
-                    while (true)
-                    {
-                        if (!tree_is_left_child(w))  // if x is left child
-                        {
-                            if (!w->is_black_)
-                            {
-                                w->is_black_ = true;
-                                parent_unsafe(w)->is_black_ = false;
-                                unguarded_tree_left_rotate(parent_unsafe(w));
-                                // x is still valid
-                                // reset root only if necessary
-                                if (root == w->left)
-                                    root = w;
-                                // reset sibling, and it still can't be null
-                                w = w->left->right;
-                            }
-                            // w->isBlack is now true, w may have null children
-                            if ((w->left == nullptr || w->left->is_black_) && (w->right == nullptr || w->right->is_black_))
-                            {
-                                w->is_black_ = false;
-                                x = parent_unsafe(w);
-                                // x can no longer be null
-                                if (x == root || !x->is_black_)
-                                {
-                                    x->is_black_ = true;
-                                    break;
-                                }
-                                // reset sibling, and it still can't be null
-                                w = tree_is_left_child(x) ? x->parent->right : x->parent->left;
-                                // continue;
-                            }
-                            else  // w has a red child
-                            {
-                                if (w->right == nullptr || w->right->is_black_)
-                                {
-                                    // w left child is non-null and red
-                                    w->left->is_black_ = true;
-                                    w->is_black_ = false;
-                                    unguarded_tree_right_rotate(w);
-                                    // w is known not to be root, so root hasn't changed
-                                    // reset sibling, and it still can't be null
-                                    w = parent_unsafe(w);
-                                }
-                                // w has a right red child, left child may be null
-                                w->is_black_ = parent_unsafe(w)->is_black_;
-                                parent_unsafe(w)->is_black_ = true;
-                                w->right->is_black_ = true;
-                                unguarded_tree_left_rotate(parent_unsafe(w));
-                                break;
-                            }
-                        }
-                        else
-                        {
-                            if (!w->is_black_)
-                            {
-                                w->is_black_ = true;
-                                parent_unsafe(w)->is_black_ = false;
-                                unguarded_tree_right_rotate(parent_unsafe(w));
-                                // x is still valid
-                                // reset root only if necessary
-                                if (root == w->right)
-                                    root = w;
-                                // reset sibling, and it still can't be null
-                                w = w->right->left;
-                            }
-                            // w->isBlack is now true, w may have null children
-                            if ((w->left == nullptr || w->left->is_black_) && (w->right == nullptr || w->right->is_black_))
-                            {
-                                w->is_black_ = false;
-                                x = parent_unsafe(w);
-                                // x can no longer be null
-                                if (!x->is_black_ || x == root)
-                                {
-                                    x->is_black_ = true;
-                                    break;
-                                }
-                                // reset sibling, and it still can't be null
-                                w = tree_is_left_child(x) ? x->parent->right : x->parent->left;
-                                // continue;
-                            }
-                            else  // w has a red child
-                            {
-                                if (w->left == nullptr || w->left->is_black_)
-                                {
-                                    // w right child is non-null and red
-                                    w->right->is_black_ = true;
-                                    w->is_black_ = false;
-                                    unguarded_tree_left_rotate(w);
-                                    // w is known not to be root, so root hasn't changed
-                                    // reset sibling, and it still can't be null
-                                    w = parent_unsafe(w);
-                                }
-                                // w has a left red child, right child may be null
-                                w->is_black_ = parent_unsafe(w)->is_black_;
-                                parent_unsafe(w)->is_black_ = true;
-                                w->left->is_black_ = true;
-                                unguarded_tree_right_rotate(parent_unsafe(w));
-                                break;
-                            }
-                        }
-                    }
-                }
+                auto [middle, last_x, rest] = rb_tree_split(right, last_node->self_downcast_unsafe()->key(), updator_, comp_);
+                ASSERT(last_x == last_node, "last must be in the tree");
+                destroy_subtree(middle.root_);
+                header = rb_tree_join_x(left, last_x, rest, updator_, comp_);
             }
+            end_node_.left = header.root_;
+            if (header.root_ != nullptr)
+                header.root_->parent = &end_node_;
+            black_height_ = header.black_height_;
+            if (begin_node_ == first_node)
+                begin_node_ = last_node;
+            return iterator(last_node);
         }
 
-        template<class key_holder_t, class mapped_holder_t, class metadata_holder_t, class metadata_updator_holder_t, class comparator_holder_t, class tag> friend
+        void clear() noexcept
+        {
+            destroy_subtree(std::exchange(end_node_.left, nullptr));
+            begin_node_ = &end_node_;
+            last_node_ = &end_node_;
+            black_height_ = 1;
+        }
+
+        template<class key_holder_t, class mapped_holder_t, class metadata_holder_t, class metadata_updator_holder_t, class comparator_holder_t, class tag, class allocator_holder_t> friend
         class rb_tree_custom_invoke;
     };
 
+    //ordered set: nodes have no mapped field, elements convert to their key
+    template<class key_t, class metadata_t = no_metadata, class metadata_updator_t = noop_metadata_updator_impl, class comparator_t = std::less<key_t>,
+            class allocator_t = std::allocator<exposure<key_t, no_mapped, metadata_t>>>
+    using rb_set = rb_tree<key_t, no_mapped, metadata_t, metadata_updator_t, comparator_t, allocator_t>;
+
 }
 
 #endif //BBST_RB_TREE_H
@@ -1,22 +1,27 @@
 #ifndef BBST_RB_TREE_CUSTOM_INVOKE_H
 #define BBST_RB_TREE_CUSTOM_INVOKE_H
 
+#include <algorithm>
+#include <limits>
 #include <type_traits>
+#include <utility>
 #include "rb_tree.h"
+#include "tree_set_operation.h"
 #include "tree_custom_invoke.h"
 
 namespace bbst
 {
 
-    template<class key_t, class mapped_t, class metadata_t, class metadata_updator_t, class comparator_t, class tag>
+    template<class key_t, class mapped_t, class metadata_t, class metadata_updator_t, class comparator_t, class tag,
+            class allocator_t = std::allocator<exposure<key_t, mapped_t, metadata_t>>>
     struct rb_tree_custom_invoke {};
 
     struct rb_tree_custom_invoke_default_tag {};
 
-    template<class key_t, class mapped_t, class metadata_t, class metadata_updator_t, class comparator_t>
-    struct rb_tree_custom_invoke<key_t, mapped_t, metadata_t, metadata_updator_t, comparator_t, rb_tree_custom_invoke_default_tag>
+    template<class key_t, class mapped_t, class metadata_t, class metadata_updator_t, class comparator_t, class allocator_t>
+    struct rb_tree_custom_invoke<key_t, mapped_t, metadata_t, metadata_updator_t, comparator_t, rb_tree_custom_invoke_default_tag, allocator_t>
     {
-        using rb_tree_t = rb_tree<key_t, mapped_t, metadata_t, metadata_updator_t, comparator_t>;
+        using rb_tree_t = rb_tree<key_t, mapped_t, metadata_t, metadata_updator_t, comparator_t, allocator_t>;
         using rb_tree_header_t = rb_tree_header<key_t, mapped_t, metadata_t>;
         using rb_tree_node_ptr_t = typename rb_tree_t::rb_tree_node_ptr_t;
 
@@ -24,93 +29,202 @@ namespace bbst
         {
             rb_tree_node_ptr_t root = std::exchange(tree.end_node_.left, nullptr);
             tree.begin_node_ = &tree.end_node_;
+            tree.last_node_ = &tree.end_node_;
             uint32_t black_height = std::exchange(tree.black_height_, 1);
             return {root, black_height};
         };
 
+        //inverse of to_rb_tree_header, tree must be empty
+        static inline void from_rb_tree_header(rb_tree_t &tree, rb_tree_header_t header)
+        {
+            ASSERT(tree.end_node_.left == nullptr, "tree must be empty");
+            tree.end_node_.left = header.root_;
+            if (header.root_ != nullptr)
+                header.root_->parent = &tree.end_node_;
+            tree.begin_node_ = header.root_ == nullptr ? &tree.end_node_ : tree_min(header.root_);
+            tree.last_node_ = header.root_ == nullptr ? &tree.end_node_ : tree_max(header.root_);
+            tree.black_height_ = header.black_height_;
+        }
+
         template<bool equal_on_left_side>
         static std::pair<rb_tree_t, rb_tree_t> split_by_key(rb_tree_t &&tree, const key_t &key)
         {
+            return split_by_key_impl<equal_on_left_side>(std::move(tree), key);
+        }
+
+        //split by anything the transparent comparator orders against the keys
+        template<bool equal_on_left_side, class query_t>
+        requires is_transparent_comparator<comparator_t>
+        static std::pair<rb_tree_t, rb_tree_t> split_by_key(rb_tree_t &&tree, const query_t &key)
+        {
+            return split_by_key_impl<equal_on_left_side>(std::move(tree), key);
+        }
 
+        //split right before pos (pos and everything after it go right) without comparing keys, pos == end() leaves the right side empty
+        static std::pair<rb_tree_t, rb_tree_t> split_at(rb_tree_t &&tree, typename rb_tree_t::const_iterator pos)
+        {
             auto &comparator = tree.comp_;
             auto &metadata_updator = tree.updator_;
+            auto end_node = &tree.end_node_;
+            auto x = const_cast<decltype(end_node)>(pos.get());
+            rb_tree_header_t header = to_rb_tree_header(std::move(tree));
+            ASSERT(rb_tree_header_invariant(header), "pre condition failed");
+            rb_tree_header_t l = header, r = rb_tree_header_t::empty_header();
+            if (x != end_node)
+                std::tie(l, r) = rb_tree_split_at(header, end_node, x, metadata_updator, comparator);
+            ASSERT(rb_tree_header_invariant(l), "post condition failed");
+            ASSERT(rb_tree_header_invariant(r), "post condition failed");
+            return {rb_tree_t(l, metadata_updator, comparator, tree.alloc_), rb_tree_t(r, metadata_updator, comparator, tree.alloc_)};
+        }
 
-            auto split_routine = [&comparator, &metadata_updator](auto self, rb_tree_header_t header
-                                                                  , const key_t &key) -> std::pair<rb_tree_header_t, rb_tree_header_t>
+        /*
+         * Hand the subtree holding exactly the keys in [lo, hi] to f (nullptr if there are none), by splitting around the range
+         * and joining back. With a lazy updator f tags the root (e.g. range_add_sum_metadata_updator::add) and a range update costs O(log n).
+         * f may change values and metadata but not keys.
+         */
+        template<class function_t>
+        static void range_update(rb_tree_t &tree, const key_t &lo, const key_t &hi, function_t &&f)
+        {
+            auto &comparator = tree.comp_;
+            auto &metadata_updator = tree.updator_;
+            rb_tree_header_t header = to_rb_tree_header(std::move(tree));
+            auto [less, less_equal, rest] = rb_tree_split<tree_split_equal::right>(header, lo, metadata_updator, comparator);
+            auto [middle, middle_equal, greater] = rb_tree_split<tree_split_equal::left>(rest, hi, metadata_updator, comparator);
+            f(middle.root_);
+            header = rb_tree_join(less, rb_tree_join(middle, greater, metadata_updator, comparator), metadata_updator, comparator);
+            ASSERT(rb_tree_header_invariant(header), "post condition failed");
+            from_rb_tree_header(tree, header);
+        }
+
+        /*
+         * Aggregate of the keys in [lo, hi] in O(log n), read from the subtree metadata through monoid (see is_aggregate_monoid).
+         * Lazy updators are excluded since metadata below a pending tag is stale, read those through range_update instead.
+         */
+        template<class monoid_t>
+        requires (is_aggregate_monoid<monoid_t, rb_tree_node_ptr_t> && !is_lazy_metadata_updator<metadata_updator_t, rb_tree_node_ptr_t>)
+        static typename monoid_t::value_type range_aggregate(const rb_tree_t &tree, const key_t &lo, const key_t &hi, const monoid_t &monoid = monoid_t())
+        {
+            return tree_range_aggregate<rb_tree_node_ptr_t>(tree.end_node_.left, lo, hi, tree.comp_, monoid);
+        }
+
+        //settle every lazy tag above it, so the value behind it is current. O(log n)
+        static void push_down_path(rb_tree_t &tree, typename rb_tree_t::const_iterator it)
+        requires is_lazy_metadata_updator<metadata_updator_t, rb_tree_node_ptr_t>
+        {
+            if (it != tree.end())
+                tree_push_down_path(tree.updator_, &tree.end_node_, const_cast<rb_tree_node_ptr_t>(it.get()->self_downcast_unsafe()));
+        }
+
+        //settle every lazy tag in the tree (pre-order), plain iteration reads current values afterwards. O(n)
+        static void push_down_all(rb_tree_t &tree)
+        requires is_lazy_metadata_updator<metadata_updator_t, rb_tree_node_ptr_t>
+        {
+            rb_tree_node_ptr_t ptr = tree.end_node_.left;
+            while (ptr != nullptr)
             {
-                if (header.empty())
+                tree.updator_.push_down(ptr);
+                if (ptr->left != nullptr)
                 {
-                    return {rb_tree_header_t::empty_header(), rb_tree_header_t::empty_header()};
+                    ptr = ptr->left;
+                    continue;
                 }
-                if (comparator(key, header.root_->key()))
+                if (ptr->right != nullptr)
                 {
-                    //key < header.root_
-                    bool left_is_black = header.root_->left == nullptr || std::exchange(header.root_->left->is_black_, true);
-                    auto [left_header, right_header] = self(self, rb_tree_header_t(header.root_->left, header.black_height_ - left_is_black), key);
-                    bool right_is_black = header.root_->right == nullptr || std::exchange(header.root_->right->is_black_, true);
-                    return {left_header, bbst::rb_tree_join_x(right_header, header.root_, rb_tree_header_t(header.root_->right,
-                            header.black_height_ - right_is_black), metadata_updator, comparator)};
+                    ptr = ptr->right;
+                    continue;
                 }
-                else
+                //climb to the first left child whose sibling is still unvisited
+                while (true)
                 {
-                    if (comparator(header.root_->key(), key))
+                    if (ptr->parent == &tree.end_node_)
+                        return;
+                    rb_tree_node_ptr_t parent = ptr->parent_unsafe();
+                    if (tree_is_left_child(ptr) && parent->right != nullptr)
                     {
-                        //header.root_ < key
-                        bool right_is_black = header.root_->right == nullptr || std::exchange(header.root_->right->is_black_, true);
-                        auto [left_header, right_header] = self(self, rb_tree_header_t(header.root_->right, header.black_height_ - right_is_black), key);
-                        bool left_is_black = header.root_->left == nullptr || std::exchange(header.root_->left->is_black_, true);
-                        return {bbst::rb_tree_join_x(rb_tree_header_t(header.root_->left, header.black_height_ - left_is_black), header
-                                .root_, left_header, metadata_updator, comparator), right_header};
-                    }
-                    else
-                    {
-                        //==
-                        bool left_is_black = header.root_->left == nullptr || std::exchange(header.root_->left->is_black_, true);
-                        bool right_is_black = header.root_->right == nullptr || std::exchange(header.root_->right->is_black_, true);
-                        rb_tree_node_ptr_t left = header.root_->left;
-                        rb_tree_node_ptr_t right = header.root_->right;
-                        if constexpr(equal_on_left_side)
-                        {
-                            return {bbst::rb_tree_join_x(rb_tree_header_t(left, header.black_height_ - left_is_black), header
-                                    .root_, rb_tree_header_t::empty_header(), metadata_updator, comparator),
-                                    rb_tree_header_t(right, header.black_height_ - right_is_black)};
-                        }
-                        else
-                        {
-                            return {rb_tree_header_t(left, header.black_height_ - left_is_black),
-                                    bbst::rb_tree_join_x(rb_tree_header_t::empty_header(), header.root_, rb_tree_header_t(right,
-                                            header.black_height_ - right_is_black), metadata_updator, comparator)};
-                        }
+                        ptr = parent->right;
+                        break;
                     }
+                    ptr = parent;
                 }
-            };
-            auto [l, r] = split_routine(split_routine, to_rb_tree_header(std::move(tree)), key);
+            }
+        }
+
+        /*
+         * Join based set operations, both trees are consumed and must share the allocator.
+         * With policy.pool set, subproblems of at least policy.grain elements are forked onto the pool.
+         * Allocators that are not always equal (node_pool_allocator) aren't safe to share between threads, those always run sequentially.
+         */
+        static rb_tree_t union_(rb_tree_t &&lhs, rb_tree_t &&rhs, const parallel_policy &policy = {})
+        {
+            return set_operation(std::move(lhs), std::move(rhs), policy, [](auto &op, rb_tree_header_t a, rb_tree_header_t b) { return op.union_(a, b); });
+        }
+
+        static rb_tree_t intersection(rb_tree_t &&lhs, rb_tree_t &&rhs, const parallel_policy &policy = {})
+        {
+            return set_operation(std::move(lhs), std::move(rhs), policy, [](auto &op, rb_tree_header_t a, rb_tree_header_t b) { return op.intersection(a, b); });
+        }
+
+        static rb_tree_t difference(rb_tree_t &&lhs, rb_tree_t &&rhs, const parallel_policy &policy = {})
+        {
+            return set_operation(std::move(lhs), std::move(rhs), policy, [](auto &op, rb_tree_header_t a, rb_tree_header_t b) { return op.difference(a, b); });
+        }
+
+    private:
+        template<bool equal_on_left_side, class query_t>
+        static std::pair<rb_tree_t, rb_tree_t> split_by_key_impl(rb_tree_t &&tree, const query_t &key)
+        {
+            auto &comparator = tree.comp_;
+            auto &metadata_updator = tree.updator_;
+            rb_tree_header_t header = to_rb_tree_header(std::move(tree));
+            ASSERT(rb_tree_header_invariant(header), "pre condition failed");
+            constexpr auto equal_policy = equal_on_left_side ? tree_split_equal::left : tree_split_equal::right;
+            auto [l, equal, r] = rb_tree_split<equal_policy>(header, key, metadata_updator, comparator);
             ASSERT(rb_tree_header_invariant(l), "post condition failed");
             ASSERT(rb_tree_header_invariant(r), "post condition failed");
-            return {rb_tree_t(l, metadata_updator, comparator), rb_tree_t(r, metadata_updator, comparator)};
+            return {rb_tree_t(l, metadata_updator, comparator, tree.alloc_), rb_tree_t(r, metadata_updator, comparator, tree.alloc_)};
+        }
+
+        template<class operation_t>
+        static rb_tree_t set_operation(rb_tree_t &&lhs, rb_tree_t &&rhs, parallel_policy policy, operation_t operation)
+        {
+            ASSERT(lhs.alloc_ == rhs.alloc_, "set operation on trees with different allocators");
+            using node_allocator_traits = typename rb_tree_t::node_allocator_traits;
+            if constexpr(!node_allocator_traits::is_always_equal::value)
+                policy.pool = nullptr;
+            auto &alloc = lhs.alloc_;
+            auto destroy = [&alloc](rb_tree_node_ptr_t root)
+            {
+                tree_destroy(root, [&alloc](rb_tree_node_ptr_t ptr) { tree_destroy_node(alloc, ptr); });
+            };
+            tree_set_operation<rb_tree_header_ops, rb_tree_header_t, metadata_updator_t, comparator_t, decltype(destroy)> op(lhs.updator_, lhs.comp_, destroy, policy);
+            rb_tree_header_t result = operation(op, to_rb_tree_header(std::move(lhs)), to_rb_tree_header(std::move(rhs)));
+            ASSERT(rb_tree_header_invariant(result), "post condition failed");
+            return rb_tree_t(result, lhs.updator_, lhs.comp_, alloc);
         }
     };
 
     struct rb_tree_custom_invoke_order_statistic_tag {};
 
-    template<class key_t, class mapped_t, class metadata_t, class metadata_updator_t, class comparator_t>
+    template<class key_t, class mapped_t, class metadata_t, class metadata_updator_t, class comparator_t, class allocator_t>
     requires (std::is_integral_v<metadata_t> &&
               bbst::is_order_statistic_metadata_updator<metadata_updator_t, bbst::rb_tree_node<bbst::exposure<key_t, mapped_t, metadata_t>> *>)
-    struct rb_tree_custom_invoke<key_t, mapped_t, metadata_t, metadata_updator_t, comparator_t, rb_tree_custom_invoke_order_statistic_tag>
+    struct rb_tree_custom_invoke<key_t, mapped_t, metadata_t, metadata_updator_t, comparator_t, rb_tree_custom_invoke_order_statistic_tag, allocator_t>
     {
-        using rb_tree_t = rb_tree<key_t, mapped_t, metadata_t, metadata_updator_t, comparator_t>;
+        using rb_tree_t = rb_tree<key_t, mapped_t, metadata_t, metadata_updator_t, comparator_t, allocator_t>;
+        using rb_tree_header_t = rb_tree_header<key_t, mapped_t, metadata_t>;
         using rb_tree_node_ptr_t = typename rb_tree_t::rb_tree_node_ptr_t;
+        using default_invoker = rb_tree_custom_invoke<key_t, mapped_t, metadata_t, metadata_updator_t, comparator_t, rb_tree_custom_invoke_default_tag, allocator_t>;
         using iterator = typename rb_tree_t::iterator;
         using const_iterator = typename rb_tree_t::const_iterator;
 
         static const_iterator find_by_order(const rb_tree_t &tree, size_t index)
         {
             rb_tree_node_ptr_t node = tree.end_node_.left;
-            if (node == nullptr || metadata_updator_t::get_order_metadata(node) <= index)
+            if (node == nullptr || size_t(metadata_updator_t::get_order_metadata(node)) <= index)
                 return tree.end();
             while (true)
             {
-                auto left_count = metadata_updator_t::get_order_metadata(node->left);
+                auto left_count = size_t(metadata_updator_t::get_order_metadata(node->left));
                 if (left_count == index)
                     return const_iterator(node);
                 else if (left_count > index)
@@ -126,24 +240,7 @@ namespace bbst
 
         static iterator find_by_order(rb_tree_t &tree, size_t index)
         {
-            rb_tree_node_ptr_t node = tree.end_node_.left;
-            if (node == nullptr || metadata_updator_t::get_order_metadata(node) <= index)
-                return tree.end();
-            while (true)
-            {
-                auto left_count = metadata_updator_t::get_order_metadata(node->left);
-                if (left_count == index)
-                    return iterator(node);
-                else if (left_count > index)
-                    node = node->left;
-                else
-                {
-                    node = node->right;
-                    index -= left_count + 1;//minus node
-                }
-            }
-            //std::unreachable();//C++23 macro
-            ASSERT(false, "unreachable");
+            return rb_tree_t::mutable_iterator(find_by_order(std::as_const(tree), index));
         }
 
         static size_t size(const rb_tree_t &tree)
@@ -152,17 +249,52 @@ namespace bbst
         }
 
         static size_t order_of_key(const rb_tree_t &tree, const key_t &key)
+        {
+            return order_of_key_impl(tree, key);
+        }
+
+        template<class query_t>
+        requires is_transparent_comparator<comparator_t>
+        static size_t order_of_key(const rb_tree_t &tree, const query_t &key)
+        {
+            return order_of_key_impl(tree, key);
+        }
+
+        /*
+         * Split by rank: the first index elements go to the left tree, the rest to the right one.
+         * O(log n), same shape as split_by_key but steering with the subtree sizes. Iterative, see tree_split_by_order.
+         */
+        static std::pair<rb_tree_t, rb_tree_t> split_by_order(rb_tree_t &&tree, size_t index)
+        {
+            auto &comparator = tree.comp_;
+            auto &metadata_updator = tree.updator_;
+            auto [l, r] = tree_split_by_order<metadata_updator_t>(default_invoker::to_rb_tree_header(std::move(tree)), index
+                                                                  , [&metadata_updator](auto h) { return rb_tree_expose(h, metadata_updator); }
+                                                                  , [&metadata_updator, &comparator](auto left, auto x, auto right)
+                                                                  {
+                                                                      return rb_tree_join_x(left, x, right, metadata_updator, comparator);
+                                                                  });
+            ASSERT(rb_tree_header_invariant(l), "post condition failed");
+            ASSERT(rb_tree_header_invariant(r), "post condition failed");
+            return {rb_tree_t(l, metadata_updator, comparator, tree.alloc_), rb_tree_t(r, metadata_updator, comparator, tree.alloc_)};
+        }
+
+    private:
+        template<class query_t>
+        static size_t order_of_key_impl(const rb_tree_t &tree, const query_t &key)
         {
             size_t less_than = 0;
             rb_tree_node_ptr_t ptr = tree.end_node_.left;
-            auto& comparator = tree.comp_;
-            while(ptr!= nullptr){
-                if(comparator(ptr->key(),key)){
-                    less_than += metadata_updator_t::get_order_metadata(ptr->left)+1;
-                    ptr=ptr->right;
-                } else {
-                    ptr = ptr->left;
+            auto &comparator = tree.comp_;
+            while (ptr != nullptr)
+            {
+                if (tree_less(comparator, ptr->key(), key))
+                {
+                    less_than += size_t(metadata_updator_t::get_order_metadata(ptr->left)) + 1;
+                    ptr = ptr->right;
                 }
+                else
+                    ptr = ptr->left;
             }
             return less_than;
         }
@@ -196,12 +328,13 @@ namespace bbst
         template<class rb_tree_node_ptr_t>
         void operator()(rb_tree_node_ptr_t ptr) const
         requires (is_pair_integral_v < typename std::remove_pointer_t<rb_tree_node_ptr_t>::metadata_type > &&
-                  is_pair_integral_v < typename std::remove_pointer_t<rb_tree_node_ptr_t>::key_type > &&
+                  is_pair_integral_v < std::remove_cv_t<typename std::remove_pointer_t<rb_tree_node_ptr_t>::key_type> > &&
                   std::is_same_v<typename std::remove_pointer_t<rb_tree_node_ptr_t>::metadata_type::first_type, typename std::remove_pointer_t<rb_tree_node_ptr_t>::key_type::first_type>)
         {
             auto left = interval_metadata_updator::get(ptr->left);
             auto right = interval_metadata_updator::get(ptr->right);
-            ptr->metadata() = std::min(left.first, ptr->key().first), std::max(right.second, ptr->key().second);
+            //keys are ordered by low end, but the highest high end can sit anywhere in the subtree
+            ptr->metadata() = {std::min(left.first, ptr->key().first), std::max({left.second, right.second, ptr->key().second})};
         }
     };
 
@@ -209,6 +342,72 @@ namespace bbst
     {
     };
 
+    /*
+     * Interval tree: keys are closed intervals {low, high}, the metadata keeps the lowest low and the highest high end of the subtree
+     * so whole subtrees that can't overlap a query get skipped.
+     */
+    template<class key_t, class mapped_t, class metadata_t, class comparator_t, class allocator_t>
+    requires (is_pair_integral_v<key_t> && std::is_same_v<key_t, metadata_t>)
+    struct rb_tree_custom_invoke<key_t, mapped_t, metadata_t, interval_metadata_updator, comparator_t, rb_tree_custom_invoke_interval_tag, allocator_t>
+    {
+        using rb_tree_t = rb_tree<key_t, mapped_t, metadata_t, interval_metadata_updator, comparator_t, allocator_t>;
+        using rb_tree_node_ptr_t = typename rb_tree_t::rb_tree_node_ptr_t;
+        using const_iterator = typename rb_tree_t::const_iterator;
+
+    private:
+        static inline bool overlap(const key_t &lhs, const key_t &rhs)
+        {
+            return lhs.first <= rhs.second && rhs.first <= lhs.second;
+        }
+
+    public:
+        /*
+         * Call f(const_iterator) on every interval overlapping query, in key order.
+         * Only subtrees reaching into query are entered, O((k + 1) log n) for k reported intervals, not O(log n + k):
+         * keyed by low end, a subtree whose highest high end reaches query can still hold non-overlapping intervals (ending too early)
+         * around each hit, up to one path of them per hit. O(log n + k) needs a structure ordered by both ends (priority search tree).
+         */
+        template<class function_t>
+        static void overlap_query(const rb_tree_t &tree, const key_t &query, function_t &&f)
+        {
+            auto query_routine = [&query, &f](auto self, rb_tree_node_ptr_t ptr) -> void
+            {
+                if (ptr == nullptr || !overlap(ptr->metadata(), query))
+                    return;
+                self(self, ptr->left);
+                if (overlap(ptr->key(), query))
+                    f(const_iterator(ptr));
+                if (ptr->key().first <= query.second)
+                    self(self, ptr->right);
+            };
+            query_routine(query_routine, tree.end_node_.left);
+        }
+
+        //call f(const_iterator) on every interval containing point, in key order
+        template<class function_t>
+        static void stabbing_query(const rb_tree_t &tree, const typename key_t::first_type &point, function_t &&f)
+        {
+            overlap_query(tree, key_t{point, point}, std::forward<function_t>(f));
+        }
+
+        /*
+         * Some interval overlapping query, end() if there is none. O(log n), a single descent:
+         * if the left subtree reaches query.first but holds no overlap, then nothing to the right starts early enough either.
+         */
+        static const_iterator any_overlap(const rb_tree_t &tree, const key_t &query)
+        {
+            rb_tree_node_ptr_t ptr = tree.end_node_.left;
+            while (ptr != nullptr && !overlap(ptr->key(), query))
+            {
+                if (ptr->left != nullptr && query.first <= ptr->left->metadata().second)
+                    ptr = ptr->left;
+                else
+                    ptr = ptr->right;
+            }
+            return ptr == nullptr ? tree.end() : const_iterator(ptr);
+        }
+    };
+
     struct sum_metadata_updator
     {
         template<class rb_tree_node_ptr_t>
@@ -221,6 +420,21 @@ namespace bbst
             };
             ptr->metadata() = ptr->key() + get(ptr->left) + get(ptr->right);
         }
+
+        //bplus_tree: a node sums the keys of its slots or the sums of its children
+        template<class metadata_t, class key_t, class mapped_t>
+        requires(std::is_arithmetic_v<metadata_t>)
+        void fold_entry(metadata_t &metadata, const key_t &key, const mapped_t &) const
+        {
+            metadata += key;
+        }
+
+        template<class metadata_t>
+        requires(std::is_arithmetic_v<metadata_t>)
+        void fold_child(metadata_t &metadata, const metadata_t &child) const
+        {
+            metadata += child;
+        }
     };
 }
 #endif //BBST_RB_TREE_CUSTOM_INVOKE_H
@@ -0,0 +1,104 @@
+#ifndef BBST_SIMD_KEY_SEARCH_H
+#define BBST_SIMD_KEY_SEARCH_H
+
+#include <bit>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <type_traits>
+#if defined(__AVX2__) || defined(__SSE4_2__)
+#include <immintrin.h>
+#endif
+#include "tree_utils.h"
+
+namespace bbst
+{
+    enum class key_search_path
+    {
+        scalar,
+        sse4_2,
+        avx2
+    };
+
+    //widest instruction set this translation unit is compiled for (-msse4.2, -mavx2, -march=native)
+    inline constexpr key_search_path native_key_search_path =
+#if defined(__AVX2__)
+            key_search_path::avx2;
+#elif defined(__SSE4_2__)
+            key_search_path::sse4_2;
+#else
+            key_search_path::scalar;
+#endif
+
+    constexpr const char *key_search_path_name(key_search_path path) noexcept
+    {
+        switch (path)
+        {
+            case key_search_path::avx2:
+                return "avx2";
+            case key_search_path::sse4_2:
+                return "sse4.2";
+            default:
+                return "scalar";
+        }
+    }
+
+    //32 or 64 bit integers looked up by themselves under std::less, whose order is the order of their values
+    template<class key_t, class comparator_t, class query_t = key_t> concept is_simd_searchable_key =
+    std::is_integral_v<key_t> && !std::is_same_v<key_t, bool> && (sizeof(key_t) == 4 || sizeof(key_t) == 8) &&
+    std::is_same_v<std::remove_cvref_t<query_t>, key_t> && (std::is_same_v<comparator_t, std::less<key_t>> || std::is_same_v<comparator_t, std::less<>>);
+
+    //path simd_count_less takes for key_t/comparator_t in this translation unit
+    template<class key_t, class comparator_t>
+    inline constexpr key_search_path key_search_path_for = is_simd_searchable_key<key_t, comparator_t> ? native_key_search_path : key_search_path::scalar;
+
+    /*
+     * Number of keys in [keys, keys + n) before key (or_equal: not after key), the partition point of a sorted array.
+     * Whole vectors are compared at once and their masks counted, with no branch on the outcome; the last n % width keys go through scalar code.
+     * Vector compares are signed, unsigned keys have their sign bit flipped on both sides.
+     */
+    template<bool or_equal, class key_t>
+    requires (std::is_integral_v<key_t> && (sizeof(key_t) == 4 || sizeof(key_t) == 8))
+    inline uint32_t simd_count_less(const key_t *keys, uint32_t n, key_t key) noexcept
+    {
+        uint32_t i = 0, count = 0;
+#if defined(__AVX2__) || defined(__SSE4_2__)
+        constexpr bool wide = sizeof(key_t) == 8;
+        typedef std::conditional_t<wide, int64_t, int32_t> lane_t;
+        constexpr lane_t bias = std::is_signed_v<key_t> ? 0 : std::numeric_limits<lane_t>::min();
+        auto lane = [](key_t k) { return lane_t(k) ^ bias; };
+#if defined(__AVX2__)
+        constexpr uint32_t width = 32 / sizeof(key_t);
+        __m256i needle = wide ? _mm256_set1_epi64x(lane(key)) : _mm256_set1_epi32(int32_t(lane(key)));
+        __m256i flip = wide ? _mm256_set1_epi64x(bias) : _mm256_set1_epi32(int32_t(bias));
+        for (; i + width <= n; i += width)
+        {
+            __m256i v = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(keys + i)), flip);
+            //or_equal counts the keys after key and takes the rest
+            __m256i after_or_before = wide ? (or_equal ? _mm256_cmpgt_epi64(v, needle) : _mm256_cmpgt_epi64(needle, v))
+                                           : (or_equal ? _mm256_cmpgt_epi32(v, needle) : _mm256_cmpgt_epi32(needle, v));
+            uint32_t mask = wide ? uint32_t(_mm256_movemask_pd(_mm256_castsi256_pd(after_or_before)))
+                                 : uint32_t(_mm256_movemask_ps(_mm256_castsi256_ps(after_or_before)));
+            count += or_equal ? width - uint32_t(std::popcount(mask)) : uint32_t(std::popcount(mask));
+        }
+#else
+        constexpr uint32_t width = 16 / sizeof(key_t);
+        __m128i needle = wide ? _mm_set1_epi64x(lane(key)) : _mm_set1_epi32(int32_t(lane(key)));
+        __m128i flip = wide ? _mm_set1_epi64x(bias) : _mm_set1_epi32(int32_t(bias));
+        for (; i + width <= n; i += width)
+        {
+            __m128i v = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(keys + i)), flip);
+            __m128i after_or_before = wide ? (or_equal ? _mm_cmpgt_epi64(v, needle) : _mm_cmpgt_epi64(needle, v))
+                                           : (or_equal ? _mm_cmpgt_epi32(v, needle) : _mm_cmpgt_epi32(needle, v));
+            uint32_t mask = wide ? uint32_t(_mm_movemask_pd(_mm_castsi128_pd(after_or_before)))
+                                 : uint32_t(_mm_movemask_ps(_mm_castsi128_ps(after_or_before)));
+            count += or_equal ? width - uint32_t(std::popcount(mask)) : uint32_t(std::popcount(mask));
+        }
+#endif
+#endif
+        for (; i < n; i++)
+            count += or_equal ? !(key < keys[i]) : keys[i] < key;
+        return count;
+    }
+}
+#endif //BBST_SIMD_KEY_SEARCH_H
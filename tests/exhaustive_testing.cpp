@@ -2,10 +2,32 @@
 #include "../avl_tree.h"
 #include "../rb_tree_custom_invoke.h"
 #include "../avl_tree_custom_invoke.h"
+#include "../treap.h"
+#include "../treap_custom_invoke.h"
+#include "../node_pool.h"
+#include "../persistent_avl_tree.h"
+#include "../tree_serialization.h"
+#include "../bplus_tree.h"
+#include "../bplus_tree_custom_invoke.h"
 
 #include <gtest/gtest.h>
+#include <algorithm>
 #include <numeric>
+#include <random>
+#include <ranges>
+#include <map>
+#include <set>
+#include <stdexcept>
 #include <array>
+#include <bit>
+#include <cstdio>
+#include <filesystem>
+#include <iostream>
+#include <iterator>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <vector>
 
 TEST(ExhaustiveTest, rb_tree)
 {
@@ -37,6 +59,1767 @@ TEST(ExhaustiveTest, avl_tree)
     } while (std::next_permutation(s.begin(), s.end()));
 }
 
+TEST(ExhaustiveTest, treap)
+{
+    constexpr int mx = 9;
+    std::array<int, mx> s{};
+    std::iota(s.begin(), s.end(), 0);
+    using treap_t = bbst::treap<int, int, int, bbst::noop_metadata_updator_impl>;
+    using treap_invoker = bbst::treap_custom_invoke<int, int, int, bbst::noop_metadata_updator_impl, std::less<int>, bbst::treap_custom_invoke_default_tag>;
+    do
+    {
+        treap_t treap;
+        for (int i: s) treap.try_emplace(i);
+        int i = 0;
+        for (auto p: treap) EXPECT_EQ(p.key, i++);
+        EXPECT_EQ(i, mx);
+        auto header = treap_invoker::to_treap_header(std::move(treap));
+        EXPECT_TRUE(bbst::treap_header_invariant(header));
+        treap_invoker::from_treap_header(treap, header);
+    } while (std::next_permutation(s.begin(), s.end()));
+}
+
+TEST(ExhaustiveTest, tree_teardown)
+{
+    //non trivial payload goes through destroy, trivial payload on an exclusive pool is released wholesale
+    constexpr int mx = 7;
+    std::array<int, mx> s{};
+    std::iota(s.begin(), s.end(), 0);
+    using pool_t = bbst::node_pool_allocator<bbst::exposure<int, int, int>>;
+    do
+    {
+        bbst::rb_tree<std::string, std::string, int, bbst::noop_metadata_updator_impl> rb;
+        bbst::avl_tree<std::string, std::string, int, bbst::noop_metadata_updator_impl> avl;
+        bbst::rb_tree<int, int, int, bbst::noop_metadata_updator_impl, std::less<int>, pool_t> rb_pool;
+        bbst::avl_tree<int, int, int, bbst::noop_metadata_updator_impl, std::less<int>, pool_t> avl_pool;
+        for (int i: s)
+        {
+            rb.try_emplace(std::string(32, char('a' + i)));
+            avl.try_emplace(std::string(32, char('a' + i)));
+            rb_pool.try_emplace(i);
+            avl_pool.try_emplace(i);
+        }
+        EXPECT_EQ(rb.begin()->key, std::string(32, 'a'));
+        EXPECT_EQ(avl.begin()->key, std::string(32, 'a'));
+    } while (std::next_permutation(s.begin(), s.end()));
+
+    //pool laid out for small nodes, then owned alone by a tree whose nodes only fit the ::operator new fallback
+    using wide_key = std::array<long long, 8>;
+    using wide_pool_t = bbst::node_pool_allocator<bbst::exposure<wide_key, int, int>>;
+    auto resource = std::make_shared<bbst::node_pool_resource>();
+    {
+        bbst::rb_tree<int, int, int, bbst::noop_metadata_updator_impl, std::less<int>, pool_t> rb_pool(
+                bbst::noop_metadata_updator_impl{}, std::less<int>{}, pool_t(resource));
+        for (int i = 0; i < mx; i++) rb_pool.try_emplace(i);
+    }
+    {
+        bbst::avl_tree<wide_key, int, int, bbst::noop_metadata_updator_impl, std::less<wide_key>, wide_pool_t> avl_wide(
+                bbst::noop_metadata_updator_impl{}, std::less<wide_key>{}, wide_pool_t(std::exchange(resource, nullptr)));
+        for (long long i = 0; i < mx; i++) avl_wide.try_emplace(wide_key{i});
+        EXPECT_EQ(avl_wide.get_allocator().resource()->oversized_block_count(), size_t(mx));
+    }
+}
+
+TEST(ExhaustiveTest, sorted_build)
+{
+    //debug build: split/insert assert the header invariants of the built tree on the way down
+    constexpr int mx = 130;
+    using rb_t = bbst::rb_tree<int, int, int, bbst::order_statistic_metadata_updator_impl>;
+    using avl_t = bbst::avl_tree<int, int, int, bbst::order_statistic_metadata_updator_impl>;
+    using rb_order_statistic_invoker = bbst::rb_tree_custom_invoke<int, int, int, bbst::order_statistic_metadata_updator_impl, std::less<int>, bbst::rb_tree_custom_invoke_order_statistic_tag>;
+    using rb_default_invoker = bbst::rb_tree_custom_invoke<int, int, int, bbst::order_statistic_metadata_updator_impl, std::less<int>, bbst::rb_tree_custom_invoke_default_tag>;
+    using avl_default_invoker = bbst::avl_tree_custom_invoke<int, int, int, bbst::order_statistic_metadata_updator_impl, std::less<int>, bbst::avl_tree_custom_invoke_default_tag>;
+    for (int n = 0; n < mx; n++)
+    {
+        std::vector<std::pair<int, int>> s;
+        for (int i = 0; i < n; i++) s.emplace_back(2 * i, i);
+        for (int split = -1; split <= 2 * n; split += 3)
+        {
+            rb_t rb(bbst::sorted_unique, s.begin(), s.end());
+            EXPECT_EQ(rb_order_statistic_invoker::size(rb), n);
+            int i = 0;
+            for (auto p: rb)
+            {
+                EXPECT_EQ(p.key, 2 * i);
+                EXPECT_EQ(p.mapped, i++);
+            }
+            EXPECT_EQ(i, n);
+            auto [rl, rr] = rb_default_invoker::split_by_key<false>(std::move(rb), split);
+            rl.try_emplace(-1);
+            rr.try_emplace(2 * n);
+
+            avl_t avl(bbst::sorted_unique, s.begin(), s.end());
+            auto [al, ar] = avl_default_invoker::split_by_key<true>(std::move(avl), split);
+            al.try_emplace(-1);
+            ar.try_emplace(2 * n);
+        }
+    }
+}
+
+TEST(ExhaustiveTest, sorted_build_equivalent)
+{
+    std::vector<int> s{0, 0, 1, 2, 2, 2, 5, 7, 7};
+    bbst::rb_tree<int, int, int, bbst::noop_metadata_updator_impl> rb(bbst::sorted_equivalent, s.begin(), s.end());
+    bbst::avl_tree<int, int, int, bbst::noop_metadata_updator_impl> avl(bbst::sorted_equivalent, s.begin(), s.end());
+    std::vector<int> expect{0, 1, 2, 5, 7}, rb_keys, avl_keys;
+    for (auto p: rb) rb_keys.push_back(p.key);
+    for (auto p: avl) avl_keys.push_back(p.key);
+    EXPECT_EQ(rb_keys, expect);
+    EXPECT_EQ(avl_keys, expect);
+}
+
+TEST(ExhaustiveTest, rb_tree_erase)
+{
+    //debug build: every erase asserts the red black invariant and the tracked black height
+    constexpr int mx = 8;
+    std::array<int, mx> s{};
+    std::iota(s.begin(), s.end(), 0);
+    using rb_t = bbst::rb_tree<int, int, int, bbst::order_statistic_metadata_updator_impl>;
+    using rb_order_statistic_invoker = bbst::rb_tree_custom_invoke<int, int, int, bbst::order_statistic_metadata_updator_impl, std::less<int>, bbst::rb_tree_custom_invoke_order_statistic_tag>;
+    do
+    {
+        for (int built = 0; built < 2; built++)
+        {
+            std::array<int, mx> keys{};
+            std::iota(keys.begin(), keys.end(), 0);
+            rb_t rb = built ? rb_t(bbst::sorted_unique, keys.begin(), keys.end()) : rb_t();
+            if (!built) for (int i: s) rb.try_emplace(i);
+            std::vector<int> alive(keys.begin(), keys.end());
+            for (int i: s)
+            {
+                EXPECT_EQ(rb.erase(i), 1);
+                EXPECT_EQ(rb.erase(i), 0);
+                alive.erase(std::find(alive.begin(), alive.end(), i));
+                EXPECT_EQ(rb_order_statistic_invoker::size(rb), alive.size());
+                for (size_t j = 0; j < alive.size(); j++) EXPECT_EQ(rb_order_statistic_invoker::find_by_order(rb, j)->key, alive[j]);
+                if (!alive.empty())
+                {
+                    EXPECT_EQ(rb.begin()->key, alive.front());
+                }
+            }
+            EXPECT_TRUE(rb.empty());
+        }
+    } while (std::next_permutation(s.begin(), s.end()));
+}
+
+TEST(ExhaustiveTest, avl_tree_erase)
+{
+    //debug build: every erase asserts the avl invariant and the tracked height
+    constexpr int mx = 8;
+    std::array<int, mx> s{};
+    std::iota(s.begin(), s.end(), 0);
+    using avl_t = bbst::avl_tree<int, int, int, bbst::noop_metadata_updator_impl>;
+    do
+    {
+        for (int built = 0; built < 2; built++)
+        {
+            std::array<int, mx> keys{};
+            std::iota(keys.begin(), keys.end(), 0);
+            avl_t avl = built ? avl_t(bbst::sorted_unique, keys.begin(), keys.end()) : avl_t();
+            if (!built) for (int i: s) avl.try_emplace(i);
+            std::vector<int> alive(keys.begin(), keys.end());
+            for (int i: s)
+            {
+                auto next = avl.erase(avl.find(i));
+                alive.erase(std::find(alive.begin(), alive.end(), i));
+                auto expect_next = std::upper_bound(alive.begin(), alive.end(), i);
+                if (expect_next == alive.end()) EXPECT_EQ(next, avl.end());
+                else EXPECT_EQ(next->key, *expect_next);
+                std::vector<int> keys_left;
+                for (auto p: avl) keys_left.push_back(p.key);
+                EXPECT_EQ(keys_left, alive);
+            }
+            EXPECT_TRUE(avl.empty());
+        }
+    } while (std::next_permutation(s.begin(), s.end()));
+}
+
+TEST(ExhaustiveTest, treap_erase)
+{
+    //debug build: every erase asserts the heap order of the priorities
+    constexpr int mx = 8;
+    std::array<int, mx> s{};
+    std::iota(s.begin(), s.end(), 0);
+    using treap_t = bbst::treap<int, int, int, bbst::order_statistic_metadata_updator_impl>;
+    using treap_order_statistic_invoker = bbst::treap_custom_invoke<int, int, int, bbst::order_statistic_metadata_updator_impl, std::less<int>, bbst::treap_custom_invoke_order_statistic_tag>;
+    do
+    {
+        for (int built = 0; built < 2; built++)
+        {
+            std::array<int, mx> keys{};
+            std::iota(keys.begin(), keys.end(), 0);
+            treap_t treap = built ? treap_t(bbst::sorted_unique, keys.begin(), keys.end()) : treap_t();
+            if (!built) for (int i: s) treap.try_emplace(i);
+            std::vector<int> alive(keys.begin(), keys.end());
+            for (int i: s)
+            {
+                auto next = treap.erase(treap.find(i));
+                alive.erase(std::find(alive.begin(), alive.end(), i));
+                auto expect_next = std::upper_bound(alive.begin(), alive.end(), i);
+                if (expect_next == alive.end()) EXPECT_EQ(next, treap.end());
+                else EXPECT_EQ(next->key, *expect_next);
+                EXPECT_EQ(treap_order_statistic_invoker::size(treap), alive.size());
+                for (size_t j = 0; j < alive.size(); j++) EXPECT_EQ(treap_order_statistic_invoker::find_by_order(treap, j)->key, alive[j]);
+                if (!alive.empty())
+                {
+                    EXPECT_EQ(treap.begin()->key, alive.front());
+                }
+            }
+            EXPECT_TRUE(treap.empty());
+        }
+    } while (std::next_permutation(s.begin(), s.end()));
+}
+
+TEST(ExhaustiveTest, treap_split_join)
+{
+    //debug build: join_x asserts the heap order of its inputs and its result
+    constexpr int mx = 40;
+    using updator_t = bbst::order_statistic_metadata_updator_impl;
+    using treap_t = bbst::treap<int, int, int, updator_t>;
+    using treap_invoker = bbst::treap_custom_invoke<int, int, int, updator_t, std::less<int>, bbst::treap_custom_invoke_default_tag>;
+    using treap_order_statistic_invoker = bbst::treap_custom_invoke<int, int, int, updator_t, std::less<int>, bbst::treap_custom_invoke_order_statistic_tag>;
+    auto check = [](treap_t &tree, int first, int last)
+    {
+        EXPECT_EQ(treap_order_statistic_invoker::size(tree), size_t(last - first));
+        int i = first;
+        for (auto p: tree) EXPECT_EQ(p.key, i++);
+        EXPECT_EQ(i, last);
+        for (int j = first; j < last; j++) EXPECT_EQ(treap_order_statistic_invoker::find_by_order(tree, j - first)->key, j);
+        auto header = treap_invoker::to_treap_header(std::move(tree));
+        EXPECT_TRUE(bbst::treap_header_invariant(header));
+        treap_invoker::from_treap_header(tree, header);
+    };
+    for (int n = 0; n <= mx; n++)
+    {
+        std::vector<int> keys(n);
+        std::iota(keys.begin(), keys.end(), 0);
+        for (int key = -1; key <= n; key++)
+        {
+            auto [l, r] = treap_invoker::split_by_key<true>(treap_t(bbst::sorted_unique, keys.begin(), keys.end()), key);
+            check(l, 0, std::clamp(key + 1, 0, n));
+            check(r, std::clamp(key + 1, 0, n), n);
+            auto [ol, or_] = treap_order_statistic_invoker::split_by_order(treap_t(bbst::sorted_unique, keys.begin(), keys.end()), std::max(key, 0));
+            check(ol, 0, std::clamp(key, 0, n));
+            check(or_, std::clamp(key, 0, n), n);
+            //the node equal to key comes back detached, the rest joins back around it
+            treap_t tree(bbst::sorted_unique, keys.begin(), keys.end());
+            auto [left, x, right] = bbst::treap_split(treap_invoker::to_treap_header(std::move(tree)), key, updator_t(), std::less<int>());
+            EXPECT_EQ(x != nullptr, 0 <= key && key < n);
+            auto joined = x != nullptr ? bbst::treap_join_x(left, x, right, updator_t(), std::less<int>())
+                                       : bbst::treap_join(left, right, updator_t(), std::less<int>());
+            treap_invoker::from_treap_header(tree, joined);
+            check(tree, 0, n);
+            //erase a range, then keep using the tree
+            if (key >= 0)
+            {
+                std::set<int> expect(keys.begin(), keys.end());
+                for (int k = key / 2; k < key; k++) expect.erase(k);
+                tree.erase(tree.lower_bound(key / 2), tree.lower_bound(key));
+                EXPECT_EQ(treap_order_statistic_invoker::size(tree), expect.size());
+                tree.try_emplace(key / 2);
+                expect.insert(key / 2);
+                EXPECT_EQ(treap_order_statistic_invoker::size(tree), expect.size());
+            }
+        }
+    }
+}
+
+TEST(ExhaustiveTest, erase_range)
+{
+    constexpr int mx = 40;
+    using rb_t = bbst::rb_tree<int, int, int, bbst::order_statistic_metadata_updator_impl>;
+    using avl_t = bbst::avl_tree<int, int, int, bbst::order_statistic_metadata_updator_impl>;
+    using rb_order_statistic_invoker = bbst::rb_tree_custom_invoke<int, int, int, bbst::order_statistic_metadata_updator_impl, std::less<int>, bbst::rb_tree_custom_invoke_order_statistic_tag>;
+    std::array<int, mx> keys{};
+    std::iota(keys.begin(), keys.end(), 0);
+    for (int first = 0; first <= mx; first++)
+    {
+        for (int last = first; last <= mx; last++)
+        {
+            rb_t rb(bbst::sorted_unique, keys.begin(), keys.end());
+            avl_t avl(bbst::sorted_unique, keys.begin(), keys.end());
+            auto rb_next = rb.erase(first == mx ? rb.end() : rb.find(first), last == mx ? rb.end() : rb.find(last));
+            auto avl_next = avl.erase(first == mx ? avl.end() : avl.find(first), last == mx ? avl.end() : avl.find(last));
+            EXPECT_EQ(rb_next, last == mx ? rb.end() : rb.find(last));
+            EXPECT_EQ(avl_next, last == mx ? avl.end() : avl.find(last));
+            std::vector<int> expect, rb_keys, avl_keys;
+            for (int i = 0; i < mx; i++) if (i < first || i >= last) expect.push_back(i);
+            for (auto p: rb) rb_keys.push_back(p.key);
+            for (auto p: avl) avl_keys.push_back(p.key);
+            EXPECT_EQ(rb_keys, expect);
+            EXPECT_EQ(avl_keys, expect);
+            EXPECT_EQ(rb_order_statistic_invoker::size(rb), expect.size());
+            for (size_t j = 0; j < expect.size(); j++) EXPECT_EQ(rb_order_statistic_invoker::find_by_order(rb, j)->key, expect[j]);
+            //still a valid tree afterwards
+            rb.try_emplace(first);
+            avl.try_emplace(first);
+            rb.erase(first);
+            avl.erase(first);
+        }
+    }
+}
+
+TEST(ExhaustiveTest, set_operation)
+{
+    //every pair of subsets of [0, mx)
+    constexpr int mx = 6;
+    using rb_t = bbst::rb_tree<int, int, int, bbst::order_statistic_metadata_updator_impl>;
+    using avl_t = bbst::avl_tree<int, int, int, bbst::order_statistic_metadata_updator_impl>;
+    using rb_invoker = bbst::rb_tree_custom_invoke<int, int, int, bbst::order_statistic_metadata_updator_impl, std::less<int>, bbst::rb_tree_custom_invoke_default_tag>;
+    using avl_invoker = bbst::avl_tree_custom_invoke<int, int, int, bbst::order_statistic_metadata_updator_impl, std::less<int>, bbst::avl_tree_custom_invoke_default_tag>;
+    using rb_order_statistic_invoker = bbst::rb_tree_custom_invoke<int, int, int, bbst::order_statistic_metadata_updator_impl, std::less<int>, bbst::rb_tree_custom_invoke_order_statistic_tag>;
+    using treap_t = bbst::treap<int, int, int, bbst::order_statistic_metadata_updator_impl>;
+    using treap_invoker = bbst::treap_custom_invoke<int, int, int, bbst::order_statistic_metadata_updator_impl, std::less<int>, bbst::treap_custom_invoke_default_tag>;
+    using treap_order_statistic_invoker = bbst::treap_custom_invoke<int, int, int, bbst::order_statistic_metadata_updator_impl, std::less<int>, bbst::treap_custom_invoke_order_statistic_tag>;
+    auto subset = [](int mask)
+    {
+        std::vector<int> keys;
+        for (int i = 0; i < mx; i++) if (mask >> i & 1) keys.push_back(i);
+        return keys;
+    };
+    auto rb_keys = [](const rb_t &tree)
+    {
+        std::vector<int> keys;
+        for (auto p: tree) keys.push_back(p.key);
+        return keys;
+    };
+    auto avl_keys = [](const avl_t &tree)
+    {
+        std::vector<int> keys;
+        for (auto p: tree) keys.push_back(p.key);
+        return keys;
+    };
+    auto treap_keys = [](const treap_t &tree)
+    {
+        std::vector<int> keys;
+        for (auto p: tree) keys.push_back(p.key);
+        return keys;
+    };
+    for (int a_mask = 0; a_mask < 1 << mx; a_mask++)
+    {
+        for (int b_mask = 0; b_mask < 1 << mx; b_mask++)
+        {
+            auto a = subset(a_mask), b = subset(b_mask);
+            std::vector<int> expect_union, expect_intersection, expect_difference;
+            std::set_union(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(expect_union));
+            std::set_intersection(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(expect_intersection));
+            std::set_difference(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(expect_difference));
+
+            auto rb_union = rb_invoker::union_(rb_t(bbst::sorted_unique, a.begin(), a.end()), rb_t(bbst::sorted_unique, b.begin(), b.end()));
+            auto rb_intersection = rb_invoker::intersection(rb_t(bbst::sorted_unique, a.begin(), a.end()), rb_t(bbst::sorted_unique, b.begin(), b.end()));
+            auto rb_difference = rb_invoker::difference(rb_t(bbst::sorted_unique, a.begin(), a.end()), rb_t(bbst::sorted_unique, b.begin(), b.end()));
+            EXPECT_EQ(rb_keys(rb_union), expect_union);
+            EXPECT_EQ(rb_keys(rb_intersection), expect_intersection);
+            EXPECT_EQ(rb_keys(rb_difference), expect_difference);
+            EXPECT_EQ(rb_order_statistic_invoker::size(rb_union), expect_union.size());
+            EXPECT_EQ(rb_order_statistic_invoker::size(rb_intersection), expect_intersection.size());
+            EXPECT_EQ(rb_order_statistic_invoker::size(rb_difference), expect_difference.size());
+
+            auto avl_union = avl_invoker::union_(avl_t(bbst::sorted_unique, a.begin(), a.end()), avl_t(bbst::sorted_unique, b.begin(), b.end()));
+            auto avl_intersection = avl_invoker::intersection(avl_t(bbst::sorted_unique, a.begin(), a.end()), avl_t(bbst::sorted_unique, b.begin(), b.end()));
+            auto avl_difference = avl_invoker::difference(avl_t(bbst::sorted_unique, a.begin(), a.end()), avl_t(bbst::sorted_unique, b.begin(), b.end()));
+            EXPECT_EQ(avl_keys(avl_union), expect_union);
+            EXPECT_EQ(avl_keys(avl_intersection), expect_intersection);
+            EXPECT_EQ(avl_keys(avl_difference), expect_difference);
+
+            auto treap_union = treap_invoker::union_(treap_t(bbst::sorted_unique, a.begin(), a.end()), treap_t(bbst::sorted_unique, b.begin(), b.end()));
+            auto treap_intersection = treap_invoker::intersection(treap_t(bbst::sorted_unique, a.begin(), a.end()), treap_t(bbst::sorted_unique, b.begin(), b.end()));
+            auto treap_difference = treap_invoker::difference(treap_t(bbst::sorted_unique, a.begin(), a.end()), treap_t(bbst::sorted_unique, b.begin(), b.end()));
+            EXPECT_EQ(treap_keys(treap_union), expect_union);
+            EXPECT_EQ(treap_keys(treap_intersection), expect_intersection);
+            EXPECT_EQ(treap_keys(treap_difference), expect_difference);
+            EXPECT_EQ(treap_order_statistic_invoker::size(treap_union), expect_union.size());
+        }
+    }
+}
+
+TEST(ExhaustiveTest, compact_node_layout)
+{
+    //color and balance share the word of the parent pointer
+    using value_t = bbst::exposure<int64_t, int64_t, int64_t>;
+    static_assert(sizeof(bbst::rb_tree_node<value_t>) == 3 * sizeof(void *) + sizeof(value_t));
+    static_assert(sizeof(bbst::avl_tree_node<value_t>) == 3 * sizeof(void *) + sizeof(value_t));
+    constexpr int mx = 64;
+    std::array<int, mx> s{};
+    std::iota(s.begin(), s.end(), 0);
+    std::shuffle(s.begin(), s.end(), std::mt19937(mx));
+    bbst::rb_tree<int, int, int, bbst::noop_metadata_updator_impl> rb;
+    bbst::avl_tree<int, int, int, bbst::noop_metadata_updator_impl> avl;
+    for (int i: s)
+    {
+        rb.try_emplace(i);
+        avl.try_emplace(i);
+    }
+    //in-order iteration climbs parent links, they have to survive the tag bits
+    for (auto it = rb.begin(); it != rb.end(); ++it) EXPECT_EQ(rb.find(it->key), it);
+    for (auto it = avl.begin(); it != avl.end(); ++it) EXPECT_EQ(avl.find(it->key), it);
+    for (int i: s)
+    {
+        EXPECT_EQ(rb.erase(i), 1);
+        EXPECT_EQ(avl.erase(i), 1);
+    }
+    EXPECT_TRUE(rb.empty());
+    EXPECT_TRUE(avl.empty());
+}
+
+TEST(ExhaustiveTest, split_by_order)
+{
+    constexpr int mx = 40;
+    using rb_t = bbst::rb_tree<int, int, int, bbst::order_statistic_metadata_updator_impl>;
+    using avl_t = bbst::avl_tree<int, int, int, bbst::order_statistic_metadata_updator_impl>;
+    using rb_order_statistic_invoker = bbst::rb_tree_custom_invoke<int, int, int, bbst::order_statistic_metadata_updator_impl, std::less<int>, bbst::rb_tree_custom_invoke_order_statistic_tag>;
+    using avl_order_statistic_invoker = bbst::avl_tree_custom_invoke<int, int, int, bbst::order_statistic_metadata_updator_impl, std::less<int>, bbst::avl_tree_custom_invoke_order_statistic_tag>;
+    for (int n = 0; n <= mx; n++)
+    {
+        std::vector<int> keys(n);
+        std::iota(keys.begin(), keys.end(), 0);
+        for (int index = 0; index <= n + 1; index++)
+        {
+            auto [rb_l, rb_r] = rb_order_statistic_invoker::split_by_order(rb_t(bbst::sorted_unique, keys.begin(), keys.end()), index);
+            auto [avl_l, avl_r] = avl_order_statistic_invoker::split_by_order(avl_t(bbst::sorted_unique, keys.begin(), keys.end()), index);
+            int left_size = std::min(index, n);
+            EXPECT_EQ(rb_order_statistic_invoker::size(rb_l), left_size);
+            EXPECT_EQ(rb_order_statistic_invoker::size(rb_r), n - left_size);
+            EXPECT_EQ(avl_order_statistic_invoker::size(avl_l), left_size);
+            EXPECT_EQ(avl_order_statistic_invoker::size(avl_r), n - left_size);
+            int i = 0;
+            for (auto p: rb_l) EXPECT_EQ(p.key, i++);
+            for (auto p: rb_r) EXPECT_EQ(p.key, i++);
+            EXPECT_EQ(i, n);
+            i = 0;
+            for (auto p: avl_l) EXPECT_EQ(p.key, i++);
+            for (auto p: avl_r) EXPECT_EQ(p.key, i++);
+            EXPECT_EQ(i, n);
+            for (int j = 0; j < left_size; j++)
+            {
+                EXPECT_EQ(avl_order_statistic_invoker::find_by_order(avl_l, j)->key, j);
+                EXPECT_EQ(avl_order_statistic_invoker::order_of_key(avl_l, j), j);
+            }
+            for (int j = left_size; j < n; j++)
+            {
+                EXPECT_EQ(avl_order_statistic_invoker::find_by_order(avl_r, j - left_size)->key, j);
+                EXPECT_EQ(avl_order_statistic_invoker::order_of_key(avl_r, j), j - left_size);
+            }
+        }
+    }
+}
+
+namespace
+{
+    //the recursive split split_by_key used to be, kept as the reference for the iterative one
+    template<bbst::tree_split_equal equal_policy, class header_t, class expose_t, class join_x_t>
+    std::pair<header_t, header_t> recursive_split(header_t header, int key, expose_t expose, join_x_t join_x)
+    {
+        if (header.empty())
+            return {header_t::empty_header(), header_t::empty_header()};
+        auto [left, root, right] = expose(header);
+        if (key < root->key())
+        {
+            auto [l, r] = recursive_split<equal_policy>(left, key, expose, join_x);
+            return {l, join_x(r, root, right)};
+        }
+        if (root->key() < key)
+        {
+            auto [l, r] = recursive_split<equal_policy>(right, key, expose, join_x);
+            return {join_x(left, root, l), r};
+        }
+        if constexpr(equal_policy == bbst::tree_split_equal::left)
+            return {join_x(left, root, header_t::empty_header()), right};
+        else
+            return {left, join_x(header_t::empty_header(), root, right)};
+    }
+
+    template<class node_ptr_t, class balance_t>
+    bool same_shape(node_ptr_t a, node_ptr_t b, balance_t balance)
+    {
+        if (a == nullptr || b == nullptr)
+            return a == b;
+        return a->key() == b->key() && a->metadata() == b->metadata() && balance(a) == balance(b) &&
+               same_shape(a->left, b->left, balance) && same_shape(a->right, b->right, balance);
+    }
+
+    template<class tree_t, class invoker_t, class expose_t, class join_x_t, class split_t, class balance_t>
+    void check_split_matches_recursive(int mx, expose_t expose, join_x_t join_x, split_t split, balance_t balance)
+    {
+        std::mt19937 gen(mx);
+        for (int n = 0; n <= mx; n++)
+        {
+            std::vector<int> keys(n);
+            std::iota(keys.begin(), keys.end(), 0);
+            std::shuffle(keys.begin(), keys.end(), gen);
+            for (int key = -1; key <= n; key++)
+            {
+                for (bool equal_on_left: {true, false})
+                {
+                    tree_t reference_tree, tree;
+                    for (int k: keys)
+                    {
+                        reference_tree.try_emplace(k);
+                        tree.try_emplace(k);
+                    }
+                    auto reference = invoker_t::to_header(std::move(reference_tree));
+                    auto header = invoker_t::to_header(std::move(tree));
+                    auto [reference_l, reference_r] = equal_on_left ? recursive_split<bbst::tree_split_equal::left>(reference, key, expose, join_x)
+                                                                    : recursive_split<bbst::tree_split_equal::right>(reference, key, expose, join_x);
+                    auto [l, r] = split(header, key, equal_on_left);
+                    EXPECT_TRUE(same_shape(reference_l.root_, l.root_, balance));
+                    EXPECT_TRUE(same_shape(reference_r.root_, r.root_, balance));
+                    using node_t = std::remove_pointer_t<decltype(header.root_)>;
+                    std::allocator<node_t> alloc;
+                    for (auto root: {reference_l.root_, reference_r.root_, l.root_, r.root_})
+                        bbst::tree_destroy_all(alloc, root);
+                }
+            }
+        }
+    }
+}
+
+TEST(ExhaustiveTest, split_by_key_matches_recursive)
+{
+    constexpr int mx = 48;
+    using updator_t = bbst::order_statistic_metadata_updator_impl;
+    using rb_t = bbst::rb_tree<int, int, int, updator_t>;
+    using avl_t = bbst::avl_tree<int, int, int, updator_t>;
+    struct rb_invoker
+    {
+        static auto to_header(rb_t &&tree)
+        {
+            return bbst::rb_tree_custom_invoke<int, int, int, updator_t, std::less<int>, bbst::rb_tree_custom_invoke_default_tag>::to_rb_tree_header(std::move(tree));
+        }
+    };
+    struct avl_invoker
+    {
+        static auto to_header(avl_t &&tree)
+        {
+            return bbst::avl_tree_custom_invoke<int, int, int, updator_t, std::less<int>, bbst::avl_tree_custom_invoke_default_tag>::to_avl_tree_header(std::move(tree));
+        }
+    };
+    check_split_matches_recursive<rb_t, rb_invoker>(
+            mx, [](auto h) { return bbst::rb_tree_expose(h, updator_t()); }
+            , [](auto l, auto x, auto r) { return bbst::rb_tree_join_x(l, x, r, updator_t(), std::less<int>()); }
+            , [](auto h, int key, bool equal_on_left)
+            {
+                auto [l, x, r] = equal_on_left ? bbst::rb_tree_split<bbst::tree_split_equal::left>(h, key, updator_t(), std::less<int>())
+                                               : bbst::rb_tree_split<bbst::tree_split_equal::right>(h, key, updator_t(), std::less<int>());
+                EXPECT_EQ(x, nullptr);
+                return std::pair(l, r);
+            }
+            , [](auto ptr) { return ptr->is_black(); });
+    check_split_matches_recursive<avl_t, avl_invoker>(
+            mx, [](auto h) { return bbst::avl_tree_expose(h, updator_t()); }
+            , [](auto l, auto x, auto r) { return bbst::avl_tree_join_x(l, x, r, updator_t(), std::less<int>()); }
+            , [](auto h, int key, bool equal_on_left)
+            {
+                auto [l, x, r] = equal_on_left ? bbst::avl_tree_split<bbst::tree_split_equal::left>(h, key, updator_t(), std::less<int>())
+                                               : bbst::avl_tree_split<bbst::tree_split_equal::right>(h, key, updator_t(), std::less<int>());
+                EXPECT_EQ(x, nullptr);
+                return std::pair(l, r);
+            }
+            , [](auto ptr) { return ptr->height_diff(); });
+}
+
+namespace
+{
+    //non commutative, collects the keys in the order the pieces are combined
+    struct key_sequence_monoid
+    {
+        using value_type = std::vector<int>;
+
+        [[nodiscard]] value_type identity() const
+        {
+            return {};
+        }
+
+        [[nodiscard]] value_type combine(const value_type &lhs, const value_type &rhs) const
+        {
+            value_type result = lhs;
+            result.insert(result.end(), rhs.begin(), rhs.end());
+            return result;
+        }
+
+        template<class node_ptr_t>
+        [[nodiscard]] value_type node(node_ptr_t ptr) const
+        {
+            return {ptr->key()};
+        }
+
+        template<class node_ptr_t>
+        [[nodiscard]] value_type subtree(node_ptr_t ptr) const
+        {
+            if (ptr == nullptr)
+                return {};
+            return combine(combine(subtree(ptr->left), node(ptr)), subtree(ptr->right));
+        }
+    };
+
+    template<class tree_t, class invoker_t>
+    void check_range_aggregate(int mx)
+    {
+        std::mt19937 gen(mx);
+        for (int n = 0; n <= mx; n++)
+        {
+            //even keys only, so bounds also fall between keys
+            std::vector<int> keys(n);
+            for (int i = 0; i < n; i++) keys[i] = 2 * i;
+            std::shuffle(keys.begin(), keys.end(), gen);
+            tree_t tree;
+            for (int k: keys) tree.try_emplace(k);
+            for (int lo = -1; lo <= 2 * n; lo++)
+            {
+                for (int hi = lo - 1; hi <= 2 * n; hi++)
+                {
+                    std::vector<int> expect;
+                    for (int k = std::max(lo, 0); k <= hi; k++)
+                        if (k % 2 == 0 && k < 2 * n) expect.push_back(k);
+                    EXPECT_EQ(invoker_t::template range_aggregate<key_sequence_monoid>(tree, lo, hi), expect);
+                    EXPECT_EQ(invoker_t::range_aggregate(tree, lo, hi, bbst::key_sum_aggregate_monoid<int>()), std::accumulate(expect.begin(), expect.end(), 0));
+                }
+            }
+        }
+    }
+}
+
+TEST(ExhaustiveTest, range_aggregate)
+{
+    constexpr int mx = 24;
+    using rb_t = bbst::rb_tree<int, int, int, bbst::sum_metadata_updator>;
+    using avl_t = bbst::avl_tree<int, int, int, bbst::sum_metadata_updator>;
+    using rb_invoker = bbst::rb_tree_custom_invoke<int, int, int, bbst::sum_metadata_updator, std::less<int>, bbst::rb_tree_custom_invoke_default_tag>;
+    using avl_invoker = bbst::avl_tree_custom_invoke<int, int, int, bbst::sum_metadata_updator, std::less<int>, bbst::avl_tree_custom_invoke_default_tag>;
+    check_range_aggregate<rb_t, rb_invoker>(mx);
+    check_range_aggregate<avl_t, avl_invoker>(mx);
+    check_range_aggregate<bbst::treap<int, int, int, bbst::sum_metadata_updator>
+            , bbst::treap_custom_invoke<int, int, int, bbst::sum_metadata_updator, std::less<int>, bbst::treap_custom_invoke_default_tag>>(mx);
+}
+
+TEST(ExhaustiveTest, interval_tree)
+{
+    constexpr int mx = 12;
+    using interval_t = std::pair<int, int>;
+    using rb_t = bbst::rb_tree<interval_t, int, interval_t, bbst::interval_metadata_updator>;
+    using rb_interval_invoker = bbst::rb_tree_custom_invoke<interval_t, int, interval_t, bbst::interval_metadata_updator, std::less<interval_t>, bbst::rb_tree_custom_invoke_interval_tag>;
+    std::vector<interval_t> all;
+    for (int lo = 0; lo < mx; lo++)
+        for (int hi = lo; hi < mx; hi++)
+            all.emplace_back(lo, hi);
+    auto overlap = [](interval_t a, interval_t b) { return a.first <= b.second && b.first <= a.second; };
+    std::mt19937 gen(mx);
+    for (int round = 0; round < 64; round++)
+    {
+        std::shuffle(all.begin(), all.end(), gen);
+        size_t n = std::uniform_int_distribution<size_t>(0, all.size())(gen);
+        rb_t tree;
+        for (size_t i = 0; i < n; i++) tree.try_emplace(all[i]);
+        //erase some again, rotations on the way out must keep the metadata right too
+        for (size_t i = 0; i < n; i += 3) tree.erase(all[i]);
+        std::vector<interval_t> stored;
+        for (auto p: tree) stored.push_back(p.key);
+        for (int lo = -1; lo <= mx; lo++)
+        {
+            for (int hi = lo; hi <= mx; hi++)
+            {
+                std::vector<interval_t> expect, found;
+                for (auto interval: stored)
+                    if (overlap(interval, {lo, hi})) expect.push_back(interval);
+                rb_interval_invoker::overlap_query(tree, {lo, hi}, [&](auto it) { found.push_back(it->key); });
+                EXPECT_EQ(found, expect);
+                auto any = rb_interval_invoker::any_overlap(tree, {lo, hi});
+                EXPECT_EQ(any == tree.end(), expect.empty());
+                if (any != tree.end())
+                {
+                    EXPECT_TRUE(overlap(any->key, {lo, hi}));
+                }
+                if (lo == hi)
+                {
+                    found.clear();
+                    rb_interval_invoker::stabbing_query(tree, lo, [&](auto it) { found.push_back(it->key); });
+                    EXPECT_EQ(found, expect);
+                }
+            }
+        }
+    }
+}
+
+namespace
+{
+    //counts how often a key gets materialized
+    struct counted_key
+    {
+        static inline int constructed = 0;
+        int value;
+
+        explicit counted_key(int value_) : value(value_)
+        {
+            constructed++;
+        }
+
+        auto operator<=>(const counted_key &) const = default;
+    };
+
+    struct counted_key_less
+    {
+        using is_transparent = void;
+
+        bool operator()(const counted_key &lhs, const counted_key &rhs) const
+        {
+            return lhs.value < rhs.value;
+        }
+
+        bool operator()(const counted_key &lhs, int rhs) const
+        {
+            return lhs.value < rhs;
+        }
+
+        bool operator()(int lhs, const counted_key &rhs) const
+        {
+            return lhs < rhs.value;
+        }
+    };
+
+    template<class tree_t, class invoker_t, class order_statistic_invoker_t>
+    void check_heterogeneous_lookup(int mx)
+    {
+        tree_t tree;
+        for (int k = 0; k < mx; k += 2)
+            EXPECT_TRUE(tree.try_emplace(k).second);
+        EXPECT_EQ(counted_key::constructed, mx / 2);
+        //lookups and failed insertions never build a key
+        for (int k = -1; k <= mx; k++)
+        {
+            EXPECT_EQ(tree.find(k) != tree.end(), k >= 0 && k < mx && k % 2 == 0);
+            auto lower = tree.lower_bound(k);
+            auto upper = tree.upper_bound(k);
+            int expect_lower = std::max(0, k + (k % 2 != 0)), expect_upper = std::max(0, k + 1 + (k % 2 == 0));
+            EXPECT_EQ(lower == tree.end() ? mx : lower->key.value, std::min(expect_lower, mx));
+            EXPECT_EQ(upper == tree.end() ? mx : upper->key.value, std::min(expect_upper, mx));
+            EXPECT_EQ(order_statistic_invoker_t::order_of_key(tree, k), size_t(std::clamp((k + 1) / 2, 0, mx / 2)));
+            if (k >= 0 && k < mx && k % 2 == 0)
+            {
+                EXPECT_FALSE(tree.try_emplace(k).second);
+            }
+        }
+        EXPECT_EQ(counted_key::constructed, mx / 2);
+        auto [l, r] = invoker_t::template split_by_key<false>(std::move(tree), mx / 2);
+        EXPECT_EQ(counted_key::constructed, mx / 2);
+        EXPECT_EQ(order_statistic_invoker_t::size(l) + order_statistic_invoker_t::size(r), size_t(mx / 2));
+        if (r.begin() != r.end())
+        {
+            EXPECT_GE(r.begin()->key.value, mx / 2);
+        }
+        counted_key::constructed = 0;
+    }
+}
+
+TEST(ExhaustiveTest, heterogeneous_lookup)
+{
+    constexpr int mx = 64;
+    using updator_t = bbst::order_statistic_metadata_updator_impl;
+    using rb_t = bbst::rb_tree<counted_key, int, int, updator_t, counted_key_less>;
+    using avl_t = bbst::avl_tree<counted_key, int, int, updator_t, counted_key_less>;
+    using rb_invoker = bbst::rb_tree_custom_invoke<counted_key, int, int, updator_t, counted_key_less, bbst::rb_tree_custom_invoke_default_tag>;
+    using avl_invoker = bbst::avl_tree_custom_invoke<counted_key, int, int, updator_t, counted_key_less, bbst::avl_tree_custom_invoke_default_tag>;
+    using rb_order_statistic_invoker = bbst::rb_tree_custom_invoke<counted_key, int, int, updator_t, counted_key_less, bbst::rb_tree_custom_invoke_order_statistic_tag>;
+    using avl_order_statistic_invoker = bbst::avl_tree_custom_invoke<counted_key, int, int, updator_t, counted_key_less, bbst::avl_tree_custom_invoke_order_statistic_tag>;
+    check_heterogeneous_lookup<rb_t, rb_invoker, rb_order_statistic_invoker>(mx);
+    check_heterogeneous_lookup<avl_t, avl_invoker, avl_order_statistic_invoker>(mx);
+    check_heterogeneous_lookup<bbst::treap<counted_key, int, int, updator_t, counted_key_less>
+            , bbst::treap_custom_invoke<counted_key, int, int, updator_t, counted_key_less, bbst::treap_custom_invoke_default_tag>
+            , bbst::treap_custom_invoke<counted_key, int, int, updator_t, counted_key_less, bbst::treap_custom_invoke_order_statistic_tag>>(mx);
+
+    //the motivating case, std::string keys looked up through std::string_view
+    bbst::rb_tree<std::string, int, int, bbst::noop_metadata_updator_impl, std::less<>> names;
+    for (std::string_view name: {"bob", "alice", "carol"}) names.try_emplace(name);
+    EXPECT_EQ(names.find(std::string_view("alice"))->key, "alice");
+    EXPECT_EQ(names.lower_bound(std::string_view("b"))->key, "bob");
+    EXPECT_EQ(names.upper_bound(std::string_view("bob"))->key, "carol");
+    EXPECT_EQ(names.find(std::string_view("dave")), names.end());
+}
+
+namespace
+{
+    //three-way comparator on reversed order, counting its calls
+    struct counting_three_way_greater
+    {
+        static inline size_t calls = 0;
+
+        std::strong_ordering operator()(int lhs, int rhs) const
+        {
+            calls++;
+            return rhs <=> lhs;
+        }
+    };
+
+    template<class tree_t, class invoker_t, class order_statistic_invoker_t>
+    void check_three_way_comparator(int mx)
+    {
+        std::vector<int> keys(mx);
+        std::iota(keys.begin(), keys.end(), 0);
+        std::shuffle(keys.begin(), keys.end(), std::mt19937(mx));
+        tree_t tree;
+        for (int k: keys)
+        {
+            size_t before = counting_three_way_greater::calls;
+            EXPECT_TRUE(tree.try_emplace(k).second);
+            //one call per level, even an avl/rb tree of mx nodes is below 2 * log2(mx) + 2 levels
+            EXPECT_LE(counting_three_way_greater::calls - before, size_t(2 * std::bit_width(unsigned(mx)) + 2));
+        }
+        for (int k: keys) EXPECT_FALSE(tree.try_emplace(k).second);
+        int expect = mx;
+        for (auto p: tree) EXPECT_EQ(p.key, --expect);
+        for (int k = 0; k < mx; k++)
+        {
+            EXPECT_EQ(tree.find(k)->key, k);
+            EXPECT_EQ(tree.lower_bound(k)->key, k);
+            EXPECT_EQ(order_statistic_invoker_t::order_of_key(tree, k), size_t(mx - 1 - k));
+        }
+        EXPECT_EQ(tree.find(mx), tree.end());
+        EXPECT_EQ(tree.erase(mx / 2), 1);
+        auto [l, r] = invoker_t::template split_by_key<true>(std::move(tree), mx / 3);
+        for (auto p: l) EXPECT_GE(p.key, mx / 3);
+        for (auto p: r) EXPECT_LT(p.key, mx / 3);
+        EXPECT_EQ(order_statistic_invoker_t::size(l) + order_statistic_invoker_t::size(r), size_t(mx - 1));
+    }
+}
+
+TEST(ExhaustiveTest, three_way_comparator)
+{
+    constexpr int mx = 256;
+    using updator_t = bbst::order_statistic_metadata_updator_impl;
+    using comparator_t = counting_three_way_greater;
+    using rb_t = bbst::rb_tree<int, int, int, updator_t, comparator_t>;
+    using avl_t = bbst::avl_tree<int, int, int, updator_t, comparator_t>;
+    using rb_invoker = bbst::rb_tree_custom_invoke<int, int, int, updator_t, comparator_t, bbst::rb_tree_custom_invoke_default_tag>;
+    using avl_invoker = bbst::avl_tree_custom_invoke<int, int, int, updator_t, comparator_t, bbst::avl_tree_custom_invoke_default_tag>;
+    using rb_order_statistic_invoker = bbst::rb_tree_custom_invoke<int, int, int, updator_t, comparator_t, bbst::rb_tree_custom_invoke_order_statistic_tag>;
+    using avl_order_statistic_invoker = bbst::avl_tree_custom_invoke<int, int, int, updator_t, comparator_t, bbst::avl_tree_custom_invoke_order_statistic_tag>;
+    check_three_way_comparator<rb_t, rb_invoker, rb_order_statistic_invoker>(mx);
+    check_three_way_comparator<avl_t, avl_invoker, avl_order_statistic_invoker>(mx);
+
+    //std::less over operator<=> keys descends with a single comparison too
+    std::less<std::string> less;
+    EXPECT_TRUE(bbst::tree_compare(less, std::string("abc"), std::string("abd")) < 0);
+    EXPECT_TRUE(bbst::tree_compare(less, std::string("abc"), std::string("abc")) == 0);
+    EXPECT_TRUE(bbst::tree_compare(std::less<>(), std::string("b"), std::string_view("a")) > 0);
+}
+
+namespace
+{
+    template<class tree_t>
+    void check_same_keys(const tree_t &tree, const std::set<int> &expect)
+    {
+        auto it = tree.begin();
+        for (int k: expect) EXPECT_EQ((it++)->key, k);
+        EXPECT_EQ(it, tree.end());
+    }
+
+    template<class tree_t>
+    void check_hinted_insertion(int mx)
+    {
+        //every key (present or not, odd keys are missing) against every hint of every tree size
+        for (int n = 0; n <= mx; n++)
+        {
+            for (int key = -1; key <= 2 * n; key++)
+            {
+                for (int hint = 0; hint <= n; hint++)
+                {
+                    std::vector<int> keys(n);
+                    for (int i = 0; i < n; i++) keys[i] = 2 * i;
+                    tree_t tree(bbst::sorted_unique, keys.begin(), keys.end());
+                    std::set<int> expect(keys.begin(), keys.end());
+                    auto pos = tree.begin();
+                    for (int i = 0; i < hint; i++) ++pos;
+                    auto it = tree.emplace_hint(pos, key);
+                    EXPECT_EQ(it->key, key);
+                    expect.insert(key);
+                    check_same_keys(tree, expect);
+                }
+            }
+        }
+        //monotone ingestion from both ends, mixed with erasures that move the greatest node
+        tree_t tree;
+        std::set<int> expect;
+        for (int i = 0; i < mx * 8; i++)
+        {
+            auto [back, back_inserted] = tree.push_back(i);
+            EXPECT_TRUE(back_inserted);
+            EXPECT_EQ(back->key, i);
+            EXPECT_TRUE(tree.push_front(-i - 1).second);
+            expect.insert({i, -i - 1});
+            if (i % 5 == 4)
+            {
+                tree.erase(i);
+                expect.erase(i);
+            }
+            if (i % 7 == 6)
+            {
+                tree.erase(tree.find(i - 3), tree.end());
+                expect.erase(expect.find(i - 3), expect.end());
+            }
+        }
+        check_same_keys(tree, expect);
+        //keys that don't extend the range fall back to the ordinary search
+        EXPECT_FALSE(tree.push_back(*expect.begin()).second);
+        EXPECT_TRUE(tree.push_back(0).second == !expect.contains(0));
+        expect.insert(0);
+        check_same_keys(tree, expect);
+    }
+}
+
+TEST(ExhaustiveTest, hinted_insertion)
+{
+    constexpr int mx = 20;
+    check_hinted_insertion<bbst::rb_tree<int, int, int, bbst::noop_metadata_updator_impl>>(mx);
+    check_hinted_insertion<bbst::avl_tree<int, int, int, bbst::noop_metadata_updator_impl>>(mx);
+    check_hinted_insertion<bbst::rb_tree<int, int, int, bbst::order_statistic_metadata_updator_impl>>(mx);
+    check_hinted_insertion<bbst::avl_tree<int, int, int, bbst::order_statistic_metadata_updator_impl>>(mx);
+    check_hinted_insertion<bbst::treap<int, int, int, bbst::order_statistic_metadata_updator_impl>>(mx);
+}
+
+namespace
+{
+    template<class tree_t, class invoker_t>
+    void check_finger_search(int mx)
+    {
+        for (int n = 0; n <= mx; n++)
+        {
+            std::vector<int> keys(n);
+            for (int i = 0; i < n; i++) keys[i] = 2 * i;
+            tree_t tree(bbst::sorted_unique, keys.begin(), keys.end());
+            const tree_t &const_tree = tree;
+            //every finger (end() included) against every key, present or not
+            for (auto finger = tree.begin();; ++finger)
+            {
+                for (int key = -1; key <= 2 * n; key++)
+                {
+                    EXPECT_EQ(tree.lower_bound_from(finger, key), tree.lower_bound(key));
+                    EXPECT_EQ(tree.find_from(finger, key), tree.find(key));
+                    EXPECT_EQ(const_tree.lower_bound_from(finger, key), const_tree.lower_bound(key));
+                    EXPECT_EQ(const_tree.find_from(finger, key), const_tree.find(key));
+                }
+                if (finger == tree.end())
+                    break;
+            }
+            for (int index = 0; index <= n; index++)
+            {
+                tree_t whole(bbst::sorted_unique, keys.begin(), keys.end());
+                auto pos = whole.begin();
+                for (int i = 0; i < index; i++) ++pos;
+                auto [l, r] = invoker_t::split_at(std::move(whole), pos);
+                EXPECT_TRUE(whole.empty());
+                int i = 0;
+                for (auto p: l) EXPECT_EQ(p.key, 2 * i++);
+                EXPECT_EQ(i, index);
+                for (auto p: r) EXPECT_EQ(p.key, 2 * i++);
+                EXPECT_EQ(i, n);
+                //both sides stay fully usable
+                l.try_emplace(-1);
+                r.try_emplace(2 * n);
+                EXPECT_EQ(l.begin()->key, -1);
+                EXPECT_EQ((--r.end())->key, 2 * n);
+            }
+        }
+    }
+}
+
+TEST(ExhaustiveTest, finger_search)
+{
+    constexpr int mx = 40;
+    using noop_t = bbst::noop_metadata_updator_impl;
+    using order_t = bbst::order_statistic_metadata_updator_impl;
+    check_finger_search<bbst::rb_tree<int, int, int, noop_t>
+            , bbst::rb_tree_custom_invoke<int, int, int, noop_t, std::less<int>, bbst::rb_tree_custom_invoke_default_tag>>(mx);
+    check_finger_search<bbst::avl_tree<int, int, int, noop_t>
+            , bbst::avl_tree_custom_invoke<int, int, int, noop_t, std::less<int>, bbst::avl_tree_custom_invoke_default_tag>>(mx);
+    check_finger_search<bbst::rb_tree<int, int, int, order_t>
+            , bbst::rb_tree_custom_invoke<int, int, int, order_t, std::less<int>, bbst::rb_tree_custom_invoke_default_tag>>(mx);
+    check_finger_search<bbst::avl_tree<int, int, int, order_t>
+            , bbst::avl_tree_custom_invoke<int, int, int, order_t, std::less<int>, bbst::avl_tree_custom_invoke_default_tag>>(mx);
+    check_finger_search<bbst::treap<int, int, int, order_t>
+            , bbst::treap_custom_invoke<int, int, int, order_t, std::less<int>, bbst::treap_custom_invoke_default_tag>>(mx);
+}
+
+namespace
+{
+    template<class tree_t>
+    void check_batched_lookup(int mx)
+    {
+        std::mt19937 gen(mx);
+        for (int n = 0; n <= mx; n++)
+        {
+            std::vector<int> keys(n);
+            for (int i = 0; i < n; i++) keys[i] = 2 * i;
+            tree_t tree(bbst::sorted_unique, keys.begin(), keys.end());
+            const tree_t &const_tree = tree;
+            //batch sizes around the group width, keys present or not, repeated and out of order
+            for (int batch = 0; batch <= 3 * int(bbst::tree_batch_width) + 1; batch++)
+            {
+                std::vector<int> queries(batch);
+                std::uniform_int_distribution<int> key(-1, 2 * n);
+                for (int &q: queries) q = key(gen);
+                std::vector<typename tree_t::iterator> found, bounds;
+                std::vector<typename tree_t::const_iterator> const_found, const_bounds;
+                tree.find_batch(queries.begin(), queries.end(), std::back_inserter(found));
+                tree.lower_bound_batch(queries.begin(), queries.end(), std::back_inserter(bounds));
+                const_tree.find_batch(queries.begin(), queries.end(), std::back_inserter(const_found));
+                const_tree.lower_bound_batch(queries.begin(), queries.end(), std::back_inserter(const_bounds));
+                ASSERT_EQ(found.size(), queries.size());
+                ASSERT_EQ(bounds.size(), queries.size());
+                ASSERT_EQ(const_found.size(), queries.size());
+                ASSERT_EQ(const_bounds.size(), queries.size());
+                for (int i = 0; i < batch; i++)
+                {
+                    EXPECT_EQ(found[i], tree.find(queries[i]));
+                    EXPECT_EQ(bounds[i], tree.lower_bound(queries[i]));
+                    EXPECT_EQ(const_found[i], const_tree.find(queries[i]));
+                    EXPECT_EQ(const_bounds[i], const_tree.lower_bound(queries[i]));
+                }
+            }
+        }
+    }
+}
+
+TEST(ExhaustiveTest, batched_lookup)
+{
+    constexpr int mx = 40;
+    check_batched_lookup<bbst::rb_tree<int, int, int, bbst::noop_metadata_updator_impl>>(mx);
+    check_batched_lookup<bbst::avl_tree<int, int, int, bbst::noop_metadata_updator_impl>>(mx);
+    check_batched_lookup<bbst::treap<int, int, int, bbst::noop_metadata_updator_impl>>(mx);
+}
+
+namespace
+{
+    //longer than the small string buffer, so a key read after its element is gone trips ASan
+    std::string long_key(int i)
+    {
+        std::string digits = std::to_string(i);
+        return std::string(32 - digits.size(), '0') + digits;
+    }
+
+    /*
+     * insert_sorted_batch from views whose iterators hand out elements by value: (key, mapped) pairs and bare keys
+     * into a tree holding every other key already
+     */
+    template<class tree_t>
+    void check_insert_sorted_batch_views(int mx)
+    {
+        for (int n = 0; n < mx; n++)
+        {
+            tree_t tree;
+            for (int i = 0; i < n; i += 2) tree.try_emplace(long_key(i), 0, -i);
+            auto pairs = std::views::iota(0, n) | std::views::transform([](int i) { return std::pair<std::string, int>(long_key(i), i); });
+            tree.insert_sorted_batch(pairs.begin(), pairs.end());
+            auto keys = std::views::iota(0, 2 * n) | std::views::transform(long_key);
+            tree.insert_sorted_batch(keys.begin(), keys.end());
+            int i = 0;
+            for (auto p: tree)
+            {
+                EXPECT_EQ(p.key, long_key(i));
+                EXPECT_EQ(p.mapped, i >= n ? 0 : i % 2 ? i : -i);
+                i++;
+            }
+            EXPECT_EQ(i, 2 * n);
+        }
+    }
+}
+
+TEST(ExhaustiveTest, insert_sorted_batch)
+{
+    constexpr int mx = 40;
+    check_insert_sorted_batch_views<bbst::rb_tree<std::string, int, int, bbst::noop_metadata_updator_impl>>(mx);
+    check_insert_sorted_batch_views<bbst::avl_tree<std::string, int, int, bbst::noop_metadata_updator_impl>>(mx);
+    check_insert_sorted_batch_views<bbst::treap<std::string, int, int, bbst::noop_metadata_updator_impl>>(mx);
+}
+
+TEST(ExhaustiveTest, persistent_avl_tree)
+{
+    constexpr int mx = 40;
+    using tree_t = bbst::persistent_avl_tree<int, int, int, bbst::order_statistic_metadata_updator_impl>;
+    auto same_keys = [](const auto &snapshot, const std::map<int, int> &expect)
+    {
+        auto it = expect.begin();
+        bool same = true;
+        snapshot.for_each([&](const auto &value)
+                          {
+                              same = same && it != expect.end() && value.key == it->first && value.mapped == it->second;
+                              ++it;
+                          });
+        return same && it == expect.end();
+    };
+    std::mt19937 gen(mx);
+    for (int n = 0; n <= mx; n++)
+    {
+        tree_t tree(2);
+        bbst::epoch_domain::reader reader(tree.domain()), old_reader(tree.domain());
+        std::map<int, int> expect;
+        std::uniform_int_distribution<int> key(0, n);
+        for (int round = 0; round < 8 * n; round++)
+        {
+            //a snapshot taken now keeps seeing this version through the writes below
+            auto old = tree.snapshot(old_reader);
+            std::map<int, int> old_expect = expect;
+            for (int i = 0; i < 4; i++)
+            {
+                int k = key(gen);
+                if (gen() % 3)
+                    EXPECT_EQ(tree.try_emplace(k, 0, round), expect.try_emplace(k, round).second);
+                else
+                    EXPECT_EQ(tree.erase(k), expect.erase(k));
+                tree.reclaim();
+            }
+            EXPECT_TRUE(same_keys(old, old_expect));
+            EXPECT_EQ(bbst::order_statistic_metadata_updator_impl::get_order_metadata(old.root()), int(old_expect.size()));
+            EXPECT_GE(bbst::persistent_avl_tree_invariant(old.root()), 0);
+            {
+                auto now = tree.snapshot(reader);
+                EXPECT_TRUE(same_keys(now, expect));
+                EXPECT_GE(bbst::persistent_avl_tree_invariant(now.root()), 0);
+                EXPECT_EQ(tree.size(), expect.size());
+                for (int k = -1; k <= n + 1; k++)
+                {
+                    auto found = now.find(k);
+                    EXPECT_EQ(found != nullptr, expect.contains(k));
+                    EXPECT_EQ(tree.find(k) != nullptr, expect.contains(k));
+                    auto bound = now.lower_bound(k);
+                    auto expect_bound = expect.lower_bound(k);
+                    EXPECT_EQ(bound == nullptr, expect_bound == expect.end());
+                    if (bound != nullptr && expect_bound != expect.end())
+                    {
+                        EXPECT_EQ(bound->key, expect_bound->first);
+                    }
+                }
+            }
+        }
+        //with no reader left pinned every replaced node goes
+        EXPECT_EQ(tree.reclaim(), 0u);
+    }
+}
+
+namespace
+{
+    //shared by every rebound budget_allocator
+    int allocations_left = std::numeric_limits<int>::max();
+
+    //std::allocator that throws std::bad_alloc once allocations_left runs out
+    template<class T>
+    struct budget_allocator
+    {
+        typedef T value_type;
+
+        budget_allocator() = default;
+
+        template<class U>
+        budget_allocator(const budget_allocator<U> &) noexcept {}
+
+        T *allocate(size_t n)
+        {
+            if (allocations_left == 0)
+                throw std::bad_alloc();
+            allocations_left--;
+            return std::allocator<T>().allocate(n);
+        }
+
+        void deallocate(T *ptr, size_t n) noexcept
+        {
+            std::allocator<T>().deallocate(ptr, n);
+        }
+
+        template<class U>
+        bool operator==(const budget_allocator<U> &) const noexcept { return true; }
+    };
+
+    //copy constructor throws once copies_left copies went through, copies_left < 0 never throws
+    struct throwing_copy
+    {
+        static inline int copies_left = -1;
+        int value;
+
+        throwing_copy(int value_) : value(value_)
+        {}
+
+        throwing_copy(const throwing_copy &other) : value(other.value)
+        {
+            if (copies_left == 0)
+                throw std::runtime_error("copy budget exhausted");
+            if (copies_left > 0)
+                copies_left--;
+        }
+
+        throwing_copy &operator=(const throwing_copy &) = default;
+    };
+
+    //every write is retried with a budget from 0 up until it goes through: a failed one leaves the tree as it was, and leaks nothing (ASan)
+    template<class tree_t, class set_budget_t>
+    void check_persistent_avl_tree_failed_writes(set_budget_t set_budget)
+    {
+        constexpr int mx = 24;
+        for (int n = 1; n <= mx; n++)
+        {
+            tree_t tree(1);
+            bbst::epoch_domain::reader reader(tree.domain());
+            std::map<int, int> expect;
+            for (int k = 0; k < n; k++)
+            {
+                tree.try_emplace(2 * k, 0, throwing_copy(k));
+                expect.emplace(2 * k, k);
+            }
+            for (int k = -1; k <= 2 * n; k++)
+            {
+                bool done = false;
+                for (int budget = 0; !done; budget++)
+                {
+                    set_budget(budget);
+                    try
+                    {
+                        if (k % 2 != 0)
+                            EXPECT_TRUE(tree.try_emplace(k, 0, throwing_copy(k)));
+                        else
+                            EXPECT_EQ(tree.erase(k), expect.contains(k) ? 1u : 0u);
+                        done = true;
+                    }
+                    catch (const std::runtime_error &)
+                    {}
+                    catch (const std::bad_alloc &)
+                    {}
+                    set_budget(-1);
+                    if (done)
+                    {
+                        if (k % 2 != 0)
+                            expect.emplace(k, k);
+                        else
+                            expect.erase(k);
+                    }
+                    EXPECT_EQ(tree.size(), expect.size());
+                    auto now = tree.snapshot(reader);
+                    EXPECT_GE(bbst::persistent_avl_tree_invariant(now.root()), 0);
+                    auto it = expect.begin();
+                    now.for_each([&](const auto &value)
+                                 {
+                                     ASSERT_NE(it, expect.end());
+                                     EXPECT_EQ(value.key, it->first);
+                                     EXPECT_EQ(value.mapped.value, it->second);
+                                     ++it;
+                                 });
+                    EXPECT_EQ(it, expect.end());
+                }
+            }
+        }
+    }
+}
+
+TEST(ExhaustiveTest, persistent_avl_tree_throwing_copy)
+{
+    using exposure_t = bbst::exposure<int, throwing_copy, int>;
+    check_persistent_avl_tree_failed_writes<bbst::persistent_avl_tree<int, throwing_copy, int, bbst::order_statistic_metadata_updator_impl>>(
+            [](int budget) { throwing_copy::copies_left = budget; });
+    check_persistent_avl_tree_failed_writes<bbst::persistent_avl_tree<int, throwing_copy, int, bbst::order_statistic_metadata_updator_impl
+                                                                      , std::less<int>, budget_allocator<exposure_t>>>(
+            [](int budget) { allocations_left = budget < 0 ? std::numeric_limits<int>::max() : budget; });
+}
+
+TEST(ExhaustiveTest, tree_file)
+{
+    constexpr int mx = 40;
+    using rb_t = bbst::rb_tree<int, long long, int, bbst::order_statistic_metadata_updator_impl>;
+    using avl_t = bbst::avl_tree<int, long long, int, bbst::noop_metadata_updator_impl>;
+    using view_t = bbst::tree_file_view<int, long long>;
+    using rb_order_statistic_invoker = bbst::rb_tree_custom_invoke<int, long long, int, bbst::order_statistic_metadata_updator_impl, std::less<int>, bbst::rb_tree_custom_invoke_order_statistic_tag>;
+    std::string path = (std::filesystem::temp_directory_path() / ("bbst_tree_file_" + std::to_string(::getpid()))).string();
+    for (int n = 0; n <= mx; n++)
+    {
+        rb_t rb;
+        for (int i = 0; i < n; i++) rb.try_emplace(2 * i, i, -1ll * i * i);
+        bbst::save(rb, path);
+        //the file holds no shape, it loads into either tree
+        auto avl = bbst::load<avl_t>(path);
+        auto rb_loaded = bbst::load<rb_t>(path);
+        EXPECT_EQ(rb_order_statistic_invoker::size(rb_loaded), n);
+        int i = 0;
+        for (auto p: avl)
+        {
+            EXPECT_EQ(p.key, 2 * i);
+            EXPECT_EQ(p.mapped, -1ll * i * i);
+            i++;
+        }
+        EXPECT_EQ(i, n);
+        view_t view(path);
+        EXPECT_EQ(view.size(), size_t(n));
+        i = 0;
+        for (auto &entry: view)
+        {
+            EXPECT_EQ(entry.first, 2 * i);
+            EXPECT_EQ(entry.second, -1ll * i * i);
+            i++;
+        }
+        for (int key = -1; key <= 2 * n; key++)
+        {
+            auto found = view.find(key);
+            auto expect = rb.find(key);
+            EXPECT_EQ(found == view.end(), expect == rb.end());
+            if (found != view.end())
+            {
+                EXPECT_EQ(found->second, expect->mapped);
+            }
+            auto bound = view.lower_bound(key);
+            auto expect_bound = rb.lower_bound(key);
+            EXPECT_EQ(bound == view.end(), expect_bound == rb.end());
+            if (bound != view.end())
+            {
+                EXPECT_EQ(bound->first, expect_bound->key);
+            }
+            EXPECT_EQ(view.upper_bound(key) - view.begin(), view.lower_bound(key + 1) - view.begin());
+        }
+    }
+    EXPECT_FALSE(std::filesystem::exists(path + ".tmp"));
+    //a save that can't go through leaves the previous file in place
+    std::filesystem::create_directory(path + ".tmp");
+    rb_t other;
+    other.try_emplace(-1);
+    EXPECT_THROW(bbst::save(other, path), std::system_error);
+    std::filesystem::remove(path + ".tmp");
+    EXPECT_EQ(view_t{path}.size(), size_t(mx));
+    //other types, truncated files and missing files are refused
+    EXPECT_THROW((bbst::tree_file_view<long long, long long>(path)), std::runtime_error);
+    std::filesystem::resize_file(path, sizeof(bbst::tree_file_header) + 3);
+    EXPECT_THROW(view_t{path}, std::runtime_error);
+    std::filesystem::remove(path);
+    EXPECT_THROW(view_t{path}, std::system_error);
+    EXPECT_THROW(bbst::load<avl_t>(path), std::system_error);
+}
+
+namespace
+{
+    //smallest nodes, so that a few hundred keys already make four levels
+    using bplus_t = bbst::bplus_tree<int, int, int, bbst::order_statistic_metadata_updator_impl, std::less<int>, std::allocator<bbst::exposure<int, int, int>>, 8>;
+    using bplus_invoker = bbst::bplus_tree_custom_invoke<int, int, int, bbst::order_statistic_metadata_updator_impl, std::less<int>
+                                                         , bbst::bplus_tree_custom_invoke_default_tag, std::allocator<bbst::exposure<int, int, int>>, 8>;
+    using bplus_order_statistic_invoker = bbst::bplus_tree_custom_invoke<int, int, int, bbst::order_statistic_metadata_updator_impl, std::less<int>
+                                                                         , bbst::bplus_tree_custom_invoke_order_statistic_tag, std::allocator<bbst::exposure<int, int, int>>, 8>;
+
+    //contents, order statistics and both iteration directions against expect (mapped is -key)
+    void check_bplus(const bplus_t &tree, const std::vector<int> &expect)
+    {
+        EXPECT_EQ(bplus_order_statistic_invoker::size(tree), expect.size());
+        auto it = tree.begin();
+        for (size_t i = 0; i < expect.size(); i++, ++it)
+        {
+            ASSERT_NE(it, tree.end());
+            EXPECT_EQ(it->key, expect[i]);
+            EXPECT_EQ(it->mapped, -expect[i]);
+            EXPECT_EQ(bplus_order_statistic_invoker::find_by_order(tree, i), it);
+            EXPECT_EQ(bplus_order_statistic_invoker::order_of_key(tree, expect[i]), i);
+        }
+        EXPECT_EQ(it, tree.end());
+        for (size_t i = expect.size(); i-- > 0;)
+            EXPECT_EQ((*--it).key, expect[i]);
+    }
+}
+
+TEST(ExhaustiveTest, bplus_tree)
+{
+    //debug build: every insertion and erasure asserts occupancy, key order and the leaf chain
+    constexpr int mx = 300;
+    std::mt19937 gen(20);
+    for (int n = 0; n <= mx; n += n < 40 ? 1 : 13)
+    {
+        std::vector<int> keys(n);
+        std::iota(keys.begin(), keys.end(), 0);
+        for (int built = 0; built < 2; built++)
+        {
+            std::vector<std::pair<int, int>> sorted;
+            for (int k = 0; k < n; k++) sorted.emplace_back(k, -k);
+            bplus_t tree = built ? bplus_t(bbst::sorted_unique, sorted.begin(), sorted.end()) : bplus_t();
+            std::shuffle(keys.begin(), keys.end(), gen);
+            if (!built)
+                for (int k: keys)
+                {
+                    EXPECT_TRUE(tree.try_emplace(k, -k).second);
+                    EXPECT_FALSE(tree.try_emplace(k, 0).second);
+                }
+            std::vector<int> alive(n);
+            std::iota(alive.begin(), alive.end(), 0);
+            check_bplus(tree, alive);
+            for (int k = -1; k <= n; k++)
+            {
+                EXPECT_EQ(tree.find(k) == tree.end(), k < 0 || k == n);
+                auto bound = tree.lower_bound(k);
+                if (std::max(k, 0) >= n) EXPECT_EQ(bound, tree.end());
+                else EXPECT_EQ(bound->key, std::max(k, 0));
+                auto upper = tree.upper_bound(k);
+                if (k + 1 >= n) EXPECT_EQ(upper, tree.end());
+                else EXPECT_EQ(upper->key, k + 1);
+            }
+            //erase half by key, the rest through iterators
+            std::shuffle(keys.begin(), keys.end(), gen);
+            for (int i = 0; i < n; i++)
+            {
+                int k = keys[i];
+                alive.erase(std::find(alive.begin(), alive.end(), k));
+                auto expect_next = std::upper_bound(alive.begin(), alive.end(), k);
+                if (i % 2 == 0)
+                {
+                    EXPECT_EQ(tree.erase(k), 1);
+                    EXPECT_EQ(tree.erase(k), 0);
+                }
+                else
+                {
+                    auto next = tree.erase(tree.find(k));
+                    if (expect_next == alive.end()) EXPECT_EQ(next, tree.end());
+                    else EXPECT_EQ(next->key, *expect_next);
+                }
+                if (i % 16 == 0 || n - i < 16) check_bplus(tree, alive);
+            }
+            EXPECT_TRUE(tree.empty());
+            EXPECT_EQ(tree.begin(), tree.end());
+        }
+    }
+}
+
+TEST(ExhaustiveTest, bplus_tree_split_join)
+{
+    //debug build: split and join assert the invariants of their inputs and results, underfull roots included
+    constexpr int mx = 120;
+    auto build = [](int first, int last)
+    {
+        std::vector<std::pair<int, int>> sorted;
+        for (int k = first; k < last; k++) sorted.emplace_back(k, -k);
+        return bplus_t(bbst::sorted_unique, sorted.begin(), sorted.end());
+    };
+    auto range = [](int first, int last)
+    {
+        std::vector<int> keys(std::max(last - first, 0));
+        std::iota(keys.begin(), keys.end(), first);
+        return keys;
+    };
+    for (int n = 0; n <= mx; n++)
+    {
+        for (int key = -1; key <= n; key++)
+        {
+            int cut = std::clamp(key + 1, 0, n);
+            auto [l, r] = bplus_invoker::split_by_key<true>(build(0, n), key);
+            check_bplus(l, range(0, cut));
+            check_bplus(r, range(cut, n));
+            auto joined = bplus_invoker::join(std::move(l), std::move(r));
+            check_bplus(joined, range(0, n));
+            auto [ol, or_] = bplus_order_statistic_invoker::split_by_order(std::move(joined), std::max(key, 0));
+            check_bplus(ol, range(0, std::clamp(key, 0, n)));
+            check_bplus(or_, range(std::clamp(key, 0, n), n));
+            //trees of unrelated heights, with the key in between
+            if (0 <= key && key < n)
+            {
+                auto [kl, kr] = bplus_invoker::split_by_key<false>(build(0, n), key);
+                kr.erase(key);
+                auto x = bplus_invoker::join_x(std::move(kl), key, -key, std::move(kr));
+                check_bplus(x, range(0, n));
+                auto shallow = bplus_invoker::join(build(-key - 1, 0), build(0, n));
+                check_bplus(shallow, range(-key - 1, n));
+            }
+        }
+    }
+}
+
+TEST(ExhaustiveTest, bplus_tree_split_join_bad_alloc)
+{
+    //split and join are retried with an allocation budget from 0 up until they go through:
+    //a failed one leaves its trees as they were, and leaks nothing (ASan)
+    using budget_bplus_t = bbst::bplus_tree<int, int, int, bbst::order_statistic_metadata_updator_impl, std::less<int>
+                                            , budget_allocator<bbst::exposure<int, int, int>>, 8>;
+    using budget_invoker = bbst::bplus_tree_custom_invoke<int, int, int, bbst::order_statistic_metadata_updator_impl, std::less<int>
+                                                          , bbst::bplus_tree_custom_invoke_default_tag, budget_allocator<bbst::exposure<int, int, int>>, 8>;
+    auto build = [](int first, int last)
+    {
+        std::vector<std::pair<int, int>> sorted;
+        for (int k = first; k < last; k++) sorted.emplace_back(k, -k);
+        return budget_bplus_t(bbst::sorted_unique, sorted.begin(), sorted.end());
+    };
+    auto keys = [](const budget_bplus_t &tree)
+    {
+        std::vector<int> result;
+        for (auto &&e: tree) result.push_back(e.key);
+        return result;
+    };
+    auto range = [](int first, int last)
+    {
+        std::vector<int> result(std::max(last - first, 0));
+        std::iota(result.begin(), result.end(), first);
+        return result;
+    };
+    auto retry = [](auto attempt, auto unchanged)
+    {
+        for (int budget = 0;; budget++)
+        {
+            allocations_left = budget;
+            try
+            {
+                auto result = attempt();
+                allocations_left = std::numeric_limits<int>::max();
+                return result;
+            }
+            catch (const std::bad_alloc &)
+            {
+                allocations_left = std::numeric_limits<int>::max();
+                unchanged();
+            }
+        }
+    };
+    //heights up to 4 with 8 slots a node
+    for (int n: {0, 1, 7, 9, 40, 64, 65, 300, 1000})
+    {
+        for (int key = -1; key <= n; key += std::max(n / 23, 1))
+        {
+            int cut = std::clamp(key + 1, 0, n);
+            budget_bplus_t tree = build(0, n);
+            auto [l, r] = retry([&] { return budget_invoker::split_by_key<true>(std::move(tree), key); },
+                                [&] { EXPECT_EQ(keys(tree), range(0, n)); });
+            EXPECT_EQ(keys(l), range(0, cut));
+            EXPECT_EQ(keys(r), range(cut, n));
+            //a deeper tree in front, so that the join walks down its spine
+            budget_bplus_t lower = build(-4 * n - 1, 0);
+            auto joined = retry([&] { return budget_invoker::join(std::move(lower), std::move(r)); },
+                                [&]
+                                {
+                                    EXPECT_EQ(keys(lower), range(-4 * n - 1, 0));
+                                    EXPECT_EQ(keys(r), range(cut, n));
+                                });
+            std::vector<int> expect = range(-4 * n - 1, 0), upper = range(cut, n);
+            expect.insert(expect.end(), upper.begin(), upper.end());
+            EXPECT_EQ(keys(joined), expect);
+        }
+    }
+}
+
+namespace
+{
+    template<class key_t>
+    void check_simd_count_less(std::mt19937 &gen)
+    {
+        constexpr key_t lo = std::numeric_limits<key_t>::min(), hi = std::numeric_limits<key_t>::max();
+        //extremes and the values around the sign bit, where a plain signed compare of unsigned keys goes wrong
+        std::vector<key_t> pool = {lo, key_t(lo + 1), key_t(-1), 0, 1, key_t(hi - 1), hi, key_t(key_t(1) << (sizeof(key_t) * 8 - 1)),
+                                   key_t(hi >> 1)};
+        //wraps around on purpose, in unsigned arithmetic
+        using unsigned_t = std::make_unsigned_t<key_t>;
+        for (int i = 0; i < 48; i++) pool.push_back(key_t(unsigned_t(gen()) * unsigned_t(gen())));
+        std::sort(pool.begin(), pool.end());
+        pool.erase(std::unique(pool.begin(), pool.end()), pool.end());
+        for (uint32_t n = 0; n <= 40 && n <= pool.size(); n++)
+        {
+            std::vector<key_t> keys(pool.begin(), pool.begin() + n);
+            for (key_t key: pool)
+            {
+                EXPECT_EQ(bbst::simd_count_less<false>(keys.data(), n, key), std::lower_bound(keys.begin(), keys.end(), key) - keys.begin());
+                EXPECT_EQ(bbst::simd_count_less<true>(keys.data(), n, key), std::upper_bound(keys.begin(), keys.end(), key) - keys.begin());
+            }
+        }
+    }
+}
+
+TEST(ExhaustiveTest, simd_key_search)
+{
+    std::cerr << "[          ] key search path = " << bbst::key_search_path_name(bbst::native_key_search_path) << std::endl;
+#ifdef BBST_EXPECTED_KEY_SEARCH_PATH
+    //the per instruction set test targets make sure their branch is the one compiled in
+    EXPECT_EQ(bbst::native_key_search_path, bbst::key_search_path::BBST_EXPECTED_KEY_SEARCH_PATH);
+#endif
+    std::mt19937 gen(23);
+    check_simd_count_less<int32_t>(gen);
+    check_simd_count_less<uint32_t>(gen);
+    check_simd_count_less<int64_t>(gen);
+    check_simd_count_less<uint64_t>(gen);
+    static_assert(bplus_t::key_search == bbst::native_key_search_path);
+    static_assert(bbst::bplus_tree<int, int, int, bbst::noop_metadata_updator_impl, std::greater<int>>::key_search == bbst::key_search_path::scalar);
+    static_assert(bbst::bplus_tree<std::string, int, int, bbst::noop_metadata_updator_impl>::key_search == bbst::key_search_path::scalar);
+    //unsigned keys on both sides of the sign bit through the tree
+    bbst::bplus_tree<uint64_t, int, int, bbst::noop_metadata_updator_impl, std::less<uint64_t>, std::allocator<bbst::exposure<uint64_t, int, int>>, 8> tree;
+    std::set<uint64_t> expect;
+    for (int i = 0; i < 500; i++)
+    {
+        uint64_t key = gen() % 2 ? uint64_t(gen()) : ~uint64_t(gen());
+        tree.try_emplace(key, i);
+        expect.insert(key);
+    }
+    EXPECT_TRUE(std::equal(expect.begin(), expect.end(), tree.begin(), tree.end(), [](uint64_t k, auto p) { return k == p.key; }));
+    for (uint64_t key: expect)
+    {
+        EXPECT_EQ(tree.find(key)->key, key);
+        auto upper = tree.upper_bound(key);
+        auto expect_upper = expect.upper_bound(key);
+        EXPECT_EQ(upper == tree.end(), expect_upper == expect.end());
+    }
+}
+
+namespace
+{
+    //trees over no_metadata: the walks skipped for a noop updator must not leave anything else undone
+    template<class tree_t, class invoker_t>
+    void check_no_metadata()
+    {
+        constexpr int mx = 7;
+        std::array<int, mx> s{};
+        std::iota(s.begin(), s.end(), 0);
+        do
+        {
+            tree_t tree;
+            for (int i: s) tree.try_emplace(i, bbst::no_metadata(), -i);
+            std::vector<int> alive(mx);
+            std::iota(alive.begin(), alive.end(), 0);
+            for (int i: s)
+            {
+                EXPECT_EQ(tree.find(i)->mapped, -i);
+                EXPECT_EQ(tree.erase(i), 1);
+                alive.erase(std::find(alive.begin(), alive.end(), i));
+                std::vector<int> keys_left;
+                for (auto p: tree) keys_left.push_back(p.key);
+                EXPECT_EQ(keys_left, alive);
+            }
+            EXPECT_TRUE(tree.empty());
+        } while (std::next_permutation(s.begin(), s.end()));
+        for (int n = 0; n <= 2 * mx; n++)
+            for (int key = -1; key <= n; key++)
+            {
+                std::vector<int> keys(n);
+                std::iota(keys.begin(), keys.end(), 0);
+                auto [l, r] = invoker_t::template split_by_key<true>(tree_t(bbst::sorted_unique, keys.begin(), keys.end()), key);
+                int left_size = 0;
+                for (auto p: l) EXPECT_EQ(p.key, left_size++);
+                EXPECT_EQ(left_size, std::clamp(key + 1, 0, n));
+                tree_t joined = invoker_t::union_(std::move(l), std::move(r));
+                std::vector<int> joined_keys;
+                for (auto p: joined) joined_keys.push_back(p.key);
+                EXPECT_EQ(joined_keys, keys);
+            }
+    }
+}
+
+TEST(ExhaustiveTest, no_metadata)
+{
+    using noop_t = bbst::noop_metadata_updator_impl;
+    static_assert(sizeof(bbst::exposure<int, int, bbst::no_metadata>) == 2 * sizeof(int));
+    static_assert(sizeof(bbst::rb_tree_node<bbst::exposure<int64_t, int64_t, bbst::no_metadata>>) <
+                  sizeof(bbst::rb_tree_node<bbst::exposure<int64_t, int64_t, int64_t>>));
+    check_no_metadata<bbst::rb_tree<int, int, bbst::no_metadata, noop_t>
+            , bbst::rb_tree_custom_invoke<int, int, bbst::no_metadata, noop_t, std::less<int>, bbst::rb_tree_custom_invoke_default_tag>>();
+    check_no_metadata<bbst::avl_tree<int, int, bbst::no_metadata, noop_t>
+            , bbst::avl_tree_custom_invoke<int, int, bbst::no_metadata, noop_t, std::less<int>, bbst::avl_tree_custom_invoke_default_tag>>();
+    check_no_metadata<bbst::treap<int, int, bbst::no_metadata, noop_t>
+            , bbst::treap_custom_invoke<int, int, bbst::no_metadata, noop_t, std::less<int>, bbst::treap_custom_invoke_default_tag>>();
+}
+
+namespace
+{
+    template<class set_t>
+    void check_set_mode(std::mt19937 &gen)
+    {
+        constexpr int mx = 200;
+        std::vector<int> keys(mx);
+        std::iota(keys.begin(), keys.end(), 0);
+        std::shuffle(keys.begin(), keys.end(), gen);
+        set_t set;
+        std::set<int> expect;
+        for (int i = 0; i < mx; i++)
+        {
+            EXPECT_EQ(set.try_emplace(keys[i] / 2).second, expect.insert(keys[i] / 2).second);
+            if (i % 3 == 2)
+            {
+                EXPECT_EQ(set.erase(keys[i - 1]), expect.erase(keys[i - 1]));
+            }
+        }
+        //elements bind to their key
+        std::vector<int> got;
+        for (const int &key: set) got.push_back(key);
+        EXPECT_EQ(got, std::vector<int>(expect.begin(), expect.end()));
+        set_t built(bbst::sorted_unique, expect.begin(), expect.end());
+        got.clear();
+        for (int key: built) got.push_back(key);
+        EXPECT_EQ(got, std::vector<int>(expect.begin(), expect.end()));
+    }
+}
+
+TEST(ExhaustiveTest, set_mode)
+{
+    using order_t = bbst::order_statistic_metadata_updator_impl;
+    static_assert(sizeof(bbst::exposure<int, bbst::no_mapped, bbst::no_metadata>) == sizeof(int));
+    static_assert(sizeof(bbst::rb_tree_node<bbst::exposure<int, bbst::no_mapped, int>>) <
+                  sizeof(bbst::rb_tree_node<bbst::exposure<int, int, int>>));
+    std::mt19937 gen(25);
+    check_set_mode<bbst::rb_set<int>>(gen);
+    check_set_mode<bbst::avl_set<int>>(gen);
+    check_set_mode<bbst::treap_set<int>>(gen);
+    check_set_mode<bbst::rb_set<int, int, order_t>>(gen);
+    check_set_mode<bbst::avl_set<int, int, order_t>>(gen);
+    //order statistics and save/load work on sets as on maps
+    using set_t = bbst::avl_set<int, int, order_t>;
+    using invoker = bbst::avl_tree_custom_invoke<int, bbst::no_mapped, int, order_t, std::less<int>, bbst::avl_tree_custom_invoke_order_statistic_tag>;
+    set_t set;
+    for (int i = 0; i < 50; i++) set.try_emplace(3 * i);
+    for (int i = 0; i < 50; i++) EXPECT_EQ(int(invoker::find_by_order(set, i)->key), 3 * i);
+    std::string path = (std::filesystem::temp_directory_path() / ("bbst_set_file_" + std::to_string(::getpid()))).string();
+    bbst::save(set, path);
+    EXPECT_EQ(std::filesystem::file_size(path), sizeof(bbst::tree_file_header) + 50 * sizeof(int));
+    auto loaded = bbst::load<bbst::rb_set<int>>(path);
+    std::filesystem::remove(path);
+    int i = 0;
+    for (int key: loaded) EXPECT_EQ(key, 3 * i++);
+    EXPECT_EQ(i, 50);
+}
+
+TEST(ExhaustiveTest, treap_deep_path)
+{
+    //priorities falling with the keys chain every node as a right child, far deeper than tree_split_max_depth
+    constexpr int n = 1000;
+    using metadata_t = bbst::range_add_sum_metadata<long long>;
+    using updator_t = bbst::range_add_sum_metadata_updator;
+    using treap_t = bbst::treap<int, long long, metadata_t, updator_t>;
+    using treap_invoker = bbst::treap_custom_invoke<int, long long, metadata_t, updator_t, std::less<int>, bbst::treap_custom_invoke_default_tag>;
+    using node_t = bbst::treap_node<bbst::exposure<int, long long, metadata_t>>;
+    auto build_chain = [&]()
+    {
+        std::allocator<node_t> alloc;
+        std::vector<node_t *> nodes(n);
+        for (int i = 0; i < n; i++)
+        {
+            nodes[i] = alloc.allocate(1);
+            std::construct_at(nodes[i], uint32_t(n - i), i, metadata_t(), (long long) i);
+            if (i != 0)
+            {
+                nodes[i - 1]->right = nodes[i];
+                nodes[i]->parent = nodes[i - 1];
+            }
+        }
+        for (int i = n - 1; i >= 0; i--) updator_t()(nodes[i]);
+        treap_t tree;
+        treap_invoker::from_treap_header(tree, bbst::treap_header<int, long long, metadata_t>(nodes[0]));
+        return tree;
+    };
+    auto expect_values = [](const treap_t &tree, int first, int last, long long delta)
+    {
+        int i = first;
+        for (auto p: tree)
+        {
+            EXPECT_EQ(p.key, i);
+            EXPECT_EQ(p.mapped, i + delta);
+            i++;
+        }
+        EXPECT_EQ(i, last);
+    };
+    //push down along the whole chain, through the lookup and through an erase
+    treap_t tree = build_chain();
+    treap_invoker::range_update(tree, 0, n - 1, [](auto root) { updator_t::add(root, 5ll); });
+    treap_invoker::push_down_path(tree, tree.find(n - 1));
+    EXPECT_EQ(tree.find(n - 1)->mapped, n - 1 + 5);
+    EXPECT_EQ(tree.erase(n - 1), 1);
+    treap_invoker::push_down_all(tree);
+    expect_values(tree, 0, n - 1, 5);
+    //split_at steering down the whole chain
+    for (int at: {n - 1, n / 2, 1})
+    {
+        treap_t whole = build_chain();
+        auto pos = whole.find(at);
+        auto [left, right] = treap_invoker::split_at(std::move(whole), pos);
+        expect_values(left, 0, at, 0);
+        expect_values(right, at, n, 0);
+    }
+}
+
 int main(int argc, char **argv)
 {
     ::testing::InitGoogleTest(&argc, argv);
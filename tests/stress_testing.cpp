@@ -1,11 +1,23 @@
+#include <algorithm>
 #include <iostream>
+#include <map>
 #include <numeric>
 #include <random>
+#include <set>
+#include <thread>
+#include <vector>
 
 #include "../rb_tree.h"
 #include "../avl_tree.h"
 #include "../rb_tree_custom_invoke.h"
 #include "../avl_tree_custom_invoke.h"
+#include "../treap.h"
+#include "../treap_custom_invoke.h"
+#include "../node_pool.h"
+#include "../fork_join_pool.h"
+#include "../persistent_avl_tree.h"
+#include "../bplus_tree.h"
+#include "../bplus_tree_custom_invoke.h"
 
 #include <gtest/gtest.h>
 
@@ -92,6 +104,144 @@ TEST(StressTest, rb_tree_order_statistic)
     }
 }
 
+TEST(StressTest, avl_tree_order_statistic)
+{
+    int iteration = mx_iteration;
+    std::array<int, mx_len> s{};
+    std::iota(s.begin(), s.end(), 0);
+    while (iteration--)
+    {
+        auto seed = std::random_device()();
+        auto gen = std::mt19937(seed);
+        std::cerr << "[          ] random seed = " << seed << std::endl;
+        std::shuffle(s.begin(), s.end(), gen);
+        bbst::avl_tree<int, int, int, bbst::order_statistic_metadata_updator_impl> avl;
+        for (int i: s) avl.try_emplace(i);
+        using avl_order_statistic_invoker = bbst::avl_tree_custom_invoke<int, int, int, bbst::order_statistic_metadata_updator_impl, std::less<int>, bbst::avl_tree_custom_invoke_order_statistic_tag>;
+        EXPECT_EQ(avl_order_statistic_invoker::size(avl), mx_len);
+        for (int i: s) EXPECT_EQ(avl_order_statistic_invoker::find_by_order(avl, i)->key, i);
+        for (int i: s) EXPECT_EQ(avl_order_statistic_invoker::order_of_key(avl, i), i);
+        EXPECT_EQ(avl_order_statistic_invoker::find_by_order(avl, mx_len), avl.end());
+
+        //should work after split
+        using avl_default_invoker = bbst::avl_tree_custom_invoke<int, int, int, bbst::order_statistic_metadata_updator_impl, std::less<int>, bbst::avl_tree_custom_invoke_default_tag>;
+        auto split = std::uniform_int_distribution<int>(0, mx_len)(gen);
+        auto [l, r] = avl_default_invoker::split_by_key<false>(std::move(avl), split);
+        EXPECT_EQ(avl_order_statistic_invoker::size(l), split);
+        EXPECT_EQ(avl_order_statistic_invoker::size(r), mx_len - split);
+        for (int i = 0; i < split; i++) EXPECT_EQ(avl_order_statistic_invoker::find_by_order(l, i)->key, i);
+        for (int i = 0; i < split; i++) EXPECT_EQ(avl_order_statistic_invoker::order_of_key(l, i), i);
+        EXPECT_EQ(avl_order_statistic_invoker::find_by_order(l, split), l.end());
+        for (int i = split; i < mx_len; i++) EXPECT_EQ(avl_order_statistic_invoker::find_by_order(r, i - split)->key, i);
+        for (int i = split; i < mx_len; i++) EXPECT_EQ(avl_order_statistic_invoker::order_of_key(r, i), i - split);
+        EXPECT_EQ(avl_order_statistic_invoker::find_by_order(r, mx_len - split), r.end());
+
+        //split by rank
+        auto rank = std::uniform_int_distribution<int>(0, mx_len - split)(gen);
+        auto [rl, rr] = avl_order_statistic_invoker::split_by_order(std::move(r), rank);
+        EXPECT_EQ(avl_order_statistic_invoker::size(rl), rank);
+        EXPECT_EQ(avl_order_statistic_invoker::size(rr), mx_len - split - rank);
+        if (rank > 0)
+        {
+            EXPECT_EQ((--rl.end())->key, split + rank - 1);
+        }
+        if (rank < mx_len - split)
+        {
+            EXPECT_EQ(rr.begin()->key, split + rank);
+        }
+    }
+}
+
+TEST(StressTest, treap_order_statistic)
+{
+    int iteration = mx_iteration;
+    std::array<int, mx_len> s{};
+    std::iota(s.begin(), s.end(), 0);
+    using treap_t = bbst::treap<int, int, int, bbst::order_statistic_metadata_updator_impl>;
+    using treap_order_statistic_invoker = bbst::treap_custom_invoke<int, int, int, bbst::order_statistic_metadata_updator_impl, std::less<int>, bbst::treap_custom_invoke_order_statistic_tag>;
+    using treap_default_invoker = bbst::treap_custom_invoke<int, int, int, bbst::order_statistic_metadata_updator_impl, std::less<int>, bbst::treap_custom_invoke_default_tag>;
+    while (iteration--)
+    {
+        auto seed = std::random_device()();
+        auto gen = std::mt19937(seed);
+        std::cerr << "[          ] random seed = " << seed << std::endl;
+        std::shuffle(s.begin(), s.end(), gen);
+        treap_t treap;
+        for (int i: s) treap.try_emplace(i);
+        EXPECT_EQ(treap_order_statistic_invoker::size(treap), mx_len);
+        for (int i: s) EXPECT_EQ(treap_order_statistic_invoker::find_by_order(treap, i)->key, i);
+        for (int i: s) EXPECT_EQ(treap_order_statistic_invoker::order_of_key(treap, i), i);
+
+        //split, erase half of one side, join back
+        auto split = std::uniform_int_distribution<int>(0, mx_len)(gen);
+        auto [l, r] = treap_default_invoker::split_by_key<false>(std::move(treap), split);
+        EXPECT_EQ(treap_order_statistic_invoker::size(l), split);
+        EXPECT_EQ(treap_order_statistic_invoker::size(r), mx_len - split);
+        for (int i = split; i < mx_len; i += 2) EXPECT_EQ(r.erase(i), 1);
+        for (int i = split; i < mx_len; i++) EXPECT_EQ(treap_order_statistic_invoker::order_of_key(r, i), (i - split) / 2);
+        auto joined = treap_default_invoker::union_(std::move(l), std::move(r));
+        EXPECT_EQ(treap_order_statistic_invoker::size(joined), split + (mx_len - split) / 2);
+        int prev = -1;
+        for (auto p: joined)
+        {
+            EXPECT_LT(prev, p.key);
+            prev = p.key;
+        }
+    }
+}
+
+TEST(StressTest, bplus_tree_order_statistic)
+{
+    int iteration = mx_iteration;
+    std::array<int, mx_len> s{};
+    std::iota(s.begin(), s.end(), 0);
+    using bplus_t = bbst::bplus_tree<int, int, int, bbst::order_statistic_metadata_updator_impl>;
+    using bplus_order_statistic_invoker = bbst::bplus_tree_custom_invoke<int, int, int, bbst::order_statistic_metadata_updator_impl, std::less<int>, bbst::bplus_tree_custom_invoke_order_statistic_tag>;
+    using bplus_default_invoker = bbst::bplus_tree_custom_invoke<int, int, int, bbst::order_statistic_metadata_updator_impl, std::less<int>, bbst::bplus_tree_custom_invoke_default_tag>;
+    while (iteration--)
+    {
+        auto seed = std::random_device()();
+        auto gen = std::mt19937(seed);
+        std::cerr << "[          ] random seed = " << seed << std::endl;
+        std::shuffle(s.begin(), s.end(), gen);
+        bplus_t bplus;
+        for (int i: s) bplus.try_emplace(i, -i);
+        EXPECT_EQ(bplus_order_statistic_invoker::size(bplus), mx_len);
+        for (int i: s) EXPECT_EQ(bplus_order_statistic_invoker::find_by_order(bplus, i)->key, i);
+        for (int i: s) EXPECT_EQ(bplus_order_statistic_invoker::order_of_key(bplus, i), i);
+
+        //split, erase half of one side, join back
+        auto split = std::uniform_int_distribution<int>(0, mx_len)(gen);
+        auto [l, r] = bplus_default_invoker::split_by_key<false>(std::move(bplus), split);
+        EXPECT_EQ(bplus_order_statistic_invoker::size(l), split);
+        EXPECT_EQ(bplus_order_statistic_invoker::size(r), mx_len - split);
+        for (int i = split; i < mx_len; i += 2) EXPECT_EQ(r.erase(i), 1);
+        for (int i = split; i < mx_len; i++) EXPECT_EQ(bplus_order_statistic_invoker::order_of_key(r, i), (i - split) / 2);
+        auto joined = bplus_default_invoker::join(std::move(l), std::move(r));
+        EXPECT_EQ(bplus_order_statistic_invoker::size(joined), split + (mx_len - split) / 2);
+        int prev = -1;
+        for (auto p: joined)
+        {
+            EXPECT_LT(prev, p.key);
+            EXPECT_EQ(p.mapped, -p.key);
+            prev = p.key;
+        }
+        //drain in random order, the tree must keep up with a std::set
+        std::set<int> expect;
+        for (auto p: joined) expect.insert(p.key);
+        std::shuffle(s.begin(), s.end(), gen);
+        for (int i: s)
+        {
+            EXPECT_EQ(joined.erase(i), expect.erase(i));
+            if (i % 1024 == 0)
+            {
+                EXPECT_EQ(bplus_order_statistic_invoker::size(joined), expect.size());
+            }
+        }
+        EXPECT_TRUE(joined.empty());
+    }
+}
+
 TEST(StressTest, avl_tree)
 {
     int iteration = mx_iteration;
@@ -138,6 +288,353 @@ TEST(StressTest, avl_tree_split_key)
     }
 }
 
+TEST(StressTest, rb_tree_node_pool_split)
+{
+    int iteration = mx_iteration;
+    std::array<int, mx_len> s{};
+    std::iota(s.begin(), s.end(), 0);
+    auto seed = std::random_device()();
+    auto gen = std::mt19937(seed);
+    std::cerr << "[          ] random seed = " << seed << std::endl;
+    using allocator = bbst::node_pool_allocator<bbst::exposure<int, int, int>>;
+    allocator pool;
+    while (iteration--)
+    {
+        std::shuffle(s.begin(), s.end(), gen);
+        bbst::rb_tree<int, int, int, bbst::noop_metadata_updator_impl, std::less<int>, allocator> rb({}, {}, pool);
+        for (int i: s) rb.try_emplace(i);
+        EXPECT_EQ(rb.get_allocator(), pool);
+        using rb_default_invoker = bbst::rb_tree_custom_invoke<int, int, int, bbst::noop_metadata_updator_impl, std::less<int>, bbst::rb_tree_custom_invoke_default_tag, allocator>;
+        auto split = std::uniform_int_distribution<int>(0, mx_len)(gen);
+        auto [l, r] = rb_default_invoker::split_by_key<false>(std::move(rb), split);
+        EXPECT_EQ(l.get_allocator(), pool);
+        EXPECT_EQ(r.get_allocator(), pool);
+        int i = 0;
+        for (auto p: l) EXPECT_EQ(p.key, i++);
+        EXPECT_EQ(i, split);
+        for (auto p: r) EXPECT_EQ(p.key, i++);
+        EXPECT_EQ(i, mx_len);
+    }
+    //every node went back to the free list, the pool never had to grow past the first tree
+    auto slabs = pool.resource()->slab_count();
+    {
+        bbst::rb_tree<int, int, int, bbst::noop_metadata_updator_impl, std::less<int>, allocator> rb({}, {}, pool);
+        for (int i: s) rb.try_emplace(i);
+    }
+    EXPECT_EQ(pool.resource()->slab_count(), slabs);
+}
+
+TEST(StressTest, avl_tree_node_pool_split)
+{
+    int iteration = mx_iteration;
+    std::array<int, mx_len> s{};
+    std::iota(s.begin(), s.end(), 0);
+    auto seed = std::random_device()();
+    auto gen = std::mt19937(seed);
+    std::cerr << "[          ] random seed = " << seed << std::endl;
+    using allocator = bbst::node_pool_allocator<bbst::exposure<int, int, int>>;
+    allocator pool;
+    while (iteration--)
+    {
+        std::shuffle(s.begin(), s.end(), gen);
+        bbst::avl_tree<int, int, int, bbst::noop_metadata_updator_impl, std::less<int>, allocator> avl({}, {}, pool);
+        for (int i: s) avl.try_emplace(i);
+        using avl_default_invoker = bbst::avl_tree_custom_invoke<int, int, int, bbst::noop_metadata_updator_impl, std::less<int>, bbst::avl_tree_custom_invoke_default_tag, allocator>;
+        auto split = std::uniform_int_distribution<int>(0, mx_len)(gen);
+        auto [l, r] = avl_default_invoker::split_by_key<true>(std::move(avl), split);
+        EXPECT_EQ(l.get_allocator(), pool);
+        EXPECT_EQ(r.get_allocator(), pool);
+        int i = 0;
+        for (auto p: l) EXPECT_EQ(p.key, i++);
+        EXPECT_EQ(i, std::min(split + 1, mx_len));
+        for (auto p: r) EXPECT_EQ(p.key, i++);
+        EXPECT_EQ(i, mx_len);
+    }
+}
+
+TEST(StressTest, erase)
+{
+    int iteration = mx_iteration;
+    auto seed = std::random_device()();
+    auto gen = std::mt19937(seed);
+    std::cerr << "[          ] random seed = " << seed << std::endl;
+    std::uniform_int_distribution<int> key(0, mx_len / 4);
+    using rb_order_statistic_invoker = bbst::rb_tree_custom_invoke<int, int, int, bbst::order_statistic_metadata_updator_impl, std::less<int>, bbst::rb_tree_custom_invoke_order_statistic_tag>;
+    while (iteration--)
+    {
+        std::set<int> expect;
+        bbst::rb_tree<int, int, int, bbst::order_statistic_metadata_updator_impl> rb;
+        bbst::avl_tree<int, int, int, bbst::noop_metadata_updator_impl> avl;
+        for (int op = 0; op < mx_len; op++)
+        {
+            int k = key(gen);
+            if (op % 3 == 2)
+            {
+                int erased = int(expect.erase(k));
+                EXPECT_EQ(rb.erase(k), erased);
+                EXPECT_EQ(avl.erase(k), erased);
+            }
+            else if (op % 1000 == 999)
+            {
+                int hi = k + key(gen) % 64;
+                expect.erase(expect.lower_bound(k), expect.lower_bound(hi));
+                rb.erase(rb.lower_bound(k), rb.lower_bound(hi));
+                avl.erase(avl.lower_bound(k), avl.lower_bound(hi));
+            }
+            else
+            {
+                expect.insert(k);
+                rb.try_emplace(k);
+                avl.try_emplace(k);
+            }
+        }
+        EXPECT_EQ(rb_order_statistic_invoker::size(rb), expect.size());
+        auto rb_it = rb.begin();
+        auto avl_it = avl.begin();
+        size_t order = 0;
+        for (int k: expect)
+        {
+            EXPECT_EQ((rb_it++)->key, k);
+            EXPECT_EQ((avl_it++)->key, k);
+            EXPECT_EQ(rb_order_statistic_invoker::order_of_key(rb, k), order++);
+        }
+        EXPECT_EQ(rb_it, rb.end());
+        EXPECT_EQ(avl_it, avl.end());
+    }
+}
+
+TEST(StressTest, parallel_set_operation)
+{
+    int iteration = mx_iteration;
+    auto seed = std::random_device()();
+    auto gen = std::mt19937(seed);
+    std::cerr << "[          ] random seed = " << seed << std::endl;
+    std::uniform_int_distribution<int> key(0, mx_len * 4);
+    using rb_t = bbst::rb_tree<int, int, int, bbst::order_statistic_metadata_updator_impl>;
+    using avl_t = bbst::avl_tree<int, int, int, bbst::noop_metadata_updator_impl>;
+    using rb_invoker = bbst::rb_tree_custom_invoke<int, int, int, bbst::order_statistic_metadata_updator_impl, std::less<int>, bbst::rb_tree_custom_invoke_default_tag>;
+    using avl_invoker = bbst::avl_tree_custom_invoke<int, int, int, bbst::noop_metadata_updator_impl, std::less<int>, bbst::avl_tree_custom_invoke_default_tag>;
+    using rb_order_statistic_invoker = bbst::rb_tree_custom_invoke<int, int, int, bbst::order_statistic_metadata_updator_impl, std::less<int>, bbst::rb_tree_custom_invoke_order_statistic_tag>;
+    bbst::fork_join_pool pool(3);
+    bbst::parallel_policy policy{&pool, 64};
+    while (iteration--)
+    {
+        std::set<int> a, b;
+        for (int i = 0; i < mx_len; i++) a.insert(key(gen));
+        for (int i = 0; i < mx_len / (iteration % 7 + 1); i++) b.insert(key(gen));
+        std::vector<int> expect_union, expect_intersection, expect_difference;
+        std::set_union(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(expect_union));
+        std::set_intersection(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(expect_intersection));
+        std::set_difference(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(expect_difference));
+        auto check = [](const auto &tree, const std::vector<int> &expect)
+        {
+            auto it = tree.begin();
+            for (int k: expect) EXPECT_EQ((it++)->key, k);
+            EXPECT_EQ(it, tree.end());
+        };
+
+        auto rb_union = rb_invoker::union_(rb_t(bbst::sorted_unique, a.begin(), a.end()), rb_t(bbst::sorted_unique, b.begin(), b.end()), policy);
+        auto rb_intersection = rb_invoker::intersection(rb_t(bbst::sorted_unique, a.begin(), a.end()), rb_t(bbst::sorted_unique, b.begin(), b.end()), policy);
+        auto rb_difference = rb_invoker::difference(rb_t(bbst::sorted_unique, a.begin(), a.end()), rb_t(bbst::sorted_unique, b.begin(), b.end()), policy);
+        check(rb_union, expect_union);
+        check(rb_intersection, expect_intersection);
+        check(rb_difference, expect_difference);
+        EXPECT_EQ(rb_order_statistic_invoker::size(rb_union), expect_union.size());
+
+        //swapped operands go through the other side of the split
+        auto avl_union = avl_invoker::union_(avl_t(bbst::sorted_unique, b.begin(), b.end()), avl_t(bbst::sorted_unique, a.begin(), a.end()), policy);
+        auto avl_intersection = avl_invoker::intersection(avl_t(bbst::sorted_unique, b.begin(), b.end()), avl_t(bbst::sorted_unique, a.begin(), a.end()), policy);
+        auto avl_difference = avl_invoker::difference(avl_t(bbst::sorted_unique, a.begin(), a.end()), avl_t(bbst::sorted_unique, b.begin(), b.end()), policy);
+        check(avl_union, expect_union);
+        check(avl_intersection, expect_intersection);
+        check(avl_difference, expect_difference);
+    }
+}
+
+TEST(StressTest, lazy_range_add)
+{
+    int iteration = mx_iteration;
+    auto seed = std::random_device()();
+    auto gen = std::mt19937(seed);
+    std::cerr << "[          ] random seed = " << seed << std::endl;
+    using metadata_t = bbst::range_add_sum_metadata<long long>;
+    using updator_t = bbst::range_add_sum_metadata_updator;
+    using rb_t = bbst::rb_tree<int, long long, metadata_t, updator_t>;
+    using avl_t = bbst::avl_tree<int, long long, metadata_t, updator_t>;
+    using rb_invoker = bbst::rb_tree_custom_invoke<int, long long, metadata_t, updator_t, std::less<int>, bbst::rb_tree_custom_invoke_default_tag>;
+    using avl_invoker = bbst::avl_tree_custom_invoke<int, long long, metadata_t, updator_t, std::less<int>, bbst::avl_tree_custom_invoke_default_tag>;
+    using treap_t = bbst::treap<int, long long, metadata_t, updator_t>;
+    using treap_invoker = bbst::treap_custom_invoke<int, long long, metadata_t, updator_t, std::less<int>, bbst::treap_custom_invoke_default_tag>;
+    constexpr int key_range = mx_len / 20;
+    std::uniform_int_distribution<int> key(0, key_range), delta(-1000, 1000), op(0, 9);
+    auto run = [&]<class tree_t, class invoker_t>(tree_t &tree, invoker_t)
+    {
+        std::map<int, long long> expect;
+        auto add = [](auto root, long long d) { updator_t::add(root, d); };
+        for (int i = 0; i < mx_len / 10; i++)
+        {
+            int k = key(gen), o = op(gen);
+            if (o < 4)
+            {
+                auto [it, inserted] = tree.try_emplace(k, metadata_t(), static_cast<long long>(k));
+                EXPECT_EQ(inserted, expect.try_emplace(k, k).second);
+            }
+            else if (o < 5)
+            {
+                EXPECT_EQ(tree.erase(k), expect.erase(k));
+            }
+            else if (o < 9)
+            {
+                int hi = std::min(key_range, k + key(gen) / 8);
+                long long d = delta(gen);
+                invoker_t::range_update(tree, k, hi, [&](auto root) { add(root, d); });
+                for (auto it = expect.lower_bound(k); it != expect.end() && it->first <= hi; ++it) it->second += d;
+            }
+            else
+            {
+                auto it = tree.find(k);
+                EXPECT_EQ(it == tree.end(), !expect.contains(k));
+                if (it != tree.end())
+                {
+                    invoker_t::push_down_path(tree, it);
+                    EXPECT_EQ(it->mapped, expect[k]);
+                }
+            }
+        }
+        //the subtree handed to range_update carries the sum of its range
+        for (int i = 0; i < 100; i++)
+        {
+            int lo = key(gen), hi = std::min(key_range, lo + key(gen) / 4);
+            long long sum = 0, expect_sum = 0;
+            invoker_t::range_update(tree, lo, hi, [&](auto root) { sum = updator_t::sum(root); });
+            for (auto it = expect.lower_bound(lo); it != expect.end() && it->first <= hi; ++it) expect_sum += it->second;
+            EXPECT_EQ(sum, expect_sum);
+        }
+        invoker_t::push_down_all(tree);
+        auto it = expect.begin();
+        for (auto p: tree)
+        {
+            EXPECT_EQ(p.key, it->first);
+            EXPECT_EQ(p.mapped, it->second);
+            ++it;
+        }
+        EXPECT_EQ(it, expect.end());
+    };
+    while (iteration--)
+    {
+        rb_t rb;
+        run(rb, rb_invoker());
+        avl_t avl;
+        run(avl, avl_invoker());
+        treap_t treap;
+        run(treap, treap_invoker());
+    }
+}
+
+TEST(StressTest, insert_sorted_batch)
+{
+    int iteration = mx_iteration;
+    auto seed = std::random_device()();
+    auto gen = std::mt19937(seed);
+    std::cerr << "[          ] random seed = " << seed << std::endl;
+    using rb_t = bbst::rb_tree<int, int, int, bbst::order_statistic_metadata_updator_impl>;
+    using avl_t = bbst::avl_tree<int, int, int, bbst::noop_metadata_updator_impl>;
+    using treap_t = bbst::treap<int, int, int, bbst::order_statistic_metadata_updator_impl>;
+    using rb_order_statistic_invoker = bbst::rb_tree_custom_invoke<int, int, int, bbst::order_statistic_metadata_updator_impl, std::less<int>, bbst::rb_tree_custom_invoke_order_statistic_tag>;
+    using treap_order_statistic_invoker = bbst::treap_custom_invoke<int, int, int, bbst::order_statistic_metadata_updator_impl, std::less<int>, bbst::treap_custom_invoke_order_statistic_tag>;
+    bbst::fork_join_pool pool(3);
+    std::uniform_int_distribution<int> key(0, mx_len * 4);
+    while (iteration--)
+    {
+        rb_t rb;
+        avl_t avl;
+        treap_t treap;
+        std::map<int, int> expect;
+        //batches from a handful of keys up to the size of the tree, sequential and forked
+        for (int round = 0, batch_size = 1; batch_size <= mx_len; round++, batch_size *= 4)
+        {
+            std::vector<std::pair<int, int>> batch(batch_size);
+            for (auto &[k, v]: batch) k = key(gen), v = round;
+            //equivalent keys in a run: only the first one counts, as with try_emplace
+            std::stable_sort(batch.begin(), batch.end(), [](const auto &a, const auto &b) { return a.first < b.first; });
+            bbst::parallel_policy policy{round % 2 ? &pool : nullptr, 64};
+            rb.insert_sorted_batch(batch.begin(), batch.end(), policy);
+            avl.insert_sorted_batch(batch.begin(), batch.end(), policy);
+            treap.insert_sorted_batch(batch.begin(), batch.end(), policy);
+            for (auto [k, v]: batch) expect.try_emplace(k, v);
+            auto check = [&expect](const auto &tree)
+            {
+                auto it = expect.begin();
+                for (auto p: tree)
+                {
+                    EXPECT_EQ(p.key, it->first);
+                    EXPECT_EQ(p.mapped, it->second);
+                    ++it;
+                }
+                EXPECT_EQ(it, expect.end());
+            };
+            check(rb);
+            check(avl);
+            check(treap);
+            EXPECT_EQ(rb_order_statistic_invoker::size(rb), expect.size());
+            EXPECT_EQ(treap_order_statistic_invoker::size(treap), expect.size());
+            //the trees stay ordinary trees afterwards
+            int k = key(gen);
+            bool inserted = expect.try_emplace(k, -1).second;
+            EXPECT_EQ(rb.try_emplace(k, 0, -1).second, inserted);
+            EXPECT_EQ(avl.try_emplace(k, 0, -1).second, inserted);
+            EXPECT_EQ(treap.try_emplace(k, 0, -1).second, inserted);
+        }
+    }
+}
+
+TEST(StressTest, persistent_avl_tree_concurrent_readers)
+{
+    //the writer grows a run of keys at the top and shrinks it at the bottom, every version readers see must be a contiguous run
+    using tree_t = bbst::persistent_avl_tree<int, int, int, bbst::order_statistic_metadata_updator_impl>;
+    constexpr int readers = 4;
+    tree_t tree(readers);
+    std::atomic<bool> done{false};
+    std::atomic<int> failures{0};
+    std::vector<std::thread> threads;
+    for (int r = 0; r < readers; r++)
+    {
+        threads.emplace_back([&tree, &done, &failures]
+                             {
+                                 bbst::epoch_domain::reader reader(tree.domain());
+                                 while (!done.load(std::memory_order_relaxed))
+                                 {
+                                     auto snapshot = tree.snapshot(reader);
+                                     int first = -1, previous = -1, count = 0;
+                                     snapshot.for_each([&](const auto &value)
+                                                       {
+                                                           if (count++ == 0) first = value.key;
+                                                           else if (value.key != previous + 1) failures++;
+                                                           if (value.mapped != value.key) failures++;
+                                                           previous = value.key;
+                                                       });
+                                     if (count != bbst::order_statistic_metadata_updator_impl::get_order_metadata(snapshot.root())) failures++;
+                                     if (count != 0 && (snapshot.find(first) == nullptr || snapshot.find(first - 1) != nullptr)) failures++;
+                                 }
+                             });
+    }
+    int low = 0;
+    for (int high = 0; high < mx_len; high++)
+    {
+        EXPECT_TRUE(tree.try_emplace(high, 0, high));
+        if (high % 3 == 2)
+        {
+            EXPECT_EQ(tree.erase(low++), 1u);
+        }
+    }
+    done = true;
+    for (auto &thread: threads)
+        thread.join();
+    EXPECT_EQ(failures.load(), 0);
+    EXPECT_EQ(tree.size(), size_t(mx_len - low));
+    EXPECT_EQ(tree.reclaim(), 0u);
+}
+
 int main(int argc, char **argv)
 {
     ::testing::InitGoogleTest(&argc, argv);
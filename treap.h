@@ -0,0 +1,1161 @@
+#ifndef BBST_TREAP_H
+#define BBST_TREAP_H
+
+#include <concepts>
+#include <cstdint>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <tuple>
+#include "tree_custom_invoke.h"
+#include "tree_set_operation.h"
+#include "tree_utils.h"
+
+//invariant debug
+namespace bbst
+{
+    //parent links and heap order of the priorities, the key order is checked by the callers
+    template<class treap_node_ptr_t>
+    bool treap_invariant(treap_node_ptr_t ptr)
+    {
+        if (ptr == nullptr)
+            return true;
+        if (ptr->left != nullptr && (ptr->left->parent != ptr || ptr->left->priority() > ptr->priority()))
+            return false;
+
+        if (ptr->right != nullptr && (ptr->right->parent != ptr || ptr->right->priority() > ptr->priority()))
+            return false;
+
+        if (ptr->left != nullptr && ptr->right != nullptr && ptr->left == ptr->right)
+            return false;
+
+        return treap_invariant(ptr->left) && treap_invariant(ptr->right);
+    }
+
+    template<class treap_header_t>
+    bool treap_header_invariant(treap_header_t header)
+    {
+        return treap_invariant(header.root_);
+    }
+}
+
+//treap_node
+namespace bbst
+{
+    template<class exposure_t>
+    struct treap_node : public base_tree_node<treap_node<exposure_t>>
+    {
+        //expose type info
+        typedef typename tree_node_base_traits<treap_node>::value_type value_type;
+        typedef typename tree_node_base_traits<treap_node>::key_type key_type;
+        typedef typename tree_node_base_traits<treap_node>::metadata_type metadata_type;
+        value_type value_;
+        //random, a node is never below one of lower priority. 32 bits don't fit the tag bits of the parent pointer
+        uint32_t priority_;
+
+        template<class... Args>
+        explicit treap_node(uint32_t priority, Args... args)
+                :
+                base_tree_node<treap_node>(nullptr, nullptr, nullptr)
+                , value_(std::forward<Args>(args)...)
+                , priority_(priority)
+        {}
+
+        [[nodiscard]] inline uint32_t priority() const noexcept
+        {
+            return priority_;
+        }
+
+        inline value_type &value() noexcept
+        {
+            return value_;
+        }
+
+        inline const value_type &value() const noexcept
+        {
+            return value_;
+        }
+
+        inline key_type &key() const noexcept
+        {
+            return value_.key;
+        }
+
+        inline metadata_type &metadata() noexcept
+        {
+            return value_.metadata;
+        }
+
+        inline const metadata_type &metadata() const noexcept
+        {
+            return value_.metadata;
+        }
+    };
+
+    template<class exposure_t>
+    struct tree_node_base_traits<treap_node<exposure_t>>
+    {
+        typedef exposure_t value_type;
+        typedef treap_node<exposure_t> impl_type;
+        typedef typename exposure_t::key_type key_type;
+        typedef typename exposure_t::mapped_type mapped_type;
+        typedef typename exposure_t::metadata_type metadata_type;
+    };
+}
+
+//treap_header
+namespace bbst
+{
+    //the priorities carry all the balance information, so unlike rb/avl headers there is no height to keep in sync
+    template<class key_t, class mapped_t, class metadata_t>
+    struct treap_header
+    {
+    private:
+        typedef treap_node<bbst::exposure<key_t, mapped_t, metadata_t>> treap_node_t;
+        typedef treap_node_t *treap_node_ptr_t;
+    public:
+
+        treap_node_ptr_t root_;
+
+        typedef treap_header<key_t, mapped_t, metadata_t> treap_header_t;
+
+        explicit treap_header(treap_node_ptr_t root)
+                :
+                root_(root)
+        {}
+
+        static inline treap_header empty_header()
+        {
+            return treap_header(nullptr);
+        }
+
+        [[nodiscard]] bool empty() const
+        {
+            return root_ == nullptr;
+        }
+
+        template<class key_holder_t, class mapped_holder_t, class metadata_holder_t, class metadata_updator_holder_t, class comparator_holder_t, class tag_holder_t, class allocator_holder_t> friend
+        class treap_custom_invoke;
+    };
+}
+
+//helper
+namespace bbst
+{
+    //refresh the metadata of ptr and its ancestors up to (not including) stop, bottom-up
+    template<class treap_node_ptr_t, class metadata_updator_t>
+    inline void treap_update_path(base_tree_node<std::remove_pointer_t<treap_node_ptr_t>> *ptr, base_tree_node<std::remove_pointer_t<treap_node_ptr_t>> *stop
+                                  , const metadata_updator_t &updator)
+    {
+        if constexpr (!is_noop_metadata_updator<metadata_updator_t>)
+            for (auto p = ptr; p != stop; p = p->parent)
+                updator(p->self_downcast_unsafe());
+    }
+
+    /*
+     * Zip two treaps into one, every key of a must be less than every key of b: walk down the right spine of a and the left spine of b
+     * and interleave them by priority. No rotation and no comparison, expected O(log n).
+     * The returned root has its parent set to nullptr.
+     */
+    template<class treap_node_ptr_t, class metadata_updator_t>
+    treap_node_ptr_t treap_zip(treap_node_ptr_t a, treap_node_ptr_t b, const metadata_updator_t &updator)
+    {
+        treap_node_ptr_t root = nullptr;
+        treap_node_ptr_t *slot = &root;
+        treap_node_ptr_t parent = nullptr;
+        while (a != nullptr && b != nullptr)
+        {
+            if (a->priority() > b->priority())
+            {
+                tree_push_down(updator, a);
+                *slot = a;
+                a->parent = parent;
+                parent = a;
+                slot = &a->right;
+                a = a->right;
+            }
+            else
+            {
+                tree_push_down(updator, b);
+                *slot = b;
+                b->parent = parent;
+                parent = b;
+                slot = &b->left;
+                b = b->left;
+            }
+        }
+        *slot = a != nullptr ? a : b;
+        if (*slot != nullptr)
+            (*slot)->parent = parent;
+        if (parent != nullptr)
+            treap_update_path<treap_node_ptr_t>(parent, nullptr, updator);
+        return root;
+    }
+
+    /*
+     * Rotate the freshly linked leaf z up to where its priority belongs, then refresh the metadata up to the root.
+     * The path above z must already be pushed down.
+     */
+    template<class base_tree_node_ptr_t, class treap_node_ptr_t, class metadata_updator_t>
+    void treap_insert_fixup(base_tree_node_ptr_t end_node, treap_node_ptr_t z, const metadata_updator_t &updator)
+    {
+        while (z->parent != end_node && z->parent_unsafe()->priority() < z->priority())
+        {
+            treap_node_ptr_t p = z->parent_unsafe();
+            if (p->left == z)
+                unguarded_tree_right_rotate(p, updator);
+            else
+                unguarded_tree_left_rotate(p, updator);
+            updator(p);
+        }
+        updator(z);
+        treap_update_path<treap_node_ptr_t>(z->parent.get(), end_node, updator);
+    }
+
+    /*
+     * Unlink z from the tree hanging off end_node (end_node->left is the root, end_node has no parent): its two subtrees are zipped
+     * into its place, then the metadata is refreshed up to the root. z is detached but not destroyed.
+     */
+    template<class base_tree_node_ptr_t, class treap_node_ptr_t, class metadata_updator_t>
+    void treap_remove(base_tree_node_ptr_t end_node, treap_node_ptr_t z, const metadata_updator_t &updator)
+    {
+        tree_push_down_path(updator, end_node, z);
+        base_tree_node_ptr_t parent = z->parent;
+        bool is_left = tree_is_left_child(z);
+        treap_node_ptr_t merged = treap_zip(z->left, z->right, updator);
+        if (merged != nullptr)
+            merged->parent = parent;
+        if (is_left)
+            parent->left = merged;
+        else
+            parent->right = merged;
+        treap_update_path<treap_node_ptr_t>(parent, end_node, updator);
+    }
+
+    /*
+     * Descend the right spine of left and the left spine of right while their nodes outrank x, and hang x (with what is left of both)
+     * where it stops. Expected O(log n) and, unlike the rb/avl version, no fixup on the way back: only metadata is refreshed.
+     */
+    template<class treap_header_t, class treap_node_ptr_t, class metadata_updator_t, class comparator_t>
+    treap_header_t treap_join_x(treap_header_t left, treap_node_ptr_t x, treap_header_t right, const metadata_updator_t &metadata_updator
+                                , const comparator_t &comparator)
+    {
+        (void) comparator;//only read by the assertions
+        ASSERT(treap_header_invariant(left), "left header invariant false");
+        ASSERT(left.root_ == nullptr || tree_less(comparator, bbst::tree_max(left.root_)->key(), x->key()), "left tree must be less than x");
+        ASSERT(treap_header_invariant(right), "right header invariant false");
+        ASSERT(right.root_ == nullptr || tree_less(comparator, x->key(), bbst::tree_min(right.root_)->key()), "right tree must be greater than x");
+        treap_node_ptr_t a = left.root_, b = right.root_;
+        treap_node_ptr_t root = nullptr;
+        treap_node_ptr_t *slot = &root;
+        treap_node_ptr_t parent = nullptr;
+        while (true)
+        {
+            if (a != nullptr && a->priority() > x->priority() && (b == nullptr || a->priority() > b->priority()))
+            {
+                tree_push_down(metadata_updator, a);
+                *slot = a;
+                a->parent = parent;
+                parent = a;
+                slot = &a->right;
+                a = a->right;
+            }
+            else if (b != nullptr && b->priority() > x->priority())
+            {
+                tree_push_down(metadata_updator, b);
+                *slot = b;
+                b->parent = parent;
+                parent = b;
+                slot = &b->left;
+                b = b->left;
+            }
+            else
+                break;
+        }
+        x->left = a;
+        if (a != nullptr) a->parent = x;
+        x->right = b;
+        if (b != nullptr) b->parent = x;
+        *slot = x;
+        x->parent = parent;
+        metadata_updator(x);
+        if (parent != nullptr)
+            treap_update_path<treap_node_ptr_t>(parent, nullptr, metadata_updator);
+        treap_header_t result(root);
+        ASSERT(treap_header_invariant(result), "post condition failed");
+        return result;
+    }
+
+    //cut a non-empty treap at its root: headers of both subtrees and the root itself, with stale child pointers
+    template<class treap_header_t, class metadata_updator_t>
+    std::tuple<treap_header_t, decltype(treap_header_t::root_), treap_header_t> treap_expose(treap_header_t header, const metadata_updator_t &metadata_updator) noexcept
+    {
+        auto root = header.root_;
+        tree_push_down(metadata_updator, root);
+        return {treap_header_t(root->left), root, treap_header_t(root->right)};
+    }
+
+    /*
+     * Split by a single descent steered by locate(ptr), which tells where the split point lies relative to ptr
+     * (less: left of it, greater: right of it, equivalent: ptr itself, handed back detached with stale child pointers, nullptr if none).
+     * The path is unzipped into the right spine of the left side and the left spine of the right side, a treap split never needs a join.
+     */
+    template<class treap_header_t, class locate_t, class metadata_updator_t>
+    std::tuple<treap_header_t, decltype(treap_header_t::root_), treap_header_t>
+    treap_split_by(treap_header_t header, locate_t &&locate, const metadata_updator_t &metadata_updator)
+    {
+        using treap_node_ptr_t = decltype(header.root_);
+        treap_node_ptr_t left_root = nullptr, right_root = nullptr, equal = nullptr;
+        treap_node_ptr_t *left_slot = &left_root, *right_slot = &right_root;
+        treap_node_ptr_t left_parent = nullptr, right_parent = nullptr;
+        treap_node_ptr_t ptr = header.root_;
+        while (ptr != nullptr)
+        {
+            tree_push_down(metadata_updator, ptr);
+            std::weak_ordering order = locate(ptr);
+            if (order == 0)
+            {
+                equal = ptr;
+                break;
+            }
+            if (order > 0)
+            {
+                *left_slot = ptr;
+                ptr->parent = left_parent;
+                left_parent = ptr;
+                left_slot = &ptr->right;
+                ptr = ptr->right;
+            }
+            else
+            {
+                *right_slot = ptr;
+                ptr->parent = right_parent;
+                right_parent = ptr;
+                right_slot = &ptr->left;
+                ptr = ptr->left;
+            }
+        }
+        *left_slot = equal != nullptr ? equal->left : nullptr;
+        if (*left_slot != nullptr)
+            (*left_slot)->parent = left_parent;
+        *right_slot = equal != nullptr ? equal->right : nullptr;
+        if (*right_slot != nullptr)
+            (*right_slot)->parent = right_parent;
+        if (left_parent != nullptr)
+            treap_update_path<treap_node_ptr_t>(left_parent, nullptr, metadata_updator);
+        if (right_parent != nullptr)
+            treap_update_path<treap_node_ptr_t>(right_parent, nullptr, metadata_updator);
+        return {treap_header_t(left_root), equal, treap_header_t(right_root)};
+    }
+
+    /*
+     * Split around key: nodes less than key end up in the left header, nodes greater in the right one.
+     * By default the node equivalent to key (nullptr if none) is handed back detached, with stale child pointers,
+     * equal_policy left/right keeps it on that side instead (the middle is nullptr then), with one comparison per node. See treap_split_by.
+     */
+    template<tree_split_equal equal_policy = tree_split_equal::detach, class treap_header_t, class key_t, class metadata_updator_t, class comparator_t>
+    std::tuple<treap_header_t, decltype(treap_header_t::root_), treap_header_t>
+    treap_split(treap_header_t header, const key_t &key, const metadata_updator_t &metadata_updator, const comparator_t &comparator)
+    {
+        return treap_split_by(header, [&key, &comparator](auto ptr)
+        {
+            if constexpr (equal_policy == tree_split_equal::left)
+                return tree_less(comparator, key, ptr->key()) ? std::weak_ordering::less : std::weak_ordering::greater;
+            else if constexpr (equal_policy == tree_split_equal::right)
+                return tree_less(comparator, ptr->key(), key) ? std::weak_ordering::greater : std::weak_ordering::less;
+            else
+                return tree_compare(comparator, key, ptr->key());
+        }, metadata_updator);
+    }
+
+    //split by rank: the first index nodes go left, the rest right. Steers the unzip by the left subtree sizes, see treap_split_by
+    template<class treap_header_t, class metadata_updator_t>
+    std::pair<treap_header_t, treap_header_t> treap_split_by_order(treap_header_t header, size_t index, const metadata_updator_t &metadata_updator)
+    {
+        auto [left, equal, right] = treap_split_by(header, [&index](auto ptr)
+        {
+            auto left_count = size_t(metadata_updator_t::get_order_metadata(ptr->left));
+            if (index <= left_count)
+                return std::weak_ordering::less;
+            index -= left_count + 1;//minus ptr
+            return std::weak_ordering::greater;
+        }, metadata_updator);
+        return {left, right};
+    }
+
+    /*
+     * Split right before x, a node of the treap under header whose root hangs from end_node: x and everything after it go right.
+     * Steers by x's parent links instead of comparing keys. See tree_split_at.
+     */
+    template<class treap_header_t, class base_tree_node_ptr_t, class metadata_updator_t, class comparator_t>
+    std::pair<treap_header_t, treap_header_t>
+    treap_split_at(treap_header_t header, base_tree_node_ptr_t end_node, base_tree_node_ptr_t x, const metadata_updator_t &metadata_updator
+                   , const comparator_t &comparator)
+    {
+        return tree_split_at(header, end_node, x, [&metadata_updator](auto h) { return treap_expose(h, metadata_updator); }
+                             , [&metadata_updator, &comparator](auto left, auto pivot, auto right)
+                             {
+                                 return treap_join_x(left, pivot, right, metadata_updator, comparator);
+                             });
+    }
+
+    //join without a middle node, every key of left must be less than every key of right. See treap_zip
+    template<class treap_header_t, class metadata_updator_t, class comparator_t>
+    treap_header_t treap_join(treap_header_t left, treap_header_t right, const metadata_updator_t &metadata_updator, const comparator_t &)
+    {
+        return treap_header_t(treap_zip(left.root_, right.root_, metadata_updator));
+    }
+
+    //header level primitives, the interface join based algorithms shared between trees (tree_set_operation.h) build on
+    struct treap_header_ops
+    {
+        template<class treap_header_t, class metadata_updator_t>
+        static inline auto expose(treap_header_t header, const metadata_updator_t &metadata_updator) noexcept
+        {
+            return treap_expose(header, metadata_updator);
+        }
+
+        template<class treap_header_t, class key_t, class metadata_updator_t, class comparator_t>
+        static inline auto split(treap_header_t header, const key_t &key, const metadata_updator_t &metadata_updator, const comparator_t &comparator)
+        {
+            return treap_split(header, key, metadata_updator, comparator);
+        }
+
+        template<class treap_header_t, class treap_node_ptr_t, class metadata_updator_t, class comparator_t>
+        static inline treap_header_t join_x(treap_header_t left, treap_node_ptr_t x, treap_header_t right, const metadata_updator_t &metadata_updator
+                                            , const comparator_t &comparator)
+        {
+            return treap_join_x(left, x, right, metadata_updator, comparator);
+        }
+
+        template<class treap_header_t, class metadata_updator_t, class comparator_t>
+        static inline treap_header_t join(treap_header_t left, treap_header_t right, const metadata_updator_t &metadata_updator, const comparator_t &comparator)
+        {
+            return treap_join(left, right, metadata_updator, comparator);
+        }
+
+        /*
+         * A treap has no deterministic size bound, this is an estimate instead: the root priority is the greatest of n uniform ones,
+         * so its distance to the top of the range is about range / (n + 1)
+         */
+        template<class treap_header_t>
+        static inline size_t size_lower_bound(const treap_header_t &header, size_t cap) noexcept
+        {
+            if (header.empty())
+                return 0;
+            uint64_t gap = (uint64_t(1) << 32) - header.root_->priority();
+            return std::min<uint64_t>(cap, (uint64_t(1) << 32) / gap);
+        }
+    };
+}
+
+//treap
+namespace bbst
+{
+    /*
+     * Randomized search tree (Seidel, Aragon): in key order and heap ordered by random priorities, so its shape is that of a random bst
+     * and every operation is expected O(log n). Split and join are a single pass over one or two spines with no fixup,
+     * for split/join heavy workloads that is cheaper than keeping rb/avl heights in sync. Same interface as rb_tree and avl_tree.
+     */
+    template<class key_t, class mapped_t, class metadata_t, class metadata_updator_t, class comparator_t=std::less<key_t>,
+            class allocator_t = std::allocator<exposure<key_t, mapped_t, metadata_t>>>
+    requires (is_tree_comparator<comparator_t, key_t, key_t> &&
+              std::regular_invocable<const metadata_updator_t &, treap_node<bbst::exposure<key_t, mapped_t, metadata_t>> *>)
+    class treap
+    {
+    private:
+        typedef treap_node<exposure<key_t, mapped_t, metadata_t>> treap_node_t;
+        typedef base_tree_node<treap_node_t> base_tree_node_t;
+        typedef base_tree_node_t *base_tree_node_ptr_t;
+        typedef treap_node_t *treap_node_ptr_t;
+        typedef treap_header<key_t, mapped_t, metadata_t> treap_header_t;
+        typedef typename treap_node_t::value_type value_type;
+        typedef typename std::allocator_traits<allocator_t>::template rebind_alloc<treap_node_t> node_allocator_t;
+        typedef std::allocator_traits<node_allocator_t> node_allocator_traits;
+    public:
+        typedef allocator_t allocator_type;
+        typedef tree_bidirectional_iterator_<base_tree_node_t> iterator;
+        typedef tree_bidirectional_const_iterator_<base_tree_node_t> const_iterator;
+
+    private:
+        base_tree_node_t end_node_;
+        base_tree_node_ptr_t begin_node_;
+        base_tree_node_ptr_t last_node_;//greatest node, &end_node_ if empty
+        [[no_unique_address]] comparator_t comp_;
+        [[no_unique_address]] metadata_updator_t updator_;
+        [[no_unique_address]] node_allocator_t alloc_;
+        uint64_t seed_;//state of the priority generator
+
+        //splitmix64, the high half of each output is a priority
+        uint32_t next_priority() noexcept
+        {
+            uint64_t z = (seed_ += 0x9e3779b97f4a7c15);
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+            return uint32_t((z ^ (z >> 31)) >> 32);
+        }
+
+        template<class... Args>
+        treap_node_ptr_t construct_node(Args... args)
+        {
+            treap_node_ptr_t ptr = node_allocator_traits::allocate(alloc_, 1);
+            try
+            {
+                node_allocator_traits::construct(alloc_, ptr, std::forward<Args>(args)...);
+            }
+            catch (...)
+            {
+                node_allocator_traits::deallocate(alloc_, ptr, 1);
+                throw;
+            }
+            return ptr;
+        }
+
+        void destroy_node(treap_node_ptr_t ptr) noexcept
+        {
+            tree_destroy_node(alloc_, ptr);
+        }
+
+        void destroy_subtree(treap_node_ptr_t ptr) noexcept
+        {
+            tree_destroy(ptr, [this](treap_node_ptr_t p) { destroy_node(p); });
+        }
+
+        //node a finger search starts from, tree must not be empty
+        [[nodiscard]] base_tree_node_ptr_t finger_node(const_iterator finger) const noexcept
+        {
+            return finger.get() == &end_node_ ? last_node_ : const_cast<base_tree_node_ptr_t>(finger.get());
+        }
+
+        static inline iterator mutable_iterator(const_iterator it) noexcept
+        {
+            return iterator(const_cast<base_tree_node_ptr_t>(it.get()));
+        }
+
+        //key_t, or a query of a transparent comparator (emplace_query_args)
+        template<class query_t>
+        std::pair<treap_node_ptr_t &, base_tree_node_ptr_t> inline find_equal_or_insert_pos(const query_t &key)
+        {
+            return bbst::find_equal_or_insert_pos<query_t, base_tree_node_ptr_t, treap_node_ptr_t, comparator_t>(key, &end_node_, comp_);
+        }
+
+        void insert_node_at(base_tree_node_ptr_t parent, treap_node_ptr_t &child, treap_node_ptr_t new_node) noexcept
+        {
+            if (parent != &end_node_)
+                tree_push_down_path(updator_, &end_node_, parent->self_downcast_unsafe());
+            new_node->left = nullptr;
+            new_node->right = nullptr;
+            new_node->parent = parent;
+            child = new_node;
+            if (begin_node_->left != nullptr)
+                begin_node_ = begin_node_->left;
+            if (last_node_ == &end_node_)
+                last_node_ = new_node;
+            else if (last_node_->right != nullptr)
+                last_node_ = last_node_->right;
+            treap_insert_fixup(&end_node_, new_node, updator_);
+        }
+
+        template<class... Args>
+        std::pair<iterator, bool> emplace_key_args(key_t key, Args... args)
+        {
+
+            auto [child, parent] = find_equal_or_insert_pos(key);
+            if (child == nullptr)
+            {
+                treap_node_ptr_t new_node = construct_node(next_priority(), std::forward<key_t>(key), std::forward<Args>(args)...);
+                insert_node_at(parent, child, new_node);
+                return {iterator(new_node), true};
+            }
+            return {iterator(child), false};
+        }
+
+        //key_t is only materialized from the query once a node is actually inserted
+        template<class query_t, class... Args>
+        std::pair<iterator, bool> emplace_query_args(query_t &&key, Args... args)
+        {
+            auto [child, parent] = find_equal_or_insert_pos(key);
+            if (child == nullptr)
+            {
+                treap_node_ptr_t new_node = construct_node(next_priority(), key_t(std::forward<query_t>(key)), std::forward<Args>(args)...);
+                insert_node_at(parent, child, new_node);
+                return {iterator(new_node), true};
+            }
+            return {iterator(child), false};
+        }
+
+        /*
+         * Insert position for key next to hint: if key fits right before (or right after) hint, the free child link
+         * between the two neighbours is returned without descending, otherwise the ordinary search from the root.
+         */
+        std::pair<treap_node_ptr_t &, base_tree_node_ptr_t> find_equal_or_insert_pos(base_tree_node_ptr_t hint, const key_t &key)
+        {
+            if (hint == &end_node_ || tree_less(comp_, key, hint->self_downcast_unsafe()->key()))
+            {
+                if (hint != &end_node_ && hint == begin_node_)
+                    return {hint->left, hint};
+                if (hint != begin_node_)
+                {
+                    base_tree_node_ptr_t prev = hint == &end_node_ ? last_node_ : tree_prev_iter(hint);
+                    if (tree_less(comp_, prev->self_downcast_unsafe()->key(), key))
+                    {
+                        if (hint == &end_node_ || hint->left != nullptr)
+                            return {prev->right, prev};
+                        return {hint->left, hint};
+                    }
+                }
+            }
+            else if (tree_less(comp_, hint->self_downcast_unsafe()->key(), key))
+            {
+                base_tree_node_ptr_t next = hint == last_node_ ? &end_node_ : tree_next_iter(hint);
+                if (next == &end_node_ || tree_less(comp_, key, next->self_downcast_unsafe()->key()))
+                {
+                    if (hint->right == nullptr)
+                        return {hint->right, hint};
+                    return {next->left, next};
+                }
+            }
+            else
+            {
+                return {tree_is_left_child(hint) ? hint->parent->left : hint->parent->right, hint};
+            }
+            return find_equal_or_insert_pos(key);
+        }
+
+        template<class... Args>
+        std::pair<iterator, bool> emplace_hint_key_args(base_tree_node_ptr_t hint, key_t key, Args... args)
+        {
+            auto [child, parent] = find_equal_or_insert_pos(hint, key);
+            if (child == nullptr)
+            {
+                treap_node_ptr_t new_node = construct_node(next_priority(), std::forward<key_t>(key), std::forward<Args>(args)...);
+                insert_node_at(parent, child, new_node);
+                return {iterator(new_node), true};
+            }
+            return {iterator(child), false};
+        }
+
+        template<class element_t>
+        treap_node_ptr_t construct_sorted_element(element_t &&element)
+        {
+            if constexpr (std::is_convertible_v<element_t, key_t>)
+                return construct_node(next_priority(), key_t(std::forward<element_t>(element)));
+            else if constexpr (std::is_empty_v<mapped_t>)
+                //nothing to read from an empty mapped type, a set's no_mapped may share its address with the key
+                return construct_node(next_priority(), key_t(std::forward<element_t>(element).first));
+            else
+                return construct_node(next_priority(), key_t(std::forward<element_t>(element).first), metadata_t(), mapped_t(std::forward<element_t>(element).second));
+        }
+
+        template<class iterator_t>
+        size_t count_sorted_unique(iterator_t first, iterator_t last) const
+        {
+            if (first == last)
+                return 0;
+            size_t n = 1;
+            for (iterator_t run = first; ++first != last;)
+            {
+                if (tree_less(comp_, sorted_element_key<key_t>(*run), sorted_element_key<key_t>(*first)))
+                {
+                    run = first;
+                    n++;
+                }
+            }
+            return n;
+        }
+
+        /*
+         * O(n) build from a sorted range into an empty tree, n is the number of distinct keys in the range.
+         * With skip_equivalent only the first element of each run of equivalent keys becomes a node.
+         * Nodes get fresh priorities and are placed as in a Cartesian tree: each one is the greatest so far, so it hangs off the right spine
+         * below the lowest spine node that outranks it and adopts the spine nodes it outranks as its left subtree.
+         * A node's subtree is final once it leaves the spine, that's when its metadata is computed.
+         */
+        template<bool skip_equivalent, class iterator_t>
+        void build_from_sorted(iterator_t first, iterator_t last, size_t n)
+        {
+            ASSERT(end_node_.left == nullptr, "tree must be empty");
+            //end_node_ tops the spine, its left link stands for the right link of a node outranking all others
+            base_tree_node_ptr_t spine = &end_node_;
+            try
+            {
+                for (size_t i = 0; i < n; i++)
+                {
+                    treap_node_ptr_t node = construct_sorted_element(*first);
+                    ++first;
+                    if constexpr (skip_equivalent)
+                    {
+                        while (first != last && !tree_less(comp_, node->key(), sorted_element_key<key_t>(*first)))
+                            ++first;
+                    }
+                    ASSERT(first == last || tree_less(comp_, node->key(), sorted_element_key<key_t>(*first)), "range must be sorted");
+                    treap_node_ptr_t below = nullptr;
+                    while (spine != &end_node_ && spine->self_downcast_unsafe()->priority() < node->priority())
+                    {
+                        below = spine->self_downcast_unsafe();
+                        updator_(below);
+                        spine = spine->parent;
+                    }
+                    node->left = below;
+                    if (below != nullptr) below->parent = node;
+                    node->parent = spine;
+                    (spine == &end_node_ ? spine->left : spine->right) = node;
+                    spine = node;
+                }
+            }
+            catch (...)
+            {
+                destroy_subtree(std::exchange(end_node_.left, nullptr));
+                throw;
+            }
+            treap_update_path<treap_node_ptr_t>(spine, &end_node_, updator_);
+            if (end_node_.left != nullptr)
+            {
+                begin_node_ = tree_min(end_node_.left);
+                last_node_ = tree_max(end_node_.left);
+            }
+        }
+
+        //hand every node over as a header, leaving the tree empty
+        treap_header_t release_header() noexcept
+        {
+            begin_node_ = last_node_ = &end_node_;
+            return treap_header_t(std::exchange(end_node_.left, nullptr));
+        }
+
+        //take over the nodes of header, tree must be empty
+        void adopt_header(treap_header_t header) noexcept
+        {
+            ASSERT(end_node_.left == nullptr, "tree must be empty");
+            end_node_.left = header.root_;
+            if (header.root_ != nullptr)
+            {
+                header.root_->parent = &end_node_;
+                begin_node_ = tree_min(header.root_);
+                last_node_ = tree_max(header.root_);
+            }
+        }
+
+        treap(treap_header_t header, const metadata_updator_t &updator, const comparator_t &comp, const node_allocator_t &alloc)
+                :
+                end_node_(nullptr, header.root_, nullptr)
+                , begin_node_(header.root_ == nullptr ? &end_node_ : tree_min(header.root_))
+                , last_node_(header.root_ == nullptr ? &end_node_ : tree_max(header.root_))
+                , comp_(comp)
+                , updator_(updator)
+                , alloc_(alloc)
+                , seed_(reinterpret_cast<uintptr_t>(this))
+        {
+            if (header.root_ != nullptr) header.root_->parent = &end_node_;
+        }
+
+    public:
+
+        template<class comparator_forward_t=comparator_t, class metadata_updator_forward_t=metadata_updator_t>
+        requires (std::is_same_v<comparator_t, std::decay_t<comparator_forward_t>> &&
+                  std::is_same_v<metadata_updator_t, std::decay_t<metadata_updator_forward_t>>)
+        treap(metadata_updator_forward_t &&updator = metadata_updator_t(), comparator_forward_t &&comp = comparator_t()
+                 , const allocator_t &alloc = allocator_t())
+                :
+                end_node_(nullptr, nullptr, nullptr)
+                , begin_node_(&end_node_)
+                , last_node_(&end_node_)
+                , comp_(std::forward<comparator_forward_t>(comp))
+                , updator_(std::forward<metadata_updator_forward_t>(updator))
+                , alloc_(alloc)
+                , seed_(reinterpret_cast<uintptr_t>(this))
+        {}
+
+        treap(treap &&other) noexcept(std::is_nothrow_move_constructible_v<comparator_t> && std::is_nothrow_move_constructible_v<metadata_updator_t>)
+                :
+                end_node_(nullptr, std::exchange(other.end_node_.left, nullptr), nullptr)
+                , begin_node_(other.begin_node_ == &other.end_node_ ? &end_node_ : std::exchange(other.begin_node_, &other.end_node_))
+                , last_node_(other.last_node_ == &other.end_node_ ? &end_node_ : std::exchange(other.last_node_, &other.end_node_))
+                , comp_(std::move(other.comp_))
+                , updator_(std::move(other.updator_))
+                , alloc_(other.alloc_)
+                , seed_(other.seed_)
+        {
+            if (end_node_.left) end_node_.left->parent = &end_node_;
+        }
+
+        //O(n) construction from a range sorted by comp, elements are keys or (key, mapped) pairs
+        template<std::forward_iterator iterator_t, class comparator_forward_t=comparator_t, class metadata_updator_forward_t=metadata_updator_t>
+        requires (std::is_same_v<comparator_t, std::decay_t<comparator_forward_t>> &&
+                  std::is_same_v<metadata_updator_t, std::decay_t<metadata_updator_forward_t>>)
+        treap(sorted_unique_t, iterator_t first, iterator_t last, metadata_updator_forward_t &&updator = metadata_updator_t()
+                , comparator_forward_t &&comp = comparator_t(), const allocator_t &alloc = allocator_t())
+                :
+                treap(std::forward<metadata_updator_forward_t>(updator), std::forward<comparator_forward_t>(comp), alloc)
+        {
+            build_from_sorted<false>(first, last, std::distance(first, last));
+        }
+
+        template<std::forward_iterator iterator_t, class comparator_forward_t=comparator_t, class metadata_updator_forward_t=metadata_updator_t>
+        requires (std::is_same_v<comparator_t, std::decay_t<comparator_forward_t>> &&
+                  std::is_same_v<metadata_updator_t, std::decay_t<metadata_updator_forward_t>>)
+        treap(sorted_equivalent_t, iterator_t first, iterator_t last, metadata_updator_forward_t &&updator = metadata_updator_t()
+                , comparator_forward_t &&comp = comparator_t(), const allocator_t &alloc = allocator_t())
+                :
+                treap(std::forward<metadata_updator_forward_t>(updator), std::forward<comparator_forward_t>(comp), alloc)
+        {
+            build_from_sorted<true>(first, last, count_sorted_unique(first, last));
+        }
+
+        template<class... Args>
+        inline std::pair<iterator, bool> try_emplace(key_t key, Args...args)
+        {
+            return emplace_key_args(std::forward<key_t>(key), std::forward<Args>(args)...);
+        }
+
+        //with a transparent comparator, look up by anything key_t can be built from, and only build it on insertion
+        template<class query_t, class... Args>
+        requires (is_transparent_comparator<comparator_t> && !std::is_same_v<std::remove_cvref_t<query_t>, key_t> &&
+                  std::constructible_from<key_t, query_t>)
+        inline std::pair<iterator, bool> try_emplace(query_t &&key, Args...args)
+        {
+            return emplace_query_args(std::forward<query_t>(key), std::forward<Args>(args)...);
+        }
+
+        /*
+         * try_emplace that first tries the spot right before hint (or right after it): if key fits there no descent is needed,
+         * and with the expected O(1) rotations the whole insertion is expected O(1) (O(log n) for updators that refresh ancestors).
+         * A wrong hint only costs the ordinary search.
+         */
+        template<class... Args>
+        inline iterator emplace_hint(const_iterator hint, key_t key, Args...args)
+        {
+            return emplace_hint_key_args(const_cast<base_tree_node_ptr_t>(hint.get()), std::forward<key_t>(key), std::forward<Args>(args)...).first;
+        }
+
+        //try_emplace for a key beyond the current greatest one (monotone ingestion), see emplace_hint
+        template<class... Args>
+        inline std::pair<iterator, bool> push_back(key_t key, Args...args)
+        {
+            return emplace_hint_key_args(&end_node_, std::forward<key_t>(key), std::forward<Args>(args)...);
+        }
+
+        //try_emplace for a key below the current least one, see emplace_hint
+        template<class... Args>
+        inline std::pair<iterator, bool> push_front(key_t key, Args...args)
+        {
+            return emplace_hint_key_args(begin_node_, std::forward<key_t>(key), std::forward<Args>(args)...);
+        }
+
+        /*
+         * try_emplace of every element of a range sorted by comp (keys or (key, mapped) pairs, of a run of equivalent keys only the first counts).
+         * Each element is placed by a finger search from the previous one, O(m log(n/m + 1)) for m elements into n instead of m full descents.
+         * With policy.pool set and at least policy.grain elements, the range is built into a tree and merged in with a forked
+         * join based union instead (see tree_set_operation), allocators that are not always equal keep to the sequential path.
+         */
+        template<std::forward_iterator iterator_t>
+        void insert_sorted_batch(iterator_t first, iterator_t last, parallel_policy policy = {})
+        {
+            if constexpr(node_allocator_traits::is_always_equal::value)
+            {
+                if (policy.pool != nullptr && size_t(std::distance(first, last)) >= policy.grain)
+                {
+                    treap batch(treap_header_t::empty_header(), updator_, comp_, alloc_);
+                    batch.template build_from_sorted<true>(first, last, batch.count_sorted_unique(first, last));
+                    auto destroy = [this](treap_node_ptr_t root) { destroy_subtree(root); };
+                    tree_set_operation<treap_header_ops, treap_header_t, metadata_updator_t, comparator_t, decltype(destroy)> op(updator_, comp_, destroy, policy);
+                    treap_header_t result = op.union_(release_header(), batch.release_header());
+                    ASSERT(treap_header_invariant(result), "post condition failed");
+                    adopt_header(result);
+                    return;
+                }
+            }
+            base_tree_node_ptr_t finger = begin_node_;
+            for (; first != last; ++first)
+            {
+                //proxy iterators (transform, zip views) hand out pairs by value, keep the element alive as long as the key
+                auto &&element = *first;
+                const key_t &key = sorted_element_key<key_t>(element);
+                if (finger != &end_node_)
+                    finger = tree_finger_lower_bound(&end_node_, finger, key, comp_);
+                auto [child, parent] = find_equal_or_insert_pos(finger, key);
+                if (child == nullptr)
+                {
+                    treap_node_ptr_t new_node = construct_sorted_element(std::forward<decltype(element)>(element));
+                    insert_node_at(parent, child, new_node);
+                    finger = new_node;
+                }
+                else
+                {
+                    finger = child;
+                }
+            }
+        }
+
+        ~treap()
+        {
+            tree_destroy_all(alloc_, end_node_.left);
+        }
+
+        inline iterator begin() noexcept
+        {
+            return iterator(begin_node_);
+        }
+
+        [[nodiscard]] inline const_iterator begin() const noexcept
+        {
+            return const_iterator(begin_node_);
+        }
+
+        inline iterator end() noexcept
+        {
+            return iterator(&end_node_);
+        }
+
+        [[nodiscard]] inline const_iterator end() const noexcept
+        {
+            return const_iterator(&end_node_);
+        }
+
+        inline comparator_t &value_comp() noexcept
+        {
+            return comp_;
+        }
+
+        [[nodiscard]] inline const comparator_t &value_comp() const noexcept
+        {
+            return comp_;
+        }
+
+        iterator lower_bound(const key_t &key)
+        {
+            return iterator(bbst::lower_bound(&end_node_, key, comp_));
+        }
+
+        [[nodiscard]] const_iterator lower_bound(const key_t &key) const
+        {
+            return const_iterator(bbst::lower_bound(&end_node_, key, comp_));
+        }
+
+        template<class query_t>
+        requires is_transparent_comparator<comparator_t>
+        iterator lower_bound(const query_t &key)
+        {
+            return iterator(bbst::lower_bound(&end_node_, key, comp_));
+        }
+
+        template<class query_t>
+        requires is_transparent_comparator<comparator_t>
+        [[nodiscard]] const_iterator lower_bound(const query_t &key) const
+        {
+            return const_iterator(bbst::lower_bound(&end_node_, key, comp_));
+        }
+
+        iterator upper_bound(const key_t &key)
+        {
+            return iterator(bbst::upper_bound(&end_node_, key, comp_));
+        }
+
+        [[nodiscard]] const_iterator upper_bound(const key_t &key) const
+        {
+            return const_iterator(bbst::upper_bound(&end_node_, key, comp_));
+        }
+
+        template<class query_t>
+        requires is_transparent_comparator<comparator_t>
+        iterator upper_bound(const query_t &key)
+        {
+            return iterator(bbst::upper_bound(&end_node_, key, comp_));
+        }
+
+        template<class query_t>
+        requires is_transparent_comparator<comparator_t>
+        [[nodiscard]] const_iterator upper_bound(const query_t &key) const
+        {
+            return const_iterator(bbst::upper_bound(&end_node_, key, comp_));
+        }
+
+        iterator find(const key_t &key)
+        {
+            return iterator(bbst::find(&end_node_, key, comp_));
+        }
+
+        [[nodiscard]] const_iterator find(const key_t &key) const
+        {
+            return const_iterator(bbst::find(&end_node_, key, comp_));
+        }
+
+        template<class query_t>
+        requires is_transparent_comparator<comparator_t>
+        iterator find(const query_t &key)
+        {
+            return iterator(bbst::find(&end_node_, key, comp_));
+        }
+
+        template<class query_t>
+        requires is_transparent_comparator<comparator_t>
+        [[nodiscard]] const_iterator find(const query_t &key) const
+        {
+            return const_iterator(bbst::find(&end_node_, key, comp_));
+        }
+
+        /*
+         * lower_bound and find from a finger instead of the root: parent links are climbed only as far as needed,
+         * O(log d) for d elements between finger and the answer. A finger at end() starts from the greatest node.
+         */
+        iterator lower_bound_from(const_iterator finger, const key_t &key)
+        {
+            if (empty())
+                return end();
+            return iterator(tree_finger_lower_bound(&end_node_, finger_node(finger), key, comp_));
+        }
+
+        [[nodiscard]] const_iterator lower_bound_from(const_iterator finger, const key_t &key) const
+        {
+            if (empty())
+                return end();
+            return const_iterator(tree_finger_lower_bound(&end_node_, static_cast<const base_tree_node_t *>(finger_node(finger)), key, comp_));
+        }
+
+        iterator find_from(const_iterator finger, const key_t &key)
+        {
+            if (empty())
+                return end();
+            return iterator(tree_finger_find(&end_node_, finger_node(finger), key, comp_));
+        }
+
+        [[nodiscard]] const_iterator find_from(const_iterator finger, const key_t &key) const
+        {
+            if (empty())
+                return end();
+            return const_iterator(tree_finger_find(&end_node_, static_cast<const base_tree_node_t *>(finger_node(finger)), key, comp_));
+        }
+
+        /*
+         * lower_bound and find of every key in [first, last), iterators written to out in the same order.
+         * Same results as one call per key, but the descents of a batch are interleaved so their cache misses overlap,
+         * see tree_lower_bound_batch.
+         */
+        template<std::forward_iterator key_iterator_t, class output_iterator_t>
+        output_iterator_t lower_bound_batch(key_iterator_t first, key_iterator_t last, output_iterator_t out)
+        {
+            tree_lower_bound_batch(&end_node_, first, last, comp_, [&out](const auto &, base_tree_node_ptr_t p) { *out++ = iterator(p); });
+            return out;
+        }
+
+        template<std::forward_iterator key_iterator_t, class output_iterator_t>
+        output_iterator_t lower_bound_batch(key_iterator_t first, key_iterator_t last, output_iterator_t out) const
+        {
+            tree_lower_bound_batch(&end_node_, first, last, comp_, [&out](const auto &, const base_tree_node_t *p) { *out++ = const_iterator(p); });
+            return out;
+        }
+
+        template<std::forward_iterator key_iterator_t, class output_iterator_t>
+        output_iterator_t find_batch(key_iterator_t first, key_iterator_t last, output_iterator_t out)
+        {
+            tree_find_batch(&end_node_, first, last, comp_, [&out](base_tree_node_ptr_t p) { *out++ = iterator(p); });
+            return out;
+        }
+
+        template<std::forward_iterator key_iterator_t, class output_iterator_t>
+        output_iterator_t find_batch(key_iterator_t first, key_iterator_t last, output_iterator_t out) const
+        {
+            tree_find_batch(&end_node_, first, last, comp_, [&out](const base_tree_node_t *p) { *out++ = const_iterator(p); });
+            return out;
+        }
+
+        [[nodiscard]] bool empty() const
+        {
+            return begin_node_ == &end_node_;
+        }
+
+        [[nodiscard]] allocator_t get_allocator() const noexcept
+        {
+            return allocator_t(alloc_);
+        }
+
+        iterator erase(const_iterator pos) noexcept
+        {
+            ASSERT(pos != end(), "end() is not erasable");
+            treap_node_ptr_t node = const_cast<base_tree_node_ptr_t>(pos.get())->self_downcast_unsafe();
+            base_tree_node_ptr_t next = tree_next_iter(static_cast<base_tree_node_ptr_t>(node));
+            if (last_node_ == node)
+                last_node_ = begin_node_ == node ? &end_node_ : tree_prev_iter(static_cast<base_tree_node_ptr_t>(node));
+            if (begin_node_ == node)
+                begin_node_ = next;
+            treap_remove(&end_node_, node, updator_);
+            ASSERT(treap_header_invariant(treap_header_t(end_node_.left)), "post condition failed");
+            destroy_node(node);
+            return iterator(next);
+        }
+
+        inline iterator erase(iterator pos) noexcept
+        {
+            return erase(const_iterator(pos));
+        }
+
+        size_t erase(const key_t &key)
+        {
+            iterator pos = find(key);
+            if (pos == end())
+                return 0;
+            erase(pos);
+            return 1;
+        }
+
+        /*
+         * O(log n + k): cut [first, last) out with two splits and sew the rest back with a single join,
+         * instead of k independent removals
+         */
+        iterator erase(const_iterator first, const_iterator last)
+        {
+            base_tree_node_ptr_t last_node = const_cast<base_tree_node_ptr_t>(last.get());
+            if (first == last)
+                return iterator(last_node);
+            if (first == begin() && last == end())
+            {
+                clear();
+                return end();
+            }
+            if (const_iterator second = first; ++second == last)
+                return erase(first);
+            treap_node_ptr_t first_node = const_cast<base_tree_node_ptr_t>(first.get())->self_downcast_unsafe();
+            if (last_node == &end_node_)
+                last_node_ = tree_prev_iter(static_cast<base_tree_node_ptr_t>(first_node));
+            treap_header_t header(std::exchange(end_node_.left, nullptr));
+            auto [left, first_x, right] = treap_split(header, first_node->key(), updator_, comp_);
+            ASSERT(first_x == first_node, "first must be in the tree");
+            destroy_node(first_x);
+            if (last_node == &end_node_)
+            {
+                destroy_subtree(right.root_);
+                header = left;
+            }
+            else
+            {
+                auto [middle, last_x, rest] = treap_split(right, last_node->self_downcast_unsafe()->key(), updator_, comp_);
+                ASSERT(last_x == last_node, "last must be in the tree");
+                destroy_subtree(middle.root_);
+                header = treap_join_x(left, last_x, rest, updator_, comp_);
+            }
+            end_node_.left = header.root_;
+            if (header.root_ != nullptr)
+                header.root_->parent = &end_node_;
+            if (begin_node_ == first_node)
+                begin_node_ = last_node;
+            return iterator(last_node);
+        }
+
+        void clear() noexcept
+        {
+            destroy_subtree(std::exchange(end_node_.left, nullptr));
+            begin_node_ = &end_node_;
+            last_node_ = &end_node_;
+        }
+
+        template<class key_holder_t, class mapped_holder_t, class metadata_holder_t, class metadata_updator_holder_t, class comparator_holder_t, class tag, class allocator_holder_t> friend
+        class treap_custom_invoke;
+    };
+
+    //ordered set: nodes have no mapped field, elements convert to their key
+    template<class key_t, class metadata_t = no_metadata, class metadata_updator_t = noop_metadata_updator_impl, class comparator_t = std::less<key_t>,
+            class allocator_t = std::allocator<exposure<key_t, no_mapped, metadata_t>>>
+    using treap_set = treap<key_t, no_mapped, metadata_t, metadata_updator_t, comparator_t, allocator_t>;
+
+}
+#endif //BBST_TREAP_H
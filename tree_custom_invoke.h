@@ -1,6 +1,7 @@
 #ifndef BBST_TREE_CUSTOM_INVOKE_H
 #define BBST_TREE_CUSTOM_INVOKE_H
 
+#include <cstddef>
 #include <type_traits>
 
 namespace bbst
@@ -14,6 +15,8 @@ namespace bbst
 
     struct noop_metadata_updator_impl
     {
+        static constexpr bool is_noop = true;
+
         template<class impl_tree_node_ptr_t>
         void operator()(impl_tree_node_ptr_t ptr) const
         {}
@@ -35,6 +38,108 @@ namespace bbst
         {
             return p == nullptr ? 0 : p->metadata();
         };
+
+        //bplus_tree: a node counts its slots or the counts of its children
+        template<class metadata_t, class key_t, class mapped_t>
+        void fold_entry(metadata_t &metadata, const key_t &, const mapped_t &) const
+        {
+            metadata += 1;
+        }
+
+        template<class metadata_t>
+        void fold_child(metadata_t &metadata, const metadata_t &child) const
+        {
+            metadata += child;
+        }
+    };
+
+    //metadata of range_add_sum_metadata_updator
+    template<class T>
+    struct range_add_sum_metadata
+    {
+        T sum{};//mapped values summed over the subtree
+        T pending{};//still to be added to every mapped value below the node (lazy tag)
+        size_t size = 0;
+    };
+
+    /*
+     * Lazy updator (see is_lazy_metadata_updator in tree_utils.h): subtree sum of mapped values,
+     * plus add(root, delta) that adds delta to every mapped value of a subtree in O(1).
+     */
+    struct range_add_sum_metadata_updator
+    {
+        template<class impl_tree_node_ptr_t>
+        void operator()(impl_tree_node_ptr_t ptr) const
+        {
+            auto &metadata = ptr->metadata();
+            metadata.size = 1 + range_add_sum_metadata_updator::size(ptr->left) + range_add_sum_metadata_updator::size(ptr->right);
+            metadata.sum = ptr->value().mapped + range_add_sum_metadata_updator::sum(ptr->left) + range_add_sum_metadata_updator::sum(ptr->right);
+        }
+
+        template<class impl_tree_node_ptr_t>
+        void push_down(impl_tree_node_ptr_t ptr) const
+        {
+            auto &pending = ptr->metadata().pending;
+            using pending_t = std::remove_reference_t<decltype(pending)>;
+            if (pending == pending_t())
+                return;
+            range_add_sum_metadata_updator::add(ptr->left, pending);
+            range_add_sum_metadata_updator::add(ptr->right, pending);
+            pending = pending_t();
+        }
+
+        template<class impl_tree_node_ptr_t, class T>
+        static void add(impl_tree_node_ptr_t ptr, const T &delta)
+        {
+            if (ptr == nullptr)
+                return;
+            auto &metadata = ptr->metadata();
+            ptr->value().mapped += delta;
+            metadata.sum += delta * static_cast<std::remove_cvref_t<decltype(metadata.sum)>>(metadata.size);
+            metadata.pending += delta;
+        }
+
+        template<class impl_tree_node_ptr_t>
+        static inline size_t size(impl_tree_node_ptr_t ptr)
+        {
+            return ptr == nullptr ? 0 : ptr->metadata().size;
+        }
+
+        template<class impl_tree_node_ptr_t>
+        static inline auto sum(impl_tree_node_ptr_t ptr)
+        {
+            using sum_t = decltype(ptr->metadata().sum);
+            return ptr == nullptr ? sum_t() : ptr->metadata().sum;
+        }
+    };
+
+    //is_aggregate_monoid reading back the key sums kept by sum_metadata_updator
+    template<class T>
+    struct key_sum_aggregate_monoid
+    {
+        using value_type = T;
+
+        [[nodiscard]] value_type identity() const
+        {
+            return value_type();
+        }
+
+        [[nodiscard]] value_type combine(const value_type &lhs, const value_type &rhs) const
+        {
+            return lhs + rhs;
+        }
+
+        template<class impl_tree_node_ptr_t>
+        [[nodiscard]] value_type node(impl_tree_node_ptr_t ptr) const
+        {
+            return ptr->key();
+        }
+
+        template<class impl_tree_node_ptr_t>
+        [[nodiscard]] value_type subtree(impl_tree_node_ptr_t ptr) const
+        {
+            return ptr->metadata();
+        }
     };
 }
 
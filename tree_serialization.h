@@ -0,0 +1,311 @@
+#ifndef BBST_TREE_SERIALIZATION_H
+#define BBST_TREE_SERIALIZATION_H
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "tree_utils.h"
+
+//file format
+namespace bbst
+{
+    /*
+     * A saved tree is this header followed by count entries in key order, native byte order and layout.
+     * Only keys and mapped values are stored: metadata is recomputed by the updator and the shape by the O(n) sorted build,
+     * so the file doesn't depend on the tree kind (a file saved from an rb_tree loads into an avl_tree and the other way around).
+     */
+    struct alignas(64) tree_file_header
+    {
+        char magic[8];
+        uint32_t byte_order;
+        uint32_t version;
+        uint32_t key_size;
+        uint32_t mapped_size;
+        uint32_t entry_size;
+        uint32_t entry_align;
+        uint64_t count;
+    };
+
+    inline constexpr char tree_file_magic[8] = {'b', 'b', 's', 't', 't', 'r', 'e', 'e'};
+    inline constexpr uint32_t tree_file_byte_order = 0x01020304;
+    inline constexpr uint32_t tree_file_version = 1;
+
+    //(key, mapped) as the sorted constructors take it, so a mapped file is a valid input range for them
+    template<class key_t, class mapped_t>
+    struct tree_file_entry
+    {
+        key_t first;
+        [[no_unique_address]] mapped_t second;//a set (no_mapped) stores keys only
+    };
+
+    template<class key_t, class mapped_t> concept is_tree_file_storable =
+    std::is_trivially_copyable_v<key_t> && std::is_trivially_copyable_v<mapped_t>;
+
+    template<class key_t, class mapped_t>
+    tree_file_header make_tree_file_header(uint64_t count) noexcept
+    {
+        tree_file_header header{};
+        std::memcpy(header.magic, tree_file_magic, sizeof(header.magic));
+        header.byte_order = tree_file_byte_order;
+        header.version = tree_file_version;
+        header.key_size = sizeof(key_t);
+        header.mapped_size = sizeof(mapped_t);
+        header.entry_size = sizeof(tree_file_entry<key_t, mapped_t>);
+        header.entry_align = alignof(tree_file_entry<key_t, mapped_t>);
+        header.count = count;
+        return header;
+    }
+
+    //types stored by a tree, read off its value type
+    template<class tree_t>
+    struct tree_file_traits
+    {
+        typedef std::remove_cvref_t<decltype(*std::declval<const tree_t &>().begin())> value_type;
+        typedef std::remove_cv_t<typename value_type::key_type> key_type;
+        typedef typename value_type::mapped_type mapped_type;
+        typedef tree_file_entry<key_type, mapped_type> entry_type;
+    };
+}
+
+//tree_file_view
+namespace bbst
+{
+    /*
+     * Read-only view of a saved tree through a private read-only mapping of the file: find, lower_bound and iteration read the
+     * entries in place by binary search, nothing is copied or allocated. comparator_t must order the keys as the saved tree did.
+     * Throws std::system_error if the file can't be opened or mapped, std::runtime_error if it isn't a tree file for these types.
+     */
+    template<class key_t, class mapped_t, class comparator_t = std::less<key_t>>
+    requires (is_tree_file_storable<key_t, mapped_t> && is_tree_comparator<comparator_t, key_t, key_t>)
+    class tree_file_view
+    {
+    public:
+        typedef tree_file_entry<key_t, mapped_t> value_type;
+        typedef const value_type *const_iterator;
+
+    private:
+        void *mapping_;
+        size_t mapping_size_;
+        const value_type *begin_, *end_;
+        [[no_unique_address]] comparator_t comp_;
+
+        void unmap() noexcept
+        {
+            if (mapping_ != nullptr)
+                ::munmap(mapping_, mapping_size_);
+            mapping_ = nullptr;
+            mapping_size_ = 0;
+            begin_ = end_ = nullptr;
+        }
+
+    public:
+        explicit tree_file_view(const std::string &path, const comparator_t &comp = comparator_t())
+                :
+                mapping_(nullptr)
+                , mapping_size_(0)
+                , begin_(nullptr)
+                , end_(nullptr)
+                , comp_(comp)
+        {
+            int fd = ::open(path.c_str(), O_RDONLY);
+            if (fd < 0)
+                throw std::system_error(errno, std::generic_category(), "tree_file_view: open " + path);
+            struct stat st{};
+            if (::fstat(fd, &st) != 0)
+            {
+                int error = errno;
+                ::close(fd);
+                throw std::system_error(error, std::generic_category(), "tree_file_view: stat " + path);
+            }
+            mapping_size_ = size_t(st.st_size);
+            if (mapping_size_ < sizeof(tree_file_header))
+            {
+                ::close(fd);
+                throw std::runtime_error("tree_file_view: " + path + " is too short for a tree file");
+            }
+            mapping_ = ::mmap(nullptr, mapping_size_, PROT_READ, MAP_PRIVATE, fd, 0);
+            int error = errno;
+            ::close(fd);
+            if (mapping_ == MAP_FAILED)
+            {
+                mapping_ = nullptr;
+                throw std::system_error(error, std::generic_category(), "tree_file_view: mmap " + path);
+            }
+            tree_file_header header;
+            std::memcpy(&header, mapping_, sizeof(header));
+            tree_file_header expect = make_tree_file_header<key_t, mapped_t>(header.count);
+            if (std::memcmp(header.magic, expect.magic, sizeof(header.magic)) != 0 || header.byte_order != expect.byte_order ||
+                header.version != expect.version || header.key_size != expect.key_size || header.mapped_size != expect.mapped_size ||
+                header.entry_size != expect.entry_size || header.entry_align != expect.entry_align ||
+                header.count != (mapping_size_ - sizeof(tree_file_header)) / sizeof(value_type) ||
+                (mapping_size_ - sizeof(tree_file_header)) % sizeof(value_type) != 0)
+            {
+                unmap();
+                throw std::runtime_error("tree_file_view: " + path + " is not a tree file of these key and mapped types");
+            }
+            //the mapping is page aligned and the header is 64 bytes, so entries are aligned for any alignment up to that
+            static_assert(alignof(value_type) <= alignof(tree_file_header));
+            begin_ = std::launder(reinterpret_cast<const value_type *>(static_cast<const char *>(mapping_) + sizeof(tree_file_header)));
+            end_ = begin_ + header.count;
+        }
+
+        tree_file_view(tree_file_view &&other) noexcept
+                :
+                mapping_(std::exchange(other.mapping_, nullptr))
+                , mapping_size_(std::exchange(other.mapping_size_, 0))
+                , begin_(std::exchange(other.begin_, nullptr))
+                , end_(std::exchange(other.end_, nullptr))
+                , comp_(std::move(other.comp_))
+        {}
+
+        tree_file_view(const tree_file_view &) = delete;
+
+        tree_file_view &operator=(const tree_file_view &) = delete;
+
+        ~tree_file_view()
+        {
+            unmap();
+        }
+
+        //hint the kernel that the entries are about to be read front to back (load does)
+        void advise_sequential() const noexcept
+        {
+            if (mapping_ != nullptr)
+                ::madvise(mapping_, mapping_size_, MADV_SEQUENTIAL);
+        }
+
+        [[nodiscard]] const_iterator begin() const noexcept
+        {
+            return begin_;
+        }
+
+        [[nodiscard]] const_iterator end() const noexcept
+        {
+            return end_;
+        }
+
+        [[nodiscard]] size_t size() const noexcept
+        {
+            return size_t(end_ - begin_);
+        }
+
+        [[nodiscard]] bool empty() const noexcept
+        {
+            return begin_ == end_;
+        }
+
+        [[nodiscard]] const_iterator lower_bound(const key_t &key) const
+        {
+            return std::partition_point(begin_, end_, [this, &key](const value_type &entry) { return tree_less(comp_, entry.first, key); });
+        }
+
+        [[nodiscard]] const_iterator upper_bound(const key_t &key) const
+        {
+            return std::partition_point(begin_, end_, [this, &key](const value_type &entry) { return !tree_less(comp_, key, entry.first); });
+        }
+
+        [[nodiscard]] const_iterator find(const key_t &key) const
+        {
+            const_iterator it = lower_bound(key);
+            return it != end_ && !tree_less(comp_, key, it->first) ? it : end_;
+        }
+    };
+}
+
+//save/load
+namespace bbst
+{
+    /*
+     * Write every (key, mapped) of tree in key order, see tree_file_header. Trees with a lazy updator must be settled first (push_down_all).
+     * The entries go to path + ".tmp", renamed over path once written and closed.
+     * Throws std::system_error on I/O failure (including a failed close), path is left as it was then.
+     */
+    template<class tree_t>
+    requires is_tree_file_storable<typename tree_file_traits<tree_t>::key_type, typename tree_file_traits<tree_t>::mapped_type>
+    void save(const tree_t &tree, const std::string &path)
+    {
+        using traits = tree_file_traits<tree_t>;
+        using entry_t = typename traits::entry_type;
+        std::string tmp_path = path + ".tmp";
+        std::unique_ptr<std::FILE, int (*)(std::FILE *)> file(std::fopen(tmp_path.c_str(), "wb"), &std::fclose);
+        if (file == nullptr)
+            throw std::system_error(errno, std::generic_category(), "save: open " + tmp_path);
+        auto write = [&file, &tmp_path](const void *data, size_t size)
+        {
+            if (size != 0 && std::fwrite(data, size, 1, file.get()) != 1)
+                throw std::system_error(errno, std::generic_category(), "save: write " + tmp_path);
+        };
+        try
+        {
+            uint64_t count = 0;
+            for (auto it = tree.begin(); it != tree.end(); ++it)
+                count++;
+            tree_file_header header = make_tree_file_header<typename traits::key_type, typename traits::mapped_type>(count);
+            write(&header, sizeof(header));
+            //entries go out in chunks, zero filled so padding bytes are deterministic
+            constexpr size_t chunk = 4096;
+            std::vector<entry_t> buffer(std::min<uint64_t>(count, chunk));
+            size_t used = 0;
+            for (auto it = tree.begin(); it != tree.end(); ++it)
+            {
+                entry_t &entry = buffer[used++];
+                std::memset(static_cast<void *>(&entry), 0, sizeof(entry));
+                std::memcpy(static_cast<void *>(&entry.first), &it->key, sizeof(entry.first));
+                //an empty mapped type (a set's no_mapped) overlaps the key in both structs, there is nothing to copy
+                if constexpr (!std::is_empty_v<typename traits::mapped_type>)
+                    std::memcpy(static_cast<void *>(&entry.second), &it->mapped, sizeof(entry.second));
+                if (used == buffer.size())
+                {
+                    write(buffer.data(), used * sizeof(entry_t));
+                    used = 0;
+                }
+            }
+            write(buffer.data(), used * sizeof(entry_t));
+            if (std::fflush(file.get()) != 0)
+                throw std::system_error(errno, std::generic_category(), "save: flush " + tmp_path);
+            //delayed write errors (ENOSPC, EIO) may only show up here
+            if (std::fclose(file.release()) != 0)
+                throw std::system_error(errno, std::generic_category(), "save: close " + tmp_path);
+            if (std::rename(tmp_path.c_str(), path.c_str()) != 0)
+                throw std::system_error(errno, std::generic_category(), "save: rename " + tmp_path + " to " + path);
+        }
+        catch (...)
+        {
+            file.reset();
+            std::remove(tmp_path.c_str());
+            throw;
+        }
+    }
+
+    /*
+     * Rebuild a tree saved by save: one sequential pass over the mapped file feeding the O(n) sorted build, instead of n insertions.
+     * args go to the tree constructor after the range (updator, comparator, allocator). Throws as tree_file_view does.
+     */
+    template<class tree_t, class... Args>
+    requires is_tree_file_storable<typename tree_file_traits<tree_t>::key_type, typename tree_file_traits<tree_t>::mapped_type>
+    tree_t load(const std::string &path, Args &&... args)
+    {
+        using traits = tree_file_traits<tree_t>;
+        tree_file_view<typename traits::key_type, typename traits::mapped_type> view(path);
+        view.advise_sequential();
+        return tree_t(sorted_unique, view.begin(), view.end(), std::forward<Args>(args)...);
+    }
+}
+
+#endif //BBST_TREE_SERIALIZATION_H
@@ -0,0 +1,146 @@
+#ifndef BBST_TREE_SET_OPERATION_H
+#define BBST_TREE_SET_OPERATION_H
+
+#include <cstddef>
+#include "fork_join_pool.h"
+#include "tree_utils.h"
+
+//join based set operation
+namespace bbst
+{
+    /*
+     * Union, intersection and difference on headers, following Blelloch, Ferizovic, Sun "Just Join for Parallel Ordered Sets":
+     * expose the root of the first tree, split the second one by its key, recurse on both sides and join back.
+     * O(m log(n/m + 1)) work and O(log n log m) span for sizes m <= n.
+     * header_ops_t is a tree specific set of primitives (rb_tree_header_ops, avl_tree_header_ops).
+     * Both inputs are consumed: surviving nodes are relinked into the result, the rest goes through destroy.
+     * When forking, destroy and the metadata updator are called concurrently on disjoint nodes.
+     */
+    template<class header_ops_t, class header_t, class metadata_updator_t, class comparator_t, class destroy_t>
+    class tree_set_operation
+    {
+    private:
+        using node_ptr_t = decltype(header_t::root_);
+
+        const metadata_updator_t &updator_;
+        const comparator_t &comp_;
+        const destroy_t &destroy_;
+        parallel_policy policy_;
+
+        [[nodiscard]] bool fork_worthy(const header_t &a, const header_t &b) const noexcept
+        {
+            return header_ops_t::size_lower_bound(a, policy_.grain) + header_ops_t::size_lower_bound(b, policy_.grain) >= policy_.grain;
+        }
+
+        template<class left_routine_t, class right_routine_t>
+        void fork(bool parallel, left_routine_t &&left, right_routine_t &&right)
+        {
+            if (parallel)
+            {
+                policy_.pool->invoke(left, right);
+            }
+            else
+            {
+                left();
+                right();
+            }
+        }
+
+        void destroy_detached(node_ptr_t x) const
+        {
+            x->left = x->right = nullptr;
+            destroy_(x);
+        }
+
+        header_t union_routine(header_t a, header_t b, bool parallel)
+        {
+            if (a.empty())
+                return b;
+            if (b.empty())
+                return a;
+            parallel = parallel && fork_worthy(a, b);
+            auto [a_left, x, a_right] = header_ops_t::expose(a, updator_);
+            auto [b_left, duplicate, b_right] = header_ops_t::split(b, x->key(), updator_, comp_);
+            if (duplicate != nullptr)
+                destroy_detached(duplicate);
+            header_t left = header_t::empty_header(), right = header_t::empty_header();
+            fork(parallel, [&, a_left = a_left, b_left = b_left] { left = union_routine(a_left, b_left, parallel); }
+                 , [&, a_right = a_right, b_right = b_right] { right = union_routine(a_right, b_right, parallel); });
+            return header_ops_t::join_x(left, x, right, updator_, comp_);
+        }
+
+        header_t intersection_routine(header_t a, header_t b, bool parallel)
+        {
+            if (a.empty() || b.empty())
+            {
+                if (!a.empty()) destroy_(a.root_);
+                if (!b.empty()) destroy_(b.root_);
+                return header_t::empty_header();
+            }
+            parallel = parallel && fork_worthy(a, b);
+            auto [a_left, x, a_right] = header_ops_t::expose(a, updator_);
+            auto [b_left, duplicate, b_right] = header_ops_t::split(b, x->key(), updator_, comp_);
+            header_t left = header_t::empty_header(), right = header_t::empty_header();
+            fork(parallel, [&, a_left = a_left, b_left = b_left] { left = intersection_routine(a_left, b_left, parallel); }
+                 , [&, a_right = a_right, b_right = b_right] { right = intersection_routine(a_right, b_right, parallel); });
+            if (duplicate != nullptr)
+            {
+                destroy_detached(duplicate);
+                return header_ops_t::join_x(left, x, right, updator_, comp_);
+            }
+            destroy_detached(x);
+            return header_ops_t::join(left, right, updator_, comp_);
+        }
+
+        header_t difference_routine(header_t a, header_t b, bool parallel)
+        {
+            if (a.empty() || b.empty())
+            {
+                if (!b.empty()) destroy_(b.root_);
+                return a;
+            }
+            parallel = parallel && fork_worthy(a, b);
+            auto [a_left, x, a_right] = header_ops_t::expose(a, updator_);
+            auto [b_left, duplicate, b_right] = header_ops_t::split(b, x->key(), updator_, comp_);
+            header_t left = header_t::empty_header(), right = header_t::empty_header();
+            fork(parallel, [&, a_left = a_left, b_left = b_left] { left = difference_routine(a_left, b_left, parallel); }
+                 , [&, a_right = a_right, b_right = b_right] { right = difference_routine(a_right, b_right, parallel); });
+            if (duplicate != nullptr)
+            {
+                destroy_detached(duplicate);
+                destroy_detached(x);
+                return header_ops_t::join(left, right, updator_, comp_);
+            }
+            return header_ops_t::join_x(left, x, right, updator_, comp_);
+        }
+
+    public:
+        tree_set_operation(const metadata_updator_t &updator, const comparator_t &comp, const destroy_t &destroy, parallel_policy policy)
+                :
+                updator_(updator)
+                , comp_(comp)
+                , destroy_(destroy)
+                , policy_(policy)
+        {}
+
+        //keys of a or b, a's node is kept for keys in both
+        header_t union_(header_t a, header_t b)
+        {
+            return union_routine(a, b, policy_.pool != nullptr);
+        }
+
+        //keys of both a and b, a's node is kept
+        header_t intersection(header_t a, header_t b)
+        {
+            return intersection_routine(a, b, policy_.pool != nullptr);
+        }
+
+        //keys of a that are not in b
+        header_t difference(header_t a, header_t b)
+        {
+            return difference_routine(a, b, policy_.pool != nullptr);
+        }
+    };
+}
+
+#endif //BBST_TREE_SET_OPERATION_H
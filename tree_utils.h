@@ -1,10 +1,19 @@
 #ifndef BBST_TREE_UTILS_H
 #define BBST_TREE_UTILS_H
 
+#include <bit>
 #include <cassert>
+#include <compare>
+#include <cstdint>
+#include <functional>
 #include <utility>
 #include <concepts>
 #include <iostream>
+#include <iterator>
+#include <memory>
+#include <tuple>
+#include <type_traits>
+#include <vector>
 
 namespace bbst
 {
@@ -23,6 +32,61 @@ namespace bbst
 #endif
 }
 
+//comparison
+namespace bbst
+{
+    //comparator answering comp(a, b) with std::weak_ordering or std::strong_ordering instead of "a goes before b"
+    template<class comparator_t, class lhs_t, class rhs_t> concept is_three_way_comparator =
+    std::regular_invocable<const comparator_t &, const lhs_t &, const rhs_t &> &&
+    std::convertible_to<std::invoke_result_t<const comparator_t &, const lhs_t &, const rhs_t &>, std::weak_ordering>;
+
+    template<class comparator_t, class lhs_t, class rhs_t> concept is_tree_comparator =
+    std::predicate<const comparator_t &, const lhs_t &, const rhs_t &> || is_three_way_comparator<comparator_t, lhs_t, rhs_t>;
+
+    template<class comparator_t>
+    struct is_std_less : std::false_type {};
+
+    template<class T>
+    struct is_std_less<std::less<T>> : std::true_type {};
+
+    //std::less (typed or transparent) over keys with a total operator<=>, answered by operator<=> itself
+    template<class comparator_t, class lhs_t, class rhs_t> concept is_spaceship_less =
+    is_std_less<comparator_t>::value && !std::is_pointer_v<lhs_t> && !std::is_pointer_v<rhs_t> &&
+    std::three_way_comparable_with<const lhs_t &, const rhs_t &, std::weak_ordering>;
+
+    //lhs goes before rhs
+    template<class comparator_t, class lhs_t, class rhs_t>
+    inline bool tree_less(const comparator_t &comp, const lhs_t &lhs, const rhs_t &rhs)
+    {
+        if constexpr (is_three_way_comparator<comparator_t, lhs_t, rhs_t>)
+            return comp(lhs, rhs) < 0;
+        else
+            return comp(lhs, rhs);
+    }
+
+    /*
+     * Where lhs goes relative to rhs, for descents that need both directions (insert, find, split).
+     * A single comparison for three-way comparators and for std::less over operator<=> keys (long strings, tuples),
+     * two calls of a plain predicate otherwise.
+     */
+    template<class comparator_t, class lhs_t, class rhs_t>
+    inline std::weak_ordering tree_compare(const comparator_t &comp, const lhs_t &lhs, const rhs_t &rhs)
+    {
+        if constexpr (is_three_way_comparator<comparator_t, lhs_t, rhs_t>)
+            return comp(lhs, rhs);
+        else if constexpr (is_spaceship_less<comparator_t, lhs_t, rhs_t>)
+            return lhs <=> rhs;
+        else
+        {
+            if (comp(lhs, rhs))
+                return std::weak_ordering::less;
+            if (comp(rhs, lhs))
+                return std::weak_ordering::greater;
+            return std::weak_ordering::equivalent;
+        }
+    }
+}
+
 //pointer template
 namespace bbst
 {
@@ -77,7 +141,7 @@ namespace bbst
         inline tree_forward_iterator_(base_tree_node_ptr_t ptr_) noexcept: ptr(ptr_)
         {}
 
-        inline base_tree_node_t get() const noexcept
+        inline base_tree_node_ptr_t get() const noexcept
         {
             return ptr;
         }
@@ -161,7 +225,7 @@ namespace bbst
 
         inline tree_forward_const_iterator_ operator++(int)
         {
-            tree_forward_iterator_ temp(*this);
+            tree_forward_const_iterator_ temp(*this);
             ++(*this);
             return temp;
         }
@@ -196,7 +260,7 @@ namespace bbst
         inline tree_bidirectional_iterator_(base_tree_node_ptr_t ptr_) noexcept: ptr(ptr_)
         {}
 
-        inline base_tree_node_t get() const noexcept
+        inline base_tree_node_ptr_t get() const noexcept
         {
             return ptr;
         }
@@ -219,7 +283,7 @@ namespace bbst
 
         inline tree_bidirectional_iterator_ operator++(int)
         {
-            tree_forward_iterator_ temp(*this);
+            tree_bidirectional_iterator_ temp(*this);
             ++(*this);
             return temp;
         }
@@ -325,6 +389,171 @@ namespace bbst
 
 }
 
+//lazy propagation
+namespace bbst
+{
+    /*
+     * Root to leaf path length kept inline by tree_path_stack. rb: 2 * black height, avl: 1.44 log2 n, both far below this for 64 bit sizes.
+     * A treap's depth is random (expected ~2.99 log2 n) without a deterministic bound, deeper paths spill over to the heap.
+     */
+    inline constexpr size_t tree_split_max_depth = 128;
+
+    //stack of per-level path entries: the first tree_split_max_depth live inline and uninitialized, the rest in a vector
+    template<class entry_t>
+    class tree_path_stack
+    {
+        static_assert(std::is_trivially_destructible_v<entry_t>);
+    private:
+        union inline_storage
+        {
+            entry_t entries[tree_split_max_depth];
+
+            inline_storage()
+            {}
+        } inline_;
+        std::vector<entry_t> overflow_;
+        size_t size_ = 0;
+
+    public:
+        tree_path_stack() = default;
+
+        tree_path_stack(const tree_path_stack &) = delete;
+
+        tree_path_stack &operator=(const tree_path_stack &) = delete;
+
+        inline void push(entry_t entry)
+        {
+            if (size_ < tree_split_max_depth)
+                ::new(&inline_.entries[size_]) entry_t(std::move(entry));
+            else
+                overflow_.push_back(std::move(entry));
+            size_++;
+        }
+
+        inline entry_t pop()
+        {
+            ASSERT(size_ != 0, "pop from an empty path");
+            if (--size_ < tree_split_max_depth)
+                return std::move(inline_.entries[size_]);
+            entry_t entry = std::move(overflow_.back());
+            overflow_.pop_back();
+            return entry;
+        }
+
+        [[nodiscard]] inline bool empty() const noexcept
+        {
+            return size_ == 0;
+        }
+    };
+
+    /*
+     * Updator with pending work for whole subtrees (segment tree style lazy tags).
+     * Convention: a node's own value and metadata are always up to date, its pending tag is owed to its children only.
+     * push_down(ptr) hands the tag over to both children (applying it to their value/metadata and composing it into their tags) and clears it.
+     * Trees push a node down before changing its child links or refreshing its metadata, and push the whole root path
+     * before linking a node in or out, so a tag only ever covers the nodes it was put on.
+     */
+    template<class updator_t, class impl_tree_node_ptr_t> concept is_lazy_metadata_updator =
+    requires(const updator_t updator, impl_tree_node_ptr_t ptr) {
+        updator.push_down(ptr);
+    };
+
+    //updator declaring static constexpr bool is_noop = true never writes metadata, walks that would only refresh metadata are skipped
+    template<class updator_t> concept is_noop_metadata_updator = requires {
+        requires updator_t::is_noop;
+    };
+
+    template<class metadata_updator_t, class impl_tree_node_ptr_t>
+    inline void tree_push_down(const metadata_updator_t &updator, impl_tree_node_ptr_t ptr)
+    {
+        if constexpr (is_lazy_metadata_updator<metadata_updator_t, impl_tree_node_ptr_t>)
+            if (ptr != nullptr)
+                updator.push_down(ptr);
+    }
+
+    //push down ptr and all of its ancestors below end_node, top-down
+    template<class metadata_updator_t, class base_tree_node_ptr_t, class impl_tree_node_ptr_t>
+    void tree_push_down_path(const metadata_updator_t &updator, base_tree_node_ptr_t end_node, impl_tree_node_ptr_t ptr)
+    {
+        if constexpr (is_lazy_metadata_updator<metadata_updator_t, impl_tree_node_ptr_t>)
+        {
+            tree_path_stack<impl_tree_node_ptr_t> path;
+            for (base_tree_node_ptr_t p = ptr; p != end_node; p = p->parent)
+                path.push(p->self_downcast_unsafe());
+            while (!path.empty())
+                updator.push_down(path.pop());
+        }
+    }
+}
+
+//range aggregate
+namespace bbst
+{
+    /*
+     * How to read an aggregate back from the metadata: identity and an associative combine over value_type,
+     * node(ptr) for a single node and subtree(ptr) for a whole (non null) subtree, the latter usually just the metadata.
+     * combine need not be commutative, pieces are always combined in key order.
+     */
+    template<class monoid_t, class impl_tree_node_ptr_t> concept is_aggregate_monoid =
+    requires(const monoid_t monoid, impl_tree_node_ptr_t ptr, const typename monoid_t::value_type &value) {
+        { monoid.identity() } -> std::convertible_to<typename monoid_t::value_type>;
+        { monoid.combine(value, value) } -> std::convertible_to<typename monoid_t::value_type>;
+        { monoid.node(ptr) } -> std::convertible_to<typename monoid_t::value_type>;
+        { monoid.subtree(ptr) } -> std::convertible_to<typename monoid_t::value_type>;
+    };
+
+    /*
+     * Aggregate of the nodes with keys in [lo, hi]: descend to the highest node inside the range,
+     * then walk both boundary paths below it, picking up whole subtrees that lie inside. O(log n)
+     */
+    template<class impl_tree_node_ptr_t, class key_t, class comparator_t, class monoid_t>
+    requires is_aggregate_monoid<monoid_t, impl_tree_node_ptr_t>
+    typename monoid_t::value_type tree_range_aggregate(impl_tree_node_ptr_t root, const key_t &lo, const key_t &hi, const comparator_t &comparator
+                                                       , const monoid_t &monoid)
+    {
+        using value_t = typename monoid_t::value_type;
+        impl_tree_node_ptr_t split = root;
+        while (split != nullptr)
+        {
+            if (tree_less(comparator, split->key(), lo))
+                split = split->right;
+            else if (tree_less(comparator, hi, split->key()))
+                split = split->left;
+            else
+                break;
+        }
+        if (split == nullptr)
+            return monoid.identity();
+        //left boundary, everything picked up lies right of what is still to come
+        value_t left = monoid.identity();
+        for (impl_tree_node_ptr_t ptr = split->left; ptr != nullptr;)
+        {
+            if (tree_less(comparator, ptr->key(), lo))
+            {
+                ptr = ptr->right;
+                continue;
+            }
+            value_t piece = ptr->right == nullptr ? monoid.node(ptr) : monoid.combine(monoid.node(ptr), monoid.subtree(ptr->right));
+            left = monoid.combine(piece, left);
+            ptr = ptr->left;
+        }
+        //right boundary, mirrored
+        value_t right = monoid.identity();
+        for (impl_tree_node_ptr_t ptr = split->right; ptr != nullptr;)
+        {
+            if (tree_less(comparator, hi, ptr->key()))
+            {
+                ptr = ptr->left;
+                continue;
+            }
+            value_t piece = ptr->left == nullptr ? monoid.node(ptr) : monoid.combine(monoid.subtree(ptr->left), monoid.node(ptr));
+            right = monoid.combine(right, piece);
+            ptr = ptr->right;
+        }
+        return monoid.combine(monoid.combine(left, monoid.node(split)), right);
+    }
+}
+
 //tree rotate
 namespace bbst
 {
@@ -507,6 +736,78 @@ namespace bbst
         return Y;
     }
 
+
+    /*
+     * Same rotations for trees with a lazy updator: every node whose children change hands is pushed down first.
+     * Compiles to the plain rotation otherwise.
+     */
+    template<class base_tree_node_ptr_t, class metadata_updator_t>
+    inline void unguarded_tree_right_rotate(base_tree_node_ptr_t P, const metadata_updator_t &updator)
+    {
+        tree_push_down(updator, P);
+        tree_push_down(updator, P->left);
+        unguarded_tree_right_rotate(P);
+    }
+
+    template<class base_tree_node_ptr_t, class metadata_updator_t>
+    inline void unguarded_tree_left_rotate(base_tree_node_ptr_t P, const metadata_updator_t &updator)
+    {
+        tree_push_down(updator, P);
+        tree_push_down(updator, P->right);
+        unguarded_tree_left_rotate(P);
+    }
+
+    template<class base_tree_node_ptr_t, class metadata_updator_t>
+    inline void tree_root_left_rotate(base_tree_node_ptr_t P, const metadata_updator_t &updator)
+    {
+        tree_push_down(updator, P);
+        tree_push_down(updator, P->right);
+        tree_root_left_rotate(P);
+    }
+
+    template<class base_tree_node_ptr_t, class metadata_updator_t>
+    inline void tree_root_right_rotate(base_tree_node_ptr_t P, const metadata_updator_t &updator)
+    {
+        tree_push_down(updator, P);
+        tree_push_down(updator, P->left);
+        tree_root_right_rotate(P);
+    }
+
+    template<class base_tree_node_ptr_t, class metadata_updator_t>
+    inline base_tree_node_ptr_t unguarded_tree_right_left_rotate(base_tree_node_ptr_t X, base_tree_node_ptr_t Z, const metadata_updator_t &updator)
+    {
+        tree_push_down(updator, X);
+        tree_push_down(updator, Z);
+        tree_push_down(updator, Z->left);
+        return unguarded_tree_right_left_rotate(X, Z);
+    }
+
+    template<class base_tree_node_ptr_t, class metadata_updator_t>
+    inline base_tree_node_ptr_t unguarded_tree_left_right_rotate(base_tree_node_ptr_t X, base_tree_node_ptr_t Z, const metadata_updator_t &updator)
+    {
+        tree_push_down(updator, X);
+        tree_push_down(updator, Z);
+        tree_push_down(updator, Z->right);
+        return unguarded_tree_left_right_rotate(X, Z);
+    }
+
+    template<class base_tree_node_ptr_t, class metadata_updator_t>
+    inline base_tree_node_ptr_t tree_root_right_left_rotate(base_tree_node_ptr_t X, base_tree_node_ptr_t Z, const metadata_updator_t &updator)
+    {
+        tree_push_down(updator, X);
+        tree_push_down(updator, Z);
+        tree_push_down(updator, Z->left);
+        return tree_root_right_left_rotate(X, Z);
+    }
+
+    template<class base_tree_node_ptr_t, class metadata_updator_t>
+    inline base_tree_node_ptr_t tree_root_left_right_rotate(base_tree_node_ptr_t X, base_tree_node_ptr_t Z, const metadata_updator_t &updator)
+    {
+        tree_push_down(updator, X);
+        tree_push_down(updator, Z);
+        tree_push_down(updator, Z->right);
+        return tree_root_left_right_rotate(X, Z);
+    }
 }
 
 //tree_node typedef
@@ -516,12 +817,74 @@ namespace bbst
     template<typename derived_t>
     struct tree_node_base_traits;
 
+    /*
+     * Pointer whose low bits (always zero for a pointer aligned node) carry a small tag.
+     * Trees keep their per node balance information (rb color, avl height difference) in the parent pointer this way,
+     * instead of a separate field that gets padded to a full word.
+     * Assigning a pointer keeps the tag, the tag itself is only changed through set_tag.
+     */
+    template<class pointer_t, size_t tag_bits>
+    class tree_tagged_pointer
+    {
+    private:
+        uintptr_t word_;
+
+    public:
+        static constexpr uintptr_t tag_mask = (uintptr_t(1) << tag_bits) - 1;
+
+        tree_tagged_pointer() = default;
+
+        inline tree_tagged_pointer(pointer_t ptr) noexcept: word_(reinterpret_cast<uintptr_t>(ptr))
+        {}
+
+        inline tree_tagged_pointer(const tree_tagged_pointer &other) = default;
+
+        inline tree_tagged_pointer &operator=(pointer_t ptr) noexcept
+        {
+            ASSERT((reinterpret_cast<uintptr_t>(ptr) & tag_mask) == 0, "pointer is not aligned enough to carry the tag");
+            word_ = reinterpret_cast<uintptr_t>(ptr) | (word_ & tag_mask);
+            return *this;
+        }
+
+        inline tree_tagged_pointer &operator=(const tree_tagged_pointer &other) noexcept
+        {
+            return *this = other.get();
+        }
+
+        [[nodiscard]] inline pointer_t get() const noexcept
+        {
+            return reinterpret_cast<pointer_t>(word_ & ~tag_mask);
+        }
+
+        inline operator pointer_t() const noexcept
+        {
+            return get();
+        }
+
+        inline pointer_t operator->() const noexcept
+        {
+            return get();
+        }
+
+        [[nodiscard]] inline uintptr_t tag() const noexcept
+        {
+            return word_ & tag_mask;
+        }
+
+        inline void set_tag(uintptr_t tag) noexcept
+        {
+            ASSERT((tag & ~tag_mask) == 0, "tag overflow");
+            word_ = (word_ & ~tag_mask) | tag;
+        }
+    };
+
     template<class tree_node_impl>
     struct base_tree_node
     {
         typedef typename tree_node_base_traits<tree_node_impl>::impl_type impl_type;
 
-        base_tree_node *parent;
+        //two spare bits for the implementation class (see tree_tagged_pointer), nodes hold pointers so they're at least 4 aligned
+        tree_tagged_pointer<base_tree_node *, 2> parent;
         tree_node_impl *left, *right;
 
         //left initialization for implementation class
@@ -537,7 +900,7 @@ namespace bbst
         impl_type *parent_unsafe()
         {
             ASSERT(parent != nullptr && (parent->parent != nullptr || parent->right != nullptr), "fuck up unsafe cast");
-            return static_cast<impl_type *>(parent);
+            return static_cast<impl_type *>(parent.get());
         }
 
         impl_type *self_downcast_unsafe()
@@ -558,16 +921,28 @@ namespace bbst
 }
 
 //value_type
-//TODO: compressed_pair for key and mapped (for set)
 //TODO: https://stackoverflow.com/questions/31623423/why-does-libcs-implementation-of-map-use-this-union
 namespace bbst
 {
+    //metadata type for trees whose updator never writes any (noop_metadata_updator_impl), takes no room in a node
+    struct no_metadata
+    {
+        friend constexpr bool operator==(no_metadata, no_metadata) noexcept = default;
+    };
+
+    //mapped type of trees used as ordered sets (rb_set, avl_set, treap_set), takes no room in a node
+    struct no_mapped
+    {
+        friend constexpr bool operator==(no_mapped, no_mapped) noexcept = default;
+    };
+
+    //empty metadata and mapped types share their address with the key instead of taking a byte each (plus padding)
     template<class key_t, class mapped_t, class metadata_t>
     struct exposure
     {
         const key_t key;
-        metadata_t metadata;
-        mapped_t mapped;
+        [[no_unique_address]] metadata_t metadata;
+        [[no_unique_address]] mapped_t mapped;
 
         typedef const key_t key_type;
         typedef mapped_t mapped_type;
@@ -580,9 +955,15 @@ namespace bbst
         explicit exposure(key_forward_t &&key_ = key_t(), metadata_forward_t &&metadata_ = metadata_t(), mapped_forward_t &&mapped_ = mapped_t())
                 :
                 key(std::forward<key_forward_t>(key_))
-                , metadata(std::forward<mapped_forward_t>(metadata_))
+                , metadata(std::forward<metadata_forward_t>(metadata_))
                 , mapped(std::forward<mapped_forward_t>(mapped_))
         {}
+
+        //in a set an element is just its key, so `for (const key_t &key: set)` works
+        operator const key_t &() const noexcept requires std::is_same_v<mapped_t, no_mapped>
+        {
+            return key;
+        }
     };
 }
 
@@ -605,9 +986,17 @@ namespace bbst
         return ptr;
     }
 
+    //comparator_t::is_transparent opts into lookups by any type it can compare with the key (e.g. std::less<> and std::string_view)
+    template<class comparator_t> concept is_transparent_comparator = requires {
+        typename comparator_t::is_transparent;
+    };
+
+    //query_t is the key type itself, or anything a transparent comparator orders against it both ways
+    template<class comparator_t, class key_t, class query_t> concept is_key_comparable =
+    is_tree_comparator<comparator_t, key_t, query_t> && is_tree_comparator<comparator_t, query_t, key_t>;
+
     template<class key_t, class base_tree_node_ptr_t, class comparator_t>
-    requires (std::predicate<const comparator_t &, const key_t &, const key_t &> &&
-              std::same_as<const key_t, typename std::remove_pointer_t<base_tree_node_ptr_t>::impl_type::key_type>)
+    requires is_key_comparable<comparator_t, typename std::remove_pointer_t<base_tree_node_ptr_t>::impl_type::key_type, key_t>
     base_tree_node_ptr_t lower_bound(base_tree_node_ptr_t root_parent, const key_t &key, const comparator_t &comp)
     {
 
@@ -615,7 +1004,23 @@ namespace bbst
         auto current = result->left;
         while (current != nullptr)
         {
-            if (!comp(current->key(), key))
+            if (!tree_less(comp, current->key(), key))
+                result = std::exchange(current, current->left);
+            else
+                current = current->right;
+        }
+        return result;
+    }
+
+    template<class key_t, class base_tree_node_ptr_t, class comparator_t>
+    requires is_key_comparable<comparator_t, typename std::remove_pointer_t<base_tree_node_ptr_t>::impl_type::key_type, key_t>
+    base_tree_node_ptr_t upper_bound(base_tree_node_ptr_t root_parent, const key_t &key, const comparator_t &comp)
+    {
+        base_tree_node_ptr_t result = root_parent;
+        auto current = result->left;
+        while (current != nullptr)
+        {
+            if (tree_less(comp, key, current->key()))
                 result = std::exchange(current, current->left);
             else
                 current = current->right;
@@ -624,12 +1029,11 @@ namespace bbst
     }
 
     template<class key_t, class base_tree_node_ptr_t, class comparator_t>
-    requires (std::predicate<const comparator_t &, const key_t &, const key_t &> &&
-              std::same_as<const key_t, typename std::remove_pointer_t<base_tree_node_ptr_t>::impl_type::key_type>)
+    requires is_key_comparable<comparator_t, typename std::remove_pointer_t<base_tree_node_ptr_t>::impl_type::key_type, key_t>
     base_tree_node_ptr_t find(base_tree_node_ptr_t root_parent, const key_t &key, const comparator_t &comp)
     {
         base_tree_node_ptr_t p = lower_bound(root_parent, key, comp);
-        if (p != root_parent && !comp(key, p->self_downcast_unsafe()->key()))
+        if (p != root_parent && !tree_less(comp, key, p->self_downcast_unsafe()->key()))
             return p;
         return root_parent;
     }
@@ -638,7 +1042,7 @@ namespace bbst
     std::pair<impl_tree_node_ptr_t &, base_tree_node_ptr_t>
     find_equal_or_insert_pos(const key_t &key, base_tree_node_ptr_t end_node, const comparator_t &comp)
     requires (std::is_same_v<typename std::remove_pointer_t<base_tree_node_ptr_t>::impl_type, std::remove_pointer_t<impl_tree_node_ptr_t>> &&
-              std::predicate<const comparator_t &, const key_t &, const key_t &>)
+              is_key_comparable<comparator_t, typename std::remove_pointer_t<impl_tree_node_ptr_t>::key_type, key_t>)
     {
         impl_tree_node_ptr_t *parent_link = &(end_node->left);
         impl_tree_node_ptr_t current_node_ptr = *parent_link;
@@ -646,7 +1050,8 @@ namespace bbst
         {
             while (true)
             {
-                if (comp(key, current_node_ptr->value_.key))
+                auto order = tree_compare(comp, key, current_node_ptr->value_.key);
+                if (order < 0)
                 {
                     if (current_node_ptr->left != nullptr)
                     {
@@ -658,7 +1063,7 @@ namespace bbst
                         return {current_node_ptr->left, current_node_ptr};
                     }
                 }
-                else if (comp(current_node_ptr->value_.key, key))
+                else if (order > 0)
                 {
                     if (current_node_ptr->right != nullptr)
                     {
@@ -679,6 +1084,404 @@ namespace bbst
         return {*parent_link, end_node};
     }
 
+    /*
+     * lower_bound starting at finger (a node of the tree, not end_node) instead of the root: climb only until the subtree reached is known
+     * to hold the answer, then descend from there. On balanced trees O(log n) worst case: the answer may be d = 1 element away but
+     * across the root (finger the greatest key of the root's left subtree, answer its successor's), climbing and descending the full height.
+     * Amortized O(log d) for d elements between finger and answer over a monotone sweep (each lookup from the previous answer),
+     * which is what insert_sorted_batch relies on.
+     */
+    template<class key_t, class base_tree_node_ptr_t, class comparator_t>
+    requires is_key_comparable<comparator_t, typename std::remove_pointer_t<base_tree_node_ptr_t>::impl_type::key_type, key_t>
+    base_tree_node_ptr_t tree_finger_lower_bound(base_tree_node_ptr_t end_node, base_tree_node_ptr_t finger, const key_t &key, const comparator_t &comp)
+    {
+        ASSERT(finger != end_node, "finger must be a node of the tree");
+        base_tree_node_ptr_t result = end_node;
+        base_tree_node_ptr_t subtree = finger;
+        if (tree_less(comp, finger->self_downcast_unsafe()->key(), key))
+        {
+            //the answer is after finger: the first ancestor we leave through a left link and that is not less than key bounds it
+            while (subtree->parent != end_node)
+            {
+                base_tree_node_ptr_t parent = subtree->parent;
+                if (tree_is_left_child(subtree) && !tree_less(comp, parent->self_downcast_unsafe()->key(), key))
+                {
+                    result = parent;
+                    break;
+                }
+                subtree = parent;
+            }
+        }
+        else
+        {
+            //finger qualifies, the answer is finger or before it: stop once the ancestor on the left is less than key
+            while (subtree->parent != end_node)
+            {
+                base_tree_node_ptr_t parent = subtree->parent;
+                if (!tree_is_left_child(subtree) && tree_less(comp, parent->self_downcast_unsafe()->key(), key))
+                    break;
+                subtree = parent;
+            }
+        }
+        auto current = subtree->self_downcast_unsafe();
+        while (current != nullptr)
+        {
+            if (!tree_less(comp, current->key(), key))
+                result = std::exchange(current, current->left);
+            else
+                current = current->right;
+        }
+        return result;
+    }
+
+    template<class key_t, class base_tree_node_ptr_t, class comparator_t>
+    requires is_key_comparable<comparator_t, typename std::remove_pointer_t<base_tree_node_ptr_t>::impl_type::key_type, key_t>
+    base_tree_node_ptr_t tree_finger_find(base_tree_node_ptr_t end_node, base_tree_node_ptr_t finger, const key_t &key, const comparator_t &comp)
+    {
+        base_tree_node_ptr_t p = tree_finger_lower_bound(end_node, finger, key, comp);
+        if (p != end_node && !tree_less(comp, key, p->self_downcast_unsafe()->key()))
+            return p;
+        return end_node;
+    }
+}
+
+//batched lookup
+namespace bbst
+{
+    inline void tree_prefetch(const void *ptr) noexcept
+    {
+#if defined(__GNUC__) || defined(__clang__)
+        __builtin_prefetch(ptr);
+#else
+        (void) ptr;
+#endif
+    }
+
+    //descents kept in flight at once, enough to cover a memory round trip with independent work
+    constexpr size_t tree_batch_width = 16;
+
+    /*
+     * lower_bound of every key in [first, last), handed to visit(key, result) in order.
+     * Keys go in groups of tree_batch_width descents advanced one level at a time in lock-step, prefetching every child as it is chosen,
+     * so the cache misses of a group overlap instead of being paid one after another.
+     */
+    template<class key_iterator_t, class base_tree_node_ptr_t, class comparator_t, class visit_t>
+    requires is_key_comparable<comparator_t, typename std::remove_pointer_t<base_tree_node_ptr_t>::impl_type::key_type, std::iter_value_t<key_iterator_t>>
+    void tree_lower_bound_batch(base_tree_node_ptr_t root_parent, key_iterator_t first, key_iterator_t last, const comparator_t &comp, visit_t &&visit)
+    {
+        using node_ptr_t = decltype(root_parent->left);
+        key_iterator_t keys[tree_batch_width];
+        base_tree_node_ptr_t results[tree_batch_width];
+        node_ptr_t current[tree_batch_width];
+        while (first != last)
+        {
+            size_t width = 0;
+            for (; width < tree_batch_width && first != last; ++width, ++first)
+            {
+                keys[width] = first;
+                results[width] = root_parent;
+                current[width] = root_parent->left;
+            }
+            for (bool active = true; active;)
+            {
+                active = false;
+                for (size_t i = 0; i < width; i++)
+                {
+                    node_ptr_t node = current[i];
+                    if (node == nullptr)
+                        continue;
+                    //selects rather than branches, the outcome of a random key is a coin flip
+                    bool go_left = !tree_less(comp, node->key(), *keys[i]);
+                    results[i] = go_left ? node : results[i];
+                    node = go_left ? node->left : node->right;
+                    current[i] = node;
+                    if (node != nullptr)
+                    {
+                        tree_prefetch(node);
+                        active = true;
+                    }
+                }
+            }
+            for (size_t i = 0; i < width; i++)
+                visit(*keys[i], results[i]);
+        }
+    }
+
+    //find of every key in [first, last) handed to visit(result) in order, root_parent when missing. See tree_lower_bound_batch
+    template<class key_iterator_t, class base_tree_node_ptr_t, class comparator_t, class visit_t>
+    requires is_key_comparable<comparator_t, typename std::remove_pointer_t<base_tree_node_ptr_t>::impl_type::key_type, std::iter_value_t<key_iterator_t>>
+    void tree_find_batch(base_tree_node_ptr_t root_parent, key_iterator_t first, key_iterator_t last, const comparator_t &comp, visit_t &&visit)
+    {
+        tree_lower_bound_batch(root_parent, first, last, comp, [root_parent, &comp, &visit](const auto &key, base_tree_node_ptr_t p)
+        {
+            visit(p != root_parent && !tree_less(comp, key, p->self_downcast_unsafe()->key()) ? p : root_parent);
+        });
+    }
+}
+
+//node teardown
+namespace bbst
+{
+    /*
+     * Tear down a whole subtree with O(1) extra space (no recursion, no stack):
+     * while the current node has a left child, rotate it up so the tree degenerates into a right spine,
+     * once there is no left child the node can be handed to destroy and the walk continues to the right.
+     * Every node is rotated at most once per left child it owns, so the walk is O(n).
+     * Parent pointers are neither read nor fixed, the subtree must not be used afterward.
+     */
+    template<class tree_node_ptr_t, class destroy_t>
+    void tree_destroy(tree_node_ptr_t ptr, destroy_t &&destroy) noexcept
+    {
+        while (ptr != nullptr)
+        {
+            if (ptr->left != nullptr)
+            {
+                tree_node_ptr_t L = ptr->left;
+                ptr->left = L->right;
+                L->right = ptr;
+                ptr = L;
+            }
+            else
+            {
+                tree_node_ptr_t next = ptr->right;
+                destroy(ptr);
+                ptr = next;
+            }
+        }
+    }
+
+    //allocator overrides construct/destroy, so destroy can't be skipped even for trivial types
+    template<class allocator_t, class T> concept has_custom_destroy =
+    requires(allocator_t &alloc, T *ptr) {
+        alloc.destroy(ptr);
+    };
+
+    //allocator able to give back all of its memory at once (see node_pool_allocator)
+    template<class allocator_t> concept is_bulk_releasable_allocator =
+    requires(allocator_t &alloc) {
+        { alloc.release_if_exclusive() } -> std::same_as<bool>;
+    };
+
+    template<class node_allocator_t, class tree_node_ptr_t>
+    inline void tree_destroy_node(node_allocator_t &alloc, tree_node_ptr_t ptr) noexcept
+    {
+        using node_t = std::remove_pointer_t<tree_node_ptr_t>;
+        if constexpr (!std::is_trivially_destructible_v<node_t> || has_custom_destroy<node_allocator_t, node_t>)
+            std::allocator_traits<node_allocator_t>::destroy(alloc, ptr);
+        std::allocator_traits<node_allocator_t>::deallocate(alloc, ptr, 1);
+    }
+
+    /*
+     * Tear down a tree owned by a container. When nothing in a node needs destruction and the allocator
+     * is the only owner of its pool, hand the slabs back wholesale instead of walking the nodes.
+     */
+    template<class node_allocator_t, class tree_node_ptr_t>
+    void tree_destroy_all(node_allocator_t &alloc, tree_node_ptr_t root) noexcept
+    {
+        using node_t = std::remove_pointer_t<tree_node_ptr_t>;
+        if constexpr (std::is_trivially_destructible_v<node_t> && !has_custom_destroy<node_allocator_t, node_t> &&
+                      is_bulk_releasable_allocator<node_allocator_t>)
+        {
+            if (alloc.release_if_exclusive())
+                return;
+        }
+        tree_destroy(root, [&alloc](tree_node_ptr_t ptr) { tree_destroy_node(alloc, ptr); });
+    }
+}
+
+//split
+namespace bbst
+{
+    //where split puts the node equivalent to the key
+    enum class tree_split_equal
+    {
+        detach, left, right
+    };
+
+    /*
+     * Split without recursion: a single descent records the spine (every exposed root and the side it belongs to)
+     * in a tree_path_stack, then both sides are rebuilt bottom-up.
+     * Issues exactly the join_x calls of the recursive split, in the same order for each side, so the resulting trees
+     * (shape, balance information and metadata) are identical.
+     * locate(root) tells where the split point lies relative to root (less: in its left subtree, equivalent: root itself).
+     * expose(header) -> (left, root, right) and join_x(left, x, right) are the tree specific primitives.
+     * The detached node (equal_policy == detach, nullptr if none) is returned with stale child pointers.
+     */
+    template<tree_split_equal equal_policy, class header_t, class locate_t, class expose_t, class join_x_t>
+    std::tuple<header_t, decltype(header_t::root_), header_t> tree_split_by(header_t header, locate_t &&locate, expose_t &&expose, join_x_t &&join_x)
+    {
+        using node_ptr_t = decltype(header_t::root_);
+        struct spine_entry
+        {
+            header_t side;
+            node_ptr_t root;
+            bool on_left;
+        };
+        tree_path_stack<spine_entry> spine;
+        header_t left = header_t::empty_header(), right = header_t::empty_header();
+        node_ptr_t equal = nullptr;
+        while (!header.empty())
+        {
+            auto [l, root, r] = expose(header);
+            std::weak_ordering order = locate(root);
+            if (order < 0)
+            {
+                //root and its right subtree belong to the right side
+                spine.push(spine_entry{r, root, false});
+                header = l;
+            }
+            else if (order > 0)
+            {
+                spine.push(spine_entry{l, root, true});
+                header = r;
+            }
+            else
+            {
+                left = l;
+                right = r;
+                equal = root;
+                break;
+            }
+        }
+        if (equal != nullptr)
+        {
+            if constexpr(equal_policy == tree_split_equal::left)
+                left = join_x(left, equal, header_t::empty_header());
+            else if constexpr(equal_policy == tree_split_equal::right)
+                right = join_x(header_t::empty_header(), equal, right);
+        }
+        while (!spine.empty())
+        {
+            spine_entry entry = spine.pop();
+            if (entry.on_left)
+                left = join_x(entry.side, entry.root, left);
+            else
+                right = join_x(right, entry.root, entry.side);
+        }
+        return {left, equal_policy == tree_split_equal::detach ? equal : nullptr, right};
+    }
+
+    //split around key, see tree_split_by
+    template<tree_split_equal equal_policy, class header_t, class key_t, class comparator_t, class expose_t, class join_x_t>
+    std::tuple<header_t, decltype(header_t::root_), header_t> tree_split(header_t header, const key_t &key, const comparator_t &comparator
+                                                                         , expose_t &&expose, join_x_t &&join_x)
+    {
+        return tree_split_by<equal_policy>(header, [&key, &comparator](auto root) { return tree_compare(comparator, key, root->key()); }
+                                           , std::forward<expose_t>(expose), std::forward<join_x_t>(join_x));
+    }
+
+    /*
+     * Split right before node x of the tree under header (x goes right), steering by x's root path instead of comparing keys.
+     * end_node is the parent of the root. The path is recorded up front since expose is free to unlink children.
+     */
+    template<class header_t, class base_tree_node_ptr_t, class expose_t, class join_x_t>
+    std::pair<header_t, header_t> tree_split_at(header_t header, base_tree_node_ptr_t end_node, base_tree_node_ptr_t x, expose_t &&expose, join_x_t &&join_x)
+    {
+        //popped top-down: whether each node on the way from the root to x is a left child
+        tree_path_stack<bool> went_left;
+        for (base_tree_node_ptr_t p = x; p->parent != end_node; p = p->parent)
+            went_left.push(tree_is_left_child(p));
+        auto [left, equal, right] = tree_split_by<tree_split_equal::right>(header, [&went_left](auto)
+        {
+            if (went_left.empty())
+                return std::weak_ordering::equivalent;
+            return went_left.pop() ? std::weak_ordering::less : std::weak_ordering::greater;
+        }, std::forward<expose_t>(expose), std::forward<join_x_t>(join_x));
+        return {left, right};
+    }
+
+    /*
+     * Split by rank: the first index nodes go left, the rest right. Steers by the left subtree sizes of the order statistic
+     * metadata (expose leaves the children of the root it hands to locate linked), see tree_split_by.
+     */
+    template<class metadata_updator_t, class header_t, class expose_t, class join_x_t>
+    std::pair<header_t, header_t> tree_split_by_order(header_t header, size_t index, expose_t &&expose, join_x_t &&join_x)
+    {
+        auto [left, equal, right] = tree_split_by<tree_split_equal::right>(header, [&index](auto root)
+        {
+            auto left_count = size_t(metadata_updator_t::get_order_metadata(root->left));
+            if (index <= left_count)
+                return std::weak_ordering::less;
+            index -= left_count + 1;//minus root
+            return std::weak_ordering::greater;
+        }, std::forward<expose_t>(expose), std::forward<join_x_t>(join_x));
+        return {left, right};
+    }
+}
+
+//bulk build
+namespace bbst
+{
+    //tag: the range is sorted and free of equivalent keys
+    struct sorted_unique_t
+    {
+        explicit sorted_unique_t() = default;
+    };
+    inline constexpr sorted_unique_t sorted_unique{};
+
+    //tag: the range is sorted but may contain runs of equivalent keys, only the first of each run is kept
+    struct sorted_equivalent_t
+    {
+        explicit sorted_equivalent_t() = default;
+    };
+    inline constexpr sorted_equivalent_t sorted_equivalent{};
+
+    /*
+     * Key of an element of a sorted input range: the element itself if it is (convertible to) a key,
+     * otherwise the first member of a (key, mapped) pair
+     */
+    template<class key_t, class element_t>
+    inline decltype(auto) sorted_element_key(const element_t &element)
+    {
+        if constexpr (std::is_same_v<key_t, element_t>)
+            return (element);
+        else if constexpr (std::is_convertible_v<const element_t &, key_t>)
+            return key_t(element);
+        else
+            return (element.first);
+    }
+
+    /*
+     * Build a perfectly balanced tree of n nodes in O(n) by in-order consumption:
+     * make_node() must produce the next node in key order, finish(node, left_size, right_size, depth) is called
+     * once per node in post-order after its children are linked (set balance info and run the updator there).
+     * The recursion depth is ceil(log2(n+1)). If make_node throws, every node built so far goes through destroy.
+     * The returned root has its parent left unset.
+     */
+    template<class tree_node_ptr_t, class make_node_t, class finish_t, class destroy_t>
+    tree_node_ptr_t tree_build_balanced(size_t n, uint32_t depth, make_node_t &make_node, finish_t &finish, destroy_t &destroy)
+    {
+        if (n == 0)
+            return nullptr;
+        size_t left_size = (n - 1) / 2;
+        size_t right_size = n - 1 - left_size;
+        tree_node_ptr_t left = tree_build_balanced<tree_node_ptr_t>(left_size, depth + 1, make_node, finish, destroy);
+        tree_node_ptr_t node;
+        try
+        {
+            node = make_node();
+        }
+        catch (...)
+        {
+            tree_destroy(left, destroy);
+            throw;
+        }
+        node->left = left;
+        if (left != nullptr) left->parent = node;
+        try
+        {
+            node->right = tree_build_balanced<tree_node_ptr_t>(right_size, depth + 1, make_node, finish, destroy);
+        }
+        catch (...)
+        {
+            node->right = nullptr;
+            tree_destroy(node, destroy);
+            throw;
+        }
+        if (node->right != nullptr) node->right->parent = node;
+        finish(node, left_size, right_size, depth);
+        return node;
+    }
 }
 
 namespace bbst